@@ -163,25 +163,6 @@ static void AddExtraModulePaths()
 
 extern obs_frontend_callbacks *InitializeAPIInterface(OBSBasic *main);
 
-static int CountVideoSources()
-{
-	int count = 0;
-
-	auto countSources = [](void *param, obs_source_t *source) {
-		if (!source)
-			return true;
-
-		uint32_t flags = obs_source_get_output_flags(source);
-		if ((flags & OBS_SOURCE_VIDEO) != 0)
-			(*reinterpret_cast<int *>(param))++;
-
-		return true;
-	};
-
-	obs_enum_sources(countSources, &count);
-	return count;
-}
-
 void assignDockToggle(QDockWidget *dock, QAction *action)
 {
 	auto handleWindowToggle = [action](bool vis) {
@@ -1352,6 +1333,8 @@ bool OBSBasic::InitBasicConfigDefaults()
 				false);
 	config_set_default_bool(basicConfig, "Output", "LowLatencyEnable",
 				false);
+	config_set_default_bool(basicConfig, "Output", "DynamicBitrate",
+				false);
 
 	int i = 0;
 	uint32_t scale_cx = cx;
@@ -5472,7 +5455,7 @@ void OBSBasic::StreamDelayStopping(int sec)
 void OBSBasic::SetStreamingSettingsControlsEnabled(bool enabled)
 {
 	ui->recordingEnabledCheckbox->setEnabled(enabled);
-	if (CountVideoSources() == 0) {
+	if (obs_get_video_source_count() == 0) {
 		ui->selectSourceButton->setEnabled(enabled);
 		onlyAudioLabel->setHidden(enabled);
 		centerOnlyAudioLabel();
@@ -5970,7 +5953,7 @@ void OBSBasic::ReplayBufferStop(int code)
 
 bool OBSBasic::NoSourcesConfirmation()
 {
-	if (CountVideoSources() == 0 && isVisible()) {
+	if (obs_get_video_source_count() == 0 && isVisible()) {
 		QString msg;
 		//msg = QTStr("NoSources.Text");
 		//msg += "\n\n";
@@ -542,6 +542,7 @@ OBSBasicSettings::OBSBasicSettings(QWidget *parent)
 	HookWidget(ui->bindToIP,             COMBO_CHANGED,  ADV_CHANGED);
 	HookWidget(ui->enableNewSocketLoop,  CHECK_CHANGED,  ADV_CHANGED);
 	HookWidget(ui->enableLowLatencyMode, CHECK_CHANGED,  ADV_CHANGED);
+	HookWidget(ui->dynBitrate,           CHECK_CHANGED,  ADV_CHANGED);
 	HookWidget(ui->disableFocusHotkeys,  CHECK_CHANGED,  ADV_CHANGED);
 	HookWidget(ui->autoRemux,            CHECK_CHANGED,  ADV_CHANGED);
 	/* clang-format on */
@@ -602,8 +603,10 @@ OBSBasicSettings::OBSBasicSettings(QWidget *parent)
 	delete ui->processPriorityLabel;
 	delete ui->processPriority;
 	delete ui->advancedGeneralGroupBox;
+#ifndef __linux__
 	delete ui->enableNewSocketLoop;
 	delete ui->enableLowLatencyMode;
+#endif
 	delete ui->browserHWAccel;
 	delete ui->sourcesGroup;
 #if defined(__APPLE__) || HAVE_PULSEAUDIO
@@ -616,8 +619,10 @@ OBSBasicSettings::OBSBasicSettings(QWidget *parent)
 	ui->processPriorityLabel = nullptr;
 	ui->processPriority = nullptr;
 	ui->advancedGeneralGroupBox = nullptr;
+#ifndef __linux__
 	ui->enableNewSocketLoop = nullptr;
 	ui->enableLowLatencyMode = nullptr;
+#endif
 	ui->browserHWAccel = nullptr;
 	ui->sourcesGroup = nullptr;
 #if defined(__APPLE__) || HAVE_PULSEAUDIO
@@ -2432,6 +2437,8 @@ void OBSBasicSettings::LoadAdvancedSettings()
 		config_get_bool(main->Config(), "Output", "OverwriteIfExists");
 	const char *bindIP =
 		config_get_string(main->Config(), "Output", "BindIP");
+	bool dynBitrate =
+		config_get_bool(main->Config(), "Output", "DynamicBitrate");
 	const char *rbPrefix = config_get_string(main->Config(), "SimpleOutput",
 						 "RecRBPrefix");
 	const char *rbSuffix = config_get_string(main->Config(), "SimpleOutput",
@@ -2475,6 +2482,8 @@ void OBSBasicSettings::LoadAdvancedSettings()
 	if (!SetComboByValue(ui->bindToIP, bindIP))
 		SetInvalidValue(ui->bindToIP, bindIP, bindIP);
 
+	ui->dynBitrate->setChecked(dynBitrate);
+
 	if (obs_video_active()) {
 		ui->advancedVideoContainer->setEnabled(false);
 	}
@@ -2494,24 +2503,27 @@ void OBSBasicSettings::LoadAdvancedSettings()
 
 	const char *processPriority = config_get_string(
 		App()->GlobalConfig(), "General", "ProcessPriority");
-	bool enableNewSocketLoop = config_get_bool(main->Config(), "Output",
-						   "NewSocketLoopEnable");
-	bool enableLowLatencyMode =
-		config_get_bool(main->Config(), "Output", "LowLatencyEnable");
 
 	int idx = ui->processPriority->findData(processPriority);
 	if (idx == -1)
 		idx = ui->processPriority->findData("Normal");
 	ui->processPriority->setCurrentIndex(idx);
 
-	ui->enableNewSocketLoop->setChecked(enableNewSocketLoop);
-	ui->enableLowLatencyMode->setChecked(enableLowLatencyMode);
-
 	bool browserHWAccel = config_get_bool(App()->GlobalConfig(), "General",
 					      "BrowserHWAccel");
 	ui->browserHWAccel->setChecked(browserHWAccel);
 #endif
 
+#if defined(_WIN32) || defined(__linux__)
+	bool enableNewSocketLoop = config_get_bool(main->Config(), "Output",
+						   "NewSocketLoopEnable");
+	bool enableLowLatencyMode =
+		config_get_bool(main->Config(), "Output", "LowLatencyEnable");
+
+	ui->enableNewSocketLoop->setChecked(enableNewSocketLoop);
+	ui->enableLowLatencyMode->setChecked(enableLowLatencyMode);
+#endif
+
 	bool disableFocusHotkeys = config_get_bool(
 		App()->GlobalConfig(), "General", "DisableHotkeysInFocus");
 	ui->disableFocusHotkeys->setChecked(disableFocusHotkeys);
@@ -3113,14 +3125,16 @@ void OBSBasicSettings::SaveAdvancedSettings()
 	if (main->Active())
 		SetProcessPriority(priority.c_str());
 
-	SaveCheckBox(ui->enableNewSocketLoop, "Output", "NewSocketLoopEnable");
-	SaveCheckBox(ui->enableLowLatencyMode, "Output", "LowLatencyEnable");
-
 	bool browserHWAccel = ui->browserHWAccel->isChecked();
 	config_set_bool(App()->GlobalConfig(), "General", "BrowserHWAccel",
 			browserHWAccel);
 #endif
 
+#if defined(_WIN32) || defined(__linux__)
+	SaveCheckBox(ui->enableNewSocketLoop, "Output", "NewSocketLoopEnable");
+	SaveCheckBox(ui->enableLowLatencyMode, "Output", "LowLatencyEnable");
+#endif
+
 	bool disableFocusHotkeys = ui->disableFocusHotkeys->isChecked();
 	config_set_bool(App()->GlobalConfig(), "General",
 			"DisableHotkeysInFocus", disableFocusHotkeys);
@@ -3166,6 +3180,7 @@ void OBSBasicSettings::SaveAdvancedSettings()
 	SaveSpinBox(ui->reconnectRetryDelay, "Output", "RetryDelay");
 	SaveSpinBox(ui->reconnectMaxRetries, "Output", "MaxRetries");
 	SaveComboData(ui->bindToIP, "Output", "BindIP");
+	SaveCheckBox(ui->dynBitrate, "Output", "DynamicBitrate");
 	SaveCheckBox(ui->autoRemux, "Video", "AutoRemux");
 
 #if defined(_WIN32) || defined(__APPLE__) || HAVE_PULSEAUDIO
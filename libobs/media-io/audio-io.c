@@ -18,6 +18,12 @@
 #include <math.h>
 #include <inttypes.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#endif
+
 #include "../util/threading.h"
 #include "../util/darray.h"
 #include "../util/circlebuf.h"
@@ -25,6 +31,7 @@
 #include "../util/profiler.h"
 
 #include "audio-io.h"
+#include "audio-mix.h"
 #include "audio-resampler.h"
 
 extern profiler_name_store_t *obs_get_profiler_name_store(void);
@@ -36,6 +43,10 @@ extern profiler_name_store_t *obs_get_profiler_name_store(void);
 		int invalid = 0; \
 	} while (0)
 
+/* wake-up lateness histogram, 100us per bucket */
+#define LATENESS_BUCKET_NS 100000ULL
+#define LATENESS_BUCKETS 256
+
 struct audio_input {
 	struct audio_convert_info conversion;
 	audio_resampler_t *resampler;
@@ -69,6 +80,12 @@ struct audio_output {
 	void *input_param;
 	pthread_mutex_t input_mutex;
 	struct audio_mix mixes[MAX_AUDIO_MIXES];
+
+	uint64_t lateness[LATENESS_BUCKETS];
+	uint64_t max_lateness;
+	uint64_t wakeups;
+
+	volatile long requested_ticks;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -166,7 +183,8 @@ static inline void do_audio_output(struct audio_output *audio, size_t mix_idx,
 	pthread_mutex_unlock(&audio->input_mutex);
 }
 
-static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
+static inline void clamp_audio_output(struct audio_output *audio, size_t bytes,
+				      uint32_t active_mixes)
 {
 	size_t float_size = bytes / sizeof(float);
 
@@ -174,20 +192,11 @@ static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
 		struct audio_mix *mix = &audio->mixes[mix_idx];
 
 		/* do not process mixing if a specific mix is inactive */
-		if (!mix->inputs.num)
+		if ((active_mixes & (1 << mix_idx)) == 0)
 			continue;
 
-		for (size_t plane = 0; plane < audio->planes; plane++) {
-			float *mix_data = mix->buffer[plane];
-			float *mix_end = &mix_data[float_size];
-
-			while (mix_data < mix_end) {
-				float val = *mix_data;
-				val = (val > 1.0f) ? 1.0f : val;
-				val = (val < -1.0f) ? -1.0f : val;
-				*(mix_data++) = val;
-			}
-		}
+		for (size_t plane = 0; plane < audio->planes; plane++)
+			audio_mix_clamp(mix->buffer[plane], float_size);
 	}
 }
 
@@ -215,16 +224,19 @@ static void input_and_output(struct audio_output *audio, uint64_t audio_time,
 	}
 	pthread_mutex_unlock(&audio->input_mutex);
 
-	/* clear mix buffers */
+	/* clear mix buffers, inactive mixes aren't mixed into */
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
 		struct audio_mix *mix = &audio->mixes[mix_idx];
 
-		memset(mix->buffer[0], 0,
-		       AUDIO_OUTPUT_FRAMES * MAX_AUDIO_CHANNELS *
-			       sizeof(float));
-
 		for (size_t i = 0; i < audio->planes; i++)
 			data[mix_idx].data[i] = mix->buffer[i];
+
+		if ((active_mixes & (1 << mix_idx)) == 0)
+			continue;
+
+		for (size_t i = 0; i < audio->planes; i++)
+			memset(mix->buffer[i], 0,
+			       AUDIO_OUTPUT_FRAMES * sizeof(float));
 	}
 
 	/* get new audio data */
@@ -234,11 +246,85 @@ static void input_and_output(struct audio_output *audio, uint64_t audio_time,
 		return;
 
 	/* clamps audio data to -1.0..1.0 */
-	clamp_audio_output(audio, bytes);
+	clamp_audio_output(audio, bytes, active_mixes);
 
 	/* output */
-	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
-		do_audio_output(audio, i, new_ts, AUDIO_OUTPUT_FRAMES);
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		if ((active_mixes & (1 << i)) != 0)
+			do_audio_output(audio, i, new_ts, AUDIO_OUTPUT_FRAMES);
+	}
+}
+
+static void set_realtime_priority(void)
+{
+#ifdef _WIN32
+	if (SetThreadPriority(GetCurrentThread(),
+			      THREAD_PRIORITY_TIME_CRITICAL))
+		blog(LOG_INFO, "audio-io: Audio thread running with time "
+			       "critical priority");
+	else
+		blog(LOG_WARNING, "audio-io: Failed to raise audio thread "
+				  "priority");
+#else
+	struct sched_param sp = {0};
+	int ret;
+
+	/* low enough to stay below anything the system itself relies on */
+	sp.sched_priority = sched_get_priority_min(SCHED_FIFO) + 9;
+	if (sp.sched_priority > sched_get_priority_max(SCHED_FIFO))
+		sp.sched_priority = sched_get_priority_max(SCHED_FIFO);
+
+	ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+	if (ret == 0)
+		blog(LOG_INFO,
+		     "audio-io: Audio thread running with SCHED_FIFO "
+		     "priority %d",
+		     sp.sched_priority);
+	else
+		blog(LOG_WARNING,
+		     "audio-io: Failed to switch audio thread to "
+		     "SCHED_FIFO (%d), running with normal priority",
+		     ret);
+#endif
+}
+
+static inline void add_lateness(struct audio_output *audio, uint64_t lateness)
+{
+	size_t bucket = (size_t)(lateness / LATENESS_BUCKET_NS);
+	if (bucket >= LATENESS_BUCKETS)
+		bucket = LATENESS_BUCKETS - 1;
+
+	audio->lateness[bucket]++;
+	audio->wakeups++;
+	if (lateness > audio->max_lateness)
+		audio->max_lateness = lateness;
+}
+
+static double lateness_percentile(const struct audio_output *audio,
+				  double percentile)
+{
+	uint64_t target = (uint64_t)((double)audio->wakeups * percentile);
+	uint64_t accu = 0;
+
+	for (size_t i = 0; i < LATENESS_BUCKETS; i++) {
+		accu += audio->lateness[i];
+		if (accu > target)
+			return (double)((i + 1) * LATENESS_BUCKET_NS) / 1000000.0;
+	}
+
+	return (double)audio->max_lateness / 1000000.0;
+}
+
+static void log_lateness(const struct audio_output *audio)
+{
+	if (!audio->wakeups)
+		return;
+
+	blog(LOG_INFO,
+	     "audio-io: audio thread woke up late by: median < %g ms, "
+	     "99th percentile < %g ms, max %g ms (%" PRIu64 " ticks)",
+	     lateness_percentile(audio, 0.5), lateness_percentile(audio, 0.99),
+	     (double)audio->max_lateness / 1000000.0, audio->wakeups);
 }
 
 static void *audio_thread(void *param)
@@ -249,23 +335,31 @@ static void *audio_thread(void *param)
 	uint64_t start_time = os_gettime_ns();
 	uint64_t prev_time = start_time;
 	uint64_t audio_time = prev_time;
-	uint32_t audio_wait_time = (uint32_t)(
-		audio_frames_to_ns(rate, AUDIO_OUTPUT_FRAMES) / 1000000);
 
 	os_set_thread_name("audio-io: audio thread");
 
+	if (audio->info.realtime)
+		set_realtime_priority();
+
 	const char *audio_thread_name =
 		profile_store_name(obs_get_profiler_name_store(),
 				   "audio_thread(%s)", audio->info.name);
+	profile_register_root(audio_thread_name,
+			      audio_frames_to_ns(rate, AUDIO_OUTPUT_FRAMES));
 
 	while (os_event_try(audio->stop_event) == EAGAIN) {
 		uint64_t cur_time;
 
-		os_sleep_ms(audio_wait_time);
+		/* wake up right when the next tick is due rather than
+		 * polling, so ticks go out evenly spaced */
+		os_sleepto_ns(audio_time);
+
+		cur_time = os_gettime_ns();
+		add_lateness(audio,
+			     cur_time > audio_time ? cur_time - audio_time : 0);
 
 		profile_start(audio_thread_name);
 
-		cur_time = os_gettime_ns();
 		while (audio_time <= cur_time) {
 			samples += AUDIO_OUTPUT_FRAMES;
 			audio_time =
@@ -273,6 +367,14 @@ static void *audio_thread(void *param)
 
 			input_and_output(audio, audio_time, prev_time);
 			prev_time = audio_time;
+
+			/* right behind the tick that asked for them, before
+			 * any other tick of the catch up */
+			while (os_atomic_load_long(&audio->requested_ticks) >
+			       0) {
+				os_atomic_dec_long(&audio->requested_ticks);
+				input_and_output(audio, prev_time, prev_time);
+			}
 		}
 
 		profile_end(audio_thread_name);
@@ -448,6 +550,7 @@ void audio_output_close(audio_t *audio)
 	if (audio->initialized) {
 		os_event_signal(audio->stop_event);
 		pthread_join(audio->thread, &thread_ret);
+		log_lateness(audio);
 	}
 
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
@@ -502,3 +605,9 @@ uint32_t audio_output_get_sample_rate(const audio_t *audio)
 {
 	return audio ? audio->info.samples_per_sec : 0;
 }
+
+void audio_output_request_tick(audio_t *audio)
+{
+	if (audio)
+		os_atomic_inc_long(&audio->requested_ticks);
+}
@@ -99,6 +99,9 @@ struct audio_output_info {
 
 	audio_input_callback_t input_callback;
 	void *input_param;
+
+	/* try to run the mixing thread with realtime priority */
+	bool realtime;
 };
 
 struct audio_convert_info {
@@ -235,6 +238,14 @@ EXPORT uint32_t audio_output_get_sample_rate(const audio_t *audio);
 EXPORT const struct audio_output_info *
 audio_output_get_info(const audio_t *audio);
 
+/**
+ * Calls the input callback one extra time right after the current call, with
+ * an empty time range ending where the current call's range ended.  Lets the
+ * callback output a tick it had buffered, taking buffering out without a gap
+ * in the output timestamps.  Meant to be called from the input callback.
+ */
+EXPORT void audio_output_request_tick(audio_t *audio);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "../util/c99defs.h"
+#include <xmmintrin.h>
+
+/*
+ * Float kernels for the audio mixing path.  Buffers don't have to be aligned,
+ * the mix and source buffers are offset by the start of the source audio
+ * within the tick.
+ */
+
+/* dst += src */
+static inline void audio_mix_add(float *dst, const float *src, size_t count)
+{
+	float *end = dst + count;
+
+	for (; end - dst >= 4; dst += 4, src += 4)
+		_mm_storeu_ps(dst, _mm_add_ps(_mm_loadu_ps(dst),
+					      _mm_loadu_ps(src)));
+	while (dst < end)
+		*(dst++) += *(src++);
+}
+
+/* dst += src * mul */
+static inline void audio_mix_add_mul(float *dst, const float *src,
+				     const float *mul, size_t count)
+{
+	float *end = dst + count;
+
+	for (; end - dst >= 4; dst += 4, src += 4, mul += 4) {
+		__m128 val = _mm_mul_ps(_mm_loadu_ps(src), _mm_loadu_ps(mul));
+		_mm_storeu_ps(dst, _mm_add_ps(_mm_loadu_ps(dst), val));
+	}
+	while (dst < end)
+		*(dst++) += *(src++) * *(mul++);
+}
+
+/* data *= vol */
+static inline void audio_mix_mul(float *data, float vol, size_t count)
+{
+	__m128 vol_val = _mm_set1_ps(vol);
+	float *end = data + count;
+
+	for (; end - data >= 4; data += 4)
+		_mm_storeu_ps(data, _mm_mul_ps(_mm_loadu_ps(data), vol_val));
+	while (data < end)
+		*(data++) *= vol;
+}
+
+/* data *= vol, per sample */
+static inline void audio_mix_mul_array(float *data, const float *vol,
+				       size_t count)
+{
+	float *end = data + count;
+
+	for (; end - data >= 4; data += 4, vol += 4)
+		_mm_storeu_ps(data, _mm_mul_ps(_mm_loadu_ps(data),
+					       _mm_loadu_ps(vol)));
+	while (data < end)
+		*(data++) *= *(vol++);
+}
+
+/* clamps to -1.0..1.0 */
+static inline void audio_mix_clamp(float *data, size_t count)
+{
+	__m128 min_val = _mm_set1_ps(-1.0f);
+	__m128 max_val = _mm_set1_ps(1.0f);
+	float *end = data + count;
+
+	for (; end - data >= 4; data += 4) {
+		__m128 val = _mm_loadu_ps(data);
+		val = _mm_min_ps(_mm_max_ps(val, min_val), max_val);
+		_mm_storeu_ps(data, val);
+	}
+	while (data < end) {
+		float val = *data;
+		val = (val > 1.0f) ? 1.0f : val;
+		val = (val < -1.0f) ? -1.0f : val;
+		*(data++) = val;
+	}
+}
@@ -30,40 +30,61 @@
 
 extern profiler_name_store_t *obs_get_profiler_name_store(void);
 
-#define MAX_CONVERT_BUFFERS 3
 #define MAX_CACHE_SIZE 16
 
 struct cached_frame_info {
 	struct video_data frame;
 	int skipped;
 	int count;
+
+	/* inputs that haven't finished with the frame yet */
+	long refs;
+};
+
+/* inputs asking for the same conversion share it, each cached frame is only
+ * scaled once and the result is kept alongside it for as long as the cached
+ * frame itself is held by any input */
+struct video_converter {
+	struct video_scale_info info;
+	video_scaler_t *scaler;
+	long refs;
+
+	pthread_mutex_t mutex;
+	struct video_frame frame[MAX_CACHE_SIZE];
+	uint64_t converted[MAX_CACHE_SIZE]; /* frame number + 1 */
+
+	long scaled;
+	long reused;
 };
 
 struct video_input {
 	struct video_scale_info conversion;
-	video_scaler_t *scaler;
-	struct video_frame frame[MAX_CONVERT_BUFFERS];
-	int cur_frame;
+	struct video_converter *converter;
 
 	void (*callback)(void *param, struct video_data *frame);
 	void *param;
-};
 
-static inline void video_input_free(struct video_input *input)
-{
-	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
-		video_frame_free(&input->frame[i]);
-	video_scaler_destroy(input->scaler);
-}
+	struct video_output *video;
+	pthread_t thread;
+	bool thread_active;
+	os_sem_t *update_semaphore;
+	volatile bool stop;
+
+	/* position in the frame cache, only touched with data_mutex held */
+	uint64_t next_frame;
+	uint64_t end_frame;
+	int repeat;
+
+	long skipped_frames;
+	long total_frames;
+};
 
 struct video_output {
 	struct video_output_info info;
 
-	pthread_t thread;
 	pthread_mutex_t data_mutex;
 	bool stop;
 
-	os_sem_t *update_semaphore;
 	uint64_t frame_time;
 	volatile long skipped_frames;
 	volatile long total_frames;
@@ -71,11 +92,14 @@ struct video_output {
 	bool initialized;
 
 	pthread_mutex_t input_mutex;
-	DARRAY(struct video_input) inputs;
-
-	size_t available_frames;
-	size_t first_added;
-	size_t last_added;
+	DARRAY(struct video_input *) inputs;
+	DARRAY(struct video_converter *) converters;
+
+	/* frames are numbered as they are added, frame n lives in cache slot
+	 * n % cache_size until every input that was connected when it was
+	 * added has consumed it */
+	uint64_t added_frames;
+	uint64_t freed_frames;
 	struct cached_frame_info cache[MAX_CACHE_SIZE];
 
 	volatile bool raw_active;
@@ -84,23 +108,39 @@ struct video_output {
 
 /* ------------------------------------------------------------------------- */
 
+static const char *scale_video_output_name = "scale_video_output";
+static const char *reuse_scaled_frame_name = "reuse_scaled_frame";
+
 static inline bool scale_video_output(struct video_input *input,
-				      struct video_data *data)
+				      uint64_t idx, struct video_data *data)
 {
+	struct video_converter *converter = input->converter;
 	bool success = true;
 
-	if (input->scaler) {
-		struct video_frame *frame;
+	if (converter) {
+		size_t slot = idx % input->video->info.cache_size;
+		struct video_frame *frame = &converter->frame[slot];
+
+		pthread_mutex_lock(&converter->mutex);
 
-		if (++input->cur_frame == MAX_CONVERT_BUFFERS)
-			input->cur_frame = 0;
+		if (converter->converted[slot] != idx + 1) {
+			profile_start(scale_video_output_name);
+			success = video_scaler_scale(
+				converter->scaler, frame->data, frame->linesize,
+				(const uint8_t *const *)data->data,
+				data->linesize);
+			profile_end(scale_video_output_name);
 
-		frame = &input->frame[input->cur_frame];
+			converter->converted[slot] = success ? idx + 1 : 0;
+			converter->scaled++;
+		} else {
+			/* only counted, shows up as calls per parent call */
+			profile_start(reuse_scaled_frame_name);
+			profile_end(reuse_scaled_frame_name);
+			converter->reused++;
+		}
 
-		success = video_scaler_scale(input->scaler, frame->data,
-					     frame->linesize,
-					     (const uint8_t *const *)data->data,
-					     data->linesize);
+		pthread_mutex_unlock(&converter->mutex);
 
 		if (success) {
 			for (size_t i = 0; i < MAX_AV_PLANES; i++) {
@@ -115,63 +155,129 @@ static inline bool scale_video_output(struct video_input *input,
 	return success;
 }
 
-static inline bool video_output_cur_frame(struct video_output *video)
+static inline struct cached_frame_info *cached_frame(struct video_output *video,
+						     uint64_t idx)
 {
-	struct cached_frame_info *frame_info;
-	bool complete;
-	bool skipped;
-
-	/* -------------------------------- */
+	return &video->cache[idx % video->info.cache_size];
+}
 
-	pthread_mutex_lock(&video->data_mutex);
+static void free_cached_frames(struct video_output *video)
+{
+	while (video->freed_frames < video->added_frames &&
+	       cached_frame(video, video->freed_frames)->refs == 0)
+		video->freed_frames++;
+}
 
-	frame_info = &video->cache[video->first_added];
+static inline void release_cached_frame(struct video_output *video,
+					uint64_t idx)
+{
+	cached_frame(video, idx)->refs--;
+	free_cached_frames(video);
+}
 
-	pthread_mutex_unlock(&video->data_mutex);
+static inline void add_frames(volatile long *counter, int count)
+{
+	while (count-- > 0)
+		os_atomic_inc_long(counter);
+}
 
-	/* -------------------------------- */
+static inline void wake_inputs(struct video_output *video)
+{
+	for (size_t i = 0; i < video->inputs.num; i++)
+		os_sem_post(video->inputs.array[i]->update_semaphore);
+}
 
-	pthread_mutex_lock(&video->input_mutex);
+/* the newest frame can still be repeated if the cache is full when the next
+ * one comes in, so an input only moves past it once a newer one is added */
+static bool video_input_next_frame(struct video_input *input,
+				   struct video_data *frame, uint64_t *idx)
+{
+	struct video_output *video = input->video;
+	bool found = false;
 
-	for (size_t i = 0; i < video->inputs.num; i++) {
-		struct video_input *input = video->inputs.array + i;
-		struct video_data frame = frame_info->frame;
+	pthread_mutex_lock(&video->data_mutex);
 
-		if (scale_video_output(input, &frame))
-			input->callback(input->param, &frame);
-	}
+	while (!os_atomic_load_bool(&input->stop) &&
+	       input->next_frame < video->added_frames) {
+		struct cached_frame_info *cfi =
+			cached_frame(video, input->next_frame);
+
+		if (input->repeat < cfi->count) {
+			*frame = cfi->frame;
+			frame->timestamp += video->frame_time * input->repeat;
+			*idx = input->next_frame;
+
+			if (input->repeat >= cfi->count - cfi->skipped)
+				input->skipped_frames++;
+			input->total_frames++;
+			input->repeat++;
+			found = true;
+			break;
+		}
 
-	pthread_mutex_unlock(&video->input_mutex);
+		if (input->next_frame + 1 == video->added_frames)
+			break;
 
-	/* -------------------------------- */
+		release_cached_frame(video, input->next_frame++);
+		input->repeat = 0;
+	}
 
-	pthread_mutex_lock(&video->data_mutex);
+	pthread_mutex_unlock(&video->data_mutex);
+	return found;
+}
 
-	frame_info->frame.timestamp += video->frame_time;
-	complete = --frame_info->count == 0;
-	skipped = frame_info->skipped > 0;
+static void video_converter_destroy(struct video_converter *converter)
+{
+	if (converter->reused)
+		blog(LOG_INFO,
+		     "Video conversion to %ux%u %s stopped, scaled %ld "
+		     "frames, shared %ld",
+		     converter->info.width, converter->info.height,
+		     get_video_format_name(converter->info.format),
+		     converter->scaled, converter->reused);
+
+	for (size_t i = 0; i < MAX_CACHE_SIZE; i++)
+		video_frame_free(&converter->frame[i]);
+	video_scaler_destroy(converter->scaler);
+	pthread_mutex_destroy(&converter->mutex);
+	bfree(converter);
+}
 
-	if (complete) {
-		if (++video->first_added == video->info.cache_size)
-			video->first_added = 0;
+static void video_converter_release(struct video_output *video,
+				    struct video_converter *converter)
+{
+	if (!converter)
+		return;
 
-		if (++video->available_frames == video->info.cache_size)
-			video->last_added = video->first_added;
-	} else if (skipped) {
-		--frame_info->skipped;
-		os_atomic_inc_long(&video->skipped_frames);
+	pthread_mutex_lock(&video->input_mutex);
+	if (--converter->refs == 0) {
+		da_erase_item(video->converters, &converter);
+		video_converter_destroy(converter);
 	}
+	pthread_mutex_unlock(&video->input_mutex);
+}
 
-	pthread_mutex_unlock(&video->data_mutex);
-
-	/* -------------------------------- */
+static inline void video_input_free(struct video_input *input)
+{
+	if (input->skipped_frames)
+		blog(LOG_INFO,
+		     "Video input stopped, number of skipped frames: "
+		     "%ld/%ld (%0.1f%%)",
+		     input->skipped_frames, input->total_frames,
+		     (double)input->skipped_frames /
+			     (double)input->total_frames * 100.0);
 
-	return complete;
+	video_converter_release(input->video, input->converter);
+	os_sem_destroy(input->update_semaphore);
+	bfree(input);
 }
 
-static void *video_thread(void *param)
+static void *video_input_thread(void *param)
 {
-	struct video_output *video = param;
+	struct video_input *input = param;
+	struct video_output *video = input->video;
+	struct video_data frame;
+	uint64_t idx;
 
 	os_set_thread_name("video-io: video thread");
 
@@ -179,24 +285,52 @@ static void *video_thread(void *param)
 		profile_store_name(obs_get_profiler_name_store(),
 				   "video_thread(%s)", video->info.name);
 
-	while (os_sem_wait(video->update_semaphore) == 0) {
-		if (video->stop)
+	while (os_sem_wait(input->update_semaphore) == 0) {
+		if (os_atomic_load_bool(&input->stop))
 			break;
 
 		profile_start(video_thread_name);
-		while (!video->stop && !video_output_cur_frame(video)) {
-			os_atomic_inc_long(&video->total_frames);
+		while (video_input_next_frame(input, &frame, &idx)) {
+			if (scale_video_output(input, idx, &frame))
+				input->callback(input->param, &frame);
 		}
-
-		os_atomic_inc_long(&video->total_frames);
 		profile_end(video_thread_name);
 
 		profile_reenable_thread();
 	}
 
+	/* give back every frame that was added while connected */
+	pthread_mutex_lock(&video->data_mutex);
+	while (input->next_frame < input->end_frame &&
+	       input->next_frame < video->added_frames)
+		release_cached_frame(video, input->next_frame++);
+	pthread_mutex_unlock(&video->data_mutex);
+
+	/* disconnected from within its own callback */
+	if (!input->thread_active)
+		video_input_free(input);
+
 	return NULL;
 }
 
+static void video_input_stop(struct video_input *input)
+{
+	if (!input->thread_active)
+		return;
+
+	os_atomic_set_bool(&input->stop, true);
+	os_sem_post(input->update_semaphore);
+
+	if (pthread_equal(pthread_self(), input->thread)) {
+		input->thread_active = false;
+		pthread_detach(input->thread);
+		return;
+	}
+
+	pthread_join(input->thread, NULL);
+	input->thread_active = false;
+}
+
 /* ------------------------------------------------------------------------- */
 
 static inline bool valid_video_params(const struct video_output_info *info)
@@ -217,8 +351,6 @@ static inline void init_cache(struct video_output *video)
 		video_frame_init(frame, video->info.format, video->info.width,
 				 video->info.height);
 	}
-
-	video->available_frames = video->info.cache_size;
 }
 
 int video_output_open(video_t **video, struct video_output_info *info)
@@ -246,10 +378,6 @@ int video_output_open(video_t **video, struct video_output_info *info)
 		goto fail;
 	if (pthread_mutex_init(&out->input_mutex, &attr) != 0)
 		goto fail;
-	if (os_sem_init(&out->update_semaphore, 0) != 0)
-		goto fail;
-	if (pthread_create(&out->thread, NULL, video_thread, out) != 0)
-		goto fail;
 
 	init_cache(out);
 
@@ -270,13 +398,13 @@ void video_output_close(video_t *video)
 	video_output_stop(video);
 
 	for (size_t i = 0; i < video->inputs.num; i++)
-		video_input_free(&video->inputs.array[i]);
+		video_input_free(video->inputs.array[i]);
 	da_free(video->inputs);
+	da_free(video->converters);
 
 	for (size_t i = 0; i < video->info.cache_size; i++)
 		video_frame_free((struct video_frame *)&video->cache[i]);
 
-	os_sem_destroy(video->update_semaphore);
 	pthread_mutex_destroy(&video->data_mutex);
 	pthread_mutex_destroy(&video->input_mutex);
 	bfree(video);
@@ -288,7 +416,7 @@ static size_t video_get_input_idx(const video_t *video,
 				  void *param)
 {
 	for (size_t i = 0; i < video->inputs.num; i++) {
-		struct video_input *input = video->inputs.array + i;
+		struct video_input *input = video->inputs.array[i];
 		if (input->callback == callback && input->param == param)
 			return i;
 	}
@@ -296,40 +424,82 @@ static size_t video_get_input_idx(const video_t *video,
 	return DARRAY_INVALID;
 }
 
+static inline bool same_conversion(const struct video_scale_info *a,
+				   const struct video_scale_info *b)
+{
+	return a->format == b->format && a->width == b->width &&
+	       a->height == b->height && a->range == b->range &&
+	       a->colorspace == b->colorspace;
+}
+
+static struct video_converter *
+video_converter_create(struct video_output *video,
+		       const struct video_scale_info *conversion)
+{
+	struct video_converter *converter;
+	struct video_scale_info from = {.format = video->info.format,
+					.width = video->info.width,
+					.height = video->info.height,
+					.range = video->info.range,
+					.colorspace = video->info.colorspace};
+
+	for (size_t i = 0; i < video->converters.num; i++) {
+		converter = video->converters.array[i];
+		if (same_conversion(&converter->info, conversion)) {
+			converter->refs++;
+			return converter;
+		}
+	}
+
+	converter = bzalloc(sizeof(*converter));
+	converter->info = *conversion;
+	converter->refs = 1;
+
+	int ret = video_scaler_create(&converter->scaler, conversion, &from,
+				      VIDEO_SCALE_FAST_BILINEAR);
+	if (ret != VIDEO_SCALER_SUCCESS) {
+		if (ret == VIDEO_SCALER_BAD_CONVERSION)
+			blog(LOG_ERROR, "video_input_init: Bad "
+					"scale conversion type");
+		else
+			blog(LOG_ERROR, "video_input_init: Failed to "
+					"create scaler");
+
+		bfree(converter);
+		return NULL;
+	}
+
+	pthread_mutex_init(&converter->mutex, NULL);
+
+	for (size_t i = 0; i < video->info.cache_size; i++)
+		video_frame_init(&converter->frame[i], conversion->format,
+				 conversion->width, conversion->height);
+
+	da_push_back(video->converters, &converter);
+	return converter;
+}
+
 static inline bool video_input_init(struct video_input *input,
 				    struct video_output *video)
 {
 	if (input->conversion.width != video->info.width ||
 	    input->conversion.height != video->info.height ||
 	    input->conversion.format != video->info.format) {
-		struct video_scale_info from = {.format = video->info.format,
-						.width = video->info.width,
-						.height = video->info.height,
-						.range = video->info.range,
-						.colorspace =
-							video->info.colorspace};
-
-		int ret = video_scaler_create(&input->scaler,
-					      &input->conversion, &from,
-					      VIDEO_SCALE_FAST_BILINEAR);
-		if (ret != VIDEO_SCALER_SUCCESS) {
-			if (ret == VIDEO_SCALER_BAD_CONVERSION)
-				blog(LOG_ERROR, "video_input_init: Bad "
-						"scale conversion type");
-			else
-				blog(LOG_ERROR, "video_input_init: Failed to "
-						"create scaler");
-
+		input->converter =
+			video_converter_create(video, &input->conversion);
+		if (!input->converter)
 			return false;
-		}
+	}
 
-		for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
-			video_frame_init(&input->frame[i],
-					 input->conversion.format,
-					 input->conversion.width,
-					 input->conversion.height);
+	if (os_sem_init(&input->update_semaphore, 0) != 0)
+		return false;
+	if (pthread_create(&input->thread, NULL, video_input_thread, input) !=
+	    0) {
+		blog(LOG_ERROR, "video_input_init: Failed to create thread");
+		return false;
 	}
 
+	input->thread_active = true;
 	return true;
 }
 
@@ -351,26 +521,26 @@ bool video_output_connect(
 	pthread_mutex_lock(&video->input_mutex);
 
 	if (video_get_input_idx(video, callback, param) == DARRAY_INVALID) {
-		struct video_input input;
-		memset(&input, 0, sizeof(input));
+		struct video_input *input = bzalloc(sizeof(*input));
 
-		input.callback = callback;
-		input.param = param;
+		input->callback = callback;
+		input->param = param;
+		input->video = video;
 
 		if (conversion) {
-			input.conversion = *conversion;
+			input->conversion = *conversion;
 		} else {
-			input.conversion.format = video->info.format;
-			input.conversion.width = video->info.width;
-			input.conversion.height = video->info.height;
+			input->conversion.format = video->info.format;
+			input->conversion.width = video->info.width;
+			input->conversion.height = video->info.height;
 		}
 
-		if (input.conversion.width == 0)
-			input.conversion.width = video->info.width;
-		if (input.conversion.height == 0)
-			input.conversion.height = video->info.height;
+		if (input->conversion.width == 0)
+			input->conversion.width = video->info.width;
+		if (input->conversion.height == 0)
+			input->conversion.height = video->info.height;
 
-		success = video_input_init(&input, video);
+		success = video_input_init(input, video);
 		if (success) {
 			if (video->inputs.num == 0) {
 				if (!os_atomic_load_long(&video->gpu_refs)) {
@@ -378,7 +548,16 @@ bool video_output_connect(
 				}
 				os_atomic_set_bool(&video->raw_active, true);
 			}
+
+			/* starts with the next frame that gets added */
+			pthread_mutex_lock(&video->data_mutex);
+			input->next_frame = video->added_frames;
+			input->end_frame = UINT64_MAX;
 			da_push_back(video->inputs, &input);
+			pthread_mutex_unlock(&video->data_mutex);
+		} else {
+			video_input_stop(input);
+			video_input_free(input);
 		}
 	}
 
@@ -412,12 +591,19 @@ void video_output_disconnect(video_t *video,
 	if (!video || !callback)
 		return;
 
+	struct video_input *input = NULL;
+
 	pthread_mutex_lock(&video->input_mutex);
 
 	size_t idx = video_get_input_idx(video, callback, param);
 	if (idx != DARRAY_INVALID) {
-		video_input_free(video->inputs.array + idx);
+		input = video->inputs.array[idx];
+
+		/* frames added from here on don't count on this input */
+		pthread_mutex_lock(&video->data_mutex);
+		input->end_frame = video->added_frames;
 		da_erase(video->inputs, idx);
+		pthread_mutex_unlock(&video->data_mutex);
 
 		if (video->inputs.num == 0) {
 			os_atomic_set_bool(&video->raw_active, false);
@@ -428,6 +614,16 @@ void video_output_disconnect(video_t *video,
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
+
+	/* stopped with input_mutex released, the input's callback may be
+	 * waiting on it (to connect or disconnect an input itself).  if this
+	 * is called from the input's own callback, its thread frees it once
+	 * the callback returns */
+	if (input) {
+		video_input_stop(input);
+		if (!pthread_equal(pthread_self(), input->thread))
+			video_input_free(input);
+	}
 }
 
 bool video_output_active(const video_t *video)
@@ -453,18 +649,18 @@ bool video_output_lock_frame(video_t *video, struct video_frame *frame,
 
 	pthread_mutex_lock(&video->data_mutex);
 
-	if (video->available_frames == 0) {
-		video->cache[video->last_added].count += count;
-		video->cache[video->last_added].skipped += count;
+	if (video->added_frames - video->freed_frames ==
+	    video->info.cache_size) {
+		cfi = cached_frame(video, video->added_frames - 1);
+		cfi->count += count;
+		cfi->skipped += count;
+		add_frames(&video->skipped_frames, count);
+		add_frames(&video->total_frames, count);
+		wake_inputs(video);
 		locked = false;
 
 	} else {
-		if (video->available_frames != video->info.cache_size) {
-			if (++video->last_added == video->info.cache_size)
-				video->last_added = 0;
-		}
-
-		cfi = &video->cache[video->last_added];
+		cfi = cached_frame(video, video->added_frames);
 		cfi->frame.timestamp = timestamp;
 		cfi->count = count;
 		cfi->skipped = 0;
@@ -481,13 +677,19 @@ bool video_output_lock_frame(video_t *video, struct video_frame *frame,
 
 void video_output_unlock_frame(video_t *video)
 {
+	struct cached_frame_info *cfi;
+
 	if (!video)
 		return;
 
 	pthread_mutex_lock(&video->data_mutex);
 
-	video->available_frames--;
-	os_sem_post(video->update_semaphore);
+	cfi = cached_frame(video, video->added_frames++);
+	cfi->refs = (long)video->inputs.num;
+	add_frames(&video->total_frames, cfi->count);
+
+	free_cached_frames(video);
+	wake_inputs(video);
 
 	pthread_mutex_unlock(&video->data_mutex);
 }
@@ -499,16 +701,36 @@ uint64_t video_output_get_frame_time(const video_t *video)
 
 void video_output_stop(video_t *video)
 {
-	void *thread_ret;
-
 	if (!video)
 		return;
 
 	if (video->initialized) {
+		DARRAY(struct video_input *) inputs;
+
+		da_init(inputs);
 		video->initialized = false;
 		video->stop = true;
-		os_sem_post(video->update_semaphore);
-		pthread_join(video->thread, &thread_ret);
+
+		/* take every input out, then stop them like a disconnect does,
+		 * with input_mutex released */
+		pthread_mutex_lock(&video->input_mutex);
+		pthread_mutex_lock(&video->data_mutex);
+		for (size_t i = 0; i < video->inputs.num; i++)
+			video->inputs.array[i]->end_frame =
+				video->added_frames;
+		da_move(inputs, video->inputs);
+		pthread_mutex_unlock(&video->data_mutex);
+		os_atomic_set_bool(&video->raw_active, false);
+		pthread_mutex_unlock(&video->input_mutex);
+
+		for (size_t i = 0; i < inputs.num; i++) {
+			struct video_input *input = inputs.array[i];
+
+			video_input_stop(input);
+			if (!pthread_equal(pthread_self(), input->thread))
+				video_input_free(input);
+		}
+		da_free(inputs);
 	}
 }
 
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "util/circlebuf.h"
+
+/* Audio buffering holds the output back by a number of ticks: the time range
+ * of every tick is queued, and the tick that gets mixed and output is the
+ * oldest one queued.  In low latency mode the buffering is taken back out
+ * one tick at a time once every source has had audio to spare for long
+ * enough. */
+
+struct ts_info {
+	uint64_t start;
+	uint64_t end;
+};
+
+/* in low latency mode, one tick of buffering is taken out after every
+ * source has had at least two ticks of audio queued for this long */
+#define BUFFERING_DECAY_TICKS 240
+
+/* queues the time range of a new tick and gets the oldest queued one.  the
+ * tick requested with audio_output_request_tick() has an empty range and
+ * queues nothing, so one more buffered tick goes out instead.  false if
+ * nothing is queued */
+static inline bool buffered_ts_next(struct circlebuf *timestamps,
+				    uint64_t start, uint64_t end,
+				    struct ts_info *ts)
+{
+	if (start != end) {
+		struct ts_info new_ts = {start, end};
+		circlebuf_push_back(timestamps, &new_ts, sizeof(new_ts));
+	}
+
+	if (!timestamps->size)
+		return false;
+
+	circlebuf_peek_front(timestamps, ts, sizeof(*ts));
+	return true;
+}
+
+static inline size_t buffered_ts_count(const struct circlebuf *timestamps)
+{
+	return timestamps->size / sizeof(struct ts_info);
+}
+
+/* counts the ticks in a row that buffering could have been reduced on,
+ * true when it is due to be */
+static inline bool buffering_decay_due(int *stable_ticks, bool can_decay)
+{
+	if (!can_decay) {
+		*stable_ticks = 0;
+		return false;
+	}
+
+	if (++*stable_ticks < BUFFERING_DECAY_TICKS)
+		return false;
+
+	*stable_ticks = 0;
+	return true;
+}
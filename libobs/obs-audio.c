@@ -17,14 +17,10 @@
 
 #include <inttypes.h>
 #include "obs-internal.h"
-
-struct ts_info {
-	uint64_t start;
-	uint64_t end;
-};
+#include "obs-audio-buffering.h"
+#include "media-io/audio-mix.h"
 
 #define DEBUG_AUDIO 0
-#define MAX_BUFFERING_TICKS 45
 
 static void push_audio_tree(obs_source_t *parent, obs_source_t *source, void *p)
 {
@@ -45,12 +41,18 @@ static inline size_t convert_time_to_frames(size_t sample_rate, uint64_t t)
 }
 
 static inline void mix_audio(struct audio_output_data *mixes,
-			     obs_source_t *source, size_t channels,
-			     size_t sample_rate, struct ts_info *ts)
+			     obs_source_t *source, uint32_t mixers,
+			     size_t channels, size_t sample_rate,
+			     struct ts_info *ts)
 {
 	size_t total_floats = AUDIO_OUTPUT_FRAMES;
 	size_t start_point = 0;
 
+	/* the source's output for mixes it isn't assigned to is silent */
+	mixers &= source->audio_mixers;
+	if (!mixers)
+		return;
+
 	if (source->audio_ts < ts->start || ts->end <= source->audio_ts)
 		return;
 
@@ -64,18 +66,13 @@ static inline void mix_audio(struct audio_output_data *mixes,
 	}
 
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
-		for (size_t ch = 0; ch < channels; ch++) {
-			register float *mix = mixes[mix_idx].data[ch];
-			register float *aud =
-				source->audio_output_buf[mix_idx][ch];
-			register float *end;
+		if ((mixers & (1 << mix_idx)) == 0)
+			continue;
 
-			mix += start_point;
-			end = aud + total_floats;
-
-			while (aud < end)
-				*(mix++) += *(aud++);
-		}
+		for (size_t ch = 0; ch < channels; ch++)
+			audio_mix_add(mixes[mix_idx].data[ch] + start_point,
+				      source->audio_output_buf[mix_idx][ch],
+				      total_floats);
 	}
 }
 
@@ -180,7 +177,7 @@ static inline void discard_audio(struct obs_core_audio *audio,
 			     source->audio_ts, ts->start);
 		}
 #endif
-		if (audio->total_buffering_ticks == MAX_BUFFERING_TICKS)
+		if (audio->total_buffering_ticks >= audio->max_buffering_ticks)
 			ignore_audio(source, channels, sample_rate);
 		return;
 	}
@@ -240,7 +237,9 @@ static void add_audio_buffering(struct obs_core_audio *audio,
 	size_t ms;
 	int ticks;
 
-	if (audio->total_buffering_ticks == MAX_BUFFERING_TICKS)
+	audio->stable_ticks = 0;
+
+	if (audio->total_buffering_ticks >= audio->max_buffering_ticks)
 		return;
 
 	if (!audio->buffering_wait_ticks)
@@ -252,9 +251,10 @@ static void add_audio_buffering(struct obs_core_audio *audio,
 
 	audio->total_buffering_ticks += ticks;
 
-	if (audio->total_buffering_ticks >= MAX_BUFFERING_TICKS) {
-		ticks -= audio->total_buffering_ticks - MAX_BUFFERING_TICKS;
-		audio->total_buffering_ticks = MAX_BUFFERING_TICKS;
+	if (audio->total_buffering_ticks >= audio->max_buffering_ticks) {
+		ticks -= audio->total_buffering_ticks -
+			 audio->max_buffering_ticks;
+		audio->total_buffering_ticks = audio->max_buffering_ticks;
 		blog(LOG_WARNING, "Max audio buffering reached!");
 	}
 
@@ -302,6 +302,64 @@ static void add_audio_buffering(struct obs_core_audio *audio,
 	*ts = new_ts;
 }
 
+/* tracks how much buffering each source needs, which is the total buffering
+ * minus however much audio it has queued beyond the tick being mixed */
+static void update_source_buffering(struct obs_core_audio *audio,
+				    obs_source_t *source, size_t sample_rate,
+				    const struct ts_info *ts, bool *can_decay)
+{
+	uint64_t tick_ns = audio_frames_to_ns(sample_rate, AUDIO_OUTPUT_FRAMES);
+	uint64_t total_ns = (uint64_t)audio->total_buffering_ticks * tick_ns;
+	uint64_t queued_end;
+	uint64_t lead = 0;
+
+	if (source->info.audio_render || !source->audio_ts) {
+		os_atomic_set_long(&source->audio_buffering_ms, 0);
+		return;
+	}
+
+	queued_end = source->audio_ts +
+		     audio_frames_to_ns(sample_rate,
+					source->audio_input_buf[0].size /
+						sizeof(float));
+	if (queued_end > ts->end)
+		lead = queued_end - ts->end;
+
+	os_atomic_set_long(&source->audio_buffering_ms,
+			   total_ns > lead ? (long)((total_ns - lead) / 1000000)
+					   : 0);
+
+	/* still needs to have a tick queued once a tick is taken out */
+	if (lead < 2 * tick_ns)
+		*can_decay = false;
+}
+
+static void decay_audio_buffering(struct obs_core_audio *audio,
+				  size_t sample_rate, bool can_decay)
+{
+	size_t total_ms;
+
+	if (!audio->low_latency || audio->buffering_wait_ticks ||
+	    !audio->total_buffering_ticks)
+		return;
+
+	if (!buffering_decay_due(&audio->stable_ticks, can_decay))
+		return;
+
+	/* the extra tick outputs the oldest buffered tick without queueing a
+	 * new one */
+	audio->total_buffering_ticks--;
+	audio_output_request_tick(audio->audio);
+
+	total_ms = audio->total_buffering_ticks * AUDIO_OUTPUT_FRAMES * 1000 /
+		   sample_rate;
+
+	blog(LOG_INFO,
+	     "removing %d milliseconds of audio buffering, total "
+	     "audio buffering is now %d milliseconds",
+	     (int)(AUDIO_OUTPUT_FRAMES * 1000 / sample_rate), (int)total_ms);
+}
+
 static bool audio_buffer_insuffient(struct obs_source *source,
 				    size_t sample_rate, uint64_t min_ts)
 {
@@ -388,15 +446,20 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 	struct obs_source *source;
 	size_t sample_rate = audio_output_get_sample_rate(audio->audio);
 	size_t channels = audio_output_get_channels(audio->audio);
-	struct ts_info ts = {start_ts_in, end_ts_in};
+	/* requested by decay_audio_buffering, see buffered_ts_next */
+	bool requested = start_ts_in == end_ts_in;
+	struct ts_info ts;
 	size_t audio_size;
 	uint64_t min_ts;
+	bool can_decay = true;
+
+	if (!buffered_ts_next(&audio->buffered_timestamps, start_ts_in,
+			      end_ts_in, &ts))
+		return false;
 
 	da_resize(audio->render_order, 0);
 	da_resize(audio->root_nodes, 0);
 
-	circlebuf_push_back(&audio->buffered_timestamps, &ts, sizeof(ts));
-	circlebuf_peek_front(&audio->buffered_timestamps, &ts, sizeof(ts));
 	min_ts = ts.start;
 
 	audio_size = AUDIO_OUTPUT_FRAMES * sizeof(float);
@@ -461,8 +524,8 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 			pthread_mutex_lock(&source->audio_buf_mutex);
 
 			if (source->audio_output_buf[0][0] && source->audio_ts)
-				mix_audio(mixes, source, channels, sample_rate,
-					  &ts);
+				mix_audio(mixes, source, mixers, channels,
+					  sample_rate, &ts);
 
 			pthread_mutex_unlock(&source->audio_buf_mutex);
 		}
@@ -475,6 +538,8 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 	source = data->first_audio_source;
 	while (source) {
 		pthread_mutex_lock(&source->audio_buf_mutex);
+		update_source_buffering(audio, source, sample_rate, &ts,
+					&can_decay);
 		discard_audio(audio, source, channels, sample_rate, &ts);
 		pthread_mutex_unlock(&source->audio_buf_mutex);
 
@@ -483,6 +548,9 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 
 	pthread_mutex_unlock(&data->audio_sources_mutex);
 
+	if (!requested)
+		decay_audio_buffering(audio, sample_rate, can_decay);
+
 	/* ------------------------------------------------ */
 	/* release audio sources */
 	release_audio_sources(audio);
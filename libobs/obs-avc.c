@@ -19,31 +19,29 @@
 #include "obs-avc.h"
 #include "util/array-serializer.h"
 
-bool obs_avc_keyframe(const uint8_t *data, size_t size)
+#if defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define AVC_SCAN_SSE2 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#else
+#define AVC_SCAN_SSE2 0
+#endif
+
+#if AVC_SCAN_SSE2
+static inline int lowest_bit(uint32_t mask)
 {
-	const uint8_t *nal_start, *nal_end;
-	const uint8_t *end = data + size;
-	int type;
-
-	nal_start = obs_avc_find_startcode(data, end);
-	while (true) {
-		while (nal_start < end && !*(nal_start++))
-			;
-
-		if (nal_start == end)
-			break;
-
-		type = nal_start[0] & 0x1F;
-
-		if (type == OBS_NAL_SLICE_IDR || type == OBS_NAL_SLICE)
-			return (type == OBS_NAL_SLICE_IDR);
-
-		nal_end = obs_avc_find_startcode(nal_start, end);
-		nal_start = nal_end;
-	}
-
-	return false;
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanForward(&idx, mask);
+	return (int)idx;
+#else
+	return __builtin_ctz(mask);
+#endif
 }
+#endif
 
 /* NOTE: I noticed that FFmpeg does some unusual special handling of certain
  * scenarios that I was unaware of, so instead of just searching for {0, 0, 1}
@@ -86,66 +84,193 @@ static const uint8_t *ff_avc_find_startcode_internal(const uint8_t *p,
 	return end + 3;
 }
 
+/* first {0, 0, 1} in [p, end) with at least one byte after it, or end, same
+ * as the FFmpeg code.  16 positions are tested at a time, most packet data
+ * has no zero bytes at all so this rarely leaves the vector loop */
+static const uint8_t *find_next_startcode(const uint8_t *p, const uint8_t *end)
+{
+#if AVC_SCAN_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi8(1);
+
+	while (end - p >= 19) {
+		__m128i b0 = _mm_loadu_si128((const __m128i *)p);
+		__m128i b1 = _mm_loadu_si128((const __m128i *)(p + 1));
+		__m128i b2 = _mm_loadu_si128((const __m128i *)(p + 2));
+		__m128i match = _mm_and_si128(
+			_mm_and_si128(_mm_cmpeq_epi8(b0, zero),
+				      _mm_cmpeq_epi8(b1, zero)),
+			_mm_cmpeq_epi8(b2, one));
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(match);
+
+		if (mask)
+			return p + lowest_bit(mask);
+		p += 16;
+	}
+#endif
+
+	return ff_avc_find_startcode_internal(p, end);
+}
+
+/* a four byte start code is returned from its leading zero */
+static inline const uint8_t *startcode_begin(const uint8_t *p,
+					     const uint8_t *code,
+					     const uint8_t *end)
+{
+	if (p < code && code < end && !code[-1])
+		code--;
+	return code;
+}
+
 const uint8_t *obs_avc_find_startcode(const uint8_t *p, const uint8_t *end)
 {
-	const uint8_t *out = ff_avc_find_startcode_internal(p, end);
-	if (p < out && out < end && !out[-1])
-		out--;
-	return out;
+	return startcode_begin(p, find_next_startcode(p, end), end);
 }
 
-static inline int get_drop_priority(int priority)
+static inline void add_nal(struct obs_avc_index *index, const uint8_t *start,
+			   const uint8_t *data, const uint8_t *end)
 {
-	return priority;
+	struct obs_avc_nal *nal;
+
+	if (index->num == index->capacity) {
+		size_t capacity = index->capacity * 2;
+
+		if (index->nals == index->inline_nals) {
+			index->nals = bmalloc(capacity * sizeof(*nal));
+			memcpy(index->nals, index->inline_nals,
+			       index->num * sizeof(*nal));
+		} else {
+			index->nals = brealloc(index->nals,
+					       capacity * sizeof(*nal));
+		}
+		index->capacity = capacity;
+	}
+
+	nal = index->nals + index->num++;
+	nal->start = start;
+	nal->data = data;
+	nal->size = (size_t)(end - data);
+	nal->type = data[0] & 0x1F;
+	nal->ref_idc = data[0] >> 5;
 }
 
-static void serialize_avc_data(struct serializer *s, const uint8_t *data,
-			       size_t size, bool *is_keyframe, int *priority)
+void obs_avc_index_build(struct obs_avc_index *index, const uint8_t *data,
+			 size_t size)
 {
-	const uint8_t *nal_start, *nal_end;
 	const uint8_t *end = data + size;
-	int type;
+	const uint8_t *p = data;
+	const uint8_t *code;
 
-	nal_start = obs_avc_find_startcode(data, end);
-	while (true) {
-		while (nal_start < end && !*(nal_start++))
-			;
+	index->nals = index->inline_nals;
+	index->capacity = OBS_AVC_INLINE_NALS;
+	index->num = 0;
 
-		if (nal_start == end)
-			break;
+	code = find_next_startcode(p, end);
 
-		type = nal_start[0] & 0x1F;
+	while (code != end) {
+		const uint8_t *start = startcode_begin(p, code, end);
+		const uint8_t *nal_start = code + 3;
 
-		if (type == OBS_NAL_SLICE_IDR || type == OBS_NAL_SLICE) {
-			if (is_keyframe)
-				*is_keyframe = (type == OBS_NAL_SLICE_IDR);
-			if (priority)
-				*priority = nal_start[0] >> 5;
+		/* the previous NAL ends where this start code begins */
+		if (index->num) {
+			struct obs_avc_nal *prev = index->nals + index->num - 1;
+			prev->size = (size_t)(start - prev->data);
 		}
 
-		nal_end = obs_avc_find_startcode(nal_start, end);
-		s_wb32(s, (uint32_t)(nal_end - nal_start));
-		s_write(s, nal_start, nal_end - nal_start);
-		nal_start = nal_end;
+		code = find_next_startcode(nal_start, end);
+
+		/* empty NALs are kept, type is read from the next start
+		 * code in that case, same as before the index */
+		add_nal(index, start, nal_start, code);
+		p = nal_start;
+	}
+}
+
+void obs_avc_index_free(struct obs_avc_index *index)
+{
+	if (index->nals != index->inline_nals)
+		bfree(index->nals);
+	index->nals = index->inline_nals;
+	index->num = 0;
+}
+
+size_t obs_avc_index_avcc_size(const struct obs_avc_index *index)
+{
+	size_t size = 0;
+
+	for (size_t i = 0; i < index->num; i++)
+		size += 4 + index->nals[i].size;
+	return size;
+}
+
+void obs_avc_index_write_avcc(const struct obs_avc_index *index, uint8_t *dst)
+{
+	for (size_t i = 0; i < index->num; i++) {
+		const struct obs_avc_nal *nal = index->nals + i;
+		uint32_t size = (uint32_t)nal->size;
+
+		dst[0] = (uint8_t)(size >> 24);
+		dst[1] = (uint8_t)(size >> 16);
+		dst[2] = (uint8_t)(size >> 8);
+		dst[3] = (uint8_t)size;
+		memcpy(dst + 4, nal->data, nal->size);
+		dst += 4 + nal->size;
+	}
+}
+
+bool obs_avc_keyframe(const uint8_t *data, size_t size)
+{
+	const uint8_t *end = data + size;
+	const uint8_t *code = find_next_startcode(data, end);
+
+	/* only up to the first slice, no need to index the whole packet */
+	while (code != end) {
+		int type = code[3] & 0x1F;
+
+		if (type == OBS_NAL_SLICE_IDR || type == OBS_NAL_SLICE)
+			return (type == OBS_NAL_SLICE_IDR);
+
+		code = find_next_startcode(code + 3, end);
 	}
+
+	return false;
+}
+
+static inline int get_drop_priority(int priority)
+{
+	return priority;
 }
 
 void obs_parse_avc_packet(struct encoder_packet *avc_packet,
 			  const struct encoder_packet *src)
 {
-	struct array_output_data output;
-	struct serializer s;
+	struct obs_avc_index index;
+	uint8_t *data;
+	size_t size;
 	long ref = 1;
 
-	array_output_serializer_init(&s, &output);
+	obs_avc_index_build(&index, src->data, src->size);
 	*avc_packet = *src;
 
-	serialize(&s, &ref, sizeof(ref));
-	serialize_avc_data(&s, src->data, src->size, &avc_packet->keyframe,
-			   &avc_packet->priority);
+	for (size_t i = 0; i < index.num; i++) {
+		const struct obs_avc_nal *nal = index.nals + i;
+
+		if (nal->type == OBS_NAL_SLICE_IDR ||
+		    nal->type == OBS_NAL_SLICE) {
+			avc_packet->keyframe = nal->type == OBS_NAL_SLICE_IDR;
+			avc_packet->priority = nal->ref_idc;
+		}
+	}
+
+	/* the exact size is known up front, one allocation per packet */
+	size = obs_avc_index_avcc_size(&index);
+	data = bmalloc(sizeof(ref) + size);
+	memcpy(data, &ref, sizeof(ref));
+	obs_avc_index_write_avcc(&index, data + sizeof(ref));
+	obs_avc_index_free(&index);
 
-	avc_packet->data = output.bytes.array + sizeof(ref);
-	avc_packet->size = output.bytes.num - sizeof(ref);
+	avc_packet->data = data + sizeof(ref);
+	avc_packet->size = size;
 	avc_packet->drop_priority = get_drop_priority(avc_packet->priority);
 }
 
@@ -160,31 +285,23 @@ static inline bool has_start_code(const uint8_t *data)
 static void get_sps_pps(const uint8_t *data, size_t size, const uint8_t **sps,
 			size_t *sps_size, const uint8_t **pps, size_t *pps_size)
 {
-	const uint8_t *nal_start, *nal_end;
-	const uint8_t *end = data + size;
-	int type;
+	struct obs_avc_index index;
 
-	nal_start = obs_avc_find_startcode(data, end);
-	while (true) {
-		while (nal_start < end && !*(nal_start++))
-			;
+	obs_avc_index_build(&index, data, size);
 
-		if (nal_start == end)
-			break;
+	for (size_t i = 0; i < index.num; i++) {
+		const struct obs_avc_nal *nal = index.nals + i;
 
-		nal_end = obs_avc_find_startcode(nal_start, end);
-
-		type = nal_start[0] & 0x1F;
-		if (type == OBS_NAL_SPS) {
-			*sps = nal_start;
-			*sps_size = nal_end - nal_start;
-		} else if (type == OBS_NAL_PPS) {
-			*pps = nal_start;
-			*pps_size = nal_end - nal_start;
+		if (nal->type == OBS_NAL_SPS) {
+			*sps = nal->data;
+			*sps_size = nal->size;
+		} else if (nal->type == OBS_NAL_PPS) {
+			*pps = nal->data;
+			*pps_size = nal->size;
 		}
-
-		nal_start = nal_end;
 	}
+
+	obs_avc_index_free(&index);
 }
 
 size_t obs_parse_avc_header(uint8_t **header, const uint8_t *data, size_t size)
@@ -223,58 +340,58 @@ size_t obs_parse_avc_header(uint8_t **header, const uint8_t *data, size_t size)
 	return output.bytes.num;
 }
 
+static inline uint8_t *alloc_nals(size_t size)
+{
+	return size ? bmalloc(size) : NULL;
+}
+
 void obs_extract_avc_headers(const uint8_t *packet, size_t size,
 			     uint8_t **new_packet_data, size_t *new_packet_size,
 			     uint8_t **header_data, size_t *header_size,
 			     uint8_t **sei_data, size_t *sei_size)
 {
-	DARRAY(uint8_t) new_packet;
-	DARRAY(uint8_t) header;
-	DARRAY(uint8_t) sei;
-	const uint8_t *nal_start, *nal_end, *nal_codestart;
-	const uint8_t *end = packet + size;
-	int type;
-
-	da_init(new_packet);
-	da_init(header);
-	da_init(sei);
-
-	nal_start = obs_avc_find_startcode(packet, end);
-	nal_end = NULL;
-	while (nal_end != end) {
-		nal_codestart = nal_start;
-
-		while (nal_start < end && !*(nal_start++))
-			;
-
-		if (nal_start == end)
-			break;
-
-		type = nal_start[0] & 0x1F;
-
-		nal_end = obs_avc_find_startcode(nal_start, end);
-		if (!nal_end)
-			nal_end = end;
-
-		if (type == OBS_NAL_SPS || type == OBS_NAL_PPS) {
-			da_push_back_array(header, nal_codestart,
-					   nal_end - nal_codestart);
-		} else if (type == OBS_NAL_SEI) {
-			da_push_back_array(sei, nal_codestart,
-					   nal_end - nal_codestart);
-
-		} else {
-			da_push_back_array(new_packet, nal_codestart,
-					   nal_end - nal_codestart);
+	struct obs_avc_index index;
+	size_t sizes[3] = {0};
+	uint8_t *outs[3];
+	size_t pos[3] = {0};
+
+	obs_avc_index_build(&index, packet, size);
+
+	/* 0: packet, 1: header, 2: sei, NALs are copied with their start
+	 * codes.  sized first so each is allocated once */
+	for (int pass = 0; pass < 2; pass++) {
+		for (size_t i = 0; i < index.num; i++) {
+			const struct obs_avc_nal *nal = index.nals + i;
+			size_t nal_size = nal->data + nal->size - nal->start;
+			int out = 0;
+
+			if (nal->type == OBS_NAL_SPS ||
+			    nal->type == OBS_NAL_PPS)
+				out = 1;
+			else if (nal->type == OBS_NAL_SEI)
+				out = 2;
+
+			if (pass == 0) {
+				sizes[out] += nal_size;
+			} else {
+				memcpy(outs[out] + pos[out], nal->start,
+				       nal_size);
+				pos[out] += nal_size;
+			}
 		}
 
-		nal_start = nal_end;
+		if (pass == 0) {
+			for (int out = 0; out < 3; out++)
+				outs[out] = alloc_nals(sizes[out]);
+		}
 	}
 
-	*new_packet_data = new_packet.array;
-	*new_packet_size = new_packet.num;
-	*header_data = header.array;
-	*header_size = header.num;
-	*sei_data = sei.array;
-	*sei_size = sei.num;
+	obs_avc_index_free(&index);
+
+	*new_packet_data = outs[0];
+	*new_packet_size = sizes[0];
+	*header_data = outs[1];
+	*header_size = sizes[1];
+	*sei_data = outs[2];
+	*sei_size = sizes[2];
 }
@@ -46,6 +46,35 @@ enum { OBS_NAL_PRIORITY_DISPOSABLE = 0,
 
 /* Helpers for parsing AVC NAL units.  */
 
+#define OBS_AVC_INLINE_NALS 32
+
+struct obs_avc_nal {
+	const uint8_t *start; /* start code, 3 or 4 bytes */
+	const uint8_t *data;  /* NAL header */
+	size_t size;          /* up to the next start code */
+	int type;
+	int ref_idc;
+};
+
+/* All NAL units of an Annex B packet, found in a single scan.  The index
+ * points into the packet data and needs no allocation unless the packet has
+ * more than OBS_AVC_INLINE_NALS units.  It must not be copied. */
+struct obs_avc_index {
+	struct obs_avc_nal *nals;
+	size_t num;
+	size_t capacity;
+	struct obs_avc_nal inline_nals[OBS_AVC_INLINE_NALS];
+};
+
+EXPORT void obs_avc_index_build(struct obs_avc_index *index,
+				const uint8_t *data, size_t size);
+EXPORT void obs_avc_index_free(struct obs_avc_index *index);
+
+/* AVCC (length prefixed) conversion into a caller provided buffer */
+EXPORT size_t obs_avc_index_avcc_size(const struct obs_avc_index *index);
+EXPORT void obs_avc_index_write_avcc(const struct obs_avc_index *index,
+				     uint8_t *dst);
+
 EXPORT bool obs_avc_keyframe(const uint8_t *data, size_t size);
 EXPORT const uint8_t *obs_avc_find_startcode(const uint8_t *p,
 					     const uint8_t *end);
@@ -48,6 +48,7 @@ static bool init_encoder(struct obs_encoder *encoder, const char *name,
 	pthread_mutex_init_value(&encoder->init_mutex);
 	pthread_mutex_init_value(&encoder->callbacks_mutex);
 	pthread_mutex_init_value(&encoder->outputs_mutex);
+	pthread_mutex_init_value(&encoder->settings_mutex);
 	pthread_mutex_init_value(&encoder->pause.mutex);
 
 	if (pthread_mutexattr_init(&attr) != 0)
@@ -63,6 +64,8 @@ static bool init_encoder(struct obs_encoder *encoder, const char *name,
 		return false;
 	if (pthread_mutex_init(&encoder->outputs_mutex, NULL) != 0)
 		return false;
+	if (pthread_mutex_init(&encoder->settings_mutex, NULL) != 0)
+		return false;
 	if (pthread_mutex_init(&encoder->pause.mutex, NULL) != 0)
 		return false;
 
@@ -272,6 +275,7 @@ static void obs_encoder_actually_destroy(obs_encoder_t *encoder)
 		pthread_mutex_destroy(&encoder->init_mutex);
 		pthread_mutex_destroy(&encoder->callbacks_mutex);
 		pthread_mutex_destroy(&encoder->outputs_mutex);
+		pthread_mutex_destroy(&encoder->settings_mutex);
 		pthread_mutex_destroy(&encoder->pause.mutex);
 		obs_context_data_free(&encoder->context);
 		if (encoder->owns_info_id)
@@ -392,13 +396,32 @@ void obs_encoder_update(obs_encoder_t *encoder, obs_data_t *settings)
 	if (!obs_encoder_valid(encoder, "obs_encoder_update"))
 		return;
 
+	pthread_mutex_lock(&encoder->settings_mutex);
 	obs_data_apply(encoder->context.settings, settings);
+	pthread_mutex_unlock(&encoder->settings_mutex);
+
+	if (!encoder->info.update || !encoder->context.data)
+		return;
 
-	if (encoder->info.update && encoder->context.data)
+	/* encoders can't be updated while they encode, an active encoder is
+	 * updated by its own thread before the next frame */
+	if (encoder_active(encoder))
+		os_atomic_set_bool(&encoder->reconfigure_requested, true);
+	else
 		encoder->info.update(encoder->context.data,
 				     encoder->context.settings);
 }
 
+void obs_encoder_request_keyframe(obs_encoder_t *encoder)
+{
+	if (!obs_encoder_valid(encoder, "obs_encoder_request_keyframe"))
+		return;
+	if (encoder->info.type != OBS_ENCODER_VIDEO)
+		return;
+
+	os_atomic_set_bool(&encoder->keyframe_requested, true);
+}
+
 bool obs_encoder_get_extra_data(const obs_encoder_t *encoder,
 				uint8_t **extra_data, size_t *size)
 {
@@ -844,6 +867,7 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 				    struct encoder_packet *packet)
 {
 	struct encoder_packet first_packet;
+	struct encoder_packet shared;
 	DARRAY(uint8_t) data;
 	uint8_t *sei;
 	size_t size;
@@ -867,10 +891,16 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 	first_packet.data = data.array;
 	first_packet.size = data.num;
 
+	/* outputs reference the packet data rather than copying it, so it
+	 * has to be a refcounted instance as well */
+	obs_encoder_packet_create_instance(&shared, &first_packet);
+	da_free(data);
+
+	first_packet = shared;
 	cb->new_packet(cb->param, &first_packet);
 	cb->sent_first_packet = true;
 
-	da_free(data);
+	obs_encoder_packet_release(&shared);
 }
 
 static inline void send_packet(struct obs_encoder *encoder,
@@ -933,18 +963,38 @@ void send_off_encoder_packet(obs_encoder_t *encoder, bool success,
 		pkt->sys_dts_usec += encoder->pause.ts_offset / 1000;
 		pthread_mutex_unlock(&encoder->pause.mutex);
 
+		/* the packet data is copied once into a refcounted instance
+		 * that every output references.  each callback still gets its
+		 * own packet struct, so per output fields such as the track
+		 * index and timestamp offsets never leak between outputs */
+		struct encoder_packet shared;
+		obs_encoder_packet_create_instance(&shared, pkt);
+
 		pthread_mutex_lock(&encoder->callbacks_mutex);
 
 		for (size_t i = encoder->callbacks.num; i > 0; i--) {
 			struct encoder_callback *cb;
+			struct encoder_packet out = shared;
 			cb = encoder->callbacks.array + (i - 1);
-			send_packet(encoder, cb, pkt);
+			send_packet(encoder, cb, &out);
 		}
 
 		pthread_mutex_unlock(&encoder->callbacks_mutex);
+
+		obs_encoder_packet_release(&shared);
 	}
 }
 
+void check_reconfigure(struct obs_encoder *encoder)
+{
+	if (!os_atomic_set_bool(&encoder->reconfigure_requested, false))
+		return;
+
+	pthread_mutex_lock(&encoder->settings_mutex);
+	encoder->info.update(encoder->context.data, encoder->context.settings);
+	pthread_mutex_unlock(&encoder->settings_mutex);
+}
+
 static const char *do_encode_name = "do_encode";
 bool do_encode(struct obs_encoder *encoder, struct encoder_frame *frame)
 {
@@ -962,6 +1012,8 @@ bool do_encode(struct obs_encoder *encoder, struct encoder_frame *frame)
 	pkt.timebase_den = encoder->timebase_den;
 	pkt.encoder = encoder;
 
+	check_reconfigure(encoder);
+
 	profile_start(encoder->profile_encoder_encode_name);
 	success = encoder->info.encode(encoder->context.data, frame, &pkt,
 				       &received);
@@ -1037,6 +1089,8 @@ static void receive_video(void *param, struct video_data *frame)
 
 	enc_frame.frames = 1;
 	enc_frame.pts = encoder->cur_pts;
+	enc_frame.force_keyframe =
+		os_atomic_set_bool(&encoder->keyframe_requested, false);
 
 	if (do_encode(encoder, &enc_frame))
 		encoder->cur_pts += encoder->timebase_num;
@@ -31,6 +31,7 @@ extern "C" {
 
 #define OBS_ENCODER_CAP_DEPRECATED (1 << 0)
 #define OBS_ENCODER_CAP_PASS_TEXTURE (1 << 1)
+#define OBS_ENCODER_CAP_DYN_BITRATE (1 << 2)
 
 /** Specifies the encoder type */
 enum obs_encoder_type {
@@ -98,6 +99,9 @@ struct encoder_frame {
 
 	/** Presentation timestamp */
 	int64_t pts;
+
+	/** Encode this frame as a keyframe (video only) */
+	bool force_keyframe;
 };
 
 /**
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "util/circlebuf.h"
+#include "util/darray.h"
+#include "obs.h"
+
+/* Packets of an output waiting to be interleaved.  Each track has its own
+ * queue in dts order, video first, then one per audio mix, and packets are
+ * sent from whichever queue has the earliest head. */
+
+#define NUM_INTERLEAVED_QUEUES (1 + MAX_AUDIO_MIXES)
+
+struct interleaved_packet {
+	struct encoder_packet packet;
+	/* arrival order, breaks ties between audio tracks */
+	uint64_t seq;
+};
+
+struct interleave_queues {
+	struct circlebuf queues[NUM_INTERLEAVED_QUEUES];
+	uint64_t seq;
+	uint64_t bytes; /* packet data referenced by the queues */
+};
+
+static inline struct circlebuf *interleave_queue(struct interleave_queues *iq,
+						 enum obs_encoder_type type,
+						 size_t audio_idx)
+{
+	return &iq->queues[type == OBS_ENCODER_VIDEO ? 0 : 1 + audio_idx];
+}
+
+static inline size_t interleave_count(const struct circlebuf *queue)
+{
+	return queue->size / sizeof(struct interleaved_packet);
+}
+
+static inline struct interleaved_packet *interleave_at(struct circlebuf *queue,
+						       size_t idx)
+{
+	return (struct interleaved_packet *)circlebuf_data(
+		queue, idx * sizeof(struct interleaved_packet));
+}
+
+/* interleaving order: by dts, video ahead of audio of the same dts, audio
+ * of the same dts in arrival order */
+static inline bool interleaved_before(const struct interleaved_packet *a,
+				      const struct interleaved_packet *b)
+{
+	bool a_video = a->packet.type == OBS_ENCODER_VIDEO;
+	bool b_video = b->packet.type == OBS_ENCODER_VIDEO;
+
+	if (a->packet.dts_usec != b->packet.dts_usec)
+		return a->packet.dts_usec < b->packet.dts_usec;
+	if (a_video != b_video)
+		return a_video;
+	return a->seq < b->seq;
+}
+
+/* walks the queues in interleaving order without removing anything */
+struct interleave_cursor {
+	size_t pos[NUM_INTERLEAVED_QUEUES];
+};
+
+static inline struct interleaved_packet *
+interleave_cursor_next(struct interleave_queues *iq,
+		       struct interleave_cursor *cursor)
+{
+	struct interleaved_packet *next = NULL;
+	size_t next_queue = 0;
+
+	for (size_t i = 0; i < NUM_INTERLEAVED_QUEUES; i++) {
+		struct circlebuf *queue = &iq->queues[i];
+		struct interleaved_packet *entry;
+
+		if (cursor->pos[i] >= interleave_count(queue))
+			continue;
+
+		entry = interleave_at(queue, cursor->pos[i]);
+		if (!next || interleaved_before(entry, next)) {
+			next = entry;
+			next_queue = i;
+		}
+	}
+
+	if (next)
+		cursor->pos[next_queue]++;
+	return next;
+}
+
+/* queue holding the first packet in interleaving order */
+static inline struct circlebuf *
+interleave_first_queue(struct interleave_queues *iq)
+{
+	struct circlebuf *first = NULL;
+
+	for (size_t i = 0; i < NUM_INTERLEAVED_QUEUES; i++) {
+		struct circlebuf *queue = &iq->queues[i];
+
+		if (!queue->size)
+			continue;
+		if (!first || interleaved_before(interleave_at(queue, 0),
+						 interleave_at(first, 0)))
+			first = queue;
+	}
+
+	return first;
+}
+
+static inline void interleave_pop(struct interleave_queues *iq,
+				  struct circlebuf *queue,
+				  struct interleaved_packet *entry)
+{
+	circlebuf_pop_front(queue, entry, sizeof(*entry));
+	iq->bytes -= entry->packet.size;
+}
+
+static inline void interleave_insert(struct interleave_queues *iq,
+				     struct encoder_packet *out)
+{
+	struct circlebuf *queue =
+		interleave_queue(iq, out->type, out->track_idx);
+	struct interleaved_packet entry = {*out, iq->seq++};
+	size_t count = interleave_count(queue);
+
+	iq->bytes += out->size;
+
+	/* encoders hand out packets in dts order, so this is an append */
+	if (!count ||
+	    !interleaved_before(&entry, interleave_at(queue, count - 1))) {
+		circlebuf_push_back(queue, &entry, sizeof(entry));
+		return;
+	}
+
+	/* otherwise move the later packets out of the way */
+	DARRAY(struct interleaved_packet) later;
+	da_init(later);
+
+	while (count &&
+	       interleaved_before(&entry, interleave_at(queue, count - 1))) {
+		struct interleaved_packet *back =
+			(struct interleaved_packet *)da_push_back_new(later);
+		circlebuf_pop_back(queue, back, sizeof(*back));
+		count--;
+	}
+
+	circlebuf_push_back(queue, &entry, sizeof(entry));
+	for (size_t i = later.num; i > 0; i--)
+		circlebuf_push_back(queue, &later.array[i - 1],
+				    sizeof(later.array[i - 1]));
+
+	da_free(later);
+}
+
+/* numbers the packets in their current interleaving order, so that ties
+ * keep it when their timestamps are rewritten */
+static inline void interleave_renumber(struct interleave_queues *iq)
+{
+	struct interleave_cursor cursor = {0};
+	struct interleaved_packet *entry;
+
+	iq->seq = 0;
+	while ((entry = interleave_cursor_next(iq, &cursor)))
+		entry->seq = iq->seq++;
+}
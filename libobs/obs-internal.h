@@ -35,6 +35,7 @@
 #include "media-io/audio-io.h"
 
 #include "obs.h"
+#include "obs-interleave.h"
 
 #define NUM_TEXTURES 2
 #define NUM_CHANNELS 3
@@ -310,6 +311,8 @@ struct obs_core_video {
 
 struct audio_monitor;
 
+#define MAX_BUFFERING_TICKS 45
+
 struct obs_core_audio {
 	audio_t *audio;
 
@@ -320,6 +323,9 @@ struct obs_core_audio {
 	struct circlebuf buffered_timestamps;
 	int buffering_wait_ticks;
 	int total_buffering_ticks;
+	int max_buffering_ticks;
+	bool low_latency;
+	int stable_ticks;
 
 	float user_volume;
 
@@ -352,6 +358,10 @@ struct obs_core_data {
 
 	long long unnamed_index;
 
+	/* video capable public inputs and groups, see
+	 * obs_get_video_source_count */
+	volatile long video_source_count;
+
 	obs_data_t *private_data;
 
 	volatile bool valid;
@@ -567,6 +577,9 @@ struct obs_source {
 	/* indicates ownership of the info.id buffer */
 	bool owns_info_id;
 
+	/* counted in obs->data.video_source_count */
+	bool counts_as_video;
+
 	/* signals to call the source update in the video thread */
 	bool defer_update;
 
@@ -609,6 +622,7 @@ struct obs_source {
 	uint64_t audio_ts;
 	struct circlebuf audio_input_buf[MAX_AUDIO_CHANNELS];
 	size_t last_audio_input_buf_size;
+	volatile long audio_buffering_ms;
 	DARRAY(struct audio_action) audio_actions;
 	float *audio_output_buf[MAX_AUDIO_MIXES][MAX_AUDIO_CHANNELS];
 	struct resample_info sample_info;
@@ -880,7 +894,7 @@ struct obs_output {
 	pthread_t end_data_capture_thread;
 	os_event_t *stopping_event;
 	pthread_mutex_t interleaved_mutex;
-	DARRAY(struct encoder_packet) interleaved_packets;
+	struct interleave_queues interleaved;
 	int stop_code;
 
 	int reconnect_retry_sec;
@@ -936,6 +950,7 @@ struct obs_output {
 	encoded_callback_t delay_callback;
 	struct circlebuf delay_data; /* struct delay_data */
 	pthread_mutex_t delay_mutex;
+	uint64_t delay_bytes; /* packet data referenced by delay_data */
 	uint32_t delay_sec;
 	uint32_t delay_flags;
 	uint32_t delay_cur_flags;
@@ -1013,6 +1028,9 @@ struct obs_encoder {
 
 	volatile bool active;
 	volatile bool paused;
+	volatile bool keyframe_requested;
+	/* settings changed while active, applied on the encoder thread */
+	volatile bool reconfigure_requested;
 	bool initialized;
 
 	/* indicates ownership of the info.id buffer */
@@ -1037,6 +1055,9 @@ struct obs_encoder {
 	uint64_t first_raw_ts;
 	uint64_t start_ts;
 
+	/* serializes settings changes with the deferred update */
+	pthread_mutex_t settings_mutex;
+
 	pthread_mutex_t outputs_mutex;
 	DARRAY(obs_output_t *) outputs;
 
@@ -1075,6 +1096,7 @@ extern void obs_encoder_remove_output(struct obs_encoder *encoder,
 extern bool start_gpu_encode(obs_encoder_t *encoder);
 extern void stop_gpu_encode(obs_encoder_t *encoder);
 
+extern void check_reconfigure(struct obs_encoder *encoder);
 extern bool do_encode(struct obs_encoder *encoder, struct encoder_frame *frame);
 extern void send_off_encoder_packet(obs_encoder_t *encoder, bool success,
 				    bool received, struct encoder_packet *pkt);
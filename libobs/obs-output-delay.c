@@ -35,10 +35,11 @@ static inline void push_packet(struct obs_output *output,
 
 	dd.msg = DELAY_MSG_PACKET;
 	dd.ts = t;
-	obs_encoder_packet_create_instance(&dd.packet, packet);
+	obs_encoder_packet_ref(&dd.packet, packet);
 
 	pthread_mutex_lock(&output->delay_mutex);
 	circlebuf_push_back(&output->delay_data, &dd, sizeof(dd));
+	output->delay_bytes += dd.packet.size;
 	pthread_mutex_unlock(&output->delay_mutex);
 }
 
@@ -72,6 +73,7 @@ void obs_output_cleanup_delay(obs_output_t *output)
 		}
 	}
 
+	output->delay_bytes = 0;
 	output->active_delay_ns = 0;
 	os_atomic_set_long(&output->delay_restart_refs, 0);
 }
@@ -99,6 +101,8 @@ static inline bool pop_packet(struct obs_output *output, uint64_t t)
 		} else if (elapsed_time > output->active_delay_ns) {
 			circlebuf_pop_front(&output->delay_data, NULL,
 					    sizeof(dd));
+			if (dd.msg == DELAY_MSG_PACKET)
+				output->delay_bytes -= dd.packet.size;
 			popped = true;
 		}
 	}
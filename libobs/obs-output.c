@@ -19,6 +19,7 @@
 #include "util/platform.h"
 #include "obs.h"
 #include "obs-internal.h"
+#include "obs-avc.h"
 
 #if BUILD_CAPTIONS
 #include <caption/caption.h>
@@ -168,10 +169,18 @@ fail:
 
 static inline void free_packets(struct obs_output *output)
 {
-	for (size_t i = 0; i < output->interleaved_packets.num; i++)
-		obs_encoder_packet_release(output->interleaved_packets.array +
-					   i);
-	da_free(output->interleaved_packets);
+	for (size_t i = 0; i < NUM_INTERLEAVED_QUEUES; i++) {
+		struct circlebuf *queue = &output->interleaved.queues[i];
+
+		while (queue->size) {
+			struct interleaved_packet entry;
+			circlebuf_pop_front(queue, &entry, sizeof(entry));
+			obs_encoder_packet_release(&entry.packet);
+		}
+		circlebuf_free(queue);
+	}
+	output->interleaved.seq = 0;
+	output->interleaved.bytes = 0;
 }
 
 static inline void clear_audio_buffers(obs_output_t *output)
@@ -1176,40 +1185,52 @@ static const uint8_t nal_start[4] = {0, 0, 0, 1};
 static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 {
 	struct encoder_packet backup = *out;
+	struct obs_avc_index index;
 	caption_frame_t cf;
 	sei_t sei;
 	uint8_t *data;
-	size_t size;
+	size_t insert = out->size;
+	size_t sei_size;
 	long ref = 1;
 
-	DARRAY(uint8_t) out_data;
-
 	if (out->priority > 1)
 		return false;
 
 	sei_init(&sei, 0.0);
 
-	da_init(out_data);
-	da_push_back_array(out_data, &ref, sizeof(ref));
-	da_push_back_array(out_data, out->data, out->size);
-
 	caption_frame_init(&cf);
 	caption_frame_from_text(&cf, &output->caption_head->text[0]);
 
 	sei_from_caption_frame(&sei, &cf);
 
-	data = malloc(sei_render_size(&sei));
-	size = sei_render(&sei, data);
-	/* TODO SEI should come after AUD/SPS/PPS, but before any VCL */
-	da_push_back_array(out_data, nal_start, 4);
-	da_push_back_array(out_data, data, size);
-	free(data);
+	/* SEI goes after AUD/SPS/PPS, but before any VCL */
+	obs_avc_index_build(&index, out->data, out->size);
+	for (size_t i = 0; i < index.num; i++) {
+		const struct obs_avc_nal *nal = index.nals + i;
+		if (nal->type >= OBS_NAL_SLICE &&
+		    nal->type <= OBS_NAL_SLICE_IDR) {
+			insert = (size_t)(nal->start - out->data);
+			break;
+		}
+	}
+	obs_avc_index_free(&index);
+
+	/* rendered straight into the new packet */
+	data = bmalloc(sizeof(ref) + out->size + sizeof(nal_start) +
+		       sei_render_size(&sei));
+	memcpy(data, &ref, sizeof(ref));
+	memcpy(data + sizeof(ref), out->data, insert);
+	memcpy(data + sizeof(ref) + insert, nal_start, sizeof(nal_start));
+	sei_size = sei_render(&sei,
+			      data + sizeof(ref) + insert + sizeof(nal_start));
+	memcpy(data + sizeof(ref) + insert + sizeof(nal_start) + sei_size,
+	       out->data + insert, out->size - insert);
 
 	obs_encoder_packet_release(out);
 
 	*out = backup;
-	out->data = (uint8_t *)out_data.array + sizeof(ref);
-	out->size = out_data.num - sizeof(ref);
+	out->data = data + sizeof(ref);
+	out->size = backup.size + sizeof(nal_start) + sei_size;
 
 	sei_free(&sei);
 
@@ -1222,15 +1243,21 @@ static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 
 static inline void send_interleaved(struct obs_output *output)
 {
-	struct encoder_packet out = output->interleaved_packets.array[0];
+	struct circlebuf *queue = interleave_first_queue(&output->interleaved);
+	struct interleaved_packet entry;
+	struct encoder_packet out;
+
+	if (!queue)
+		return;
 
 	/* do not send an interleaved packet if there's no packet of the
 	 * opposing type of a higher timestamp in the interleave buffer.
 	 * this ensures that the timestamps are monotonic */
-	if (!has_higher_opposing_ts(output, &out))
+	if (!has_higher_opposing_ts(output, &interleave_at(queue, 0)->packet))
 		return;
 
-	da_erase(output->interleaved_packets, 0);
+	interleave_pop(&output->interleaved, queue, &entry);
+	out = entry.packet;
 
 	if (out.type == OBS_ENCODER_VIDEO) {
 		output->total_frames++;
@@ -1288,12 +1315,15 @@ static size_t get_interleaved_start_idx(struct obs_output *output)
 	int64_t closest_diff = 0x7FFFFFFFFFFFFFFFLL;
 	struct encoder_packet *first_video =
 		find_first_packet_type(output, OBS_ENCODER_VIDEO, 0);
+	struct interleave_cursor cursor = {0};
+	struct interleaved_packet *entry;
 	size_t video_idx = DARRAY_INVALID;
 	size_t idx = 0;
 
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
+	for (size_t i = 0;
+	     (entry = interleave_cursor_next(&output->interleaved, &cursor));
+	     i++) {
+		struct encoder_packet *packet = &entry->packet;
 		int64_t diff;
 
 		if (packet->type != OBS_ENCODER_AUDIO) {
@@ -1329,7 +1359,7 @@ static int prune_premature_packets(struct obs_output *output)
 	}
 
 	max_idx = video_idx;
-	video = &output->interleaved_packets.array[video_idx];
+	video = find_first_packet_type(output, OBS_ENCODER_VIDEO, 0);
 	duration_usec = video->timebase_num * 1000000LL / video->timebase_den;
 
 	for (size_t i = 0; i < audio_mixes; i++) {
@@ -1343,7 +1373,7 @@ static int prune_premature_packets(struct obs_output *output)
 			return -1;
 		}
 
-		audio = &output->interleaved_packets.array[audio_idx];
+		audio = find_first_packet_type(output, OBS_ENCODER_AUDIO, i);
 		if (audio_idx > max_idx)
 			max_idx = audio_idx;
 
@@ -1358,12 +1388,16 @@ static int prune_premature_packets(struct obs_output *output)
 static void discard_to_idx(struct obs_output *output, size_t idx)
 {
 	for (size_t i = 0; i < idx; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		obs_encoder_packet_release(packet);
-	}
+		struct circlebuf *queue =
+			interleave_first_queue(&output->interleaved);
+		struct interleaved_packet entry;
+
+		if (!queue)
+			break;
 
-	da_erase_range(output->interleaved_packets, 0, idx);
+		interleave_pop(&output->interleaved, queue, &entry);
+		obs_encoder_packet_release(&entry.packet);
+	}
 }
 
 #define DEBUG_STARTING_PACKETS 0
@@ -1375,9 +1409,12 @@ static bool prune_interleaved_packets(struct obs_output *output)
 
 #if DEBUG_STARTING_PACKETS == 1
 	blog(LOG_DEBUG, "--------- Pruning! %d ---------", prune_start);
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
+	struct interleave_cursor cursor = {0};
+	struct interleaved_packet *entry;
+	for (size_t i = 0;
+	     (entry = interleave_cursor_next(&output->interleaved, &cursor));
+	     i++) {
+		struct encoder_packet *packet = &entry->packet;
 		blog(LOG_DEBUG, "packet: %s %d, ts: %lld, pruned = %s",
 		     packet->type == OBS_ENCODER_AUDIO ? "audio" : "video",
 		     (int)packet->track_idx, packet->dts_usec,
@@ -1399,43 +1436,24 @@ static bool prune_interleaved_packets(struct obs_output *output)
 	return true;
 }
 
+/* index of the first packet of a track in interleaving order */
 static int find_first_packet_type_idx(struct obs_output *output,
 				      enum obs_encoder_type type,
 				      size_t audio_idx)
 {
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-
-		if (packet->type == type) {
-			if (type == OBS_ENCODER_AUDIO &&
-			    packet->track_idx != audio_idx) {
-				continue;
-			}
-
-			return (int)i;
-		}
-	}
+	struct encoder_packet *first =
+		find_first_packet_type(output, type, audio_idx);
+	struct interleave_cursor cursor = {0};
+	struct interleaved_packet *entry;
 
-	return -1;
-}
-
-static int find_last_packet_type_idx(struct obs_output *output,
-				     enum obs_encoder_type type,
-				     size_t audio_idx)
-{
-	for (size_t i = output->interleaved_packets.num; i > 0; i--) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i - 1];
-
-		if (packet->type == type) {
-			if (type == OBS_ENCODER_AUDIO &&
-			    packet->track_idx != audio_idx) {
-				continue;
-			}
+	if (!first)
+		return -1;
 
-			return (int)(i - 1);
-		}
+	for (int i = 0;
+	     (entry = interleave_cursor_next(&output->interleaved, &cursor));
+	     i++) {
+		if (&entry->packet == first)
+			return i;
 	}
 
 	return -1;
@@ -1445,16 +1463,19 @@ static inline struct encoder_packet *
 find_first_packet_type(struct obs_output *output, enum obs_encoder_type type,
 		       size_t audio_idx)
 {
-	int idx = find_first_packet_type_idx(output, type, audio_idx);
-	return (idx != -1) ? &output->interleaved_packets.array[idx] : NULL;
+	struct circlebuf *queue =
+		interleave_queue(&output->interleaved, type, audio_idx);
+	return queue->size ? &interleave_at(queue, 0)->packet : NULL;
 }
 
 static inline struct encoder_packet *
 find_last_packet_type(struct obs_output *output, enum obs_encoder_type type,
 		      size_t audio_idx)
 {
-	int idx = find_last_packet_type_idx(output, type, audio_idx);
-	return (idx != -1) ? &output->interleaved_packets.array[idx] : NULL;
+	struct circlebuf *queue =
+		interleave_queue(&output->interleaved, type, audio_idx);
+	size_t count = interleave_count(queue);
+	return count ? &interleave_at(queue, count - 1)->packet : NULL;
 }
 
 static bool get_audio_and_video_packets(struct obs_output *output,
@@ -1533,64 +1554,35 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 	output->highest_audio_ts -= audio[0]->dts_usec;
 	output->highest_video_ts -= video->dts_usec;
 
-	/* apply new offsets to all existing packet DTS/PTS values */
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		apply_interleaved_packet_offset(output, packet);
-	}
-
-	return true;
-}
+	/* the new timestamps can change the interleaving order */
+	interleave_renumber(&output->interleaved);
 
-static inline void insert_interleaved_packet(struct obs_output *output,
-					     struct encoder_packet *out)
-{
-	size_t idx;
-	for (idx = 0; idx < output->interleaved_packets.num; idx++) {
-		struct encoder_packet *cur_packet;
-		cur_packet = output->interleaved_packets.array + idx;
+	/* apply new offsets to all existing packet DTS/PTS values */
+	for (size_t i = 0; i < NUM_INTERLEAVED_QUEUES; i++) {
+		struct circlebuf *queue = &output->interleaved.queues[i];
 
-		if (out->dts_usec == cur_packet->dts_usec &&
-		    out->type == OBS_ENCODER_VIDEO) {
-			break;
-		} else if (out->dts_usec < cur_packet->dts_usec) {
-			break;
-		}
+		for (size_t j = 0; j < interleave_count(queue); j++)
+			apply_interleaved_packet_offset(
+				output, &interleave_at(queue, j)->packet);
 	}
 
-	da_insert(output->interleaved_packets, idx, out);
-}
-
-static void resort_interleaved_packets(struct obs_output *output)
-{
-	DARRAY(struct encoder_packet) old_array;
-
-	old_array.da = output->interleaved_packets.da;
-	memset(&output->interleaved_packets, 0,
-	       sizeof(output->interleaved_packets));
-
-	for (size_t i = 0; i < old_array.num; i++)
-		insert_interleaved_packet(output, &old_array.array[i]);
-
-	da_free(old_array);
+	return true;
 }
 
 static void discard_unused_audio_packets(struct obs_output *output,
 					 int64_t dts_usec)
 {
-	size_t idx = 0;
+	struct circlebuf *queue;
 
-	for (; idx < output->interleaved_packets.num; idx++) {
-		struct encoder_packet *p =
-			&output->interleaved_packets.array[idx];
+	while ((queue = interleave_first_queue(&output->interleaved))) {
+		struct interleaved_packet entry;
 
-		if (p->dts_usec >= dts_usec)
+		if (interleave_at(queue, 0)->packet.dts_usec >= dts_usec)
 			break;
-	}
 
-	if (idx)
-		discard_to_idx(output, idx);
+		interleave_pop(&output->interleaved, queue, &entry);
+		obs_encoder_packet_release(&entry.packet);
+	}
 }
 
 static void interleave_packets(void *data, struct encoder_packet *packet)
@@ -1623,14 +1615,14 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 	if (output->active_delay_ns)
 		out = *packet;
 	else
-		obs_encoder_packet_create_instance(&out, packet);
+		obs_encoder_packet_ref(&out, packet);
 
 	if (was_started)
 		apply_interleaved_packet_offset(output, &out);
 	else
 		check_received(output, packet);
 
-	insert_interleaved_packet(output, &out);
+	interleave_insert(&output->interleaved, &out);
 	set_higher_ts(output, &out);
 
 	/* when both video and audio have been received, we're ready
@@ -1638,10 +1630,8 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 	if (output->received_audio && output->received_video) {
 		if (!was_started) {
 			if (prune_interleaved_packets(output)) {
-				if (initialize_interleaved_packets(output)) {
-					resort_interleaved_packets(output);
+				if (initialize_interleaved_packets(output))
 					send_interleaved(output);
-				}
 			}
 		} else {
 			send_interleaved(output);
@@ -2477,6 +2467,26 @@ void obs_output_output_caption_text2(obs_output_t *output, const char *text,
 }
 #endif
 
+uint64_t obs_output_get_retained_bytes(obs_output_t *output)
+{
+	uint64_t bytes;
+
+	if (!obs_output_valid(output, "obs_output_get_retained_bytes"))
+		return 0;
+
+	pthread_mutex_lock(&output->interleaved_mutex);
+	bytes = output->interleaved.bytes;
+	pthread_mutex_unlock(&output->interleaved_mutex);
+
+	pthread_mutex_lock(&output->delay_mutex);
+	bytes += output->delay_bytes;
+	pthread_mutex_unlock(&output->delay_mutex);
+
+	if (output->info.get_retained_bytes)
+		bytes += output->info.get_retained_bytes(output->context.data);
+	return bytes;
+}
+
 float obs_output_get_congestion(obs_output_t *output)
 {
 	if (!obs_output_valid(output, "obs_output_get_congestion"))
@@ -18,6 +18,7 @@
 
 #include "util/threading.h"
 #include "graphics/math-defs.h"
+#include "media-io/audio-mix.h"
 #include "obs-scene.h"
 
 const struct obs_source_info group_info;
@@ -1042,24 +1043,13 @@ static void process_all_audio_actions(struct obs_scene_item *item,
 static void mix_audio_with_buf(float *p_out, float *p_in, float *buf_in,
 			       size_t pos, size_t count)
 {
-	register float *out = p_out;
-	register float *buf = buf_in + pos;
-	register float *in = p_in + pos;
-	register float *end = in + count;
-
-	while (in < end)
-		*(out++) += *(in++) * *(buf++);
+	audio_mix_add_mul(p_out, p_in + pos, buf_in + pos, count);
 }
 
 static inline void mix_audio(float *p_out, float *p_in, size_t pos,
 			     size_t count)
 {
-	register float *out = p_out;
-	register float *in = p_in + pos;
-	register float *end = in + count;
-
-	while (in < end)
-		*(out++) += *(in++);
+	audio_mix_add(p_out, p_in + pos, count);
 }
 
 static bool scene_audio_render(void *data, uint64_t *ts_out,
@@ -1104,6 +1094,7 @@ static bool scene_audio_render(void *data, uint64_t *ts_out,
 	item = scene->first_item;
 	while (item) {
 		uint64_t source_ts;
+		uint32_t child_mixers;
 		size_t pos, count;
 		bool apply_buf;
 
@@ -1130,9 +1121,13 @@ static bool scene_audio_render(void *data, uint64_t *ts_out,
 			continue;
 		}
 
+		/* the child's output for mixes it isn't assigned to is
+		 * silent, no need to add it */
+		child_mixers = mixers & item->source->audio_mixers;
+
 		obs_source_get_audio_mix(item->source, &child_audio);
 		for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
-			if ((mixers & (1 << mix)) == 0)
+			if ((child_mixers & (1 << mix)) == 0)
 				continue;
 
 			for (size_t ch = 0; ch < channels; ch++) {
@@ -21,6 +21,7 @@
 #include "media-io/format-conversion.h"
 #include "media-io/video-frame.h"
 #include "media-io/audio-io.h"
+#include "media-io/audio-mix.h"
 #include "util/threading.h"
 #include "util/platform.h"
 #include "callback/calldata.h"
@@ -30,6 +31,8 @@
 #include "obs.h"
 #include "obs-internal.h"
 
+extern const struct obs_source_info group_info;
+
 static inline bool data_valid(const struct obs_source *source, const char *f)
 {
 	return obs_source_valid(source, f) && source->context.data;
@@ -195,6 +198,16 @@ bool obs_source_init(struct obs_source *source)
 
 	obs_context_data_insert(&source->context, &obs->data.sources_mutex,
 				&obs->data.first_source);
+
+	/* same sources as obs_enum_sources would count: all groups, and
+	 * inputs that are not private */
+	if ((source->info.output_flags & OBS_SOURCE_VIDEO) != 0 &&
+	    (source->info.id == group_info.id ||
+	     (source->info.type == OBS_SOURCE_TYPE_INPUT &&
+	      !source->context.private))) {
+		source->counts_as_video = true;
+		os_atomic_inc_long(&obs->data.video_source_count);
+	}
 	return true;
 }
 
@@ -554,6 +567,11 @@ void obs_source_destroy(struct obs_source *source)
 
 	obs_context_data_remove(&source->context);
 
+	if (source->counts_as_video) {
+		source->counts_as_video = false;
+		os_atomic_dec_long(&obs->data.video_source_count);
+	}
+
 	blog(LOG_DEBUG, "%ssource '%s' destroyed",
 	     source->context.private ? "private " : "", source->context.name);
 
@@ -3819,6 +3837,14 @@ uint32_t obs_source_get_audio_mixers(const obs_source_t *source)
 	return source->audio_mixers;
 }
 
+uint32_t obs_source_get_audio_buffering_ms(const obs_source_t *source)
+{
+	if (!obs_source_valid(source, "obs_source_get_audio_buffering_ms"))
+		return 0;
+
+	return (uint32_t)os_atomic_load_long(&source->audio_buffering_ms);
+}
+
 void obs_source_draw_set_color_matrix(const struct matrix4 *color_matrix,
 				      const struct vec3 *color_range_min,
 				      const struct vec3 *color_range_max)
@@ -4186,24 +4212,16 @@ static float get_source_volume(obs_source_t *source, uint64_t os_time)
 static inline void multiply_output_audio(obs_source_t *source, size_t mix,
 					 size_t channels, float vol)
 {
-	register float *out = source->audio_output_buf[mix][0];
-	register float *end = out + AUDIO_OUTPUT_FRAMES * channels;
-
-	while (out < end)
-		*(out++) *= vol;
+	audio_mix_mul(source->audio_output_buf[mix][0], vol,
+		      AUDIO_OUTPUT_FRAMES * channels);
 }
 
 static inline void multiply_vol_data(obs_source_t *source, size_t mix,
 				     size_t channels, float *vol_data)
 {
-	for (size_t ch = 0; ch < channels; ch++) {
-		register float *out = source->audio_output_buf[mix][ch];
-		register float *end = out + AUDIO_OUTPUT_FRAMES;
-		register float *vol = vol_data;
-
-		while (out < end)
-			*(out++) *= *(vol++);
-	}
+	for (size_t ch = 0; ch < channels; ch++)
+		audio_mix_mul_array(source->audio_output_buf[mix][ch],
+				    vol_data, AUDIO_OUTPUT_FRAMES);
 }
 
 static inline void apply_audio_action(obs_source_t *source,
@@ -1153,9 +1153,11 @@ int obs_reset_video(struct obs_video_info *ovi)
 	return obs_init_video(ovi);
 }
 
-bool obs_reset_audio(const struct obs_audio_info *oai)
+bool obs_reset_audio2(const struct obs_audio_info2 *oai)
 {
-	struct audio_output_info ai;
+	struct obs_core_audio *audio = &obs->audio;
+	struct audio_output_info ai = {0};
+	int max_ticks = MAX_BUFFERING_TICKS;
 
 	if (!obs)
 		return false;
@@ -1173,17 +1175,49 @@ bool obs_reset_audio(const struct obs_audio_info *oai)
 	ai.format = AUDIO_FORMAT_FLOAT_PLANAR;
 	ai.speakers = oai->speakers;
 	ai.input_callback = audio_callback;
+	ai.realtime = oai->realtime;
+
+	if (oai->max_buffering_ms) {
+		uint64_t frames = (uint64_t)oai->max_buffering_ms *
+				  oai->samples_per_sec / 1000;
+		max_ticks = (int)((frames + AUDIO_OUTPUT_FRAMES - 1) /
+				  AUDIO_OUTPUT_FRAMES);
+		if (max_ticks > MAX_BUFFERING_TICKS)
+			max_ticks = MAX_BUFFERING_TICKS;
+	}
+
+	audio->max_buffering_ticks = max_ticks;
+	audio->low_latency = oai->low_latency;
 
 	blog(LOG_INFO, "---------------------------------");
 	blog(LOG_INFO,
 	     "audio settings reset:\n"
 	     "\tsamples per sec: %d\n"
-	     "\tspeakers:        %d",
-	     (int)ai.samples_per_sec, (int)ai.speakers);
+	     "\tspeakers:        %d\n"
+	     "\tmax buffering:   %d milliseconds\n"
+	     "\tlow latency:     %s\n"
+	     "\trealtime:        %s",
+	     (int)ai.samples_per_sec, (int)ai.speakers,
+	     (int)((uint64_t)max_ticks * AUDIO_OUTPUT_FRAMES * 1000 /
+		   ai.samples_per_sec),
+	     oai->low_latency ? "true" : "false",
+	     oai->realtime ? "true" : "false");
 
 	return obs_init_audio(&ai);
 }
 
+bool obs_reset_audio(const struct obs_audio_info *oai)
+{
+	struct obs_audio_info2 oai2 = {0};
+
+	if (!oai)
+		return obs_reset_audio2(NULL);
+
+	oai2.samples_per_sec = oai->samples_per_sec;
+	oai2.speakers = oai->speakers;
+	return obs_reset_audio2(&oai2);
+}
+
 bool obs_get_video_info(struct obs_video_info *ovi)
 {
 	struct obs_core_video *video = &obs->video;
@@ -1210,6 +1244,38 @@ bool obs_get_audio_info(struct obs_audio_info *oai)
 	return true;
 }
 
+bool obs_get_audio_info2(struct obs_audio_info2 *oai)
+{
+	struct obs_core_audio *audio = &obs->audio;
+	const struct audio_output_info *info;
+
+	if (!obs || !oai || !audio->audio)
+		return false;
+
+	info = audio_output_get_info(audio->audio);
+
+	oai->samples_per_sec = info->samples_per_sec;
+	oai->speakers = info->speakers;
+	oai->max_buffering_ms =
+		(uint32_t)((uint64_t)audio->max_buffering_ticks *
+			   AUDIO_OUTPUT_FRAMES * 1000 / info->samples_per_sec);
+	oai->low_latency = audio->low_latency;
+	oai->realtime = info->realtime;
+	return true;
+}
+
+uint32_t obs_get_audio_buffering_ms(void)
+{
+	struct obs_core_audio *audio = &obs->audio;
+
+	if (!obs || !audio->audio)
+		return 0;
+
+	return (uint32_t)((uint64_t)audio->total_buffering_ticks *
+			  AUDIO_OUTPUT_FRAMES * 1000 /
+			  audio_output_get_sample_rate(audio->audio));
+}
+
 bool obs_enum_source_types(size_t idx, const char **id)
 {
 	if (!obs)
@@ -2349,6 +2415,12 @@ uint32_t obs_get_lagged_frames(void)
 	return obs ? obs->video.lagged_frames : 0;
 }
 
+size_t obs_get_video_source_count(void)
+{
+	return obs ? (size_t)os_atomic_load_long(&obs->data.video_source_count)
+		   : 0;
+}
+
 void start_raw_video(video_t *v, const struct video_scale_info *conversion,
 		     void (*callback)(void *param, struct video_data *frame),
 		     void *param)
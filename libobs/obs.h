@@ -187,6 +187,34 @@ struct obs_audio_info {
 	enum speaker_layout speakers;
 };
 
+/**
+ * Audio initialization structure with buffering options
+ */
+struct obs_audio_info2 {
+	uint32_t samples_per_sec;
+	enum speaker_layout speakers;
+
+	/**
+	 * Ceiling for the audio buffering that late sources can add, 0 for
+	 * the default of about a second.  Audio from sources that are later
+	 * than this is dropped.
+	 */
+	uint32_t max_buffering_ms;
+
+	/**
+	 * Buffering is taken back out once every source has been keeping up
+	 * for a few seconds, instead of staying until audio is reset.
+	 */
+	bool low_latency;
+
+	/**
+	 * Try to run the audio thread with realtime priority (SCHED_FIFO, or
+	 * time critical on Windows).  Stays at normal priority if the system
+	 * doesn't allow it.
+	 */
+	bool realtime;
+};
+
 /**
  * Sent to source filters via the filter_audio callback to allow filtering of
  * audio data
@@ -382,12 +410,17 @@ EXPORT int obs_reset_video(struct obs_video_info *ovi);
  * @note Cannot reset base audio if an output is currently active.
  */
 EXPORT bool obs_reset_audio(const struct obs_audio_info *oai);
+EXPORT bool obs_reset_audio2(const struct obs_audio_info2 *oai);
 
 /** Gets the current video settings, returns false if no video */
 EXPORT bool obs_get_video_info(struct obs_video_info *ovi);
 
 /** Gets the current audio settings, returns false if no audio */
 EXPORT bool obs_get_audio_info(struct obs_audio_info *oai);
+EXPORT bool obs_get_audio_info2(struct obs_audio_info2 *oai);
+
+/** Gets the current total audio buffering in milliseconds */
+EXPORT uint32_t obs_get_audio_buffering_ms(void);
 
 /**
  * Opens a plugin module directly from a specific path.
@@ -736,6 +769,13 @@ EXPORT uint64_t obs_get_frame_interval_ns(void);
 EXPORT uint32_t obs_get_total_frames(void);
 EXPORT uint32_t obs_get_lagged_frames(void);
 
+/**
+ * Returns the number of video sources obs_enum_sources would return (public
+ * inputs and all groups) with OBS_SOURCE_VIDEO set. Maintained on source
+ * creation/destruction, does not lock the sources list.
+ */
+EXPORT size_t obs_get_video_source_count(void);
+
 EXPORT bool obs_nv12_tex_active(void);
 
 EXPORT void obs_apply_private_data(obs_data_t *settings);
@@ -1010,6 +1050,13 @@ EXPORT void obs_source_set_audio_mixers(obs_source_t *source, uint32_t mixers);
 /** Gets audio mixer flags */
 EXPORT uint32_t obs_source_get_audio_mixers(const obs_source_t *source);
 
+/**
+ * Gets how much audio buffering the source needs to be mixed without gaps,
+ * in milliseconds.  The total audio buffering follows the source that needs
+ * the most, so this shows which sources are adding latency.
+ */
+EXPORT uint32_t obs_source_get_audio_buffering_ms(const obs_source_t *source);
+
 /**
  * Increments the 'showing' reference counter to indicate that the source is
  * being shown somewhere.  If the reference counter was 0, will call the 'show'
@@ -1814,6 +1861,9 @@ EXPORT void obs_output_output_caption_text2(obs_output_t *output,
 EXPORT float obs_output_get_congestion(obs_output_t *output);
 EXPORT int obs_output_get_connect_time_ms(obs_output_t *output);
 
+/** Returns the bytes of shared encoded packet data the output references */
+EXPORT uint64_t obs_output_get_retained_bytes(obs_output_t *output);
+
 EXPORT bool obs_output_reconnecting(const obs_output_t *output);
 
 /** Pass a string of the last output error, for UI use */
@@ -1984,10 +2034,18 @@ EXPORT obs_properties_t *obs_encoder_properties(const obs_encoder_t *encoder);
 
 /**
  * Updates the settings of the encoder context.  Usually used for changing
- * bitrate while active
+ * bitrate while active, in which case the encoder is updated from its own
+ * thread before it encodes the next frame.
  */
 EXPORT void obs_encoder_update(obs_encoder_t *encoder, obs_data_t *settings);
 
+/**
+ * Asks a video encoder to make the next frame a keyframe, for outputs that
+ * have to recover a receiver from packet loss.  Encoders that don't support
+ * it keep their regular keyframe interval.
+ */
+EXPORT void obs_encoder_request_keyframe(obs_encoder_t *encoder);
+
 /** Gets extra data (headers) associated with this context */
 EXPORT bool obs_encoder_get_extra_data(const obs_encoder_t *encoder,
 				       uint8_t **extra_data, size_t *size);
@@ -151,6 +151,19 @@ bool os_sleepto_ns(uint64_t time_target)
 	if (time_target < current)
 		return false;
 
+#if !defined(__APPLE__)
+	/* same clock as os_gettime_ns, an absolute deadline doesn't drift if
+	 * the thread gets preempted before going to sleep */
+	struct timespec deadline;
+	deadline.tv_sec = time_target / 1000000000;
+	deadline.tv_nsec = time_target % 1000000000;
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline,
+			       NULL) == EINTR)
+		;
+
+	return true;
+#else
 	time_target -= current;
 
 	struct timespec req, remain;
@@ -165,6 +178,7 @@ bool os_sleepto_ns(uint64_t time_target)
 	}
 
 	return true;
+#endif
 }
 
 void os_sleep_ms(uint32_t duration)
@@ -0,0 +1,267 @@
+#pragma once
+
+/*
+ * Shared memory ring used instead of the stdin pipe to hand packets to the
+ * muxer process.  The stream written into the ring is exactly what would
+ * otherwise be written to the pipe (ffm_packet_info followed by the packet
+ * data), the pipe is only kept open as a control channel so the muxer can
+ * tell when obs goes away.
+ *
+ * The ring lives in a memfd that the muxer opens through
+ * /proc/<pid>/fd/<fd>, so the descriptor never has to be inherited.  Both
+ * sides only sleep (on a futex in the shared header) when the ring is
+ * empty or full, and only wake the other side when it actually sleeps, so
+ * a busy recording makes no syscalls at all to move packets.
+ */
+
+#ifdef __linux__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define FFM_SHM_MAGIC 0x4d464652 /* "RFFM" */
+#define FFM_SHM_SIZE (32 * 1024 * 1024)
+#define FFM_SHM_WAIT_MS 100
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+struct ffm_shm_header {
+	uint32_t magic;
+	uint32_t closed;
+	uint64_t size;
+	int32_t consumer_pid;
+
+	/* each side's position on its own cache line */
+	uint8_t pad1[64 - 20];
+	uint64_t write_pos;
+	uint32_t data_seq;
+	uint32_t reader_waiting;
+	uint8_t pad2[64 - 16];
+	uint64_t read_pos;
+	uint32_t space_seq;
+	uint32_t writer_waiting;
+	uint8_t pad3[64 - 16];
+};
+
+struct ffm_shm {
+	struct ffm_shm_header *header;
+	uint8_t *data;
+	size_t map_size;
+	int fd;
+};
+
+/* returns false if the other side has died */
+typedef bool (*ffm_shm_alive_t)(void *param);
+
+static inline void ffm_shm_futex_wait(uint32_t *addr, uint32_t val)
+{
+	struct timespec ts = {0, FFM_SHM_WAIT_MS * 1000000L};
+	syscall(SYS_futex, addr, FUTEX_WAIT, val, &ts, NULL, 0);
+}
+
+static inline void ffm_shm_futex_wake(uint32_t *addr)
+{
+	__atomic_add_fetch(addr, 1, __ATOMIC_SEQ_CST);
+	syscall(SYS_futex, addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+static inline bool ffm_shm_map(struct ffm_shm *shm, int fd, size_t map_size)
+{
+	void *ptr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			 fd, 0);
+	if (ptr == MAP_FAILED)
+		return false;
+
+	shm->header = ptr;
+	shm->data = (uint8_t *)ptr + sizeof(struct ffm_shm_header);
+	shm->map_size = map_size;
+	shm->fd = fd;
+	return true;
+}
+
+static inline void ffm_shm_free(struct ffm_shm *shm)
+{
+	if (shm->header)
+		munmap(shm->header, shm->map_size);
+	if (shm->fd > 0)
+		close(shm->fd);
+	memset(shm, 0, sizeof(*shm));
+}
+
+/* producer side, size must be a power of two */
+static inline bool ffm_shm_create(struct ffm_shm *shm, size_t size)
+{
+	size_t map_size = sizeof(struct ffm_shm_header) + size;
+	int fd = (int)syscall(SYS_memfd_create, "obs-ffmpeg-mux", MFD_CLOEXEC);
+
+	if (fd == -1)
+		return false;
+
+	if (ftruncate(fd, (off_t)map_size) != 0 ||
+	    !ffm_shm_map(shm, fd, map_size)) {
+		close(fd);
+		return false;
+	}
+
+	shm->header->magic = FFM_SHM_MAGIC;
+	shm->header->size = size;
+	return true;
+}
+
+/* consumer side, path is /proc/<producer pid>/fd/<fd> */
+static inline bool ffm_shm_open(struct ffm_shm *shm, const char *path)
+{
+	struct stat st;
+	int fd = open(path, O_RDWR | O_CLOEXEC);
+
+	if (fd == -1)
+		return false;
+
+	if (fstat(fd, &st) != 0 ||
+	    (size_t)st.st_size <= sizeof(struct ffm_shm_header) ||
+	    !ffm_shm_map(shm, fd, (size_t)st.st_size)) {
+		close(fd);
+		return false;
+	}
+
+	if (shm->header->magic != FFM_SHM_MAGIC ||
+	    shm->header->size + sizeof(struct ffm_shm_header) !=
+		    (uint64_t)st.st_size) {
+		ffm_shm_free(shm);
+		return false;
+	}
+
+	__atomic_store_n(&shm->header->consumer_pid, (int32_t)getpid(),
+			 __ATOMIC_RELEASE);
+	return true;
+}
+
+static inline size_t ffm_shm_write(struct ffm_shm *shm, const void *vdata,
+				   size_t size, ffm_shm_alive_t alive,
+				   void *param)
+{
+	struct ffm_shm_header *h = shm->header;
+	const uint8_t *data = vdata;
+	uint64_t pos = h->write_pos;
+	size_t total = size;
+
+	while (size > 0) {
+		uint64_t read_pos =
+			__atomic_load_n(&h->read_pos, __ATOMIC_ACQUIRE);
+		size_t space = (size_t)(h->size - (pos - read_pos));
+
+		if (!space) {
+			uint32_t seq = __atomic_load_n(&h->space_seq,
+						       __ATOMIC_SEQ_CST);
+			__atomic_store_n(&h->writer_waiting, 1,
+					 __ATOMIC_SEQ_CST);
+			if (__atomic_load_n(&h->read_pos, __ATOMIC_SEQ_CST) ==
+			    read_pos)
+				ffm_shm_futex_wait(&h->space_seq, seq);
+			__atomic_store_n(&h->writer_waiting, 0,
+					 __ATOMIC_SEQ_CST);
+
+			if (__atomic_load_n(&h->read_pos, __ATOMIC_ACQUIRE) ==
+				    read_pos &&
+			    !alive(param))
+				break;
+			continue;
+		}
+
+		size_t offset = (size_t)(pos & (h->size - 1));
+		size_t chunk = size < space ? size : space;
+		if (chunk > h->size - offset)
+			chunk = (size_t)(h->size - offset);
+
+		memcpy(shm->data + offset, data, chunk);
+		data += chunk;
+		size -= chunk;
+		pos += chunk;
+
+		__atomic_store_n(&h->write_pos, pos, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&h->reader_waiting, __ATOMIC_SEQ_CST))
+			ffm_shm_futex_wake(&h->data_seq);
+	}
+
+	return total - size;
+}
+
+static inline size_t ffm_shm_read(struct ffm_shm *shm, void *vdata,
+				  size_t size, ffm_shm_alive_t alive,
+				  void *param)
+{
+	struct ffm_shm_header *h = shm->header;
+	uint8_t *data = vdata;
+	uint64_t pos = h->read_pos;
+	size_t total = size;
+
+	while (size > 0) {
+		uint64_t write_pos =
+			__atomic_load_n(&h->write_pos, __ATOMIC_ACQUIRE);
+		size_t avail = (size_t)(write_pos - pos);
+
+		if (!avail) {
+			/* the last write may have landed between loading
+			 * write_pos and seeing closed */
+			if (__atomic_load_n(&h->closed, __ATOMIC_ACQUIRE)) {
+				if (__atomic_load_n(&h->write_pos,
+						    __ATOMIC_ACQUIRE) == pos)
+					break;
+				continue;
+			}
+
+			uint32_t seq = __atomic_load_n(&h->data_seq,
+						       __ATOMIC_SEQ_CST);
+			__atomic_store_n(&h->reader_waiting, 1,
+					 __ATOMIC_SEQ_CST);
+			if (__atomic_load_n(&h->write_pos, __ATOMIC_SEQ_CST) ==
+				    write_pos &&
+			    !__atomic_load_n(&h->closed, __ATOMIC_SEQ_CST))
+				ffm_shm_futex_wait(&h->data_seq, seq);
+			__atomic_store_n(&h->reader_waiting, 0,
+					 __ATOMIC_SEQ_CST);
+
+			if (__atomic_load_n(&h->write_pos, __ATOMIC_ACQUIRE) ==
+				    write_pos &&
+			    !alive(param))
+				break;
+			continue;
+		}
+
+		size_t offset = (size_t)(pos & (h->size - 1));
+		size_t chunk = size < avail ? size : avail;
+		if (chunk > h->size - offset)
+			chunk = (size_t)(h->size - offset);
+
+		memcpy(data, shm->data + offset, chunk);
+		data += chunk;
+		size -= chunk;
+		pos += chunk;
+
+		__atomic_store_n(&h->read_pos, pos, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&h->writer_waiting, __ATOMIC_SEQ_CST))
+			ffm_shm_futex_wake(&h->space_seq);
+	}
+
+	return total - size;
+}
+
+/* producer side: no more data, the consumer drains the ring and exits */
+static inline void ffm_shm_close(struct ffm_shm *shm)
+{
+	__atomic_store_n(&shm->header->closed, 1, __ATOMIC_SEQ_CST);
+	ffm_shm_futex_wake(&shm->header->data_seq);
+}
+
+#endif
@@ -25,8 +25,14 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "ffmpeg-mux.h"
 
+#ifdef __linux__
+#include <poll.h>
+#include "ffmpeg-mux-shm.h"
+#endif
+
 #include <libavformat/avformat.h>
 
 #if LIBAVCODEC_VERSION_MAJOR >= 58
@@ -81,6 +87,7 @@ struct main_params {
 	int fps_den;
 	char *acodec;
 	char *muxer_settings;
+	char *shm_path;
 };
 
 struct audio_params {
@@ -106,6 +113,9 @@ struct ffmpeg_mux {
 	int num_audio_streams;
 	bool initialized;
 	char error[4096];
+#ifdef __linux__
+	struct ffm_shm shm;
+#endif
 };
 
 static void header_free(struct header *header)
@@ -154,6 +164,10 @@ static void ffmpeg_mux_free(struct ffmpeg_mux *ffm)
 		free(ffm->audio);
 	}
 
+#ifdef __linux__
+	ffm_shm_free(&ffm->shm);
+#endif
+
 	memset(ffm, 0, sizeof(*ffm));
 }
 
@@ -259,6 +273,15 @@ static bool init_params(int *argc, char ***argv, struct main_params *params,
 
 	get_opt_str(argc, argv, &params->muxer_settings, "muxer settings");
 
+	/* packets come through shared memory instead of stdin */
+	if (*argc && strcmp((*argv)[0], "--shm") == 0) {
+		(*argc)--;
+		(*argv)++;
+		if (!get_opt_str(argc, argv, &params->shm_path,
+				 "shared memory path"))
+			return false;
+	}
+
 	return true;
 }
 
@@ -421,15 +444,38 @@ static size_t safe_read(void *vdata, size_t size)
 	return total;
 }
 
+#ifdef __linux__
+/* obs closes the control pipe when it's done with us, or when it dies */
+static bool producer_alive(void *param)
+{
+	struct pollfd pfd = {.fd = STDIN_FILENO, .events = POLLIN};
+
+	(void)param;
+	if (poll(&pfd, 1, 0) <= 0)
+		return true;
+	return (pfd.revents & (POLLHUP | POLLERR)) == 0;
+}
+#endif
+
+static size_t read_data(struct ffmpeg_mux *ffm, void *data, size_t size)
+{
+#ifdef __linux__
+	if (ffm->shm.header)
+		return ffm_shm_read(&ffm->shm, data, size, producer_alive,
+				    NULL);
+#endif
+	return safe_read(data, size);
+}
+
 static bool ffmpeg_mux_get_header(struct ffmpeg_mux *ffm)
 {
 	struct ffm_packet_info info = {0};
 
-	bool success = safe_read(&info, sizeof(info)) == sizeof(info);
+	bool success = read_data(ffm, &info, sizeof(info)) == sizeof(info);
 	if (success) {
 		uint8_t *data = malloc(info.size);
 
-		if (safe_read(data, info.size) == info.size) {
+		if (read_data(ffm, data, info.size) == info.size) {
 			ffmpeg_mux_header(ffm, data, &info);
 		} else {
 			success = false;
@@ -566,6 +612,15 @@ static int ffmpeg_mux_init_internal(struct ffmpeg_mux *ffm, int argc,
 			calloc(1, sizeof(struct header) * ffm->params.tracks);
 	}
 
+#ifdef __linux__
+	if (ffm->params.shm_path &&
+	    !ffm_shm_open(&ffm->shm, ffm->params.shm_path)) {
+		fprintf(stderr, "Couldn't open shared memory '%s'\n",
+			ffm->params.shm_path);
+		return FFM_ERROR;
+	}
+#endif
+
 #if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(58, 9, 100)
 	av_register_all();
 #endif
@@ -687,10 +742,11 @@ int main(int argc, char *argv[])
 		return ret;
 	}
 
-	while (!fail && safe_read(&info, sizeof(info)) == sizeof(info)) {
+	while (!fail &&
+	       read_data(&ffm, &info, sizeof(info)) == sizeof(info)) {
 		resize_buf_resize(&rb, info.size);
 
-		if (safe_read(rb.buf, info.size) == info.size) {
+		if (read_data(&ffm, rb.buf, info.size) == info.size) {
 			ffmpeg_mux_packet(&ffm, rb.buf, &info);
 		} else {
 			fail = true;
@@ -25,6 +25,11 @@
 #include <util/circlebuf.h>
 #include <util/threading.h>
 #include "ffmpeg-mux/ffmpeg-mux.h"
+#include "replay-store.h"
+
+#ifdef __linux__
+#include "ffmpeg-mux/ffmpeg-mux-shm.h"
+#endif
 
 #ifdef _WIN32
 #include "util/windows/win-version.h"
@@ -50,20 +55,26 @@ struct ffmpeg_muxer {
 	volatile bool stopping;
 	volatile bool capturing;
 
-	/* replay buffer */
-	struct circlebuf packets;
-	int64_t cur_size;
-	int64_t cur_time;
-	int64_t max_size;
-	int64_t max_time;
+	/* replay buffer, only the packet thread changes the store */
+	struct replay_store store;
+	/* held while it does, so other threads can read the store's sizes,
+	 * and while the save thread sets path */
+	pthread_mutex_t store_mutex;
 	int64_t save_ts;
-	int keyframes;
 	obs_hotkey_id hotkey;
 
-	DARRAY(struct encoder_packet) mux_packets;
-	pthread_t mux_thread;
-	bool mux_thread_joinable;
+	/* saves are written by their own thread from packet snapshots */
+	DARRAY(struct replay_save *) saves;
+	pthread_mutex_t saves_mutex;
+	os_sem_t *saves_sem;
+	pthread_t save_thread;
+	bool save_thread_active;
 	volatile bool muxing;
+
+#ifdef __linux__
+	struct ffm_shm shm;
+	uint64_t shm_start_ns;
+#endif
 };
 
 static const char *ffmpeg_mux_getname(void *type)
@@ -74,19 +85,27 @@ static const char *ffmpeg_mux_getname(void *type)
 
 static inline void replay_buffer_clear(struct ffmpeg_muxer *stream)
 {
-	while (stream->packets.size > 0) {
-		struct encoder_packet pkt;
-		circlebuf_pop_front(&stream->packets, &pkt, sizeof(pkt));
-		obs_encoder_packet_release(&pkt);
-	}
-
-	circlebuf_free(&stream->packets);
-	stream->cur_size = 0;
-	stream->cur_time = 0;
-	stream->max_size = 0;
-	stream->max_time = 0;
+	replay_store_free(&stream->store);
 	stream->save_ts = 0;
-	stream->keyframes = 0;
+}
+
+static int stop_pipe(struct ffmpeg_muxer *stream)
+{
+	int ret;
+
+#ifdef __linux__
+	/* lets the muxer drain the ring and exit before the pipe is closed */
+	if (stream->shm.header)
+		ffm_shm_close(&stream->shm);
+#endif
+
+	ret = os_process_pipe_destroy(stream->pipe);
+	stream->pipe = NULL;
+
+#ifdef __linux__
+	ffm_shm_free(&stream->shm);
+#endif
+	return ret;
 }
 
 static void ffmpeg_mux_destroy(void *data)
@@ -94,12 +113,9 @@ static void ffmpeg_mux_destroy(void *data)
 	struct ffmpeg_muxer *stream = data;
 
 	replay_buffer_clear(stream);
-	if (stream->mux_thread_joinable)
-		pthread_join(stream->mux_thread, NULL);
-	da_free(stream->mux_packets);
-
-	os_process_pipe_destroy(stream->pipe);
+	stop_pipe(stream);
 	dstr_free(&stream->path);
+	pthread_mutex_destroy(&stream->store_mutex);
 	bfree(stream);
 }
 
@@ -108,6 +124,12 @@ static void *ffmpeg_mux_create(obs_data_t *settings, obs_output_t *output)
 	struct ffmpeg_muxer *stream = bzalloc(sizeof(*stream));
 	stream->output = output;
 
+	pthread_mutex_init_value(&stream->store_mutex);
+	if (pthread_mutex_init(&stream->store_mutex, NULL) != 0) {
+		bfree(stream);
+		return NULL;
+	}
+
 	UNUSED_PARAMETER(settings);
 	return stream;
 }
@@ -236,9 +258,11 @@ static void build_command_line(struct ffmpeg_muxer *stream, struct dstr *cmd,
 	dstr_insert_ch(cmd, 0, '\"');
 	dstr_cat(cmd, "\" \"");
 
+	pthread_mutex_lock(&stream->store_mutex);
 	dstr_copy(&stream->path, path);
 	dstr_replace(&stream->path, "\"", "\"\"");
 	dstr_cat_dstr(cmd, &stream->path);
+	pthread_mutex_unlock(&stream->store_mutex);
 
 	dstr_catf(cmd, "\" %d %d ", vencoder ? 1 : 0, num_tracks);
 
@@ -254,14 +278,87 @@ static void build_command_line(struct ffmpeg_muxer *stream, struct dstr *cmd,
 	}
 
 	add_muxer_params(cmd, stream);
+
+#ifdef __linux__
+	if (stream->shm.header)
+		dstr_catf(cmd, "--shm /proc/%d/fd/%d", (int)getpid(),
+			  stream->shm.fd);
+#endif
 }
 
+#ifdef __linux__
+static void create_shm(struct ffmpeg_muxer *stream)
+{
+	obs_data_t *settings = obs_output_get_settings(stream->output);
+	bool use_shm = obs_data_get_bool(settings, "shm_transport");
+	obs_data_release(settings);
+
+	if (!use_shm)
+		return;
+
+	if (!ffm_shm_create(&stream->shm, FFM_SHM_SIZE)) {
+		warn("Failed to create shared memory, using the pipe instead");
+		return;
+	}
+
+	stream->shm_start_ns = os_gettime_ns();
+}
+
+#define SHM_ATTACH_TIMEOUT_NS 5000000000ULL
+
+static bool shm_consumer_alive(void *param)
+{
+	struct ffmpeg_muxer *stream = param;
+	int pid = __atomic_load_n(&stream->shm.header->consumer_pid,
+				  __ATOMIC_ACQUIRE);
+	char path[64];
+	char stat[256];
+	char *state;
+	size_t len;
+	FILE *file;
+
+	if (!pid)
+		return os_gettime_ns() - stream->shm_start_ns <
+		       SHM_ATTACH_TIMEOUT_NS;
+
+	/* a muxer that exited stays a zombie until the pipe is closed */
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	file = fopen(path, "r");
+	if (!file)
+		return false;
+
+	len = fread(stat, 1, sizeof(stat) - 1, file);
+	stat[len] = 0;
+	fclose(file);
+
+	state = strrchr(stat, ')');
+	return state && state[1] == ' ' && state[2] != 'Z' && state[2] != 'X';
+}
+#endif
+
 static inline void start_pipe(struct ffmpeg_muxer *stream, const char *path)
 {
 	struct dstr cmd;
+#ifdef __linux__
+	create_shm(stream);
+#endif
 	build_command_line(stream, &cmd, path);
 	stream->pipe = os_process_pipe_create(cmd.array, "w");
 	dstr_free(&cmd);
+
+	if (!stream->pipe)
+		stop_pipe(stream);
+}
+
+static size_t write_data(struct ffmpeg_muxer *stream, const uint8_t *data,
+			 size_t size)
+{
+#ifdef __linux__
+	if (stream->shm.header)
+		return ffm_shm_write(&stream->shm, data, size,
+				     shm_consumer_alive, stream);
+#endif
+	return os_process_pipe_write(stream->pipe, data, size);
 }
 
 static bool ffmpeg_mux_start(void *data)
@@ -330,8 +427,7 @@ static int deactivate(struct ffmpeg_muxer *stream, int code)
 	int ret = -1;
 
 	if (active(stream)) {
-		ret = os_process_pipe_destroy(stream->pipe);
-		stream->pipe = NULL;
+		ret = stop_pipe(stream);
 
 		os_atomic_set_bool(&stream->active, false);
 		os_atomic_set_bool(&stream->sent_headers, false);
@@ -391,8 +487,8 @@ static void signal_failure(struct ffmpeg_muxer *stream)
 	os_atomic_set_bool(&stream->capturing, false);
 }
 
-static bool write_packet(struct ffmpeg_muxer *stream,
-			 struct encoder_packet *packet)
+static bool write_packet_data(struct ffmpeg_muxer *stream,
+			      struct encoder_packet *packet)
 {
 	bool is_video = packet->type == OBS_ENCODER_VIDEO;
 	size_t ret;
@@ -405,18 +501,15 @@ static bool write_packet(struct ffmpeg_muxer *stream,
 							: FFM_PACKET_AUDIO,
 				       .keyframe = packet->keyframe};
 
-	ret = os_process_pipe_write(stream->pipe, (const uint8_t *)&info,
-				    sizeof(info));
+	ret = write_data(stream, (const uint8_t *)&info, sizeof(info));
 	if (ret != sizeof(info)) {
-		warn("os_process_pipe_write for info structure failed");
-		signal_failure(stream);
+		warn("write_data for info structure failed");
 		return false;
 	}
 
-	ret = os_process_pipe_write(stream->pipe, packet->data, packet->size);
+	ret = write_data(stream, packet->data, packet->size);
 	if (ret != packet->size) {
-		warn("os_process_pipe_write for packet data failed");
-		signal_failure(stream);
+		warn("write_data for packet data failed");
 		return false;
 	}
 
@@ -424,6 +517,17 @@ static bool write_packet(struct ffmpeg_muxer *stream,
 	return true;
 }
 
+static bool write_packet(struct ffmpeg_muxer *stream,
+			 struct encoder_packet *packet)
+{
+	if (!write_packet_data(stream, packet)) {
+		signal_failure(stream);
+		return false;
+	}
+
+	return true;
+}
+
 static bool send_audio_headers(struct ffmpeg_muxer *stream,
 			       obs_encoder_t *aencoder, size_t idx)
 {
@@ -431,7 +535,7 @@ static bool send_audio_headers(struct ffmpeg_muxer *stream,
 		.type = OBS_ENCODER_AUDIO, .timebase_den = 1, .track_idx = idx};
 
 	obs_encoder_get_extra_data(aencoder, &packet.data, &packet.size);
-	return write_packet(stream, &packet);
+	return write_packet_data(stream, &packet);
 }
 
 static bool send_video_headers(struct ffmpeg_muxer *stream)
@@ -442,7 +546,7 @@ static bool send_video_headers(struct ffmpeg_muxer *stream)
 					.timebase_den = 1};
 
 	obs_encoder_get_extra_data(vencoder, &packet.data, &packet.size);
-	return write_packet(stream, &packet);
+	return write_packet_data(stream, &packet);
 }
 
 static bool send_headers(struct ffmpeg_muxer *stream)
@@ -480,8 +584,10 @@ static void ffmpeg_mux_data(void *data, struct encoder_packet *packet)
 	}
 
 	if (!stream->sent_headers) {
-		if (!send_headers(stream))
+		if (!send_headers(stream)) {
+			signal_failure(stream);
 			return;
+		}
 
 		stream->sent_headers = true;
 	}
@@ -568,10 +674,15 @@ static void save_replay_proc(void *data, calldata_t *cd)
 static void get_last_replay(void *data, calldata_t *cd)
 {
 	struct ffmpeg_muxer *stream = data;
+
+	pthread_mutex_lock(&stream->store_mutex);
 	if (!os_atomic_load_bool(&stream->muxing))
 		calldata_set_string(cd, "path", stream->path.array);
+	pthread_mutex_unlock(&stream->store_mutex);
 }
 
+static void *replay_buffer_save_thread(void *data);
+
 static void *replay_buffer_create(obs_data_t *settings, obs_output_t *output)
 {
 	UNUSED_PARAMETER(settings);
@@ -588,6 +699,23 @@ static void *replay_buffer_create(obs_data_t *settings, obs_output_t *output)
 	proc_handler_add(ph, "void get_last_replay(out string path)",
 			 get_last_replay, stream);
 
+	pthread_mutex_init_value(&stream->store_mutex);
+	pthread_mutex_init_value(&stream->saves_mutex);
+	if (pthread_mutex_init(&stream->store_mutex, NULL) != 0)
+		goto fail;
+	if (pthread_mutex_init(&stream->saves_mutex, NULL) != 0)
+		goto fail;
+	if (os_sem_init(&stream->saves_sem, 0) != 0)
+		goto fail;
+	if (pthread_create(&stream->save_thread, NULL,
+			   replay_buffer_save_thread, stream) != 0)
+		goto fail;
+
+	stream->save_thread_active = true;
+	return stream;
+
+fail:
+	warn("Failed to create save thread, saving will not work");
 	return stream;
 }
 
@@ -596,6 +724,16 @@ static void replay_buffer_destroy(void *data)
 	struct ffmpeg_muxer *stream = data;
 	if (stream->hotkey)
 		obs_hotkey_unregister(stream->hotkey);
+
+	/* finishes any queued saves first */
+	if (stream->save_thread_active) {
+		os_sem_post(stream->saves_sem);
+		pthread_join(stream->save_thread, NULL);
+	}
+
+	os_sem_destroy(stream->saves_sem);
+	pthread_mutex_destroy(&stream->saves_mutex);
+	da_free(stream->saves);
 	ffmpeg_mux_destroy(data);
 }
 
@@ -609,8 +747,18 @@ static bool replay_buffer_start(void *data)
 		return false;
 
 	obs_data_t *s = obs_output_get_settings(stream->output);
-	stream->max_time = obs_data_get_int(s, "max_time_sec") * 1000000LL;
-	stream->max_size = obs_data_get_int(s, "max_size_mb") * (1024 * 1024);
+	int64_t max_time = obs_data_get_int(s, "max_time_sec") * 1000000LL;
+	int64_t max_size = obs_data_get_int(s, "max_size_mb") * (1024 * 1024);
+	int64_t max_memory =
+		obs_data_get_int(s, "max_memory_mb") * (1024 * 1024);
+	bool has_video = !!obs_output_get_video_encoder(stream->output);
+
+	/* anything over max_memory_mb goes to a file in the replay
+	 * directory, so long buffers don't have to stay in memory */
+	pthread_mutex_lock(&stream->store_mutex);
+	replay_store_init(&stream->store, max_time, max_size, max_memory,
+			  has_video, obs_data_get_string(s, "directory"));
+	pthread_mutex_unlock(&stream->store_mutex);
 	obs_data_release(s);
 
 	os_atomic_set_bool(&stream->active, true);
@@ -621,78 +769,28 @@ static bool replay_buffer_start(void *data)
 	return true;
 }
 
-static bool purge_front(struct ffmpeg_muxer *stream)
-{
-	struct encoder_packet pkt;
-	bool keyframe;
-
-	circlebuf_pop_front(&stream->packets, &pkt, sizeof(pkt));
-
-	keyframe = pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe;
-
-	if (keyframe)
-		stream->keyframes--;
-
-	if (!stream->packets.size) {
-		stream->cur_size = 0;
-		stream->cur_time = 0;
-	} else {
-		struct encoder_packet first;
-		circlebuf_peek_front(&stream->packets, &first, sizeof(first));
-		stream->cur_time = first.dts_usec;
-		stream->cur_size -= (int64_t)pkt.size;
-	}
-
-	obs_encoder_packet_release(&pkt);
-	return keyframe;
-}
-
-static inline void purge(struct ffmpeg_muxer *stream)
-{
-	if (purge_front(stream)) {
-		struct encoder_packet pkt;
-
-		for (;;) {
-			circlebuf_peek_front(&stream->packets, &pkt,
-					     sizeof(pkt));
-			if (pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe)
-				return;
-
-			purge_front(stream);
-		}
-	}
-}
-
-static inline void replay_buffer_purge(struct ffmpeg_muxer *stream,
-				       struct encoder_packet *pkt)
-{
-	if (stream->max_size) {
-		if (!stream->packets.size || stream->keyframes <= 2)
-			return;
-
-		while ((stream->cur_size + (int64_t)pkt->size) >
-		       stream->max_size)
-			purge(stream);
-	}
-
-	if (!stream->packets.size || stream->keyframes <= 2)
-		return;
+struct replay_save {
+	/* packets in buffer order, references to the buffer's packets or
+	 * pointers into its pinned spill file */
+	DARRAY(struct encoder_packet) packets;
+	struct replay_spill *spill;
+	uint64_t spill_pin;
 
-	while ((pkt->dts_usec - stream->cur_time) > stream->max_time)
-		purge(stream);
-}
+	struct dstr path;
+	int64_t size;
+	uint64_t request_ts;
+	uint64_t snapshot_ns;
+};
 
 static void insert_packet(struct darray *array, struct encoder_packet *packet,
 			  int64_t video_offset, int64_t *audio_offsets,
 			  int64_t video_dts_offset, int64_t *audio_dts_offsets)
 {
-	struct encoder_packet pkt;
+	struct encoder_packet pkt = *packet;
 	DARRAY(struct encoder_packet) packets;
 	packets.da = *array;
 	size_t idx;
 
-	obs_encoder_packet_ref(&pkt, packet);
-
 	if (pkt.type == OBS_ENCODER_VIDEO) {
 		pkt.dts_usec -= video_offset;
 		pkt.dts -= video_dts_offset;
@@ -713,11 +811,84 @@ static void insert_packet(struct darray *array, struct encoder_packet *packet,
 	*array = packets.da;
 }
 
-static void *replay_buffer_mux_thread(void *data)
+/* rebase each track's timestamps on its first packet and interleave */
+static void reorder_packets(struct replay_save *save)
 {
-	struct ffmpeg_muxer *stream = data;
+	DARRAY(struct encoder_packet) sorted;
+
+	bool found_video = false;
+	bool found_audio[MAX_AUDIO_MIXES] = {0};
+	int64_t video_offset = 0;
+	int64_t video_dts_offset = 0;
+	int64_t audio_offsets[MAX_AUDIO_MIXES] = {0};
+	int64_t audio_dts_offsets[MAX_AUDIO_MIXES] = {0};
+
+	da_init(sorted);
+	da_reserve(sorted, save->packets.num);
 
-	start_pipe(stream, stream->path.array);
+	for (size_t i = 0; i < save->packets.num; i++) {
+		struct encoder_packet *pkt = save->packets.array + i;
+
+		if (pkt->type == OBS_ENCODER_VIDEO) {
+			if (!found_video) {
+				video_offset = pkt->dts_usec;
+				video_dts_offset = pkt->dts;
+				found_video = true;
+			}
+		} else {
+			if (!found_audio[pkt->track_idx]) {
+				found_audio[pkt->track_idx] = true;
+				audio_offsets[pkt->track_idx] = pkt->dts_usec;
+				audio_dts_offsets[pkt->track_idx] = pkt->dts;
+			}
+		}
+
+		insert_packet(&sorted.da, pkt, video_offset, audio_offsets,
+			      video_dts_offset, audio_dts_offsets);
+	}
+
+	da_free(save->packets);
+	save->packets.da = sorted.da;
+}
+
+static inline void release_save_packet(struct replay_save *save,
+				       struct encoder_packet *pkt)
+{
+	if (!replay_spill_owns(save->spill, pkt->data))
+		obs_encoder_packet_release(pkt);
+}
+
+static void replay_save_free(struct replay_save *save)
+{
+	for (size_t i = 0; i < save->packets.num; i++)
+		release_save_packet(save, save->packets.array + i);
+
+	da_free(save->packets);
+	replay_spill_unpin(save->spill, save->spill_pin);
+	dstr_free(&save->path);
+	bfree(save);
+}
+
+static int64_t replay_buffer_mem_size(struct ffmpeg_muxer *stream)
+{
+	int64_t mem_size;
+
+	pthread_mutex_lock(&stream->store_mutex);
+	mem_size = stream->store.mem_size;
+	pthread_mutex_unlock(&stream->store_mutex);
+	return mem_size;
+}
+
+static void write_replay(struct ffmpeg_muxer *stream, struct replay_save *save)
+{
+	uint64_t start = os_gettime_ns();
+	int64_t held = save->size;
+	int64_t peak = 0;
+	size_t i = 0;
+
+	reorder_packets(save);
+
+	start_pipe(stream, save->path.array);
 
 	if (!stream->pipe) {
 		warn("Failed to create process pipe");
@@ -726,66 +897,117 @@ static void *replay_buffer_mux_thread(void *data)
 
 	if (!send_headers(stream)) {
 		warn("Could not write headers for file '%s'",
-		     stream->path.array);
+		     save->path.array);
 		goto error;
 	}
 
-	for (size_t i = 0; i < stream->mux_packets.num; i++) {
-		struct encoder_packet *pkt = &stream->mux_packets.array[i];
-		write_packet(stream, pkt);
-		obs_encoder_packet_release(pkt);
+	for (; i < save->packets.num; i++) {
+		struct encoder_packet *pkt = save->packets.array + i;
+		int64_t total = replay_buffer_mem_size(stream) + held;
+
+		/* packets still in the buffer are counted twice, so this is
+		 * an upper bound of the memory kept alive during the save */
+		if (total > peak)
+			peak = total;
+
+		if (!write_packet_data(stream, pkt))
+			break;
+
+		held -= (int64_t)pkt->size;
+		release_save_packet(save, pkt);
 	}
 
-	info("Wrote replay buffer to '%s'", stream->path.array);
+	if (i == save->packets.num) {
+		uint64_t end = os_gettime_ns();
+		info("Wrote replay buffer to '%s' (%.1f MB): snapshot took "
+		     "%.2f ms, writing %.1f ms, %.1f ms after the request, "
+		     "at most %.1f MB of packets kept in memory",
+		     save->path.array,
+		     (double)save->size / (1024.0 * 1024.0),
+		     (double)save->snapshot_ns / 1000000.0,
+		     (double)(end - start) / 1000000.0,
+		     (double)(end / 1000 - save->request_ts) / 1000.0,
+		     (double)peak / (1024.0 * 1024.0));
+	} else {
+		warn("Failed to write replay buffer to '%s'",
+		     save->path.array);
+	}
 
 error:
-	os_process_pipe_destroy(stream->pipe);
-	stream->pipe = NULL;
-	da_free(stream->mux_packets);
-	os_atomic_set_bool(&stream->muxing, false);
-	return NULL;
+	stop_pipe(stream);
+
+	/* anything not written yet */
+	for (; i < save->packets.num; i++)
+		release_save_packet(save, save->packets.array + i);
+	save->packets.num = 0;
 }
 
-static void replay_buffer_save(struct ffmpeg_muxer *stream)
+static void *replay_buffer_save_thread(void *data)
 {
-	const size_t size = sizeof(struct encoder_packet);
-	size_t num_packets = stream->packets.size / size;
-
-	da_reserve(stream->mux_packets, num_packets);
+	struct ffmpeg_muxer *stream = data;
 
-	/* ---------------------------- */
-	/* reorder packets */
+	os_set_thread_name("replay buffer: save thread");
 
-	bool found_video = false;
-	bool found_audio[MAX_AUDIO_MIXES] = {0};
-	int64_t video_offset = 0;
-	int64_t video_dts_offset = 0;
-	int64_t audio_offsets[MAX_AUDIO_MIXES] = {0};
-	int64_t audio_dts_offsets[MAX_AUDIO_MIXES] = {0};
+	for (;;) {
+		struct replay_save *save = NULL;
 
-	for (size_t i = 0; i < num_packets; i++) {
-		struct encoder_packet *pkt;
-		pkt = circlebuf_data(&stream->packets, i * size);
+		os_sem_wait(stream->saves_sem);
 
-		if (pkt->type == OBS_ENCODER_VIDEO) {
-			if (!found_video) {
-				video_offset = pkt->dts_usec;
-				video_dts_offset = pkt->dts;
-				found_video = true;
-			}
-		} else {
-			if (!found_audio[pkt->track_idx]) {
-				found_audio[pkt->track_idx] = true;
-				audio_offsets[pkt->track_idx] = pkt->dts_usec;
-				audio_dts_offsets[pkt->track_idx] = pkt->dts;
-			}
+		pthread_mutex_lock(&stream->saves_mutex);
+		if (stream->saves.num) {
+			save = stream->saves.array[0];
+			da_erase(stream->saves, 0);
 		}
+		pthread_mutex_unlock(&stream->saves_mutex);
+
+		/* posted without a save: shutting down */
+		if (!save)
+			break;
 
-		insert_packet(&stream->mux_packets.da, pkt, video_offset,
-			      audio_offsets, video_dts_offset,
-			      audio_dts_offsets);
+		write_replay(stream, save);
+		replay_save_free(save);
+
+		pthread_mutex_lock(&stream->saves_mutex);
+		if (!stream->saves.num)
+			os_atomic_set_bool(&stream->muxing, false);
+		pthread_mutex_unlock(&stream->saves_mutex);
 	}
 
+	return NULL;
+}
+
+static void replay_buffer_save(struct ffmpeg_muxer *stream)
+{
+	struct replay_store *rs = &stream->store;
+	struct replay_save *save;
+	size_t num_segments = replay_store_num_segments(rs);
+	size_t first = 0;
+	uint64_t start = os_gettime_ns();
+
+	if (!stream->save_thread_active) {
+		warn("Could not save buffer, no save thread");
+		return;
+	}
+
+	/* the keyframe index gives the save point directly: the segment
+	 * covering the start of the last max_time of packets */
+	if (num_segments) {
+		struct replay_segment *last =
+			replay_store_segment(rs, num_segments - 1);
+		int64_t end = last->packets.array[last->packets.num - 1].dts_usec;
+		first = replay_store_seek(rs, end - rs->max_time);
+	}
+
+	/* only references are taken here, everything else happens on the
+	 * save thread so that packet intake isn't held up */
+	save = bzalloc(sizeof(*save));
+	save->request_ts = (uint64_t)stream->save_ts;
+	save->spill = replay_store_snapshot(rs, first, &save->packets.da,
+					    &save->spill_pin);
+
+	for (size_t i = 0; i < save->packets.num; i++)
+		save->size += (int64_t)save->packets.array[i].size;
+
 	/* ---------------------------- */
 	/* generate filename */
 
@@ -797,21 +1019,25 @@ static void replay_buffer_save(struct ffmpeg_muxer *stream)
 
 	char *filename = os_generate_formatted_filename(ext, space, fmt);
 
-	dstr_copy(&stream->path, dir);
-	dstr_replace(&stream->path, "\\", "/");
-	if (dstr_end(&stream->path) != '/')
-		dstr_cat_ch(&stream->path, '/');
-	dstr_cat(&stream->path, filename);
+	dstr_copy(&save->path, dir);
+	dstr_replace(&save->path, "\\", "/");
+	if (dstr_end(&save->path) != '/')
+		dstr_cat_ch(&save->path, '/');
+	dstr_cat(&save->path, filename);
 
 	bfree(filename);
 	obs_data_release(settings);
 
 	/* ---------------------------- */
 
+	save->snapshot_ns = os_gettime_ns() - start;
+
+	pthread_mutex_lock(&stream->saves_mutex);
+	da_push_back(stream->saves, &save);
 	os_atomic_set_bool(&stream->muxing, true);
-	stream->mux_thread_joinable = pthread_create(&stream->mux_thread, NULL,
-						     replay_buffer_mux_thread,
-						     stream) == 0;
+	pthread_mutex_unlock(&stream->saves_mutex);
+
+	os_sem_post(stream->saves_sem);
 }
 
 static void deactivate_replay_buffer(struct ffmpeg_muxer *stream, int code)
@@ -825,7 +1051,10 @@ static void deactivate_replay_buffer(struct ffmpeg_muxer *stream, int code)
 	os_atomic_set_bool(&stream->active, false);
 	os_atomic_set_bool(&stream->sent_headers, false);
 	os_atomic_set_bool(&stream->stopping, false);
+
+	pthread_mutex_lock(&stream->store_mutex);
 	replay_buffer_clear(stream);
+	pthread_mutex_unlock(&stream->store_mutex);
 }
 
 static void replay_buffer_data(void *data, struct encoder_packet *packet)
@@ -850,35 +1079,29 @@ static void replay_buffer_data(void *data, struct encoder_packet *packet)
 	}
 
 	obs_encoder_packet_ref(&pkt, packet);
-	replay_buffer_purge(stream, &pkt);
-
-	if (!stream->packets.size)
-		stream->cur_time = pkt.dts_usec;
-	stream->cur_size += pkt.size;
-
-	circlebuf_push_back(&stream->packets, packet, sizeof(*packet));
-
-	if (packet->type == OBS_ENCODER_VIDEO && packet->keyframe)
-		stream->keyframes++;
+	pthread_mutex_lock(&stream->store_mutex);
+	replay_store_push(&stream->store, &pkt);
+	pthread_mutex_unlock(&stream->store_mutex);
 
 	if (stream->save_ts && packet->sys_dts_usec >= stream->save_ts) {
-		if (os_atomic_load_bool(&stream->muxing))
-			return;
-
-		if (stream->mux_thread_joinable) {
-			pthread_join(stream->mux_thread, NULL);
-			stream->mux_thread_joinable = false;
-		}
-
-		stream->save_ts = 0;
 		replay_buffer_save(stream);
+		stream->save_ts = 0;
 	}
 }
 
+static uint64_t replay_buffer_retained_bytes(void *data)
+{
+	struct ffmpeg_muxer *stream = data;
+	return (uint64_t)replay_buffer_mem_size(stream);
+}
+
 static void replay_buffer_defaults(obs_data_t *s)
 {
 	obs_data_set_default_int(s, "max_time_sec", 15);
 	obs_data_set_default_int(s, "max_size_mb", 500);
+	/* 0 keeps the whole buffer in memory.  not exposed in the UI,
+	 * frontends set it on the output's settings */
+	obs_data_set_default_int(s, "max_memory_mb", 0);
 	obs_data_set_default_string(s, "format", "%CCYY-%MM-%DD %hh-%mm-%ss");
 	obs_data_set_default_string(s, "extension", "mp4");
 	obs_data_set_default_bool(s, "allow_spaces", true);
@@ -896,4 +1119,5 @@ struct obs_output_info replay_buffer = {
 	.encoded_packet = replay_buffer_data,
 	.get_total_bytes = ffmpeg_mux_total_bytes,
 	.get_defaults = replay_buffer_defaults,
+	.get_retained_bytes = replay_buffer_retained_bytes,
 };
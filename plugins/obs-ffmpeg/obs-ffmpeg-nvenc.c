@@ -186,6 +186,8 @@ static bool nvenc_update(void *data, obs_data_t *settings)
 	av_opt_set(enc->context->priv_data, "level", "auto", 0);
 	av_opt_set_int(enc->context->priv_data, "2pass", twopass, 0);
 	av_opt_set_int(enc->context->priv_data, "gpu", gpu, 0);
+	/* keyframe requests have to give decoders a starting point */
+	av_opt_set_int(enc->context->priv_data, "forced-idr", true, 0);
 
 	enc->context->bit_rate = bitrate * 1000;
 	enc->context->rc_buffer_size = bitrate * 1000;
@@ -338,6 +340,8 @@ static bool nvenc_encode(void *data, struct encoder_frame *frame,
 	copy_data(enc->vframe, frame, enc->height, enc->context->pix_fmt);
 
 	enc->vframe->pts = frame->pts;
+	enc->vframe->pict_type = frame->force_keyframe ? AV_PICTURE_TYPE_I
+						       : AV_PICTURE_TYPE_NONE;
 #if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 40, 101)
 	ret = avcodec_send_frame(enc->context, enc->vframe);
 	if (ret == 0)
@@ -0,0 +1,418 @@
+#include "replay-store.h"
+
+#include <util/platform.h>
+#include <util/dstr.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <unistd.h>
+#endif
+
+#define do_log(level, format, ...) \
+	blog(level, "[replay buffer] " format, ##__VA_ARGS__)
+
+#define warn(format, ...) do_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...) do_log(LOG_INFO, format, ##__VA_ARGS__)
+
+/* a segment is closed on the first keyframe after this much time */
+#define SEGMENT_MIN_USEC 1000000LL
+
+/* ------------------------------------------------------------------------- */
+/* spill file: packet data of the oldest segments, used as a ring */
+
+#ifdef _WIN32
+static bool spill_map(struct replay_spill *spill, const char *dir,
+		      uint64_t size)
+{
+	struct dstr path = {0};
+	wchar_t *wpath = NULL;
+	HANDLE file;
+	HANDLE mapping;
+	void *data;
+
+	dstr_copy(&path, dir);
+	dstr_replace(&path, "/", "\\");
+	if (dstr_end(&path) != '\\')
+		dstr_cat_ch(&path, '\\');
+	dstr_catf(&path, "obs-replay-spill-%llu.tmp",
+		  (unsigned long long)os_gettime_ns());
+
+	os_utf8_to_wcs_ptr(path.array, path.len, &wpath);
+	dstr_free(&path);
+
+	file = CreateFileW(wpath, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+			   CREATE_NEW,
+			   FILE_ATTRIBUTE_HIDDEN | FILE_FLAG_DELETE_ON_CLOSE,
+			   NULL);
+	bfree(wpath);
+
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	mapping = CreateFileMappingW(file, NULL, PAGE_READWRITE,
+				     (DWORD)(size >> 32), (DWORD)size, NULL);
+	if (!mapping) {
+		CloseHandle(file);
+		return false;
+	}
+
+	data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0,
+			     (SIZE_T)size);
+	if (!data) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	spill->file = file;
+	spill->mapping = mapping;
+	spill->data = data;
+	return true;
+}
+
+static void spill_unmap(struct replay_spill *spill)
+{
+	UnmapViewOfFile(spill->data);
+	CloseHandle(spill->mapping);
+	CloseHandle(spill->file);
+}
+
+#else
+static bool spill_map(struct replay_spill *spill, const char *dir,
+		      uint64_t size)
+{
+	struct dstr path = {0};
+	void *data;
+	int fd;
+
+	dstr_copy(&path, dir);
+	if (dstr_end(&path) != '/')
+		dstr_cat_ch(&path, '/');
+	dstr_cat(&path, ".obs-replay-spill-XXXXXX");
+
+	fd = mkstemp(path.array);
+	if (fd != -1)
+		unlink(path.array);
+	dstr_free(&path);
+
+	if (fd == -1)
+		return false;
+
+	if (ftruncate(fd, (off_t)size) != 0) {
+		close(fd);
+		return false;
+	}
+
+	data = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED)
+		return false;
+
+	spill->data = data;
+	return true;
+}
+
+static void spill_unmap(struct replay_spill *spill)
+{
+	munmap(spill->data, (size_t)spill->size);
+}
+#endif
+
+static struct replay_spill *spill_open(const char *dir, uint64_t size)
+{
+	struct replay_spill *spill;
+
+	if (size > SIZE_MAX) {
+		warn("Spill file of %llu bytes can't be mapped",
+		     (unsigned long long)size);
+		return NULL;
+	}
+
+	spill = bzalloc(sizeof(*spill));
+	spill->refs = 1;
+	spill->size = size;
+
+	if (!spill_map(spill, dir, size)) {
+		warn("Failed to create spill file in '%s', keeping the "
+		     "whole buffer in memory",
+		     dir);
+		bfree(spill);
+		return NULL;
+	}
+
+	pthread_mutex_init(&spill->mutex, NULL);
+	info("Spilling to '%s', up to %llu MB", dir,
+	     (unsigned long long)(size / (1024 * 1024)));
+	return spill;
+}
+
+static void spill_release(struct replay_spill *spill)
+{
+	if (!spill || os_atomic_dec_long(&spill->refs) != 0)
+		return;
+
+	spill_unmap(spill);
+	pthread_mutex_destroy(&spill->mutex);
+	da_free(spill->pins);
+	bfree(spill);
+}
+
+static uint8_t *spill_alloc(struct replay_spill *spill, uint64_t tail,
+			    size_t size)
+{
+	uint64_t head = spill->head;
+	uint64_t offset = head % spill->size;
+
+	/* packets stay contiguous, skip the end of the file if needed */
+	if (offset + size > spill->size) {
+		head += spill->size - offset;
+		offset = 0;
+	}
+
+	if (head + size - tail > spill->size)
+		return NULL;
+
+	spill->head = head + size;
+	return spill->data + offset;
+}
+
+static bool spill_segment(struct replay_store *rs, struct replay_segment *seg)
+{
+	struct replay_spill *spill = rs->spill;
+	DARRAY(uint8_t *) dsts;
+	uint64_t head = spill->head;
+	uint64_t tail = spill->tail;
+
+	/* saves still writing from the file hold on to their part of it */
+	pthread_mutex_lock(&spill->mutex);
+	for (size_t i = 0; i < spill->pins.num; i++) {
+		if (spill->pins.array[i] < tail)
+			tail = spill->pins.array[i];
+	}
+	pthread_mutex_unlock(&spill->mutex);
+
+	da_init(dsts);
+	da_reserve(dsts, seg->packets.num);
+
+	for (size_t i = 0; i < seg->packets.num; i++) {
+		struct encoder_packet *pkt = seg->packets.array + i;
+		uint8_t *dst = spill_alloc(spill, tail, pkt->size);
+
+		if (!dst) {
+			spill->head = head;
+			da_free(dsts);
+			return false;
+		}
+
+		memcpy(dst, pkt->data, pkt->size);
+		da_push_back(dsts, &dst);
+	}
+
+	for (size_t i = 0; i < seg->packets.num; i++) {
+		struct encoder_packet *pkt = seg->packets.array + i;
+		struct encoder_packet spilled = *pkt;
+
+		spilled.data = dsts.array[i];
+		obs_encoder_packet_release(pkt);
+		*pkt = spilled;
+	}
+
+	seg->spilled = true;
+	seg->spill_start = head;
+	seg->spill_end = spill->head;
+	rs->mem_size -= seg->size;
+
+	da_free(dsts);
+	return true;
+}
+
+static void spill_segments(struct replay_store *rs)
+{
+	size_t num = replay_store_num_segments(rs);
+
+	if (!rs->spill)
+		return;
+
+	/* never the segment that's still being filled */
+	while (rs->mem_size > rs->max_memory && rs->num_spilled + 1 < num) {
+		struct replay_segment *seg =
+			replay_store_segment(rs, rs->num_spilled);
+
+		if (!spill_segment(rs, seg))
+			break;
+
+		rs->num_spilled++;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+void replay_store_init(struct replay_store *rs, int64_t max_time,
+		       int64_t max_size, int64_t max_memory, bool has_video,
+		       const char *spill_dir)
+{
+	memset(rs, 0, sizeof(*rs));
+	rs->max_time = max_time;
+	rs->max_size = max_size;
+	rs->max_memory = max_memory;
+	rs->has_video = has_video;
+
+	/* the buffer can go over max_size by up to a segment, leave room
+	 * for that so spilling doesn't stall while old data drains */
+	if (spill_dir && *spill_dir && max_size && max_memory)
+		rs->spill = spill_open(spill_dir, max_size + max_size / 4);
+}
+
+static void evict_front(struct replay_store *rs)
+{
+	struct replay_segment seg;
+	circlebuf_pop_front(&rs->segments, &seg, sizeof(seg));
+
+	if (seg.spilled) {
+		rs->spill->tail = seg.spill_end;
+		rs->num_spilled--;
+	} else {
+		for (size_t i = 0; i < seg.packets.num; i++)
+			obs_encoder_packet_release(seg.packets.array + i);
+		rs->mem_size -= seg.size;
+	}
+
+	rs->size -= seg.size;
+	da_free(seg.packets);
+}
+
+void replay_store_free(struct replay_store *rs)
+{
+	while (rs->segments.size)
+		evict_front(rs);
+
+	circlebuf_free(&rs->segments);
+	spill_release(rs->spill);
+	rs->spill = NULL;
+	rs->size = 0;
+	rs->mem_size = 0;
+}
+
+static void trim(struct replay_store *rs, const struct encoder_packet *pkt)
+{
+	/* always keep at least two segments (keyframes) around */
+	while (replay_store_num_segments(rs) > 2) {
+		struct replay_segment *front = replay_store_segment(rs, 0);
+		bool over_size = rs->max_size &&
+				 rs->size + (int64_t)pkt->size > rs->max_size;
+		bool over_time = pkt->dts_usec - front->start_dts_usec >
+				 rs->max_time;
+
+		if (!over_size && !over_time)
+			break;
+
+		evict_front(rs);
+	}
+}
+
+static inline struct replay_segment *last_segment(struct replay_store *rs)
+{
+	size_t num = replay_store_num_segments(rs);
+	return num ? replay_store_segment(rs, num - 1) : NULL;
+}
+
+void replay_store_push(struct replay_store *rs, struct encoder_packet *packet)
+{
+	bool split_point = rs->has_video ? packet->type == OBS_ENCODER_VIDEO &&
+						   packet->keyframe
+					 : true;
+	struct replay_segment *cur;
+
+	trim(rs, packet);
+
+	cur = last_segment(rs);
+	if (!cur || (split_point && packet->dts_usec - cur->start_dts_usec >=
+					    SEGMENT_MIN_USEC)) {
+		struct replay_segment seg = {0};
+		seg.start_dts_usec = packet->dts_usec;
+		circlebuf_push_back(&rs->segments, &seg, sizeof(seg));
+
+		/* the previous segment is complete now */
+		if (cur)
+			spill_segments(rs);
+
+		cur = last_segment(rs);
+	}
+
+	da_push_back(cur->packets, packet);
+	cur->size += (int64_t)packet->size;
+	rs->size += (int64_t)packet->size;
+	rs->mem_size += (int64_t)packet->size;
+}
+
+size_t replay_store_seek(struct replay_store *rs, int64_t dts_usec)
+{
+	size_t lo = 0;
+	size_t hi = replay_store_num_segments(rs);
+
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (replay_store_segment(rs, mid)->start_dts_usec <= dts_usec)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+struct replay_spill *replay_store_snapshot(struct replay_store *rs,
+					   size_t first, struct darray *dst,
+					   uint64_t *pin)
+{
+	DARRAY(struct encoder_packet) packets;
+	struct replay_spill *spill = NULL;
+	size_t num = replay_store_num_segments(rs);
+
+	packets.da = *dst;
+
+	for (size_t i = first; i < num; i++) {
+		struct replay_segment *seg = replay_store_segment(rs, i);
+
+		if (seg->spilled && !spill) {
+			spill = rs->spill;
+			*pin = seg->spill_start;
+
+			os_atomic_inc_long(&spill->refs);
+			pthread_mutex_lock(&spill->mutex);
+			da_push_back(spill->pins, pin);
+			pthread_mutex_unlock(&spill->mutex);
+		}
+
+		if (seg->spilled) {
+			da_push_back_array(packets, seg->packets.array,
+					   seg->packets.num);
+			continue;
+		}
+
+		for (size_t j = 0; j < seg->packets.num; j++) {
+			struct encoder_packet *pkt = da_push_back_new(packets);
+			obs_encoder_packet_ref(pkt, seg->packets.array + j);
+		}
+	}
+
+	*dst = packets.da;
+	return spill;
+}
+
+void replay_spill_unpin(struct replay_spill *spill, uint64_t pin)
+{
+	if (!spill)
+		return;
+
+	pthread_mutex_lock(&spill->mutex);
+	da_erase_item(spill->pins, &pin);
+	pthread_mutex_unlock(&spill->mutex);
+
+	spill_release(spill);
+}
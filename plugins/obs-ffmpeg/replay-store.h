@@ -0,0 +1,104 @@
+#pragma once
+
+#include <obs-module.h>
+#include <util/circlebuf.h>
+#include <util/darray.h>
+#include <util/threading.h>
+
+/* a replay segment is a run of packets starting on a video keyframe, the
+ * replay buffer is trimmed and saved a whole segment at a time */
+struct replay_segment {
+	DARRAY(struct encoder_packet) packets;
+	int64_t start_dts_usec;
+	int64_t size;
+
+	/* packet data lives in the spill file rather than in refcounted
+	 * encoder packets, between spill_start and spill_end */
+	bool spilled;
+	uint64_t spill_start;
+	uint64_t spill_end;
+};
+
+/* shared with saves in progress, which pin the part of the file they still
+ * have to write so that it isn't reused */
+struct replay_spill {
+	volatile long refs;
+	uint8_t *data;
+	uint64_t size;
+	uint64_t head;
+	uint64_t tail;
+
+	pthread_mutex_t mutex;
+	DARRAY(uint64_t) pins;
+
+#ifdef _WIN32
+	void *file;
+	void *mapping;
+#endif
+};
+
+struct replay_store {
+	struct circlebuf segments; /* struct replay_segment */
+	size_t num_spilled;        /* spilled segments are always the oldest */
+
+	int64_t size;     /* all packet data */
+	int64_t mem_size; /* packet data not spilled to disk */
+
+	int64_t max_time;
+	int64_t max_size;
+	int64_t max_memory;
+	bool has_video;
+
+	struct replay_spill *spill;
+};
+
+/* spill_dir may be NULL, spilling also needs max_size and max_memory */
+extern void replay_store_init(struct replay_store *rs, int64_t max_time,
+			      int64_t max_size, int64_t max_memory,
+			      bool has_video, const char *spill_dir);
+extern void replay_store_free(struct replay_store *rs);
+
+/* takes ownership of the packet reference */
+extern void replay_store_push(struct replay_store *rs,
+			      struct encoder_packet *packet);
+
+/* index of the last segment starting at or before dts_usec */
+extern size_t replay_store_seek(struct replay_store *rs, int64_t dts_usec);
+
+/* appends the packets of segments first and up to dst (a DARRAY of
+ * struct encoder_packet), taking a reference to packets held in memory.
+ * spilled packets point into the spill file, which is then pinned and
+ * returned along with the pin; pass them to replay_spill_unpin() once
+ * the packets have been written */
+extern struct replay_spill *replay_store_snapshot(struct replay_store *rs,
+						  size_t first,
+						  struct darray *dst,
+						  uint64_t *pin);
+
+extern void replay_spill_unpin(struct replay_spill *spill, uint64_t pin);
+
+static inline bool replay_spill_owns(const struct replay_spill *spill,
+				     const uint8_t *data)
+{
+	return spill && data >= spill->data && data < spill->data + spill->size;
+}
+
+static inline size_t replay_store_num_segments(const struct replay_store *rs)
+{
+	return rs->segments.size / sizeof(struct replay_segment);
+}
+
+static inline struct replay_segment *
+replay_store_segment(struct replay_store *rs, size_t idx)
+{
+	return circlebuf_data(&rs->segments,
+			      idx * sizeof(struct replay_segment));
+}
+
+static inline size_t replay_store_num_packets(struct replay_store *rs)
+{
+	size_t num = 0;
+	for (size_t i = 0; i < replay_store_num_segments(rs); i++)
+		num += replay_store_segment(rs, i)->packets.num;
+	return num;
+}
@@ -2,12 +2,9 @@
 
 #include "AudioDeviceModuleWrapper.h"
 
-#include "obs.h"
-#include "media-io/audio-io.h"
-
-AudioDeviceModuleWrapper::AudioDeviceModuleWrapper() : _initialized(false)
+AudioDeviceModuleWrapper::AudioDeviceModuleWrapper()
+    : _initialized(false), audioTransport(nullptr)
 {
-    pendingLength = 0;
 }
 
 AudioDeviceModuleWrapper::~AudioDeviceModuleWrapper() {}
@@ -40,65 +37,27 @@ bool AudioDeviceModuleWrapper::Initialized() const
     return _initialized;
 }
 
-void AudioDeviceModuleWrapper::onIncomingData(uint8_t* data,
-                                              size_t samples_per_channel)
+void AudioDeviceModuleWrapper::onIncomingData(const float *const *planes,
+                                              size_t channels,
+                                              size_t samples_per_channel,
+                                              uint32_t sample_rate)
 {
-    _critSect.Enter();
+    rtc::CritScope lock(&_critSect);
     if (!audioTransport)
         return;
-    _critSect.Leave();
-
-    // Get audio
-    audio_t *audio = obs_get_audio();
-    // This info is set on the stream before starting capture
-    size_t channels = 2;
-    uint32_t sample_rate = 48000;
-    size_t sample_size = 2;
-    // Get chunk for 10ms
-    size_t chunk = (sample_rate / 100);
 
-    size_t i = 0;
-    uint32_t level;
-
-    // Check if we had pending chunks
-    if (pendingLength) {
-        // Copy missing chunks
-        i = chunk - pendingLength;
-        memcpy(pending + pendingLength * sample_size * channels,
-               data,
-               i * sample_size * channels);
-        // Add sent
-        audioTransport->RecordedDataIsAvailable(pending,
-                                                chunk,
-                                                sample_size * channels,
-                                                channels,
-                                                sample_rate,
+    // Samples are converted straight into the framer chunk, which is handed
+    // to libwebrtc as is once 10ms are buffered
+    framer.push(planes, channels, samples_per_channel, sample_rate,
+                [this](const int16_t *data, size_t frames,
+                       size_t chunk_channels, uint32_t rate) {
+        uint32_t level = 0;
+        audioTransport->RecordedDataIsAvailable(data,
+                                                frames,
+                                                sizeof(int16_t) * chunk_channels,
+                                                chunk_channels,
+                                                rate,
                                                 0, 0, 0, false,
                                                 level);
-        // No pending chunks
-        pendingLength = 0;
-    }
-
-    // Send all possible full chunks
-    while (i + chunk < samples_per_channel) {
-        // Send them
-        audioTransport->RecordedDataIsAvailable(data + i * sample_size * channels,
-                                                chunk,
-                                                sample_size * channels,
-                                                channels,
-                                                sample_rate,
-                                                0, 0, 0, false,
-                                                level);
-        i += chunk;
-    }
-
-    // If there are missing chunks
-    if (i != samples_per_channel) {
-        // Calculate pending chunks
-        pendingLength = samples_per_channel - i;
-        // Copy chunks to pending buffer
-        memcpy(pending,
-               data + i * sample_size * channels,
-               pendingLength * sample_size * channels);
-    }
+    });
 }
@@ -3,6 +3,8 @@
 #ifndef _AUDIO_DEVICE_MODULE_WRAPPER_H_
 #define _AUDIO_DEVICE_MODULE_WRAPPER_H_
 
+#include "AudioFramer.h"
+
 #include "api/scoped_refptr.h"
 #include "modules/audio_device/include/audio_device_default.h"
 #include "rtc_base/checks.h"
@@ -30,7 +32,9 @@ public:
     int32_t Terminate() override;
     bool Initialized() const override;
 
-    void onIncomingData(uint8_t* data, size_t samples_per_channel);
+    // Float planar audio from the OBS mixer, at its native rate and layout
+    void onIncomingData(const float *const *planes, size_t channels,
+                        size_t samples_per_channel, uint32_t sample_rate);
 
     virtual int64_t TimeUntilNextProcess() { return 1000; }
     virtual void Process() {}
@@ -45,6 +49,7 @@ public:
     // Full-duplex transportation of PCM audio
     int32_t RegisterAudioCallback(AudioTransport* audioCallback) override
     {
+        rtc::CritScope lock(&_critSect);
         this->audioTransport = audioCallback;
         return 0;
     }
@@ -84,8 +89,7 @@ public:
     bool                 _initialized;
     rtc::CriticalSection _critSect;
     AudioTransport*      audioTransport;
-    uint8_t              pending[640 * 2 * 2];
-    size_t               pendingLength;
+    AudioFramer          framer;
 };
 
 #endif
@@ -0,0 +1,174 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#include "AudioFramer.h"
+
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AUDIO_FRAMER_SSE2
+#include <emmintrin.h>
+#endif
+
+#define MAX_DOWNMIX_CHANNELS 8
+
+namespace {
+
+// Gains of each OBS channel in the left/right downmix, indexed by channel
+// count since it identifies the OBS speaker layout. LFE is dropped.
+const float kCenter = 0.70710678f;
+const float kSurround = 0.70710678f;
+
+void downmixCoefficients(size_t channels, float *left, float *right)
+{
+    for (size_t c = 0; c < MAX_DOWNMIX_CHANNELS; c++)
+        left[c] = right[c] = 0.0f;
+
+    left[0] = 1.0f;
+    right[1] = 1.0f;
+
+    switch (channels) {
+    case 4: // FL, FR, FC, RC
+        left[2] = right[2] = kCenter;
+        left[3] = right[3] = kSurround * kCenter;
+        break;
+    case 5: // FL, FR, FC, LFE, RC
+        left[2] = right[2] = kCenter;
+        left[4] = right[4] = kSurround * kCenter;
+        break;
+    case 6: // FL, FR, FC, LFE, RL, RR
+        left[2] = right[2] = kCenter;
+        left[4] = right[5] = kSurround;
+        break;
+    case 8: // FL, FR, FC, LFE, RL, RR, SL, SR
+        left[2] = right[2] = kCenter;
+        left[4] = right[5] = kSurround;
+        left[6] = right[7] = kSurround;
+        break;
+    default: // 2.1 drops LFE, stereo is as is
+        break;
+    }
+}
+
+inline int16_t toS16(float sample)
+{
+    sample *= 32767.0f;
+    if (sample > 32767.0f)
+        return 32767;
+    if (sample < -32768.0f)
+        return -32768;
+    return (int16_t)lrintf(sample);
+}
+
+#ifdef AUDIO_FRAMER_SSE2
+// Rounds to nearest and saturates, same as toS16
+inline __m128i packS16(__m128 a, __m128 b)
+{
+    const __m128 scale = _mm_set1_ps(32767.0f);
+    return _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(a, scale)),
+                           _mm_cvtps_epi32(_mm_mul_ps(b, scale)));
+}
+
+// Two stereo frames per 128 bit lane pair: l0 r0 l1 r1 l2 r2 l3 r3
+inline void storeStereo(int16_t *out, __m128 left, __m128 right)
+{
+    _mm_storeu_si128((__m128i *)out,
+                     packS16(_mm_unpacklo_ps(left, right),
+                             _mm_unpackhi_ps(left, right)));
+}
+#endif
+
+void convertMono(const float *in, size_t frames, int16_t *out)
+{
+    size_t i = 0;
+#ifdef AUDIO_FRAMER_SSE2
+    for (; i + 8 <= frames; i += 8)
+        _mm_storeu_si128((__m128i *)(out + i),
+                         packS16(_mm_loadu_ps(in + i),
+                                 _mm_loadu_ps(in + i + 4)));
+#endif
+    for (; i < frames; i++)
+        out[i] = toS16(in[i]);
+}
+
+void convertStereo(const float *in_l, const float *in_r, size_t frames,
+                   int16_t *out)
+{
+    size_t i = 0;
+#ifdef AUDIO_FRAMER_SSE2
+    for (; i + 4 <= frames; i += 4)
+        storeStereo(out + i * 2, _mm_loadu_ps(in_l + i),
+                    _mm_loadu_ps(in_r + i));
+#endif
+    for (; i < frames; i++) {
+        out[i * 2] = toS16(in_l[i]);
+        out[i * 2 + 1] = toS16(in_r[i]);
+    }
+}
+
+void convertDownmix(const float *const *in, size_t channels, size_t offset,
+                    size_t frames, int16_t *out)
+{
+    float left[MAX_DOWNMIX_CHANNELS];
+    float right[MAX_DOWNMIX_CHANNELS];
+    downmixCoefficients(channels, left, right);
+
+    if (channels > MAX_DOWNMIX_CHANNELS)
+        channels = MAX_DOWNMIX_CHANNELS;
+
+    size_t i = 0;
+#ifdef AUDIO_FRAMER_SSE2
+    for (; i + 4 <= frames; i += 4) {
+        __m128 l = _mm_setzero_ps();
+        __m128 r = _mm_setzero_ps();
+        for (size_t c = 0; c < channels; c++) {
+            __m128 v = _mm_loadu_ps(in[c] + offset + i);
+            l = _mm_add_ps(l, _mm_mul_ps(v, _mm_set1_ps(left[c])));
+            r = _mm_add_ps(r, _mm_mul_ps(v, _mm_set1_ps(right[c])));
+        }
+        storeStereo(out + i * 2, l, r);
+    }
+#endif
+    for (; i < frames; i++) {
+        float l = 0.0f;
+        float r = 0.0f;
+        for (size_t c = 0; c < channels; c++) {
+            l += in[c][offset + i] * left[c];
+            r += in[c][offset + i] * right[c];
+        }
+        out[i * 2] = toS16(l);
+        out[i * 2 + 1] = toS16(r);
+    }
+}
+
+}
+
+AudioFramer::AudioFramer()
+    : sample_rate(0),
+      input_channels(0),
+      output_channels(0),
+      chunk_frames(0),
+      filled(0)
+{
+}
+
+void AudioFramer::reset(uint32_t sample_rate, size_t input_channels)
+{
+    this->sample_rate = sample_rate;
+    this->input_channels = input_channels;
+    output_channels = outputChannels(input_channels);
+    chunk_frames = sample_rate / 100;
+    filled = 0;
+    chunk.resize(chunk_frames * output_channels);
+}
+
+void AudioFramer::convert(const float *const *planes, size_t input_channels,
+                          size_t offset, size_t frames, int16_t *out)
+{
+    if (input_channels == 1)
+        convertMono(planes[0] + offset, frames, out);
+    else if (input_channels == 2)
+        convertStereo(planes[0] + offset, planes[1] + offset, frames, out);
+    else
+        convertDownmix(planes, input_channels, offset, frames, out);
+}
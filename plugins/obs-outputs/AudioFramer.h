@@ -0,0 +1,75 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#ifndef _OBS_AUDIO_FRAMER_H_
+#define _OBS_AUDIO_FRAMER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// Repacks the float planar audio of the OBS mixer into the 10 ms interleaved
+// int16 chunks libwebrtc expects. Any OBS sample rate and speaker layout is
+// accepted: mono stays mono, everything else is downmixed to stereo (the most
+// libwebrtc capture supports). Samples are converted, downmixed and
+// interleaved in a single pass straight into the chunk handed to the sink.
+class AudioFramer {
+public:
+    AudioFramer();
+
+    // Output channel count for a given OBS channel count
+    static size_t outputChannels(size_t input_channels)
+    {
+        return input_channels == 1 ? 1 : 2;
+    }
+
+    // Convert, downmix and interleave |frames| samples of |input_channels|
+    // planes into |out|. Exposed for the conversion kernel only.
+    static void convert(const float *const *planes, size_t input_channels,
+                        size_t offset, size_t frames, int16_t *out);
+
+    // Sink is called as sink(const int16_t *data, size_t frames,
+    // size_t channels, uint32_t sample_rate) for each complete 10 ms chunk.
+    template <typename Sink>
+    void push(const float *const *planes, size_t input_channels,
+              size_t frames, uint32_t sample_rate, Sink &&sink)
+    {
+        if (!planes || !input_channels || !sample_rate)
+            return;
+
+        // Format changed (or first call): drop the partial chunk
+        if (sample_rate != this->sample_rate ||
+            input_channels != this->input_channels)
+            reset(sample_rate, input_channels);
+
+        size_t offset = 0;
+        while (offset < frames) {
+            size_t count = chunk_frames - filled;
+            if (count > frames - offset)
+                count = frames - offset;
+
+            convert(planes, input_channels, offset, count,
+                    chunk.data() + filled * output_channels);
+            filled += count;
+            offset += count;
+
+            if (filled == chunk_frames) {
+                sink(chunk.data(), chunk_frames, output_channels,
+                     sample_rate);
+                filled = 0;
+            }
+        }
+    }
+
+private:
+    void reset(uint32_t sample_rate, size_t input_channels);
+
+    uint32_t sample_rate;
+    size_t input_channels;
+    size_t output_channels;
+    size_t chunk_frames;
+    size_t filled;
+    std::vector<int16_t> chunk;
+};
+
+#endif
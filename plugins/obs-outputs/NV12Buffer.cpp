@@ -0,0 +1,163 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#include "NV12Buffer.h"
+
+#include "rtc_base/checks.h"
+#include <libyuv.h>
+
+#include <algorithm>
+
+#include <string.h>
+
+I420ConversionPool::I420ConversionPool() {}
+
+rtc::scoped_refptr<webrtc::I420Buffer>
+I420ConversionPool::CreateBuffer(int width, int height, int layer)
+{
+    RTC_DCHECK(layer >= 0 && layer <= SCALED_LAYER_POOL);
+    std::lock_guard<std::mutex> lock(mutex);
+    return pools[layer].CreateBuffer(width, height);
+}
+
+NV12Buffer::NV12Buffer(int width, int height,
+                       rtc::scoped_refptr<I420ConversionPool> conversion_pool)
+    : width_(width),
+      height_(height),
+      stride_y_(width),
+      stride_uv_((width + 1) / 2 * 2),
+      data_(new uint8_t[width * height + stride_uv_ * ((height + 1) / 2)]),
+      conversion_pool_(conversion_pool)
+{
+}
+
+NV12Buffer::~NV12Buffer() {}
+
+void NV12Buffer::CopyFrom(const uint8_t *src_y, int src_stride_y,
+                          const uint8_t *src_uv, int src_stride_uv)
+{
+    libyuv::CopyPlane(src_y, src_stride_y, data_.get(), stride_y_,
+                      width_, height_);
+    libyuv::CopyPlane(src_uv, src_stride_uv,
+                      data_.get() + stride_y_ * height_, stride_uv_,
+                      stride_uv_, (height_ + 1) / 2);
+    layers_.clear();
+    scaled_.clear();
+}
+
+rtc::scoped_refptr<webrtc::I420BufferInterface> NV12Buffer::ToI420()
+{
+    if (!layers_.empty())
+        return layers_.front();
+    return ConvertToI420();
+}
+
+rtc::scoped_refptr<webrtc::I420Buffer> NV12Buffer::ConvertToI420()
+{
+    rtc::scoped_refptr<webrtc::I420Buffer> i420 =
+            conversion_pool_->CreateBuffer(width_, height_);
+    if (!i420)
+        i420 = webrtc::I420Buffer::Create(width_, height_);
+
+    libyuv::NV12ToI420(DataY(), StrideY(), DataUV(), StrideUV(),
+                       i420->MutableDataY(), i420->StrideY(),
+                       i420->MutableDataU(), i420->StrideU(),
+                       i420->MutableDataV(), i420->StrideV(),
+                       width_, height_);
+    return i420;
+}
+
+void NV12Buffer::ScaleLayers(int layers)
+{
+    layers = std::max(1, std::min(layers, MAX_SIMULCAST_LAYERS));
+    layers_.clear();
+    scaled_.clear();
+    layers_.reserve(layers);
+
+    layers_.push_back(ConvertToI420());
+
+    // Each layer is box filtered from the previous one, sizes are truncated
+    // to a multiple of 2^(layers - 1) as in the libwebrtc simulcast config
+    const int shift = layers - 1;
+    for (int i = 1; i < layers; i++) {
+        int width = ((width_ >> i) >> shift) << shift;
+        int height = ((height_ >> i) >> shift) << shift;
+        if (width < 2 || height < 2)
+            break;
+
+        rtc::scoped_refptr<webrtc::I420Buffer> layer =
+                conversion_pool_->CreateBuffer(width, height, i);
+        if (!layer)
+            layer = webrtc::I420Buffer::Create(width, height);
+        layer->ScaleFrom(*layers_.back());
+        layers_.push_back(layer);
+    }
+}
+
+rtc::scoped_refptr<webrtc::I420BufferInterface>
+NV12Buffer::GetLayer(int width, int height)
+{
+    if (layers_.empty() && width == width_ && height == height_)
+        return ToI420();
+
+    for (const auto &scaled : scaled_) {
+        if (scaled->width() == width && scaled->height() == height)
+            return scaled;
+    }
+
+    // Smallest layer still large enough for the requested size
+    rtc::scoped_refptr<webrtc::I420BufferInterface> source;
+    for (const auto &layer : layers_) {
+        if (layer->width() < width || layer->height() < height)
+            break;
+        source = layer;
+    }
+    if (!source)
+        source = ToI420();
+    if (source->width() == width && source->height() == height)
+        return source;
+
+    rtc::scoped_refptr<webrtc::I420Buffer> scaled =
+            conversion_pool_->CreateBuffer(width, height, SCALED_LAYER_POOL);
+    if (!scaled)
+        scaled = webrtc::I420Buffer::Create(width, height);
+    scaled->ScaleFrom(*source);
+    scaled_.push_back(scaled);
+    return scaled;
+}
+
+NV12BufferPool::NV12BufferPool(size_t max_buffers)
+    : max_buffers(max_buffers),
+      conversion_pool(new rtc::RefCountedObject<I420ConversionPool>())
+{
+}
+
+NV12BufferPool::~NV12BufferPool() {}
+
+void NV12BufferPool::Release()
+{
+    buffers.clear();
+}
+
+rtc::scoped_refptr<NV12Buffer> NV12BufferPool::CreateBuffer(int width,
+                                                            int height)
+{
+    // Resolution changed: drop our references, in-flight frames stay valid
+    if (!buffers.empty() &&
+        (buffers.front()->width() != width ||
+         buffers.front()->height() != height))
+        Release();
+
+    for (const rtc::scoped_refptr<PooledBuffer> &buffer : buffers) {
+        // Only the pool holds a reference: webrtc is done with it
+        if (buffer->HasOneRef())
+            return buffer;
+    }
+
+    if (buffers.size() >= max_buffers)
+        return nullptr;
+
+    rtc::scoped_refptr<PooledBuffer> buffer =
+            new PooledBuffer(width, height, conversion_pool);
+    buffers.push_back(buffer);
+    return buffer;
+}
@@ -0,0 +1,107 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#ifndef _OBS_NV12_BUFFER_H_
+#define _OBS_NV12_BUFFER_H_
+
+#include "api/scoped_refptr.h"
+#include "api/video/i420_buffer.h"
+#include "api/video/video_frame_buffer.h"
+#include "common_video/include/i420_buffer_pool.h"
+#include "rtc_base/ref_counted_object.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Full resolution plus two downscaled simulcast layers
+#define MAX_SIMULCAST_LAYERS 3
+// Conversion pool for encoder sizes that match none of the layers
+#define SCALED_LAYER_POOL MAX_SIMULCAST_LAYERS
+
+// Pools of I420 buffers shared by all NV12 buffers of a pool, used when an
+// encoder needs planar I420 input, one pool per simulcast layer (and one for
+// SCALED_LAYER_POOL). Ref-counted
+// because frames may still be queued in the encoder after the stream (and
+// the NV12 pool) is gone.
+class I420ConversionPool : public rtc::RefCountInterface {
+public:
+    I420ConversionPool();
+
+    rtc::scoped_refptr<webrtc::I420Buffer> CreateBuffer(int width, int height,
+                                                        int layer = 0);
+
+private:
+    std::mutex mutex;
+    webrtc::I420BufferPool pools[MAX_SIMULCAST_LAYERS + 1];
+};
+
+// NV12 frame copied from the OBS video output. It is handed to libwebrtc as a
+// native buffer, so the I420 conversion only runs if the encoder asks for it
+// (and never for frames dropped before encoding).
+class NV12Buffer : public webrtc::VideoFrameBuffer {
+public:
+    Type type() const override { return Type::kNative; }
+    int width() const override { return width_; }
+    int height() const override { return height_; }
+    rtc::scoped_refptr<webrtc::I420BufferInterface> ToI420() override;
+
+    const uint8_t *DataY() const { return data_.get(); }
+    const uint8_t *DataUV() const { return data_.get() + stride_y_ * height_; }
+    int StrideY() const { return stride_y_; }
+    int StrideUV() const { return stride_uv_; }
+
+    void CopyFrom(const uint8_t *src_y, int src_stride_y,
+                  const uint8_t *src_uv, int src_stride_uv);
+
+    // Convert to I420 and downscale by two |layers| - 1 times, once for all
+    // the simulcast encoders. Sizes are rounded like libwebrtc does for
+    // simulcast streams so that encoders get an exact match.
+    void ScaleLayers(int layers);
+    // I420 picture of the given size, taken from the matching layer or
+    // scaled from the closest larger one. Scaled pictures are kept until the
+    // next frame so each size is only scaled once per frame.
+    rtc::scoped_refptr<webrtc::I420BufferInterface> GetLayer(int width,
+                                                             int height);
+
+protected:
+    NV12Buffer(int width, int height,
+               rtc::scoped_refptr<I420ConversionPool> conversion_pool);
+    ~NV12Buffer() override;
+
+private:
+    friend class rtc::RefCountedObject<NV12Buffer>;
+
+    rtc::scoped_refptr<webrtc::I420Buffer> ConvertToI420();
+
+    const int width_;
+    const int height_;
+    const int stride_y_;
+    const int stride_uv_;
+    std::unique_ptr<uint8_t[]> data_;
+    rtc::scoped_refptr<I420ConversionPool> conversion_pool_;
+    // Largest first, empty unless ScaleLayers() was called for this frame
+    std::vector<rtc::scoped_refptr<webrtc::I420Buffer>> layers_;
+    // Pictures scaled by GetLayer() to sizes matching no layer
+    std::vector<rtc::scoped_refptr<webrtc::I420Buffer>> scaled_;
+};
+
+// Fixed size pool of NV12 buffers sized to the output resolution. A buffer is
+// reused as soon as libwebrtc has released its last reference to it.
+class NV12BufferPool {
+public:
+    explicit NV12BufferPool(size_t max_buffers = 8);
+    ~NV12BufferPool();
+
+    // Returns nullptr when every buffer of the pool is still in use
+    rtc::scoped_refptr<NV12Buffer> CreateBuffer(int width, int height);
+    void Release();
+
+private:
+    typedef rtc::RefCountedObject<NV12Buffer> PooledBuffer;
+
+    const size_t max_buffers;
+    std::vector<rtc::scoped_refptr<PooledBuffer>> buffers;
+    rtc::scoped_refptr<I420ConversionPool> conversion_pool;
+};
+
+#endif
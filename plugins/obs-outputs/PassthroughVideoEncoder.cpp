@@ -0,0 +1,338 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#include "PassthroughVideoEncoder.h"
+
+#include "obs-avc.h"
+
+#include "api/video/i420_buffer.h"
+#include "media/base/media_constants.h"
+#include "modules/include/module_common_types.h"
+#include "modules/video_coding/include/video_codec_interface.h"
+#include "modules/video_coding/include/video_error_codes.h"
+
+#include <cstdio>
+#include <utility>
+
+#define info(format, ...)  blog(LOG_INFO,    format, ##__VA_ARGS__)
+#define warn(format, ...)  blog(LOG_WARNING, format, ##__VA_ARGS__)
+
+EncodedFrameBuffer::EncodedFrameBuffer(obs_encoder_t *encoder, int width,
+                                       int height, bool keyframe,
+                                       const uint8_t *header,
+                                       size_t header_size,
+                                       const uint8_t *data, size_t size)
+    : encoder_(obs_encoder_get_weak_encoder(encoder)),
+      width_(width), height_(height), keyframe_(keyframe)
+{
+    data_.reserve(header_size + size);
+    if (header && header_size)
+        data_.insert(data_.end(), header, header + header_size);
+    data_.insert(data_.end(), data, data + size);
+}
+
+EncodedFrameBuffer::~EncodedFrameBuffer()
+{
+    obs_weak_encoder_release(encoder_);
+}
+
+void EncodedFrameBuffer::RequestKeyframe() const
+{
+    obs_encoder_t *encoder = obs_weak_encoder_get_encoder(encoder_);
+    if (!encoder)
+        return;
+    obs_encoder_request_keyframe(encoder);
+    obs_encoder_release(encoder);
+}
+
+rtc::scoped_refptr<webrtc::I420BufferInterface> EncodedFrameBuffer::ToI420()
+{
+    rtc::scoped_refptr<webrtc::I420Buffer> buffer =
+            webrtc::I420Buffer::Create(width_, height_);
+    webrtc::I420Buffer::SetBlack(buffer);
+    return buffer;
+}
+
+PassthroughVideoEncoder::PassthroughVideoEncoder(
+        const absl::optional<webrtc::H264::ProfileLevelId> &negotiated)
+    : callback(nullptr), negotiated_(negotiated), waiting_for_keyframe(true),
+      keyframe_requested(false), has_last_frame_id(false), last_frame_id(0),
+      incompatible_logged(false), level_logged(false)
+{
+}
+
+PassthroughVideoEncoder::~PassthroughVideoEncoder() {}
+
+int32_t PassthroughVideoEncoder::InitEncode(
+        const webrtc::VideoCodec *codec_settings, int32_t /* number_of_cores */,
+        size_t /* max_payload_size */)
+{
+    if (!codec_settings ||
+        codec_settings->codecType != webrtc::kVideoCodecH264)
+        return WEBRTC_VIDEO_CODEC_ERR_PARAMETER;
+
+    rtc::CritScope lock(&crit_);
+    waiting_for_keyframe = true;
+    has_last_frame_id = false;
+    return WEBRTC_VIDEO_CODEC_OK;
+}
+
+int32_t PassthroughVideoEncoder::RegisterEncodeCompleteCallback(
+        webrtc::EncodedImageCallback *callback)
+{
+    rtc::CritScope lock(&crit_);
+    this->callback = callback;
+    return WEBRTC_VIDEO_CODEC_OK;
+}
+
+int32_t PassthroughVideoEncoder::Release()
+{
+    rtc::CritScope lock(&crit_);
+    callback = nullptr;
+    return WEBRTC_VIDEO_CODEC_OK;
+}
+
+// Later frames reference the dropped one, nothing can be forwarded until
+// the next keyframe, which is asked for right away
+void PassthroughVideoEncoder::DropFrame(const EncodedFrameBuffer *packet)
+{
+    waiting_for_keyframe = true;
+    if (packet && !keyframe_requested) {
+        packet->RequestKeyframe();
+        keyframe_requested = true;
+    }
+}
+
+static bool ProfileDecodable(webrtc::H264::Profile stream,
+                             webrtc::H264::Profile negotiated)
+{
+    using namespace webrtc::H264;
+
+    if (stream == negotiated)
+        return true;
+
+    switch (stream) {
+    case kProfileConstrainedBaseline:
+        return true;
+    case kProfileMain:
+    case kProfileConstrainedHigh:
+        return negotiated == kProfileHigh;
+    default:
+        return false;
+    }
+}
+
+// Checks the SPS of a keyframe against the profile the remote end accepted
+bool PassthroughVideoEncoder::IsCompatible(const uint8_t *sps, size_t size)
+{
+    if (!negotiated_ || size < 4)
+        return true;
+
+    char str[7];
+    snprintf(str, sizeof(str), "%02x%02x%02x", sps[1], sps[2], sps[3]);
+    absl::optional<webrtc::H264::ProfileLevelId> stream =
+            webrtc::H264::ParseProfileLevelId(str);
+
+    if (!stream || !ProfileDecodable(stream->profile, negotiated_->profile)) {
+        if (!incompatible_logged) {
+            warn("PassthroughVideoEncoder: encoder profile-level-id %s "
+                 "can't be decoded by the remote end, dropping video",
+                 str);
+            incompatible_logged = true;
+        }
+        return false;
+    }
+
+    // Decoders generally cope with a higher level, so this is only logged
+    if (stream->level > negotiated_->level && !level_logged) {
+        warn("PassthroughVideoEncoder: encoder level is above the "
+             "negotiated level (profile-level-id %s)", str);
+        level_logged = true;
+    }
+
+    return true;
+}
+
+int32_t PassthroughVideoEncoder::Encode(
+        const webrtc::VideoFrame &frame,
+        const std::vector<webrtc::VideoFrameType> *frame_types)
+{
+    rtc::CritScope lock(&crit_);
+    if (!callback)
+        return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
+
+    rtc::scoped_refptr<webrtc::VideoFrameBuffer> buffer =
+            frame.video_frame_buffer();
+    if (buffer->type() != webrtc::VideoFrameBuffer::Type::kNative) {
+        DropFrame(nullptr);
+        return WEBRTC_VIDEO_CODEC_ERROR;
+    }
+
+    EncodedFrameBuffer *packet =
+            static_cast<EncodedFrameBuffer *>(buffer.get());
+
+    if (packet->keyframe())
+        keyframe_requested = false;
+
+    // Frames are numbered by the stream, a gap means frames were dropped
+    // before they got here
+    if (has_last_frame_id && (uint16_t)(frame.id() - last_frame_id) != 1 &&
+        !packet->keyframe())
+        DropFrame(packet);
+    has_last_frame_id = true;
+    last_frame_id = frame.id();
+
+    // Key frame requests from the remote end (PLI/FIR) go to the OBS encoder
+    if (frame_types && !packet->keyframe() && !keyframe_requested) {
+        for (webrtc::VideoFrameType type : *frame_types) {
+            if (type == webrtc::VideoFrameType::kVideoFrameKey) {
+                info("PassthroughVideoEncoder: keyframe requested");
+                packet->RequestKeyframe();
+                keyframe_requested = true;
+                break;
+            }
+        }
+    }
+
+    // Decoders cannot start on a delta frame
+    if (waiting_for_keyframe && !packet->keyframe()) {
+        DropFrame(packet);
+        return WEBRTC_VIDEO_CODEC_OK;
+    }
+
+    // Split the Annex-B access unit into NAL units for the packetizer
+    const uint8_t *data = packet->data();
+    const uint8_t *end = data + packet->size();
+    std::vector<std::pair<size_t, size_t>> nals;
+
+    const uint8_t *nal_start = obs_avc_find_startcode(data, end);
+    while (true) {
+        while (nal_start < end && !*(nal_start++))
+            ;
+
+        if (nal_start == end)
+            break;
+
+        const uint8_t *nal_end = obs_avc_find_startcode(nal_start, end);
+        nals.emplace_back(nal_start - data, nal_end - nal_start);
+        nal_start = nal_end;
+    }
+
+    if (nals.empty()) {
+        DropFrame(packet);
+        return WEBRTC_VIDEO_CODEC_OK;
+    }
+
+    if (packet->keyframe()) {
+        for (const auto &nal : nals) {
+            if ((data[nal.first] & 0x1f) != OBS_NAL_SPS)
+                continue;
+            if (!IsCompatible(data + nal.first, nal.second)) {
+                waiting_for_keyframe = true;
+                return WEBRTC_VIDEO_CODEC_OK;
+            }
+            break;
+        }
+    }
+    waiting_for_keyframe = false;
+
+    webrtc::RTPFragmentationHeader fragmentation;
+    fragmentation.VerifyAndAllocateFragmentationHeader(nals.size());
+    for (size_t i = 0; i < nals.size(); i++) {
+        fragmentation.fragmentationOffset[i] = nals[i].first;
+        fragmentation.fragmentationLength[i] = nals[i].second;
+    }
+
+    webrtc::EncodedImage image(const_cast<uint8_t *>(data), packet->size(),
+                               packet->size());
+    image._encodedWidth = packet->width();
+    image._encodedHeight = packet->height();
+    image._frameType = packet->keyframe()
+            ? webrtc::VideoFrameType::kVideoFrameKey
+            : webrtc::VideoFrameType::kVideoFrameDelta;
+    image.SetTimestamp(frame.timestamp());
+    image.ntp_time_ms_ = frame.ntp_time_ms();
+    image.capture_time_ms_ = frame.render_time_ms();
+    image.rotation_ = frame.rotation();
+    image.content_type_ = webrtc::VideoContentType::UNSPECIFIED;
+    image.timing_.flags = webrtc::VideoSendTiming::kInvalid;
+
+    webrtc::CodecSpecificInfo codec_info;
+    codec_info.codecType = webrtc::kVideoCodecH264;
+    codec_info.codecSpecific.H264.packetization_mode =
+            webrtc::H264PacketizationMode::NonInterleaved;
+
+    webrtc::EncodedImageCallback::Result result =
+            callback->OnEncodedImage(image, &codec_info, &fragmentation);
+    if (result.error != webrtc::EncodedImageCallback::Result::OK) {
+        DropFrame(packet);
+        return WEBRTC_VIDEO_CODEC_ERROR;
+    }
+
+    return WEBRTC_VIDEO_CODEC_OK;
+}
+
+void PassthroughVideoEncoder::SetRates(
+        const RateControlParameters & /* parameters */)
+{
+    // Bitrate is driven by the OBS encoder settings
+}
+
+webrtc::VideoEncoder::EncoderInfo PassthroughVideoEncoder::GetEncoderInfo() const
+{
+    EncoderInfo encoder_info;
+    encoder_info.implementation_name = "OBS passthrough";
+    encoder_info.supports_native_handle = true;
+    encoder_info.has_trusted_rate_controller = true;
+    encoder_info.is_hardware_accelerated = true;
+    encoder_info.has_internal_source = false;
+    encoder_info.scaling_settings = VideoEncoder::ScalingSettings::kOff;
+    return encoder_info;
+}
+
+std::vector<webrtc::SdpVideoFormat>
+PassthroughVideoEncoderFactory::GetSupportedFormats() const
+{
+    using namespace webrtc::H264;
+
+    // The profile is whatever the OBS encoder is set to, offer the ones it
+    // can produce and let the remote end pick. High first, as a High decoder
+    // also takes Main and Constrained Baseline streams; the SPS is checked
+    // against the negotiated profile by the encoder.
+    static const Profile profiles[] = { kProfileHigh, kProfileMain,
+                                        kProfileConstrainedBaseline };
+
+    std::vector<webrtc::SdpVideoFormat> formats;
+    for (Profile profile : profiles) {
+        absl::optional<std::string> id =
+                ProfileLevelIdToString(ProfileLevelId(profile, kLevel3_1));
+        formats.emplace_back(cricket::kH264CodecName,
+                webrtc::SdpVideoFormat::Parameters {
+                        { cricket::kH264FmtpProfileLevelId, *id },
+                        { cricket::kH264FmtpLevelAsymmetryAllowed, "1" },
+                        { cricket::kH264FmtpPacketizationMode, "1" } });
+    }
+    return formats;
+}
+
+webrtc::VideoEncoderFactory::CodecInfo
+PassthroughVideoEncoderFactory::QueryVideoEncoder(
+        const webrtc::SdpVideoFormat & /* format */) const
+{
+    CodecInfo codec_info;
+    codec_info.is_hardware_accelerated = true;
+    codec_info.has_internal_source = false;
+    return codec_info;
+}
+
+std::unique_ptr<webrtc::VideoEncoder>
+PassthroughVideoEncoderFactory::CreateVideoEncoder(
+        const webrtc::SdpVideoFormat &format)
+{
+    if (format.name != cricket::kH264CodecName) {
+        warn("PassthroughVideoEncoderFactory: unsupported codec %s",
+             format.name.c_str());
+        return nullptr;
+    }
+    return std::unique_ptr<webrtc::VideoEncoder>(new PassthroughVideoEncoder(
+            webrtc::H264::ParseSdpProfileLevelId(format.parameters)));
+}
@@ -0,0 +1,91 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#ifndef _OBS_PASSTHROUGH_VIDEO_ENCODER_H_
+#define _OBS_PASSTHROUGH_VIDEO_ENCODER_H_
+
+#include "api/scoped_refptr.h"
+#include "api/video/video_frame_buffer.h"
+#include "api/video_codecs/sdp_video_format.h"
+#include "api/video_codecs/video_encoder.h"
+#include "api/video_codecs/video_encoder_factory.h"
+#include "media/base/h264_profile_level_id.h"
+#include "rtc_base/critical_section.h"
+
+#include "obs.h"
+
+#include <memory>
+#include <vector>
+
+// H264 access unit (Annex-B) already encoded by an OBS encoder, carried
+// through the libwebrtc video pipeline in place of a raw frame.
+class EncodedFrameBuffer : public webrtc::VideoFrameBuffer {
+public:
+    EncodedFrameBuffer(obs_encoder_t *encoder, int width, int height,
+                       bool keyframe, const uint8_t *header,
+                       size_t header_size, const uint8_t *data, size_t size);
+    ~EncodedFrameBuffer() override;
+
+    Type type() const override { return Type::kNative; }
+    int width() const override { return width_; }
+    int height() const override { return height_; }
+    // Only used if a sink needs pixels (e.g. black frames): returns black
+    rtc::scoped_refptr<webrtc::I420BufferInterface> ToI420() override;
+
+    bool keyframe() const { return keyframe_; }
+    const uint8_t *data() const { return data_.data(); }
+    size_t size() const { return data_.size(); }
+
+    // Asks the OBS encoder that produced this frame for a keyframe
+    void RequestKeyframe() const;
+
+private:
+    obs_weak_encoder_t *encoder_;
+    const int width_;
+    const int height_;
+    const bool keyframe_;
+    std::vector<uint8_t> data_;
+};
+
+// Fake encoder forwarding EncodedFrameBuffer payloads to the RTP packetizer
+class PassthroughVideoEncoder : public webrtc::VideoEncoder {
+public:
+    explicit PassthroughVideoEncoder(
+            const absl::optional<webrtc::H264::ProfileLevelId> &negotiated);
+    ~PassthroughVideoEncoder() override;
+
+    int32_t InitEncode(const webrtc::VideoCodec *codec_settings,
+                       int32_t number_of_cores,
+                       size_t max_payload_size) override;
+    int32_t RegisterEncodeCompleteCallback(
+            webrtc::EncodedImageCallback *callback) override;
+    int32_t Release() override;
+    int32_t Encode(const webrtc::VideoFrame &frame,
+                   const std::vector<webrtc::VideoFrameType> *frame_types) override;
+    void SetRates(const RateControlParameters &parameters) override;
+    EncoderInfo GetEncoderInfo() const override;
+
+private:
+    bool IsCompatible(const uint8_t *sps, size_t size);
+    void DropFrame(const EncodedFrameBuffer *packet);
+
+    rtc::CriticalSection crit_;
+    webrtc::EncodedImageCallback *callback;
+    absl::optional<webrtc::H264::ProfileLevelId> negotiated_;
+    bool waiting_for_keyframe;
+    bool keyframe_requested;
+    bool has_last_frame_id;
+    uint16_t last_frame_id;
+    bool incompatible_logged;
+    bool level_logged;
+};
+
+class PassthroughVideoEncoderFactory : public webrtc::VideoEncoderFactory {
+public:
+    std::vector<webrtc::SdpVideoFormat> GetSupportedFormats() const override;
+    CodecInfo QueryVideoEncoder(
+            const webrtc::SdpVideoFormat &format) const override;
+    std::unique_ptr<webrtc::VideoEncoder> CreateVideoEncoder(
+            const webrtc::SdpVideoFormat &format) override;
+};
+
+#endif
@@ -3,196 +3,438 @@
 #pragma once
 
 // clang-format off
-#include <regex>
-#include <sstream>
+#include <algorithm>
+#include <map>
 #include <string>
 #include <string.h>
+#include <utility>
 #include <vector>
 
 class SDPModif {
 public:
-    // Enable stereo. Set audio bitrate (if nonzero)
-    static void stereoSDP(std::string &sdp, int audioBitrate)
-    {
-        std::vector<std::string> sdpLines;
-        split(sdp, (char *)"\r\n", sdpLines);
-        int aLine = findLines(sdpLines, "m=audio ");
-        int vLine = findLines(sdpLines, "m=video ");
-        int audio_start = aLine > 0 ? aLine : 0;
-        int audio_end = vLine > audio_start ? vLine : sdpLines.size();
-        int testLine = findLines(sdpLines, "stereo=1;sprop-stereo=1");
-        // audio section contains at least 1 stereo codec
-        if (testLine >= audio_start && testLine <= audio_end)
-            return;
-        std::string opusRe = "a=rtpmap:([0-9]{1,3}) [oO][pP][uU][sS]";
-        int rtpmap = findLinesRegEx(sdpLines, opusRe);
-        if (rtpmap == -1)
-            return;
-        std::string aBitrate = std::to_string(audioBitrate);
-        std::string maxAvgBitrate = std::to_string(audioBitrate * 1024);
-        std::smatch match;
-        std::regex re(opusRe);
-        if (!std::regex_search(sdpLines[rtpmap], match, re))
-            return;
-        std::string payloadNumber = match[1].str();
-        int fmtp = findLines(sdpLines, "a=fmtp:" + payloadNumber);
-        if (fmtp != -1) {
-            sdpLines[fmtp] =
-                sdpLines[fmtp].append(";stereo=1;sprop-stereo=1")
-                              .append(";maxplaybackrate=48000")
-                              .append(";sprop-maxcapturerate=48000");
-            if (audioBitrate > 0) {
-                sdpLines[fmtp] =
-                    sdpLines[fmtp].append(";maxaveragebitrate=" + maxAvgBitrate)
-                                  .append(";x-google-min-bitrate=" + aBitrate)
-                                  .append(";x-google-max-bitrate=" + aBitrate);
+    // Session description parsed once into media sections, with the
+    // rtpmap/fmtp/apt attributes indexed by payload type. Edits are applied
+    // on the model and the SDP is serialized back with toString().
+    class Description {
+    public:
+        explicit Description(const std::string &sdp)
+        {
+            std::vector<std::string> sdpLines;
+            split(sdp, sdpLines);
+            for (const auto &text : sdpLines) {
+                if (text.compare(0, 2, "m=") == 0) {
+                    media.emplace_back();
+                    media.back().parseMLine(text);
+                } else if (media.empty()) {
+                    session.push_back(text);
+                } else {
+                    media.back().addLine(text);
+                }
             }
         }
-        else {
-            std::string fmtpLine = "a=fmtp:" + payloadNumber;
-            sdpLines.insert(sdpLines.begin() + rtpmap + 1, fmtpLine);
-            sdpLines[rtpmap+1] =
-                sdpLines[rtpmap+1].append(" minptime=10;useinbandfec=1")
-                                  .append(";stereo=1;sprop-stereo=1")
-                                  .append(";maxplaybackrate=48000")
-                                  .append(";sprop-maxcapturerate=48000");
-            if (audioBitrate > 0) {
-                sdpLines[rtpmap+1] =
-                    sdpLines[rtpmap+1].append(";maxaveragebitrate=" + maxAvgBitrate)
-                                      .append(";x-google-min-bitrate=" + aBitrate)
-                                      .append(";x-google-max-bitrate=" + aBitrate);
-            }
+
+        std::string toString() const
+        {
+            std::string sdp;
+            for (const auto &text : session)
+                sdp.append(text).append("\r\n");
+            for (const auto &m : media)
+                m.serialize(sdp);
+            return sdp;
         }
-        sdp = join(sdpLines, "\r\n");
-    }
 
-    // Set video bitrate constraint (b=AS)
-    static void bitrateSDP(std::string &sdp, int newBitrate)
-    {
-        std::vector<std::string> sdpLines;
-        split(sdp, (char *)"\r\n", sdpLines);
-        int aLine = findLines(sdpLines, "m=audio ");
-        int vLine = findLines(sdpLines, "m=video ");
-        int video_start = vLine > 0 ? vLine : 0;
-        int video_end = aLine > video_start ? aLine : sdpLines.size();
-        int testLine = findLines(sdpLines, "b=AS:");
-        if (testLine >= video_start && testLine <= video_end)
-            return;
-        std::ostringstream newLine;
-        newLine << "b=AS:" << newBitrate;
-        if (strncmp(sdpLines[vLine+1].c_str(), "c=", 2) == 0)
-            sdpLines.insert(sdpLines.begin() + vLine+2, newLine.str());
-        else
-            sdpLines.insert(sdpLines.begin() + vLine+1, newLine.str());
-        sdp = join(sdpLines, "\r\n");
-    }
+        // Remove all payloads except |audio_codec| & |video_codec| (and
+        // their RTX). An empty codec keeps every payload of that media.
+        // Retained payload types are returned in |*_payload_numbers|.
+        void forcePayload(std::vector<int> &audio_payload_numbers,
+                          std::vector<int> &video_payload_numbers,
+                          const std::string &audio_codec,
+                          const std::string &video_codec,
+                          const int h264_packetization_mode,
+                          const std::string &h264_profile_level_id,
+                          const int vp9_profile_id)
+        {
+            for (auto &m : media) {
+                if (m.type == "audio")
+                    m.filterPayloads(audio_payload_numbers, audio_codec,
+                                     h264_packetization_mode,
+                                     h264_profile_level_id, vp9_profile_id);
+                else if (m.type == "video")
+                    m.filterPayloads(video_payload_numbers, video_codec,
+                                     h264_packetization_mode,
+                                     h264_profile_level_id, vp9_profile_id);
+            }
+        }
 
-    // Set video bitrate constraint (b=AS, x-google-min, x-google-max)
-    static void bitrateMaxMinSDP(std::string &sdp,
-                                 const int newBitrate,
-                                 const std::vector<int> &video_payload_numbers)
-    {
-        std::string kbps = std::to_string(newBitrate);
-        std::vector<std::string> sdpLines;
-        split(sdp, (char *)"\r\n", sdpLines);
-        int aLine = findLines(sdpLines, "m=audio ");
-        int vLine = findLines(sdpLines, "m=video ");
-        int video_start = vLine > 0 ? vLine : 0;
-        int video_end = aLine > video_start ? aLine : sdpLines.size();
-        int testLine = findLines(sdpLines, "b=AS:");
-
-        // video section does not have b=AS. insert line with b=AS constraint
-        if (testLine < video_start || testLine > video_end) {
-            int vLine = findLines(sdpLines, "m=video ");
-            std::ostringstream newLine;
-            newLine << "b=AS:" << newBitrate;
-            if (strncmp(sdpLines[vLine+1].c_str(), "c=", 2) == 0)
-                sdpLines.insert(sdpLines.begin() + vLine+2, newLine.str());
-            else
-                sdpLines.insert(sdpLines.begin() + vLine+1, newLine.str());
+        // Set video bitrate constraint (b=AS) unless there is one already
+        void bitrate(int newBitrate)
+        {
+            for (auto &m : media)
+                if (m.type == "video" && m.findLine("b=AS:") == -1)
+                    m.setBandwidth(newBitrate);
         }
-        // video section contains b=AS. replace line with new b=AS constraint
-        else {
-            std::ostringstream newLine;
-            newLine << "b=AS:" << newBitrate;
-            sdpLines.insert(sdpLines.begin() + testLine+1, newLine.str());
-            sdpLines.erase(sdpLines.begin() + testLine);
+
+        // Set video bitrate constraint (b=AS, x-google-min, x-google-max)
+        void bitrateMaxMin(const int newBitrate,
+                           const std::vector<int> &video_payload_numbers)
+        {
+            std::string kbps = std::to_string(newBitrate);
+            for (auto &m : media) {
+                if (m.type != "video")
+                    continue;
+                m.setBandwidth(newBitrate);
+                for (const auto &num : video_payload_numbers) {
+                    if (!m.codecs.count(num))
+                        continue;
+                    m.setFmtpParam(num, "x-google-min-bitrate", kbps);
+                    m.setFmtpParam(num, "x-google-max-bitrate", kbps);
+                }
+            }
         }
 
-        testLine = findLines(sdpLines, "x-google-min-bitrate=" + kbps);
-
-        // video section already has an fmtp line with x-google-min-bitrate constraint
-        // replace |testLine| with new x-google-min/max-constraint
-        if (testLine >= video_start && testLine <= video_end) {
-            std::smatch match;
-            std::ostringstream newLine;
-            std::string payloadRe = "(a=fmtp:[0-9]+ [^ ]+)(?:x-google-min-bitrate=[0-9]+)(?:;x-google-max-bitrate=[0-9]+)?([^ ]*)";
-            std::regex re(payloadRe);
-            if (std::regex_search(sdpLines[testLine], match, re)) {
-                std::string pre = match[1].str();
-                std::string post = match[2].str();
-                newLine << pre << "x-google-min-bitrate=" << kbps;
-                newLine << ";x-google-max-bitrate=" << kbps << post;
-                sdpLines.insert(sdpLines.begin() + testLine+1, newLine.str());
-                sdpLines.erase(sdpLines.begin() + testLine);
+        // Enable stereo. Set audio bitrate (if nonzero)
+        void stereo(int audioBitrate)
+        {
+            for (auto &m : media) {
+                if (m.type != "audio")
+                    continue;
+
+                int opus = -1;
+                for (const auto &num : m.formats) {
+                    auto codec = m.codecs.find(num);
+                    if (codec == m.codecs.end())
+                        continue;
+                    // Audio section contains at least 1 stereo codec
+                    if (m.fmtpParam(num, "stereo") == "1" &&
+                        m.fmtpParam(num, "sprop-stereo") == "1") {
+                        opus = -1;
+                        break;
+                    }
+                    if (opus == -1 &&
+                        caseInsensitiveStringCompare(codec->second, "opus"))
+                        opus = num;
+                }
+                if (opus == -1)
+                    continue;
+
+                if (!m.fmtp.count(opus)) {
+                    m.setFmtpParam(opus, "minptime", "10");
+                    m.setFmtpParam(opus, "useinbandfec", "1");
+                }
+                m.setFmtpParam(opus, "stereo", "1");
+                m.setFmtpParam(opus, "sprop-stereo", "1");
+                m.setFmtpParam(opus, "maxplaybackrate", "48000");
+                m.setFmtpParam(opus, "sprop-maxcapturerate", "48000");
+                if (audioBitrate > 0) {
+                    std::string aBitrate = std::to_string(audioBitrate);
+                    m.setFmtpParam(opus, "maxaveragebitrate",
+                                   std::to_string(audioBitrate * 1024));
+                    m.setFmtpParam(opus, "x-google-min-bitrate", aBitrate);
+                    m.setFmtpParam(opus, "x-google-max-bitrate", aBitrate);
+                }
             }
-            sdp = join(sdpLines, "\r\n");
-            return;
         }
 
-        for (const auto &num : video_payload_numbers) {
-            int fmtp = findLines(sdpLines, "a=fmtp:" + std::to_string(num));
-            int rtpmap = findLines(sdpLines, "a=rtpmap:" + std::to_string(num));
-            // fmtp line exists, append x-google-*-bitrate constraint
-            if (fmtp != -1) {
-                std::string x = "x-google-min-bitrate=";
-                // fmtp line has x-google-min-bitrate constraint
-                // replace line with new x-google-min/max-constraint
-                if (sdpLines[fmtp].find(x) != std::string::npos) {
-                    std::smatch match;
-                    std::ostringstream newLine;
-                    std::string payloadRe =
-                        "(a=fmtp:[0-9]+ [^ ]+)(?:x-google-min-bitrate=[0-9]+)";
-                    payloadRe += "(?:;x-google-max-bitrate=[0-9]+)?([^ ]*)";
-                    std::regex re(payloadRe);
-                    if (std::regex_search(sdpLines[testLine], match, re)) {
-                        std::string pre = match[1].str();
-                        std::string post = match[2].str();
-                        newLine << pre << "x-google-min-bitrate=" << kbps;
-                        newLine << ";x-google-max-bitrate=" << kbps << post;
-                        sdpLines.insert(sdpLines.begin() + testLine+1, newLine.str());
-                        sdpLines.erase(sdpLines.begin() + testLine);
+    private:
+        struct Line {
+            std::string text;
+            int payload; // payload type of rtpmap/fmtp/rtcp-fb lines, else -1
+        };
+
+        struct Media {
+            std::string type;              // audio, video, application...
+            std::string header;            // m-line up to the formats
+            std::vector<std::string> fmts; // m-line formats as written
+            std::vector<int> formats;      // numeric payload types
+            std::vector<Line> lines;
+
+            std::map<int, std::string> codecs; // pt -> rtpmap encoding name
+            std::map<int, size_t> fmtp;        // pt -> index in |lines|
+            std::map<int, int> apt;            // rtx pt -> primary pt
+
+            void parseMLine(const std::string &text)
+            {
+                // m=<media> <port> <proto> <fmt> ...
+                std::vector<std::string> fields;
+                tokenize(text.substr(2), ' ', fields);
+                type = fields.empty() ? "" : fields[0];
+                header = "m=";
+                for (size_t i = 0; i < fields.size(); i++) {
+                    if (i < 3) {
+                        header += (i ? " " : "") + fields[i];
+                        continue;
                     }
+                    fmts.push_back(fields[i]);
+                    int num;
+                    if (toInt(fields[i], num))
+                        formats.push_back(num);
                 }
-                // fmtp line does not have x-google-*-bitrate constraint
-                // append x-google-*-bitrate constraints to fmtp line
-                else {
-                    sdpLines[fmtp] =
-                        sdpLines[fmtp].append(";x-google-min-bitrate=" + kbps)
-                                      .append(";x-google-max-bitrate=" + kbps);
+            }
+
+            void addLine(const std::string &text)
+            {
+                Line line = { text, -1 };
+                size_t colon;
+                if (text.compare(0, 9, "a=rtpmap:") == 0)
+                    colon = 8;
+                else if (text.compare(0, 7, "a=fmtp:") == 0)
+                    colon = 6;
+                else if (text.compare(0, 10, "a=rtcp-fb:") == 0)
+                    colon = 9;
+                else
+                    colon = std::string::npos;
+
+                if (colon != std::string::npos) {
+                    size_t space = text.find(' ', colon);
+                    int num;
+                    if (space != std::string::npos &&
+                        toInt(text.substr(colon + 1, space - colon - 1), num))
+                        line.payload = num;
                 }
+                lines.push_back(line);
+                index(lines.size() - 1);
             }
-            // insert fmtp line below rtmap line
-            else if (rtpmap != -1) {
-                std::string fmtpLine = "a= fmtp:" + std::to_string(num);
-                sdpLines.insert(sdpLines.begin() + rtpmap + 1, fmtpLine);
-                sdpLines[rtpmap+1] =
-                    sdpLines[rtpmap+1].append(" x-google-min-bitrate=" + kbps)
-                                      .append(";x-google-max-bitrate=" + kbps);
+
+            // Update the payload maps for |lines[i]|
+            void index(size_t i)
+            {
+                const Line &line = lines[i];
+                if (line.payload == -1)
+                    return;
+
+                size_t value = line.text.find(' ') + 1;
+                if (line.text.compare(0, 9, "a=rtpmap:") == 0) {
+                    // <encoding name>/<clock rate>[/<encoding parameters>]
+                    size_t slash = line.text.find('/', value);
+                    codecs[line.payload] = line.text.substr(value,
+                            slash == std::string::npos ? slash : slash - value);
+                } else if (line.text.compare(0, 7, "a=fmtp:") == 0) {
+                    fmtp[line.payload] = i;
+                    int primary;
+                    if (toInt(paramValue(line.text.substr(value), "apt"),
+                              primary))
+                        apt[line.payload] = primary;
+                }
             }
-        }
-        sdp = join(sdpLines, "\r\n");
+
+            void reindex()
+            {
+                codecs.clear();
+                fmtp.clear();
+                apt.clear();
+                for (size_t i = 0; i < lines.size(); i++)
+                    index(i);
+            }
+
+            int findLine(const std::string &prefix) const
+            {
+                for (size_t i = 0; i < lines.size(); i++)
+                    if (lines[i].text.compare(0, prefix.size(), prefix) == 0)
+                        return (int)i;
+                return -1;
+            }
+
+            std::string fmtpParam(int num, const std::string &key) const
+            {
+                auto it = fmtp.find(num);
+                if (it == fmtp.end())
+                    return "";
+                const std::string &text = lines[it->second].text;
+                return paramValue(text.substr(text.find(' ') + 1), key);
+            }
+
+            // Set (or add) |key|=|value| in the fmtp line of payload |num|,
+            // creating the fmtp line after the rtpmap if needed
+            void setFmtpParam(int num, const std::string &key,
+                              const std::string &value)
+            {
+                auto it = fmtp.find(num);
+                if (it == fmtp.end()) {
+                    size_t pos = lines.size();
+                    for (size_t i = 0; i < lines.size(); i++) {
+                        if (lines[i].payload == num &&
+                            lines[i].text.compare(0, 9, "a=rtpmap:") == 0) {
+                            pos = i + 1;
+                            break;
+                        }
+                    }
+                    Line line = { "a=fmtp:" + std::to_string(num) + " " +
+                                  key + "=" + value, num };
+                    lines.insert(lines.begin() + pos, line);
+                    reindex();
+                    return;
+                }
+
+                std::string &text = lines[it->second].text;
+                size_t start = text.find(' ') + 1;
+                std::vector<std::string> params;
+                tokenize(text.substr(start), ';', params);
+                bool found = false;
+                for (auto &param : params) {
+                    if (paramKey(param) == key) {
+                        param = key + "=" + value;
+                        found = true;
+                    }
+                }
+                if (!found)
+                    params.push_back(key + "=" + value);
+
+                text.erase(start);
+                for (size_t i = 0; i < params.size(); i++)
+                    text.append(i ? ";" : "").append(params[i]);
+            }
+
+            // Insert or replace b=AS, after the c= line if it follows m=
+            void setBandwidth(int bitrate)
+            {
+                Line line = { "b=AS:" + std::to_string(bitrate), -1 };
+                int current = findLine("b=AS:");
+                if (current != -1) {
+                    lines[current] = line;
+                    return;
+                }
+                size_t pos = !lines.empty() &&
+                        lines[0].text.compare(0, 2, "c=") == 0 ? 1 : 0;
+                lines.insert(lines.begin() + pos, line);
+                reindex();
+            }
+
+            bool matches(int num, const std::string &codec,
+                         const int h264_packetization_mode,
+                         const std::string &h264_profile_level_id,
+                         const int vp9_profile_id) const
+            {
+                auto name = codecs.find(num);
+                if (name == codecs.end() ||
+                    !caseInsensitiveStringCompare(codec, name->second))
+                    return false;
+
+                int value;
+                if (caseInsensitiveStringCompare("h264", name->second)) {
+                    std::string profile = fmtpParam(num, "profile-level-id");
+                    if (profile.empty())
+                        return true;
+                    std::string mode = fmtpParam(num, "packetization-mode");
+                    int pkt_mode = toInt(mode, value) ? value : 0;
+                    return caseInsensitiveStringCompare(h264_profile_level_id,
+                                                        profile) &&
+                           h264_packetization_mode == pkt_mode;
+                }
+                if (caseInsensitiveStringCompare("vp9", name->second)) {
+                    if (!toInt(fmtpParam(num, "profile-id"), value))
+                        return true;
+                    return vp9_profile_id == value;
+                }
+                return true;
+            }
+
+            // Remove all payloads except |codec| and its RTX
+            void filterPayloads(std::vector<int> &payload_numbers,
+                                const std::string &codec,
+                                const int h264_packetization_mode,
+                                const std::string &h264_profile_level_id,
+                                const int vp9_profile_id)
+            {
+                bool all = codec.empty();
+                std::vector<int> keep;
+                for (const auto &num : formats) {
+                    if (all || matches(num, codec, h264_packetization_mode,
+                                       h264_profile_level_id, vp9_profile_id))
+                        keep.push_back(num);
+                }
+
+                auto kept = [&keep](int num) {
+                    return std::find(keep.begin(), keep.end(), num) != keep.end();
+                };
+                for (const auto &num : keep) {
+                    if (std::find(payload_numbers.begin(),
+                                  payload_numbers.end(),
+                                  num) == payload_numbers.end())
+                        payload_numbers.push_back(num);
+                }
+                if (all)
+                    return;
+
+                // RTX of a retained payload is retained too
+                for (const auto &rtx : apt) {
+                    if (kept(rtx.second) && !kept(rtx.first))
+                        keep.push_back(rtx.first);
+                }
+
+                std::vector<std::string> newFmts;
+                std::vector<int> newFormats;
+                for (size_t i = 0; i < fmts.size(); i++) {
+                    int num;
+                    if (toInt(fmts[i], num) && kept(num)) {
+                        newFmts.push_back(fmts[i]);
+                        newFormats.push_back(num);
+                    }
+                }
+                fmts.swap(newFmts);
+                formats.swap(newFormats);
+
+                lines.erase(std::remove_if(lines.begin(), lines.end(),
+                                [&kept](const Line &line) {
+                                    return line.payload != -1 &&
+                                           !kept(line.payload);
+                                }),
+                            lines.end());
+                reindex();
+            }
+
+            void serialize(std::string &sdp) const
+            {
+                sdp.append(header);
+                for (const auto &fmt : fmts)
+                    sdp.append(" ").append(fmt);
+                sdp.append("\r\n");
+                for (const auto &line : lines)
+                    sdp.append(line.text).append("\r\n");
+            }
+        };
+
+        std::vector<std::string> session;
+        std::vector<Media> media;
+    };
+
+    // Enable stereo. Set audio bitrate (if nonzero)
+    static void stereoSDP(std::string &sdp, int audioBitrate)
+    {
+        Description description(sdp);
+        description.stereo(audioBitrate);
+        sdp = description.toString();
+    }
+
+    // Set video bitrate constraint (b=AS)
+    static void bitrateSDP(std::string &sdp, int newBitrate)
+    {
+        Description description(sdp);
+        description.bitrate(newBitrate);
+        sdp = description.toString();
+    }
+
+    // Set video bitrate constraint (b=AS, x-google-min, x-google-max)
+    static void bitrateMaxMinSDP(std::string &sdp,
+                                 const int newBitrate,
+                                 const std::vector<int> &video_payload_numbers)
+    {
+        Description description(sdp);
+        description.bitrateMaxMin(newBitrate, video_payload_numbers);
+        sdp = description.toString();
     }
 
     // Only accept ice candidates matching protocol (UDP, TCP)
     static bool filterIceCandidates(const std::string &candidate, const std::string &protocol)
     {
-        std::smatch match;
-        std::regex re("candidate:([0-9]+) ([0-9]+) ([tTuU][cCdD][pP])");
-        if (std::regex_search(candidate, match, re))
-            if (caseInsensitiveStringCompare(match[3].str(), protocol))
-                return true;
-        return false;
+        // candidate:<foundation> <component> <transport> ...
+        size_t start = candidate.find("candidate:");
+        if (start == std::string::npos)
+            return false;
+        std::vector<std::string> fields;
+        tokenize(candidate.substr(start + 10), ' ', fields);
+        return fields.size() >= 3 &&
+               isDigits(fields[0]) && isDigits(fields[1]) &&
+               caseInsensitiveStringCompare(fields[2], protocol);
     }
 
     // Remove all payloads from SDP except Opus and video_codec
@@ -253,259 +495,93 @@ public:
                              const std::string &h264_profile_level_id,
                              const int vp9_profile_id)
     {
-        int line;
-        std::ostringstream newLineA;
-        std::ostringstream newLineV;
-        std::string audio_payloads = "";
-        std::string video_payloads = "";
-        std::vector<std::string> sdpLines;
-        // Retained payloads stored in |audio_payload_numbers|
-        filterPayloads(sdp, audio_payloads, audio_payload_numbers, "audio", audio_codec,
-                       h264_packetization_mode, h264_profile_level_id, vp9_profile_id);
-        // Retained payloads stored in |video_payload_numbers|
-        filterPayloads(sdp, video_payloads, video_payload_numbers, "video", video_codec,
-                       h264_packetization_mode, h264_profile_level_id, vp9_profile_id);
-        split(sdp, (char *)"\r\n", sdpLines);
-        // Replace audio m-line
-        line = findLines(sdpLines, "m=audio");
-        if (line != -1) {
-            newLineA << "m=audio 9 UDP/TLS/RTP/SAVPF" << audio_payloads;
-            sdpLines.insert(sdpLines.begin() + line+1, newLineA.str());
-            sdpLines.erase(sdpLines.begin() + line);
-        }
-        // Replace video m-line
-        line = findLines(sdpLines, "m=video");
-        if (line != -1) {
-            newLineV << "m=video 9 UDP/TLS/RTP/SAVPF" << video_payloads;
-            sdpLines.insert(sdpLines.begin() + line+1, newLineV.str());
-            sdpLines.erase(sdpLines.begin() + line);
-        }
-        sdp = join(sdpLines, "\r\n");
+        Description description(sdp);
+        description.forcePayload(audio_payload_numbers, video_payload_numbers,
+                                 audio_codec, video_codec,
+                                 h264_packetization_mode,
+                                 h264_profile_level_id, vp9_profile_id);
+        sdp = description.toString();
     }
 
 private:
-    // Remove all payloads from SDP except Opus and codec
-    static void filterPayloads(std::string &sdp,
-                               std::string &payloads,
-                               std::vector<int> &payload_numbers,
-                               const std::string &media_type,
-                               const std::string &codec)
+    static bool caseInsensitiveStringCompare(const std::string &s1, const std::string &s2)
     {
-        return filterPayloads(sdp, payloads, payload_numbers, media_type, codec,
-                              0, "42e01f", 0);
+        return s1.size() == s2.size() &&
+               std::equal(s1.begin(), s1.end(), s2.begin(),
+                          [](char a, char b) {
+                              return ::tolower((unsigned char)a) ==
+                                     ::tolower((unsigned char)b);
+                          });
     }
 
-    // Remove all payloads of media_type from SDP except media_codec
-    static void filterPayloads(std::string &sdp,
-                               std::string &payloads,
-                               std::vector<int> &payload_numbers,
-                               const std::string &media_type,
-                               const std::string &media_codec,
-                               const int h264_packetization_mode,
-                               const std::string &h264_profile_level_id,
-                               const int vp9_profile_id)
+    // Foundations are 32 bit and may not fit an int
+    static bool isDigits(const std::string &s)
     {
-        std::vector<int> apt_payload_numbers;
-        std::vector<std::string> sdpLines;
-        split(sdp, (char *)"\r\n", sdpLines);
-        int aLine = findLines(sdpLines, "m=audio ");
-        int vLine = findLines(sdpLines, "m=video ");
-        int for_start = 0;
-        int for_end = sdpLines.size();
-        if (media_type == "audio") {
-            for_start = aLine > 0 ? aLine : 0;
-            for_end = vLine > for_start ? vLine : sdpLines.size();
-        }
-        else if (media_type == "video") {
-            for_start = vLine > 0 ? vLine : 0;
-            for_end = aLine > for_start ? aLine : sdpLines.size();
-        }
-        for (int i = for_start; i < for_end; i++) {
-            std::smatch match;
-            std::string payloadRe = "a=rtpmap:([0-9]+) ([a-zA-Z0-9-]+)";
-            std::regex re(payloadRe);
-            if (std::regex_search(sdpLines[i], match, re)) {
-                std::string payloadNumber = match[1].str();
-                std::string payloadCodec = match[2].str();
-                bool found = caseInsensitiveStringCompare(media_codec, payloadCodec);
-                bool all = media_codec.empty();
-                getMatchingPayloads(sdp, sdpLines, payloads, payload_numbers,
-                                    apt_payload_numbers, payloadCodec,
-                                    payloadNumber, all, found,
-                                    h264_packetization_mode,
-                                    h264_profile_level_id, vp9_profile_id);
-            }
-        }
+        return !s.empty() &&
+               s.find_first_not_of("0123456789") == std::string::npos;
     }
 
-    // Store matching payloads in |payloads| & |payload_numbers|
-    static void getMatchingPayloads(std::string &sdp,
-                                    std::vector<std::string> &sdpLines,
-                                    std::string &payloads,
-                                    std::vector<int> &payload_numbers,
-                                    std::vector<int> &apt_payload_numbers,
-                                    const std::string &payloadCodec,
-                                    const std::string &payloadNumber,
-                                    const bool all,
-                                    const bool found,
-                                    const int h264_packetization_mode,
-                                    const std::string &h264_profile_level_id,
-                                    const int vp9_profile_id)
+    // Strict decimal integer (payload types, ids)
+    static bool toInt(const std::string &s, int &value)
     {
-        bool keep = false;
-        bool aptKeep = false;
-        std::string h264fmtp =
-            " level-asymmetry-allowed=[0-1];packetization-mode=([0-9]);profile-level-id=([0-9a-f]{6})";
-        std::string vp9fmtp = " profile-id=([0-9])";
-        int h264fmtpLine = findLinesRegEx(sdpLines, payloadNumber + h264fmtp);
-        int vp9fmtpLine  = findLinesRegEx(sdpLines, payloadNumber + vp9fmtp);
-        if (found) {
-            if (caseInsensitiveStringCompare("h264", payloadCodec)
-                    && h264fmtpLine != -1) {
-                std::smatch match;
-                std::regex re(payloadNumber + h264fmtp);
-                if (std::regex_search(sdpLines[h264fmtpLine], match, re)) {
-                    int pkt_mode = std::stoi(match[1].str());
-                    std::string p_level_id = match[2].str();
-                    if (caseInsensitiveStringCompare(h264_profile_level_id, p_level_id)
-                            && h264_packetization_mode == pkt_mode) {
-                        keep = true;
-                    }
-                }
-            }
-            else if (caseInsensitiveStringCompare("vp9", payloadCodec)
-                    && vp9fmtpLine != -1) {
-                std::smatch match;
-                std::regex re(payloadNumber + vp9fmtp);
-                if (std::regex_search(sdpLines[vp9fmtpLine], match, re)) {
-                    int profile_id = std::stoi(match[1].str());
-                    if (vp9_profile_id == profile_id) {
-                        keep = true;
-                    }
-                }
-            }
-            else {
-                keep = true;
-            }
-        }
-        else if (all) {
-            keep = true;
-        }
-        std::string rtxPayloadNumber = "";
-        int aptLine = findLines(sdpLines, "apt=" + payloadNumber);
-        if (aptLine != -1) {
-            std::smatch matchApt;
-            std::regex reApt("a=fmtp:([0-9]+) apt");
-            if (std::regex_search(sdpLines[aptLine], matchApt, reApt)) {
-                rtxPayloadNumber = matchApt[1].str();
-                if (keep) {
-                    aptKeep = true;
-                }
-            }
-        }
-        if (keep) {
-            payloads += " " + payloadNumber;
-            payload_numbers.push_back(std::stoi(payloadNumber));
-        }
-        if (aptKeep) {
-            if (!all) {
-                payloads += " " + rtxPayloadNumber;
-            }
-            apt_payload_numbers.push_back(std::stoi(rtxPayloadNumber));
-        }
-        if (!keep && !aptKeep) {
-            const auto begin = payload_numbers.begin();
-            const auto end = payload_numbers.end();
-            const auto apt_begin = apt_payload_numbers.begin();
-            const auto apt_end = apt_payload_numbers.end();
-            const auto payload = std::stoi(payloadNumber);
-            if (std::find(apt_begin, apt_end, payload) == apt_end
-                    && std::find(begin, end, payload) == end) {
-                deletePayload(sdp, payload);
-            }
+        if (s.empty() || s.size() > 9)
+            return false;
+        value = 0;
+        for (char c : s) {
+            if (c < '0' || c > '9')
+                return false;
+            value = value * 10 + (c - '0');
         }
+        return true;
     }
 
-    // Delete payload from SDP (string)
-    static void deletePayload(std::string &sdp, const int payloadNumber)
+    static std::string paramKey(const std::string &param)
     {
-        std::vector<std::string> sdpLines;
-        split(sdp, (char *)"\r\n", sdpLines);
-        int line;
-        do {
-            line = findLines(sdpLines, ":" + std::to_string(payloadNumber) + " ");
-            if (line != -1)
-                sdpLines.erase(sdpLines.begin() + line);
-        } while (line != -1);
-        sdp = join(sdpLines, "\r\n");
+        size_t begin = param.find_first_not_of(' ');
+        if (begin == std::string::npos)
+            return "";
+        size_t end = param.find('=', begin);
+        return param.substr(begin, end == std::string::npos ? end : end - begin);
     }
 
-    // Delete payload from SDP (vector<string>)
-    static void deletePayload(std::vector<std::string> &sdpLines, const int payloadNumber)
+    // Value of |key| in a "key=value;key=value" fmtp parameter list
+    static std::string paramValue(const std::string &params, const std::string &key)
     {
-        int line;
-        do {
-            line = findLines(sdpLines, ":" + std::to_string(payloadNumber) + " ");
-            if (line != -1)
-                sdpLines.erase(sdpLines.begin() + line);
-        } while (line != -1);
-    }
-
-    static bool caseInsensitiveStringCompare(const char *str1, const char *str2)
-    {
-        return caseInsensitiveStringCompare(std::string(str1), std::string(str2));
-    }
-
-    static bool caseInsensitiveStringCompare(const std::string &s1, const std::string &s2)
-    {
-        std::string s1Cpy = s1;
-        std::string s2Cpy = s2;
-        std::transform(s1Cpy.begin(), s1Cpy.end(), s1Cpy.begin(), ::tolower);
-        std::transform(s2Cpy.begin(), s2Cpy.end(), s2Cpy.begin(), ::tolower);
-        return (s1Cpy == s2Cpy);
-    }
-
-    static int findLines(const std::vector<std::string> &sdpLines, std::string prefix)
-    {
-        for (unsigned long i = 0; i < sdpLines.size(); i++) {
-            if (sdpLines[i].find(prefix) != std::string::npos)
-                return i;
-        }
-        return -1;
-    }
-
-    static int findLinesRegEx(const std::vector<std::string> &sdpLines, std::string prefix)
-    {
-        std::regex re(prefix);
-        for (unsigned long i = 0; i < sdpLines.size(); i++) {
-            std::smatch match;
-            if (std::regex_search(sdpLines[i], match, re))
-                return i;
+        std::vector<std::string> fields;
+        tokenize(params, ';', fields);
+        for (const auto &param : fields) {
+            if (paramKey(param) == key) {
+                size_t eq = param.find('=');
+                return eq == std::string::npos ? "" : param.substr(eq + 1);
+            }
         }
-        return -1;
+        return "";
     }
 
-    static std::string join(std::vector<std::string> &v, std::string delim)
+    static void tokenize(const std::string &s, char delim, std::vector<std::string> &v)
     {
-        std::ostringstream s;
-        for (const auto &i : v) {
-            if (&i != &v[0])
-                s << delim;
-            s << i;
+        size_t start = 0;
+        while (start <= s.size()) {
+            size_t end = s.find(delim, start);
+            if (end == std::string::npos)
+                end = s.size();
+            if (end > start)
+                v.push_back(s.substr(start, end - start));
+            start = end + 1;
         }
-        s << delim;
-        return s.str();
     }
 
-    static void split(const std::string &s, char *delim, std::vector<std::string> &v)
+    // Split on CR/LF, skipping empty lines
+    static void split(const std::string &s, std::vector<std::string> &v)
     {
-        char *dup = strdup(s.c_str());
-        char *token = strtok(dup, delim);
-        while (token != NULL) {
-            v.push_back(std::string(token));
-            token = strtok(NULL, delim);
+        size_t start = 0;
+        while (start < s.size()) {
+            size_t end = s.find_first_of("\r\n", start);
+            if (end == std::string::npos)
+                end = s.size();
+            if (end > start)
+                v.push_back(s.substr(start, end - start));
+            start = end + 1;
         }
-        free(dup);
     }
 };
-
@@ -0,0 +1,150 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#include "SimulcastEncoderFactory.h"
+#include "NV12Buffer.h"
+
+#include "obs.h"
+
+#include "api/video/video_frame.h"
+#include "media/engine/simulcast_encoder_adapter.h"
+#include "modules/video_coding/include/video_error_codes.h"
+
+#include <utility>
+
+#define warn(format, ...)  blog(LOG_WARNING, format, ##__VA_ARGS__)
+
+LayerSelectingEncoder::LayerSelectingEncoder(
+        std::unique_ptr<webrtc::VideoEncoder> encoder)
+    : encoder(std::move(encoder)), width(0), height(0)
+{
+}
+
+LayerSelectingEncoder::~LayerSelectingEncoder() {}
+
+int32_t LayerSelectingEncoder::InitEncode(
+        const webrtc::VideoCodec *codec_settings, int32_t number_of_cores,
+        size_t max_payload_size)
+{
+    if (!codec_settings)
+        return WEBRTC_VIDEO_CODEC_ERR_PARAMETER;
+
+    width = codec_settings->width;
+    height = codec_settings->height;
+    return encoder->InitEncode(codec_settings, number_of_cores,
+                               max_payload_size);
+}
+
+int32_t LayerSelectingEncoder::RegisterEncodeCompleteCallback(
+        webrtc::EncodedImageCallback *callback)
+{
+    return encoder->RegisterEncodeCompleteCallback(callback);
+}
+
+int32_t LayerSelectingEncoder::Release()
+{
+    return encoder->Release();
+}
+
+int32_t LayerSelectingEncoder::Encode(
+        const webrtc::VideoFrame &frame,
+        const std::vector<webrtc::VideoFrameType> *frame_types)
+{
+    rtc::scoped_refptr<webrtc::VideoFrameBuffer> buffer =
+            frame.video_frame_buffer();
+
+    // Non native frames were already scaled by the simulcast adapter, and
+    // the full resolution layer is converted lazily by the encoder itself
+    if (buffer->type() != webrtc::VideoFrameBuffer::Type::kNative ||
+        (buffer->width() == width && buffer->height() == height))
+        return encoder->Encode(frame, frame_types);
+
+    // The raw outputs only produce NV12Buffer native frames
+    NV12Buffer *nv12 = static_cast<NV12Buffer *>(buffer.get());
+    webrtc::VideoFrame layer =
+            webrtc::VideoFrame::Builder()
+            .set_video_frame_buffer(nv12->GetLayer(width, height))
+            .set_timestamp_rtp(frame.timestamp())
+            .set_timestamp_us(frame.timestamp_us())
+            .set_ntp_time_ms(frame.ntp_time_ms())
+            .set_rotation(frame.rotation())
+            .set_id(frame.id())
+            .build();
+    return encoder->Encode(layer, frame_types);
+}
+
+void LayerSelectingEncoder::SetRates(const RateControlParameters &parameters)
+{
+    encoder->SetRates(parameters);
+}
+
+void LayerSelectingEncoder::OnPacketLossRateUpdate(float packet_loss_rate)
+{
+    encoder->OnPacketLossRateUpdate(packet_loss_rate);
+}
+
+void LayerSelectingEncoder::OnRttUpdate(int64_t rtt_ms)
+{
+    encoder->OnRttUpdate(rtt_ms);
+}
+
+webrtc::VideoEncoder::EncoderInfo LayerSelectingEncoder::GetEncoderInfo() const
+{
+    EncoderInfo encoder_info = encoder->GetEncoderInfo();
+    // Native NV12 frames are handled here, keep them native up to us
+    encoder_info.supports_native_handle = true;
+    return encoder_info;
+}
+
+std::vector<webrtc::SdpVideoFormat>
+SimulcastEncoderFactory::LayerFactory::GetSupportedFormats() const
+{
+    return internal.GetSupportedFormats();
+}
+
+webrtc::VideoEncoderFactory::CodecInfo
+SimulcastEncoderFactory::LayerFactory::QueryVideoEncoder(
+        const webrtc::SdpVideoFormat &format) const
+{
+    return internal.QueryVideoEncoder(format);
+}
+
+std::unique_ptr<webrtc::VideoEncoder>
+SimulcastEncoderFactory::LayerFactory::CreateVideoEncoder(
+        const webrtc::SdpVideoFormat &format)
+{
+    std::unique_ptr<webrtc::VideoEncoder> encoder =
+            internal.CreateVideoEncoder(format);
+    if (!encoder) {
+        warn("SimulcastEncoderFactory: unsupported codec %s",
+             format.name.c_str());
+        return nullptr;
+    }
+    return std::unique_ptr<webrtc::VideoEncoder>(
+            new LayerSelectingEncoder(std::move(encoder)));
+}
+
+SimulcastEncoderFactory::SimulcastEncoderFactory() {}
+
+SimulcastEncoderFactory::~SimulcastEncoderFactory() {}
+
+std::vector<webrtc::SdpVideoFormat>
+SimulcastEncoderFactory::GetSupportedFormats() const
+{
+    return layer_factory.GetSupportedFormats();
+}
+
+webrtc::VideoEncoderFactory::CodecInfo
+SimulcastEncoderFactory::QueryVideoEncoder(
+        const webrtc::SdpVideoFormat &format) const
+{
+    return layer_factory.QueryVideoEncoder(format);
+}
+
+std::unique_ptr<webrtc::VideoEncoder>
+SimulcastEncoderFactory::CreateVideoEncoder(
+        const webrtc::SdpVideoFormat &format)
+{
+    // The adapter creates one layer encoder per simulcast stream
+    return std::unique_ptr<webrtc::VideoEncoder>(
+            new webrtc::SimulcastEncoderAdapter(&layer_factory, format));
+}
@@ -0,0 +1,73 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#ifndef _OBS_SIMULCAST_ENCODER_FACTORY_H_
+#define _OBS_SIMULCAST_ENCODER_FACTORY_H_
+
+#include "api/video_codecs/sdp_video_format.h"
+#include "api/video_codecs/video_encoder.h"
+#include "api/video_codecs/video_encoder_factory.h"
+#include "media/engine/internal_encoder_factory.h"
+
+#include <memory>
+#include <vector>
+
+// Wraps a builtin encoder so that it is fed the simulcast layer matching its
+// resolution. Frames from the OBS output are NV12Buffer native frames which
+// already carry their downscaled layers (see NV12Buffer::ScaleLayers), so no
+// encoder scales the full picture on its own.
+class LayerSelectingEncoder : public webrtc::VideoEncoder {
+public:
+    explicit LayerSelectingEncoder(std::unique_ptr<webrtc::VideoEncoder> encoder);
+    ~LayerSelectingEncoder() override;
+
+    int32_t InitEncode(const webrtc::VideoCodec *codec_settings,
+                       int32_t number_of_cores,
+                       size_t max_payload_size) override;
+    int32_t RegisterEncodeCompleteCallback(
+            webrtc::EncodedImageCallback *callback) override;
+    int32_t Release() override;
+    int32_t Encode(const webrtc::VideoFrame &frame,
+                   const std::vector<webrtc::VideoFrameType> *frame_types) override;
+    void SetRates(const RateControlParameters &parameters) override;
+    void OnPacketLossRateUpdate(float packet_loss_rate) override;
+    void OnRttUpdate(int64_t rtt_ms) override;
+    EncoderInfo GetEncoderInfo() const override;
+
+private:
+    std::unique_ptr<webrtc::VideoEncoder> encoder;
+    int width;
+    int height;
+};
+
+// Encoder factory of the raw WebRTC outputs: every codec goes through the
+// simulcast adapter, each layer being a LayerSelectingEncoder. With a single
+// layer this is equivalent to the builtin factory.
+class SimulcastEncoderFactory : public webrtc::VideoEncoderFactory {
+public:
+    SimulcastEncoderFactory();
+    ~SimulcastEncoderFactory() override;
+
+    std::vector<webrtc::SdpVideoFormat> GetSupportedFormats() const override;
+    CodecInfo QueryVideoEncoder(
+            const webrtc::SdpVideoFormat &format) const override;
+    std::unique_ptr<webrtc::VideoEncoder> CreateVideoEncoder(
+            const webrtc::SdpVideoFormat &format) override;
+
+private:
+    // Creates the per layer encoders for the simulcast adapter
+    class LayerFactory : public webrtc::VideoEncoderFactory {
+    public:
+        std::vector<webrtc::SdpVideoFormat> GetSupportedFormats() const override;
+        CodecInfo QueryVideoEncoder(
+                const webrtc::SdpVideoFormat &format) const override;
+        std::unique_ptr<webrtc::VideoEncoder> CreateVideoEncoder(
+                const webrtc::SdpVideoFormat &format) override;
+
+    private:
+        webrtc::InternalEncoderFactory internal;
+    };
+
+    LayerFactory layer_factory;
+};
+
+#endif
@@ -0,0 +1,171 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#include "WebRTCContext.h"
+#include "PassthroughVideoEncoder.h"
+#include "SimulcastEncoderFactory.h"
+
+#include "obs.h"
+
+#include "api/audio_codecs/builtin_audio_decoder_factory.h"
+#include "api/audio_codecs/builtin_audio_encoder_factory.h"
+#include "api/create_peerconnection_factory.h"
+#include "api/video_codecs/builtin_video_decoder_factory.h"
+
+#include <algorithm>
+
+#define info(format, ...)  blog(LOG_INFO,    format, ##__VA_ARGS__)
+
+namespace {
+std::mutex gContextMutex;
+WebRTCContext *gContexts[2] = { nullptr, nullptr };
+// Tears down a context whose last reference went away on one of its threads
+std::thread gTeardown;
+}
+
+WebRTCContext *WebRTCContext::acquire(bool encoded)
+{
+    std::lock_guard<std::mutex> lock(gContextMutex);
+    if (gTeardown.joinable())
+        gTeardown.join();
+    WebRTCContext *&context = gContexts[encoded ? 1 : 0];
+    if (!context)
+        context = new WebRTCContext(encoded);
+    context->refs++;
+    return context;
+}
+
+void WebRTCContext::release(WebRTCContext *context)
+{
+    if (!context)
+        return;
+
+    std::lock_guard<std::mutex> lock(gContextMutex);
+    if (--context->refs > 0)
+        return;
+    gContexts[context->encoded ? 1 : 0] = nullptr;
+
+    // Streams are refcounted by libwebrtc observers and can be released on
+    // the signaling thread, which can't stop itself
+    if (context->isCurrent()) {
+        if (gTeardown.joinable())
+            gTeardown.join();
+        gTeardown = std::thread([context]() { delete context; });
+        return;
+    }
+    delete context;
+}
+
+void WebRTCContext::shutdown()
+{
+    std::lock_guard<std::mutex> lock(gContextMutex);
+    if (gTeardown.joinable())
+        gTeardown.join();
+}
+
+extern "C" void webrtc_context_shutdown(void)
+{
+    WebRTCContext::shutdown();
+}
+
+bool WebRTCContext::isCurrent() const
+{
+    return network->IsCurrent() || worker->IsCurrent() ||
+           signaling->IsCurrent();
+}
+
+WebRTCContext::WebRTCContext(bool encoded) : encoded(encoded), refs(0)
+{
+    info("++ WebRTCContext::WebRTCContext (%s)",
+         encoded ? "encoded" : "raw");
+
+    // Create audio device module
+    adm = new rtc::RefCountedObject<AudioDeviceModuleWrapper>();
+
+    // Network thread
+    network = rtc::Thread::CreateWithSocketServer();
+    network->SetName("network", nullptr);
+    network->Start();
+
+    // Worker thread
+    worker = rtc::Thread::Create();
+    worker->SetName("worker", nullptr);
+    worker->Start();
+
+    // Signaling thread
+    signaling = rtc::Thread::Create();
+    signaling->SetName("signaling", nullptr);
+    signaling->Start();
+
+    // Encoded outputs forward the OBS encoder packets instead of encoding,
+    // raw outputs encode each simulcast layer from the pre-scaled frames
+    std::unique_ptr<webrtc::VideoEncoderFactory> video_encoder_factory;
+    if (encoded)
+        video_encoder_factory.reset(new PassthroughVideoEncoderFactory());
+    else
+        video_encoder_factory.reset(new SimulcastEncoderFactory());
+
+    factory = webrtc::CreatePeerConnectionFactory(
+            network.get(),
+            worker.get(),
+            signaling.get(),
+            adm,
+            webrtc::CreateBuiltinAudioEncoderFactory(),
+            webrtc::CreateBuiltinAudioDecoderFactory(),
+            std::move(video_encoder_factory),
+            webrtc::CreateBuiltinVideoDecoderFactory(),
+            nullptr,
+            nullptr);
+}
+
+WebRTCContext::~WebRTCContext()
+{
+    info("++ WebRTCContext::~WebRTCContext (%s)",
+         encoded ? "encoded" : "raw");
+
+    // Free factories
+    factory = nullptr;
+    adm = nullptr;
+
+    // Never on one of these threads, see release()
+    network->Stop();
+    worker->Stop();
+    signaling->Stop();
+
+    signaling.reset();
+    worker.reset();
+    network.reset();
+}
+
+void WebRTCContext::addAudioFeeder(const void *feeder)
+{
+    std::lock_guard<std::mutex> lock(feeders_mutex);
+    if (std::find(audio_feeders.begin(), audio_feeders.end(), feeder) ==
+        audio_feeders.end())
+        audio_feeders.push_back(feeder);
+}
+
+void WebRTCContext::removeAudioFeeder(const void *feeder)
+{
+    std::lock_guard<std::mutex> lock(feeders_mutex);
+    audio_feeders.erase(std::remove(audio_feeders.begin(),
+                                    audio_feeders.end(), feeder),
+                        audio_feeders.end());
+}
+
+void WebRTCContext::onAudioFrame(const void *feeder, audio_data *frame)
+{
+    {
+        std::lock_guard<std::mutex> lock(feeders_mutex);
+        if (audio_feeders.empty() || audio_feeders.front() != feeder)
+            return;
+    }
+    // Outputs request the mixer format as is, float planar
+    audio_t *audio = obs_get_audio();
+    if (!audio)
+        return;
+
+    // Push it to the device
+    adm->onIncomingData(reinterpret_cast<const float *const *>(frame->data),
+                        audio_output_get_channels(audio), frame->frames,
+                        audio_output_get_sample_rate(audio));
+}
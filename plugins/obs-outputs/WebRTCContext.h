@@ -0,0 +1,63 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#ifndef _WEBRTC_CONTEXT_H_
+#define _WEBRTC_CONTEXT_H_
+
+#include "AudioDeviceModuleWrapper.h"
+
+#include "api/peer_connection_interface.h"
+#include "api/scoped_refptr.h"
+#include "rtc_base/thread.h"
+
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct audio_data;
+
+// Process-wide libwebrtc state shared by every WebRTC output: network, worker
+// and signaling threads, the audio device module and the PeerConnection
+// factory. One context exists per video encoder flavour (builtin encoders or
+// OBS encoder pass-through), created on first acquire and destroyed when the
+// last output releases it.
+class WebRTCContext {
+public:
+    static WebRTCContext *acquire(bool encoded);
+    static void release(WebRTCContext *context);
+    // Waits for a context released from one of its own threads to be gone
+    static void shutdown();
+
+    rtc::Thread *signalingThread() const { return signaling.get(); }
+    rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> peerConnectionFactory() const
+    {
+        return factory;
+    }
+
+    // The audio device module is shared, so only one of the outputs feeding
+    // it (the first registered) is forwarded, the others get the same mix.
+    void addAudioFeeder(const void *feeder);
+    void removeAudioFeeder(const void *feeder);
+    void onAudioFrame(const void *feeder, audio_data *frame);
+
+private:
+    explicit WebRTCContext(bool encoded);
+    ~WebRTCContext();
+
+    bool isCurrent() const;
+
+    bool encoded;
+    int refs;
+
+    std::mutex feeders_mutex;
+    std::vector<const void *> audio_feeders;
+
+    rtc::scoped_refptr<AudioDeviceModuleWrapper> adm;
+    rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> factory;
+
+    std::unique_ptr<rtc::Thread> network;
+    std::unique_ptr<rtc::Thread> worker;
+    std::unique_ptr<rtc::Thread> signaling;
+};
+
+#endif
@@ -2,13 +2,10 @@
 
 #include "WebRTCStream.h"
 #include "SDPModif.h"
+#include "NV12Buffer.h"
 
 #include "media-io/video-io.h"
 
-#include "api/audio_codecs/builtin_audio_decoder_factory.h"
-#include "api/audio_codecs/builtin_audio_encoder_factory.h"
-#include "api/video_codecs/builtin_video_decoder_factory.h"
-#include "api/video_codecs/builtin_video_encoder_factory.h"
 #include "api/video/i420_buffer.h"
 #include "common_video/libyuv/include/webrtc_libyuv.h"
 #include "pc/rtc_stats_collector.h"
@@ -30,42 +27,39 @@
 #define warn(format, ...)  blog(LOG_WARNING, format, ##__VA_ARGS__)
 #define error(format, ...) blog(LOG_ERROR,   format, ##__VA_ARGS__)
 
-namespace {
-static int gVideoSourceCount = 0;
-static int CountVideoSources()
-{
-        int count = 0;
-
-        auto countSources = [](void *param, obs_source_t *source) {
-                if (!source)
-                        return true;
-
-                uint32_t flags = obs_source_get_output_flags(source);
-                if ((flags & OBS_SOURCE_VIDEO) != 0)
-                        (*reinterpret_cast<int *>(param))++;
-
-                return true;
-        };
-
-        obs_enum_sources(countSources, &count);
-        return count;
-}
-}
+// Weak handle on the stream for pending stats requests. Reports are
+// delivered on the signaling thread, which is also where the stream detaches
+// itself when it stops sampling, so a late report never reaches it.
+class StatsLink : public rtc::RefCountInterface {
+public:
+    explicit StatsLink(WebRTCStream *stream) : stream(stream) {}
+    WebRTCStream *stream;
+};
 
 class StatsCallback : public webrtc::RTCStatsCollectorCallback {
 public:
-    rtc::scoped_refptr<const webrtc::RTCStatsReport> report() { return report_; }
-    bool called() const { return called_; }
+    explicit StatsCallback(const rtc::scoped_refptr<StatsLink> &link)
+        : link_(link) {}
 protected:
     void OnStatsDelivered(
             const rtc::scoped_refptr<const webrtc::RTCStatsReport> &report) override
     {
-        report_ = report;
-        called_ = true;
+        if (link_->stream)
+            link_->stream->onStatsReport(report);
+    }
+private:
+    rtc::scoped_refptr<StatsLink> link_;
+};
+
+class StatsSampler : public rtc::MessageHandler {
+public:
+    explicit StatsSampler(WebRTCStream *stream) : stream_(stream) {}
+    void OnMessage(rtc::Message * /* msg */) override
+    {
+        stream_->sampleStats();
     }
 private:
-    bool called_ = false;
-    rtc::scoped_refptr<const webrtc::RTCStatsReport> report_;
+    WebRTCStream *stream_;
 };
 
 class CustomLogger : public rtc::LogSink {
@@ -78,7 +72,29 @@ public:
 
 CustomLogger logger;
 
-WebRTCStream::WebRTCStream(obs_output_t *output)
+// Packets are forwarded in decode order, nothing can reorder them, so
+// B-frames are forced off before the encoder starts, like the FTL output
+// does. x264 only applies "bf" once it is set, over a preset that has
+// B-frames on, and "x264opts" is applied after it.
+static void disableBFrames(obs_encoder_t *encoder)
+{
+    obs_data_t *settings = obs_encoder_get_settings(encoder);
+    obs_data_set_int(settings, "bf", 0);
+
+    if (strcmp(obs_encoder_get_id(encoder), "obs_x264") == 0) {
+        std::string opts = obs_data_get_string(settings, "x264opts");
+        if (opts.find("bframes=0") == std::string::npos) {
+            if (!opts.empty())
+                opts += " ";
+            opts += "bframes=0";
+            obs_data_set_string(settings, "x264opts", opts.c_str());
+        }
+    }
+
+    obs_data_release(settings);
+}
+
+WebRTCStream::WebRTCStream(obs_output_t *output, bool encoded)
 {
     rtc::LogMessage::RemoveLogToStream(&logger);
     rtc::LogMessage::AddLogToStream(&logger, rtc::LoggingSeverity::LS_VERBOSE);
@@ -86,47 +102,31 @@ WebRTCStream::WebRTCStream(obs_output_t *output)
     info("++ WebRTCStream::WebRTCStream");
 
     frame_id = 0;
-    pli_received = 0;
-    audio_bytes_sent = 0;
-    video_bytes_sent = 0;
-    total_bytes_sent = 0;
+    stats_interval_ms = 1000;
+    keepalive_interval_ms = 10000;
+    stats_sampling = false;
+    stats_sampler.reset(new StatsSampler(this));
+
+    // Let frontend plugins query transport metrics
+    proc_handler_t *ph = obs_output_get_proc_handler(output);
+    proc_handler_add(ph, "void get_webrtc_metrics(in ptr metrics)",
+                     &WebRTCStream::getMetricsProc, this);
 
     audio_bitrate = 128;
     video_bitrate = 2500;
+    simulcast_layers = 1;
+    for (int i = 0; i < MAX_SIMULCAST_LAYERS; i++)
+        simulcast_bitrates[i] = 0;
 
     // Store output
     this->output = output;
     this->client = nullptr;
+    this->encoded = encoded;
+    this->audio_connected = false;
+    this->reorder_reported = false;
 
-    // Create audio device module
-    adm = new rtc::RefCountedObject<AudioDeviceModuleWrapper>();
-
-    // Network thread
-    network = rtc::Thread::CreateWithSocketServer();
-    network->SetName("network", nullptr);
-    network->Start();
-
-    // Worker thread
-    worker = rtc::Thread::Create();
-    worker->SetName("worker", nullptr);
-    worker->Start();
-
-    // Signaling thread
-    signaling = rtc::Thread::Create();
-    signaling->SetName("signaling", nullptr);
-    signaling->Start();
-
-    factory = webrtc::CreatePeerConnectionFactory(
-            network.get(),
-            worker.get(),
-            signaling.get(),
-            adm,
-            webrtc::CreateBuiltinAudioEncoderFactory(),
-            webrtc::CreateBuiltinAudioDecoderFactory(),
-            webrtc::CreateBuiltinVideoEncoderFactory(),
-            webrtc::CreateBuiltinVideoDecoderFactory(),
-            nullptr,
-            nullptr);
+    // Shared threads and factory are acquired on first start
+    context = nullptr;
 
     // Create video capture module
     videoCapturer = new rtc::RefCountedObject<VideoCapturer>();
@@ -142,22 +142,14 @@ WebRTCStream::~WebRTCStream()
     close(false);
 
     // Free factories
-    adm = nullptr;
     pc = nullptr;
     factory = nullptr;
     videoCapturer = nullptr;
+    frame_pool.Release();
 
-    // Stop all threads
-    if (!network->IsCurrent())
-        network->Stop();
-    if (!worker->IsCurrent())
-        worker->Stop();
-    if (!signaling->IsCurrent())
-        signaling->Stop();
-
-    network.release();
-    worker.release();
-    signaling.release();
+    // Drop our reference to the shared threads and factory
+    WebRTCContext::release(context);
+    context = nullptr;
 }
 
 bool WebRTCStream::start(WebRTCStream::Type type)
@@ -188,6 +180,14 @@ bool WebRTCStream::start(WebRTCStream::Type type)
     info("Video codec: %s", video_codec.empty() ? "Automatic" : video_codec.c_str());
     info("Protocol:    %s", protocol.empty()    ? "Automatic" : protocol.c_str());
 
+    reorder_reported = false;
+
+    // Packets from the OBS encoder can only be negotiated as H264
+    if (encoded && video_codec != "h264") {
+        info("Encoded output, forcing video codec to h264");
+        video_codec = "h264";
+    }
+
     // Stream setting sanity check
 
     bool isServiceValid = true;
@@ -220,16 +220,63 @@ bool WebRTCStream::start(WebRTCStream::Type type)
 
     obs_output_t *context = output;
 
+    // Encoded outputs are video only, audio is taken raw from the mixer
     obs_encoder_t *aencoder = obs_output_get_audio_encoder(context, 0);
-    obs_data_t *asettings = obs_encoder_get_settings(aencoder);
-    audio_bitrate = (int)obs_data_get_int(asettings, "bitrate");
-    obs_data_release(asettings);
+    if (aencoder) {
+        obs_data_t *asettings = obs_encoder_get_settings(aencoder);
+        audio_bitrate = (int)obs_data_get_int(asettings, "bitrate");
+        obs_data_release(asettings);
+    }
+
+    obs_data_t *osettings = obs_output_get_settings(context);
+    stats_interval_ms = (int)obs_data_get_int(osettings, "stats_interval_ms");
+    if (stats_interval_ms <= 0)
+        stats_interval_ms = 1000;
+    keepalive_interval_ms =
+            (int)obs_data_get_int(osettings, "keepalive_interval_ms");
+    obs_data_release(osettings);
 
     obs_encoder_t *vencoder = obs_output_get_video_encoder(context);
     obs_data_t *vsettings = obs_encoder_get_settings(vencoder);
     video_bitrate = (int)obs_data_get_int(vsettings, "bitrate");
     obs_data_release(vsettings);
 
+    // An encoder shared with an active output keeps its settings, frames
+    // it reorders stop the stream in onVideoPacket()
+    if (encoded && vencoder) {
+        if (obs_encoder_active(vencoder))
+            warn("Video encoder already active, B-frames can't be disabled");
+        else
+            disableBFrames(vencoder);
+    }
+
+    // Simulcast layers are defined by the service
+    simulcast_layers = 1;
+    obs_data_t *ssettings = obs_service_get_settings(service);
+    if (obs_data_get_bool(ssettings, "simulcast")) {
+        if (encoded) {
+            warn("Simulcast needs raw video, disabled for encoded output");
+        } else {
+            simulcast_layers = std::max(2, std::min(MAX_SIMULCAST_LAYERS,
+                    (int)obs_data_get_int(ssettings, "simulcast_layers")));
+            simulcast_bitrates[0] =
+                    (int)obs_data_get_int(ssettings, "simulcast_bitrate_full");
+            simulcast_bitrates[1] =
+                    (int)obs_data_get_int(ssettings, "simulcast_bitrate_half");
+            simulcast_bitrates[2] =
+                    (int)obs_data_get_int(ssettings, "simulcast_bitrate_quarter");
+            // Full resolution layer defaults to the encoder bitrate
+            if (simulcast_bitrates[0] <= 0)
+                simulcast_bitrates[0] = video_bitrate;
+            video_bitrate = 0;
+            for (int i = 0; i < simulcast_layers; i++)
+                video_bitrate += simulcast_bitrates[i];
+            info("Simulcast:        %d layers, %d kbps total",
+                 simulcast_layers, video_bitrate);
+        }
+    }
+    obs_data_release(ssettings);
+
     // Shutdown websocket connection and close Peer Connection (just in case)
     if (close(false))
         obs_output_signal_stop(output, OBS_OUTPUT_ERROR);
@@ -242,9 +289,18 @@ bool WebRTCStream::start(WebRTCStream::Type type)
     // config.disable_ipv6 = true;
     // config.rtcp_mux_policy = webrtc::PeerConnectionInterface::kRtcpMuxPolicyRequire;
     // config.sdp_semantics = webrtc::SdpSemantics::kUnifiedPlan;
+    // RID based simulcast is only available with Unified Plan
+    if (simulcast_layers > 1)
+        config.sdp_semantics = webrtc::SdpSemantics::kUnifiedPlan;
     // config.set_cpu_adaptation(false);
     // config.set_suspend_below_min_bitrate(false);
 
+    // Threads and PeerConnection factory are shared by all WebRTC outputs
+    if (!this->context) {
+        this->context = WebRTCContext::acquire(encoded);
+        factory = this->context->peerConnectionFactory();
+    }
+
     webrtc::PeerConnectionDependencies dependencies(this);
 
     pc = factory->CreatePeerConnection(config, std::move(dependencies));
@@ -278,14 +334,36 @@ bool WebRTCStream::start(WebRTCStream::Type type)
     // pc->AddTrack(audio_track, {"obs"});
     stream->AddTrack(audio_track);
 
-    gVideoSourceCount = CountVideoSources();
-    if (gVideoSourceCount) {
+    bool video_sources = obs_get_video_source_count() != 0;
+    if (video_sources || encoded) {
         video_track = factory->CreateVideoTrack("video", videoCapturer);
         stream->AddTrack(video_track);
     }
 
-    // Add the stream to the peer connection
-    if (!pc->AddStream(stream)) {
+    bool added;
+    if (simulcast_layers > 1) {
+        // Unified Plan: audio track, then one video transceiver sending an
+        // RTP encoding per layer, lowest resolution first
+        added = pc->AddTrack(audio_track, { "obs" }).ok();
+        if (added && video_sources) {
+            webrtc::RtpTransceiverInit init;
+            init.direction = webrtc::RtpTransceiverDirection::kSendOnly;
+            init.stream_ids = { "obs" };
+            static const char *rids[MAX_SIMULCAST_LAYERS] = { "f", "h", "q" };
+            for (int i = simulcast_layers - 1; i >= 0; i--) {
+                webrtc::RtpEncodingParameters encoding;
+                encoding.rid = rids[i];
+                encoding.scale_resolution_down_by = (double)(1 << i);
+                encoding.max_bitrate_bps = simulcast_bitrates[i] * 1000;
+                init.send_encodings.push_back(encoding);
+            }
+            added = pc->AddTransceiver(video_track, init).ok();
+        }
+    } else {
+        // Add the stream to the peer connection
+        added = pc->AddStream(stream);
+    }
+    if (!added) {
         warn("Adding stream to PeerConnection failed");
         // Close Peer Connection
         close(false);
@@ -307,6 +385,7 @@ bool WebRTCStream::start(WebRTCStream::Type type)
         obs_output_signal_stop(output, OBS_OUTPUT_CONNECT_FAILED);
         return false;
     }
+    client->setKeepAliveInterval(keepalive_interval_ms);
 
     // Extra logging
 
@@ -368,7 +447,7 @@ void WebRTCStream::OnSuccess(webrtc::SessionDescriptionInterface *desc)
     info("OFFER:\n\n%s\n", sdp.c_str());
 
     std::string sdpCopy = sdp;
-    if (gVideoSourceCount == 0) {
+    if (obs_get_video_source_count() == 0) {
         std::vector<int> audio_payloads;
         std::vector<int> video_payloads;
         // If codec setting is Automatic
@@ -376,13 +455,24 @@ void WebRTCStream::OnSuccess(webrtc::SessionDescriptionInterface *desc)
             audio_codec = "";
             video_codec = "";
         }
+        SDPModif::Description description(sdpCopy);
         // Force specific video/audio payload
-        SDPModif::forcePayload(sdpCopy, audio_payloads, video_payloads,
+        description.forcePayload(audio_payloads, video_payloads,
                 audio_codec, video_codec, 0, "42e01f", 0);
         // Constrain video bitrate
-        SDPModif::bitrateMaxMinSDP(sdpCopy, video_bitrate, video_payloads);
+        if (simulcast_layers == 1)
+            description.bitrateMaxMin(video_bitrate, video_payloads);
         // Enable stereo & constrain audio bitrate
-        SDPModif::stereoSDP(sdpCopy, audio_bitrate);
+        description.stereo(audio_bitrate);
+        sdpCopy = description.toString();
+    }
+
+    // Simulcast layers are capped by their encoding parameters, the offer
+    // only carries their total, whatever else is munged
+    if (simulcast_layers > 1) {
+        SDPModif::Description description(sdpCopy);
+        description.bitrate(video_bitrate);
+        sdpCopy = description.toString();
     }
 
     info("SETTING LOCAL DESCRIPTION\n\n");
@@ -468,11 +558,13 @@ void WebRTCStream::onOpened(const std::string &sdp)
 
     std::string sdpCopy = sdp;
 
-    if (gVideoSourceCount) {
+    if (obs_get_video_source_count()) {
+        SDPModif::Description description(sdpCopy);
         // Constrain video bitrate
-        SDPModif::bitrateSDP(sdpCopy, video_bitrate);
+        description.bitrate(video_bitrate);
         // Enable stereo & constrain audio bitrate
-        SDPModif::stereoSDP(sdpCopy, audio_bitrate);
+        description.stereo(audio_bitrate);
+        sdpCopy = description.toString();
     }
 
     // SetRemoteDescription observer
@@ -486,15 +578,30 @@ void WebRTCStream::onOpened(const std::string &sdp)
     info("SETTING REMOTE DESCRIPTION\n\n%s", sdpCopy.c_str());
     pc->SetRemoteDescription(std::move(answer), srd_observer);
 
-    // Set audio conversion info
+    // Keep the mixer rate and layout, the audio device module does the 10ms
+    // framing and the int16 conversion itself
+    const struct audio_output_info *audio_info =
+            audio_output_get_info(obs_get_audio());
     audio_convert_info conversion;
-    conversion.format = AUDIO_FORMAT_16BIT;
-    conversion.samples_per_sec = 48000;
-    conversion.speakers = SPEAKERS_STEREO;
-    obs_output_set_audio_conversion(output, &conversion);
+    conversion.format = AUDIO_FORMAT_FLOAT_PLANAR;
+    conversion.samples_per_sec = audio_info->samples_per_sec;
+    conversion.speakers = audio_info->speakers;
+    if (encoded) {
+        // Encoded outputs don't get raw audio from the output, tap the mixer
+        audio_connected = audio_output_connect(obs_get_audio(), 0,
+                &conversion, &WebRTCStream::onRawAudio, this);
+        if (!audio_connected)
+            warn("Unable to connect to the OBS audio output");
+    } else {
+        obs_output_set_audio_conversion(output, &conversion);
+    }
+
+    context->addAudioFeeder(this);
 
     info("Begin data capture...");
     obs_output_begin_data_capture(output, 0);
+
+    startStatsSampling();
 }
 
 void WebRTCStream::OnSetRemoteDescriptionComplete(webrtc::RTCError error)
@@ -508,6 +615,14 @@ void WebRTCStream::OnSetRemoteDescriptionComplete(webrtc::RTCError error)
 bool WebRTCStream::close(bool wait)
 {
     info("++ WebRTCStream::close");
+    stopStatsSampling();
+    if (context)
+        context->removeAudioFeeder(this);
+    if (audio_connected) {
+        audio_output_disconnect(obs_get_audio(), 0,
+                &WebRTCStream::onRawAudio, this);
+        audio_connected = false;
+    }
     if (!pc.get())
         return false;
     // Get pointer
@@ -574,8 +689,73 @@ void WebRTCStream::onAudioFrame(audio_data *frame)
 {
     if (!frame)
         return;
-    // Push it to the device
-    adm->onIncomingData(frame->data[0], frame->frames);
+    // Push it to the shared device, if we are the one feeding it
+    if (context)
+        context->onAudioFrame(this, frame);
+}
+
+void WebRTCStream::onRawAudio(void *param, size_t /* mix_idx */,
+                              audio_data *frame)
+{
+    WebRTCStream *stream = static_cast<WebRTCStream *>(param);
+    stream->onAudioFrame(frame);
+}
+
+void WebRTCStream::onVideoPacket(encoder_packet *packet)
+{
+    if (!packet)
+        return;
+    if (!videoCapturer)
+        return;
+    if (packet->type != OBS_ENCODER_VIDEO)
+        return;
+
+    // B-frames from an encoder that was already active in start()
+    if (packet->pts != packet->dts) {
+        if (reorder_reported)
+            return;
+        reorder_reported = true;
+        warn("Encoded output received a reordered (B-)frame, stopping");
+        obs_output_set_last_error(output,
+            "B-frames are not supported by this output, please set them "
+            "to 0 in the encoder settings.");
+        obs_output_signal_stop(output, OBS_OUTPUT_UNSUPPORTED);
+        return;
+    }
+
+    // Keyframes must carry SPS/PPS in band for the remote decoder
+    uint8_t *header = nullptr;
+    size_t header_size = 0;
+    if (packet->keyframe && packet->encoder)
+        obs_encoder_get_extra_data(packet->encoder, &header, &header_size);
+
+    rtc::scoped_refptr<EncodedFrameBuffer> buffer =
+            new rtc::RefCountedObject<EncodedFrameBuffer>(
+                    packet->encoder,
+                    (int)obs_output_get_width(output),
+                    (int)obs_output_get_height(output),
+                    packet->keyframe, header, header_size,
+                    packet->data, packet->size);
+
+    // RTP timestamps are presentation times, dts_usec is in the same base
+    const int64_t obs_timestamp_us = packet->dts_usec +
+            (packet->pts - packet->dts) * 1000000LL * packet->timebase_num /
+                    packet->timebase_den;
+
+    // Align timestamps from OBS encoder with rtc::TimeMicros timebase
+    const int64_t aligned_timestamp_us =
+            timestamp_aligner_.TranslateTimestamp(obs_timestamp_us, rtc::TimeMicros());
+
+    webrtc::VideoFrame video_frame =
+            webrtc::VideoFrame::Builder()
+            .set_video_frame_buffer(buffer)
+            .set_rotation(webrtc::kVideoRotation_0)
+            .set_timestamp_us(aligned_timestamp_us)
+            .set_id(++frame_id)
+            .build();
+
+    // Send packet to video capturer, the passthrough encoder picks it up
+    videoCapturer->OnFrameCaptured(video_frame);
 }
 
 void WebRTCStream::onVideoFrame(video_data *frame)
@@ -584,40 +764,29 @@ void WebRTCStream::onVideoFrame(video_data *frame)
         return;
     if (!videoCapturer)
         return;
-    if (!gVideoSourceCount)
+    if (!obs_get_video_source_count())
         return;
 
     if (std::chrono::system_clock::time_point(std::chrono::duration<int>(0)) == previous_time)
       // First frame sent: Initialize previous_time
       previous_time = std::chrono::system_clock::now();
 
-    // Calculate size
     int outputWidth = obs_output_get_width(output);
     int outputHeight = obs_output_get_height(output);
-    auto videoType = webrtc::VideoType::kNV12;
-    uint32_t size = outputWidth * outputHeight * 3 / 2;
-
-    int stride_y = outputWidth;
-    int stride_uv = (outputWidth + 1) / 2;
-    int target_width = abs(outputWidth);
-    int target_height = abs(outputHeight);
 
-    // Convert frame
-    rtc::scoped_refptr<webrtc::I420Buffer> buffer = webrtc::I420Buffer::Create(
-            target_width, target_height, stride_y, stride_uv, stride_uv);
-
-    libyuv::RotationMode rotation_mode = libyuv::kRotate0;
-
-    const int conversionResult = libyuv::ConvertToI420(
-            frame->data[0], size,
-            buffer.get()->MutableDataY(), buffer.get()->StrideY(),
-            buffer.get()->MutableDataU(), buffer.get()->StrideU(),
-            buffer.get()->MutableDataV(), buffer.get()->StrideV(), 0, 0,
-            outputWidth, outputHeight, target_width, target_height,
-            rotation_mode, ConvertVideoType(videoType));
-
-    // not using the result yet, silence compiler
-    (void)conversionResult;
+    // Copy the NV12 frame into a recycled buffer, conversion to I420 is
+    // deferred to the encoder and skipped when it accepts native frames
+    rtc::scoped_refptr<NV12Buffer> buffer =
+            frame_pool.CreateBuffer(outputWidth, outputHeight);
+    if (!buffer) {
+        debug("No free frame buffer, dropping frame");
+        return;
+    }
+    buffer->CopyFrom(frame->data[0], (int)frame->linesize[0],
+                     frame->data[1], (int)frame->linesize[1]);
+    // Downscaled layers are produced once here for all layer encoders
+    if (simulcast_layers > 1)
+        buffer->ScaleLayers(simulcast_layers);
 
     const int64_t obs_timestamp_us =
             (int64_t)frame->timestamp / rtc::kNumNanosecsPerMicrosec;
@@ -648,19 +817,6 @@ void WebRTCStream::getStats()
   }
   stats_list = "";
 
-  std::vector<const webrtc::RTCOutboundRTPStreamStats*> send_stream_stats =
-          report->GetStatsOfType<webrtc::RTCOutboundRTPStreamStats>();
-  for (const auto& stat : send_stream_stats) {
-    if (stat->kind.ValueToString() == "audio") {
-      audio_bytes_sent = std::stoll(stat->bytes_sent.ValueToJson());
-    }
-    if (stat->kind.ValueToString() == "video") {
-      video_bytes_sent = std::stoll(stat->bytes_sent.ValueToJson());
-      pli_received = std::stoi(stat->pli_count.ValueToJson());
-    }
-  }
-  total_bytes_sent = audio_bytes_sent + video_bytes_sent;
-
   // RTCDataChannelStats
   std::vector<const webrtc::RTCDataChannelStats*> data_channel_stats =
           report->GetStatsOfType<webrtc::RTCDataChannelStats>();
@@ -783,19 +939,187 @@ void WebRTCStream::getStats()
 
 rtc::scoped_refptr<const webrtc::RTCStatsReport> WebRTCStream::NewGetStats()
 {
-    rtc::CritScope lock(&crit_);
+    std::lock_guard<std::mutex> lock(report_mutex);
+    return last_report;
+}
 
-    if (nullptr == pc) {
-      return nullptr;
+void WebRTCStream::startStatsSampling()
+{
+    rtc::Thread *signaling = context->signalingThread();
+    signaling->Invoke<void>(RTC_FROM_HERE, [this, signaling]() {
+        if (stats_sampling)
+            return;
+        previous_counters = WebRTCStatsCounters();
+        stats_link = new rtc::RefCountedObject<StatsLink>(this);
+        stats_sampling = true;
+        signaling->PostDelayed(RTC_FROM_HERE, stats_interval_ms,
+                               stats_sampler.get());
+    });
+}
+
+void WebRTCStream::stopStatsSampling()
+{
+    if (!context)
+        return;
+    rtc::Thread *signaling = context->signalingThread();
+    // Runs inline when already on the signaling thread
+    signaling->Invoke<void>(RTC_FROM_HERE, [this, signaling]() {
+        stats_sampling = false;
+        signaling->Clear(stats_sampler.get());
+        // Requests still in flight deliver into the void
+        if (stats_link) {
+            stats_link->stream = nullptr;
+            stats_link = nullptr;
+        }
+    });
+}
+
+void WebRTCStream::sampleStats()
+{
+    if (!stats_sampling)
+        return;
+
+    if (pc) {
+        rtc::scoped_refptr<StatsCallback> stats_callback =
+            new rtc::RefCountedObject<StatsCallback>(stats_link);
+        pc->GetStats(stats_callback);
+    }
+
+    context->signalingThread()->PostDelayed(RTC_FROM_HERE, stats_interval_ms,
+                                            stats_sampler.get());
+}
+
+void WebRTCStream::onStatsReport(
+        const rtc::scoped_refptr<const webrtc::RTCStatsReport> &report)
+{
+    uint64_t audio_bytes_sent = 0;
+    uint64_t video_bytes_sent = 0;
+    uint32_t frames_sent = 0;
+    double available_outgoing_bitrate = 0.0;
+    double round_trip_time = 0.0;
+    WebRTCStatsCounters counters;
+    counters.timestamp_us = report->timestamp_us();
+
+    for (const auto *stat :
+         report->GetStatsOfType<webrtc::RTCOutboundRTPStreamStats>()) {
+        if (!stat->kind.is_defined())
+            continue;
+        if (*stat->kind == "audio") {
+            if (stat->bytes_sent.is_defined())
+                audio_bytes_sent += *stat->bytes_sent;
+        } else if (*stat->kind == "video") {
+            if (stat->bytes_sent.is_defined())
+                video_bytes_sent += *stat->bytes_sent;
+            if (stat->packets_sent.is_defined())
+                counters.packets_sent += *stat->packets_sent;
+            if (stat->pli_count.is_defined())
+                counters.pli_count += *stat->pli_count;
+            if (stat->nack_count.is_defined())
+                counters.nack_count += *stat->nack_count;
+        }
+    }
+
+    // Losses as reported back by the receiver in RTCP
+    for (const auto *stat :
+         report->GetStatsOfType<webrtc::RTCRemoteInboundRtpStreamStats>()) {
+        if (stat->kind.is_defined() && *stat->kind == "video" &&
+            stat->packets_lost.is_defined())
+            counters.packets_lost += *stat->packets_lost;
+    }
+
+    for (const auto *stat :
+         report->GetStatsOfType<webrtc::RTCMediaStreamTrackStats>()) {
+        if (stat->kind.is_defined() && *stat->kind == "video" &&
+            stat->frames_sent.is_defined())
+            frames_sent += *stat->frames_sent;
     }
 
-    rtc::scoped_refptr<StatsCallback> stats_callback =
-        new rtc::RefCountedObject<StatsCallback>();
+    // Only the nominated pair carries the bandwidth estimate in use
+    for (const auto *stat :
+         report->GetStatsOfType<webrtc::RTCIceCandidatePairStats>()) {
+        if (!stat->nominated.is_defined() || !*stat->nominated)
+            continue;
+        if (stat->available_outgoing_bitrate.is_defined())
+            available_outgoing_bitrate = *stat->available_outgoing_bitrate;
+        if (stat->current_round_trip_time.is_defined())
+            round_trip_time = *stat->current_round_trip_time;
+    }
 
-    pc->GetStats(stats_callback);
+    // Rates over the last sampling interval
+    double packet_loss = 0.0;
+    double packet_rate = 0.0;
+    double nack_rate = 0.0;
+    double pli_rate = 0.0;
+    const WebRTCStatsCounters &prev = previous_counters;
+    if (prev.timestamp_us && counters.timestamp_us > prev.timestamp_us) {
+        double seconds =
+                (double)(counters.timestamp_us - prev.timestamp_us) / 1000000.0;
+        double sent = (double)counters.packets_sent - prev.packets_sent;
+        double lost = (double)counters.packets_lost - prev.packets_lost;
+        if (sent > 0.0 && lost > 0.0)
+            packet_loss = std::min(lost / (sent + lost), 1.0);
+        packet_rate = sent / seconds;
+        nack_rate = ((double)counters.nack_count - prev.nack_count) / seconds;
+        pli_rate = ((double)counters.pli_count - prev.pli_count) / seconds;
+    }
+    previous_counters = counters;
+
+    const double target_bitrate =
+            (double)(video_bitrate + audio_bitrate) * 1000.0;
+
+    // Each signal is mapped to 0..1 and the worst one wins:
+    //  - bandwidth estimate below the configured bitrate
+    //  - 10% packet loss or more
+    //  - RTT from 100ms (none) to 500ms (full)
+    //  - NACKs for 5% of the packets, or one PLI per second
+    double level = 0.0;
+    if (available_outgoing_bitrate > 0.0 && target_bitrate > 0.0)
+        level = std::max(level, 1.0 - available_outgoing_bitrate / target_bitrate);
+    level = std::max(level, packet_loss / 0.1);
+    level = std::max(level, (round_trip_time - 0.1) / 0.4);
+    if (packet_rate > 0.0)
+        level = std::max(level, nack_rate / packet_rate / 0.05);
+    level = std::max(level, pli_rate);
+    level = std::min(std::max(level, 0.0), 1.0);
+
+    // Smooth it so the UI indicator does not flicker between samples
+    float congestion = 0.7f * stats.congestion.load() + 0.3f * (float)level;
+
+    stats.audio_bytes_sent = audio_bytes_sent;
+    stats.video_bytes_sent = video_bytes_sent;
+    stats.total_bytes_sent = audio_bytes_sent + video_bytes_sent;
+    stats.pli_count = counters.pli_count;
+    stats.nack_count = counters.nack_count;
+    stats.frames_sent = frames_sent;
+    stats.target_bitrate = target_bitrate;
+    stats.available_outgoing_bitrate = available_outgoing_bitrate;
+    stats.round_trip_time = round_trip_time;
+    stats.packet_loss = packet_loss;
+    stats.nack_rate = nack_rate;
+    stats.pli_rate = pli_rate;
+    stats.congestion = congestion;
+
+    std::lock_guard<std::mutex> lock(report_mutex);
+    last_report = report;
+}
 
-    while (!stats_callback->called())
-        std::this_thread::sleep_for(std::chrono::microseconds(1));
+void WebRTCStream::getMetrics(webrtc_stream_metrics *metrics)
+{
+    metrics->total_bytes_sent = stats.total_bytes_sent;
+    metrics->target_bitrate = stats.target_bitrate;
+    metrics->available_outgoing_bitrate = stats.available_outgoing_bitrate;
+    metrics->round_trip_time = stats.round_trip_time;
+    metrics->packet_loss = stats.packet_loss;
+    metrics->nack_rate = stats.nack_rate;
+    metrics->pli_rate = stats.pli_rate;
+    metrics->congestion = stats.congestion;
+}
 
-    return stats_callback->report();
+void WebRTCStream::getMetricsProc(void *param, calldata_t *cd)
+{
+    WebRTCStream *stream = static_cast<WebRTCStream *>(param);
+    webrtc_stream_metrics *metrics =
+            static_cast<webrtc_stream_metrics *>(calldata_ptr(cd, "metrics"));
+    if (metrics)
+        stream->getMetrics(metrics);
 }
@@ -13,7 +13,10 @@
 #include "obs.h"
 #include "WebsocketClient.h"
 #include "VideoCapturer.h"
-#include "AudioDeviceModuleWrapper.h"
+#include "WebRTCContext.h"
+#include "NV12Buffer.h"
+#include "PassthroughVideoEncoder.h"
+#include "webrtc-metrics.h"
 
 #include "api/create_peerconnection_factory.h"
 #include "api/media_stream_interface.h"
@@ -26,13 +29,16 @@
 #include "rtc_base/thread.h"
 #include "rtc_base/timestamp_aligner.h"
 
+#include <atomic>
 #include <initializer_list>
-#include <regex>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <chrono>
 #include <thread>
 
+class StatsLink;
+
 class WebRTCStreamInterface :
     public WebsocketClient::Listener,
     public webrtc::PeerConnectionObserver,
@@ -40,6 +46,33 @@ class WebRTCStreamInterface :
     public webrtc::SetSessionDescriptionObserver,
     public webrtc::SetRemoteDescriptionObserverInterface {};
 
+// Counters parsed from the last stats report. Written by the stats sampler on
+// the signaling thread, read without locking from the output callbacks.
+struct WebRTCStatsSnapshot {
+    std::atomic<uint64_t> audio_bytes_sent{0};
+    std::atomic<uint64_t> video_bytes_sent{0};
+    std::atomic<uint64_t> total_bytes_sent{0};
+    std::atomic<uint32_t> pli_count{0};
+    std::atomic<uint32_t> nack_count{0};
+    std::atomic<uint32_t> frames_sent{0};
+    std::atomic<double>   target_bitrate{0.0};
+    std::atomic<double>   available_outgoing_bitrate{0.0};
+    std::atomic<double>   round_trip_time{0.0};
+    std::atomic<double>   packet_loss{0.0};
+    std::atomic<double>   nack_rate{0.0};
+    std::atomic<double>   pli_rate{0.0};
+    std::atomic<float>    congestion{0.0f};
+};
+
+// Video counters of the previous stats sample, used to derive rates
+struct WebRTCStatsCounters {
+    int64_t  timestamp_us = 0;
+    uint32_t packets_sent = 0;
+    int32_t  packets_lost = 0;
+    uint32_t nack_count = 0;
+    uint32_t pli_count = 0;
+};
+
 class WebRTCStream : public rtc::RefCountedObject<WebRTCStreamInterface> {
 public:
     enum Type {
@@ -49,7 +82,9 @@ public:
         Evercast  = 3
     };
 
-    WebRTCStream(obs_output_t *output);
+    // When encoded is set, video comes as H264 packets from the OBS encoder
+    // and is sent as is, audio is still captured raw from the OBS mixer.
+    WebRTCStream(obs_output_t *output, bool encoded = false);
     ~WebRTCStream() override;
 
     bool close(bool wait);
@@ -57,6 +92,7 @@ public:
     bool stop();
     void onAudioFrame(audio_data *frame);
     void onVideoFrame(video_data *frame);
+    void onVideoPacket(encoder_packet *packet);
     void setCodec(const std::string &new_codec) { this->video_codec = new_codec; }
 
     //
@@ -99,11 +135,16 @@ public:
     // WebRTC stats
     void getStats();
     const char *get_stats_list() { return stats_list.c_str(); }
-    // Bitrate & dropped frames
-    uint64_t getBitrate()        { return total_bytes_sent; }
-    int getDroppedFrames()       { return pli_received; }
-    // Synchronously get stats
+    // Bitrate, dropped frames & congestion, read from the sampled snapshot
+    uint64_t getBitrate()        { return stats.total_bytes_sent; }
+    int getDroppedFrames()       { return (int)stats.pli_count; }
+    float getCongestion()        { return stats.congestion; }
+    void getMetrics(webrtc_stream_metrics *metrics);
+    // Last report delivered to the stats sampler, nullptr if none yet
     rtc::scoped_refptr<const webrtc::RTCStatsReport> NewGetStats();
+    // Called on the signaling thread
+    void sampleStats();
+    void onStatsReport(const rtc::scoped_refptr<const webrtc::RTCStatsReport> &report);
 
     template <typename T>
     rtc::scoped_refptr<T> make_scoped_refptr(T *t) {
@@ -111,8 +152,17 @@ public:
     }
 
 private:
+    static void onRawAudio(void *param, size_t mix_idx, audio_data *frame);
+    static void getMetricsProc(void *param, calldata_t *cd);
+    void startStatsSampling();
+    void stopStatsSampling();
+
     // Connection properties
     Type type;
+    bool encoded;
+    // Set once a reordered packet stopped an encoded output
+    bool reorder_reported;
+    bool audio_connected;
     int audio_bitrate;
     int video_bitrate;
     std::string url;
@@ -123,14 +173,24 @@ private:
     std::string audio_codec;
     std::string video_codec;
     int channel_count;
+    int keepalive_interval_ms;
+    // Number of simulcast layers (1 when disabled) and their bitrates in
+    // kbps, full resolution first
+    int simulcast_layers;
+    int simulcast_bitrates[MAX_SIMULCAST_LAYERS];
 
     // NOTE LUDO: #80 add getStats
     std::string stats_list;
     uint16_t frame_id;
-    uint64_t audio_bytes_sent;
-    uint64_t video_bytes_sent;
-    uint64_t total_bytes_sent;
-    int pli_received;
+    WebRTCStatsSnapshot stats;
+    int stats_interval_ms;
+    bool stats_sampling;
+    std::unique_ptr<rtc::MessageHandler> stats_sampler;
+    // Only touched on the signaling thread
+    rtc::scoped_refptr<StatsLink> stats_link;
+    std::mutex report_mutex;
+    rtc::scoped_refptr<const webrtc::RTCStatsReport> last_report;
+    WebRTCStatsCounters previous_counters;
     // Used to compute fps
     // NOTE ALEX: Should be initialized in constructor.
     std::chrono::system_clock::time_point previous_time
@@ -141,11 +201,12 @@ private:
 
     rtc::CriticalSection crit_;
 
-    // Audio Wrapper
-    rtc::scoped_refptr<AudioDeviceModuleWrapper> adm;
+    // Shared threads, audio device and PeerConnection factory
+    WebRTCContext *context;
 
     // Video Capturer
     rtc::scoped_refptr<VideoCapturer> videoCapturer;
+    NV12BufferPool frame_pool;
     rtc::TimestampAligner timestamp_aligner_;
 
     // PeerConnection
@@ -162,11 +223,6 @@ private:
     rtc::scoped_refptr<webrtc::AudioTrackInterface> audio_track;
     rtc::scoped_refptr<webrtc::VideoTrackInterface> video_track;
 
-    // WebRTC threads
-    std::unique_ptr<rtc::Thread> network;
-    std::unique_ptr<rtc::Thread> worker;
-    std::unique_ptr<rtc::Thread> signaling;
-
     // Websocket client
     WebsocketClient *client;
 
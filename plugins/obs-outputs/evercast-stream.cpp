@@ -17,6 +17,8 @@
 #define OPT_BIND_IP "bind_ip"
 #define OPT_NEWSOCKETLOOP_ENABLED "new_socket_loop_enabled"
 #define OPT_LOWLATENCY_ENABLED "low_latency_mode_enabled"
+#define OPT_STATS_INTERVAL_MS "stats_interval_ms"
+#define OPT_KEEPALIVE_INTERVAL_MS "keepalive_interval_ms"
 
 #include "WebRTCStream.h"
 
@@ -96,6 +98,8 @@ extern "C" void evercast_stream_defaults(obs_data_t *defaults)
 	obs_data_set_default_string(defaults, OPT_BIND_IP, "default");
 	obs_data_set_default_bool(defaults, OPT_NEWSOCKETLOOP_ENABLED, false);
 	obs_data_set_default_bool(defaults, OPT_LOWLATENCY_ENABLED, false);
+	obs_data_set_default_int(defaults, OPT_STATS_INTERVAL_MS, 1000);
+	obs_data_set_default_int(defaults, OPT_KEEPALIVE_INTERVAL_MS, 10000);
 }
 
 extern "C" obs_properties_t *evercast_stream_properties(void *unused)
@@ -133,8 +137,35 @@ extern "C" int evercast_stream_dropped_frames(void *data)
 
 extern "C" float evercast_stream_congestion(void *data)
 {
-	UNUSED_PARAMETER(data);
-	return 0.0f;
+	//Get stream
+	WebRTCStream *stream = (WebRTCStream*)data;
+	return stream->getCongestion();
+}
+
+extern "C" const char *evercast_encoded_stream_getname(void *unused)
+{
+	info("evercast_encoded_stream_getname");
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("EVERCASTStream.Encoded");
+}
+
+extern "C" void *evercast_encoded_stream_create(obs_data_t *, obs_output_t *output)
+{
+	info("evercast_encoded_stream_create");
+	//Create new stream fed by the OBS video encoder
+	WebRTCStream *stream = new WebRTCStream(output, true);
+	//Don't allow it to be deleted
+	stream->AddRef();
+	//Return it
+	return (void*)stream;
+}
+
+extern "C" void evercast_receive_video_packet(void *data, struct encoder_packet *packet)
+{
+	//Get stream
+	WebRTCStream *stream = (WebRTCStream*)data;
+	//Process encoded video
+	stream->onVideoPacket(packet);
 }
 
 extern "C" {
@@ -193,3 +224,59 @@ extern "C" {
 	};
 #endif
 }
+
+extern "C" {
+#ifdef _WIN32
+	struct obs_output_info evercast_encoded_output_info = {
+		"evercast_encoded_output", //id
+		OBS_OUTPUT_VIDEO | OBS_OUTPUT_ENCODED | OBS_OUTPUT_SERVICE, //flags
+		evercast_encoded_stream_getname, //get_name
+		evercast_encoded_stream_create, //create
+		evercast_stream_destroy, //destroy
+		evercast_stream_start, //start
+		evercast_stream_stop, //stop
+		nullptr, //raw_video
+		nullptr, //raw_audio
+		evercast_receive_video_packet, //encoded_packet
+		nullptr, //update
+		evercast_stream_defaults, //get_defaults
+		evercast_stream_properties, //get_properties
+		nullptr, //unused1 (formerly pause)
+		evercast_stream_total_bytes_sent, //get_total_bytes
+		evercast_stream_dropped_frames, //get_dropped_frames
+		nullptr, //type_data
+		nullptr, //free_type_data
+		evercast_stream_congestion, //get_congestion
+		nullptr, //get_connect_time_ms
+		"h264", //encoded_video_codecs
+		nullptr, //encoded_audio_codecs
+		nullptr //raw_audio2
+	};
+#else
+	struct obs_output_info evercast_encoded_output_info = {
+		.id                   = "evercast_encoded_output",
+		.flags                = OBS_OUTPUT_VIDEO | OBS_OUTPUT_ENCODED | OBS_OUTPUT_SERVICE,
+		.get_name             = evercast_encoded_stream_getname,
+		.create               = evercast_encoded_stream_create,
+		.destroy              = evercast_stream_destroy,
+		.start                = evercast_stream_start,
+		.stop                 = evercast_stream_stop,
+		.raw_video            = nullptr,
+		.raw_audio            = nullptr,
+		.encoded_packet       = evercast_receive_video_packet,
+		.update               = nullptr,
+		.get_defaults         = evercast_stream_defaults,
+		.get_properties       = evercast_stream_properties,
+		.unused1              = nullptr,
+		.get_total_bytes      = evercast_stream_total_bytes_sent,
+		.get_dropped_frames   = evercast_stream_dropped_frames,
+		.type_data            = nullptr,
+		.free_type_data       = nullptr,
+		.get_congestion       = evercast_stream_congestion,
+		.get_connect_time_ms  = nullptr,
+		.encoded_video_codecs = "h264",
+		.encoded_audio_codecs = nullptr,
+		.raw_audio2           = nullptr
+	};
+#endif
+}
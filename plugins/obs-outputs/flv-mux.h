@@ -21,6 +21,19 @@
 
 #define MILLISECOND_DEN 1000
 
+/* tag header (11 bytes) plus trailing tag size (4 bytes) */
+#define FLV_TAG_OVERHEAD 15
+#define FLV_MAX_PREFIX_SIZE 5
+
+/* Fields of the FLV tag of an audio/video packet, minus the payload: the
+ * codec bytes in |prefix| are followed by the packet data */
+struct flv_tag {
+	uint8_t type;
+	int32_t time_ms;
+	uint8_t prefix[FLV_MAX_PREFIX_SIZE];
+	size_t prefix_size;
+};
+
 static int32_t get_ms_time(struct encoder_packet *packet, int64_t val)
 {
 	return (int32_t)(val * MILLISECOND_DEN / packet->timebase_den);
@@ -30,5 +43,7 @@ extern void write_file_info(FILE *file, int64_t duration_ms, int64_t size);
 
 extern bool flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 			  bool write_header, size_t audio_idx);
+extern void flv_packet_tag(struct encoder_packet *packet, int32_t dts_offset,
+			   struct flv_tag *tag, bool is_header);
 extern void flv_packet_mux(struct encoder_packet *packet, int32_t dts_offset,
 			   uint8_t **output, size_t *size, bool is_header);
@@ -95,6 +95,15 @@ TLS_CTX RTMP_TLS_ctx = NULL;
 
 static const int packetSize[] = { 12, 8, 4, 1 };
 
+/* most buffers gathered by a single send call */
+#define RTMP_MAX_IOV 64
+
+typedef struct RTMPIOVec
+{
+    const char *base;
+    int len;
+} RTMPIOVec;
+
 int RTMP_ctrlC;
 
 const char RTMPProtocolStrings[][7] =
@@ -1711,6 +1720,87 @@ WriteN(RTMP *r, const char *buffer, int n)
     return n == 0;
 }
 
+/* Gathers |count| buffers into as few send calls as possible. Only used for
+ * plain (no HTTP, no encryption) connections; the custom send function of
+ * the socket thread gets one call per buffer. |iov| is consumed. */
+static int
+WriteV(RTMP *r, RTMPIOVec *iov, int count)
+{
+    int i;
+
+    if (r->m_bCustomSend && r->m_customSendFunc)
+    {
+        for (i = 0; i < count; i++)
+        {
+            if (!WriteN(r, iov[i].base, iov[i].len))
+                return FALSE;
+        }
+        return TRUE;
+    }
+
+    while (count > 0)
+    {
+        int nBytes;
+#ifdef _WIN32
+        WSABUF bufs[RTMP_MAX_IOV];
+        DWORD sent = 0;
+
+        for (i = 0; i < count; i++)
+        {
+            bufs[i].buf = (char *)iov[i].base;
+            bufs[i].len = iov[i].len;
+        }
+        nBytes = WSASend(r->m_sb.sb_socket, bufs, count, &sent, 0, NULL,
+                         NULL) == 0 ? (int)sent : -1;
+#else
+        struct iovec vecs[RTMP_MAX_IOV];
+        struct msghdr msg;
+
+        for (i = 0; i < count; i++)
+        {
+            vecs[i].iov_base = (void *)iov[i].base;
+            vecs[i].iov_len = iov[i].len;
+        }
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = vecs;
+        msg.msg_iovlen = count;
+        nBytes = (int)sendmsg(r->m_sb.sb_socket, &msg, MSG_NOSIGNAL);
+#endif
+
+        if (nBytes < 0)
+        {
+            int sockerr = GetSockError();
+            RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error %d (%d buffers)",
+                     __FUNCTION__, sockerr, count);
+
+            if (sockerr == EINTR && !RTMP_ctrlC)
+                continue;
+
+            r->last_error_code = sockerr;
+
+            RTMP_Close(r);
+            return FALSE;
+        }
+
+        if (nBytes == 0)
+            return FALSE;
+
+        /* skip what went out, a partial send resumes mid buffer */
+        while (count > 0 && nBytes >= iov->len)
+        {
+            nBytes -= iov->len;
+            iov++;
+            count--;
+        }
+        if (count > 0)
+        {
+            iov->base += nBytes;
+            iov->len -= nBytes;
+        }
+    }
+    return TRUE;
+}
+
 #define SAVC(x)	static const AVal av_##x = AVC(#x)
 
 SAVC(app);
@@ -5526,3 +5616,159 @@ RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx)
     }
     return size+s2;
 }
+
+/* Sends an audio or video message whose body is |prefix| (the FLV tag
+ * codec bytes) followed by |data|, without muxing it into an FLV tag first.
+ * On plain connections the chunk headers and the payload are gathered
+ * straight from the caller's buffers, so the payload is never copied.
+ * Returns the body size or -1 on error. */
+int
+RTMP_WriteMedia(RTMP *r, int packetType, uint32_t timestamp,
+                const char *prefix, int prefixSize,
+                const char *data, int size, int streamIdx)
+{
+    RTMPPacket packet = {0};
+    const RTMPPacket *prevPacket;
+    RTMPIOVec iov[RTMP_MAX_IOV];
+    char hbuf[RTMP_MAX_HEADER_SIZE + RTMP_MAX_PREFIX_SIZE];
+    char *hptr, *hend = hbuf + sizeof(hbuf);
+    char c, cont;
+    uint32_t last = 0, t;
+    int nSize, nChunkSize, offset, count = 0;
+
+    if (prefixSize > RTMP_MAX_PREFIX_SIZE || prefixSize + size <= 0)
+        return 0;
+
+    packet.m_nChannel = 0x04;	/* source channel */
+    packet.m_nInfoField2 = r->Link.streams[streamIdx].id;
+    packet.m_packetType = packetType;
+    packet.m_nTimeStamp = timestamp;
+    packet.m_nBodySize = prefixSize + size;
+    packet.m_headerType = timestamp ? RTMP_PACKET_SIZE_MEDIUM
+                          : RTMP_PACKET_SIZE_LARGE;
+
+    /* tunneled and encrypted connections need the body in one piece */
+    if ((r->Link.protocol & RTMP_FEATURE_HTTP)
+#ifdef CRYPTO
+            || r->Link.rc4keyOut
+#ifndef NO_SSL
+            || r->m_sb.sb_ssl
+#endif
+#endif
+       )
+    {
+        int ret;
+
+        if (!RTMPPacket_Alloc(&packet, packet.m_nBodySize))
+        {
+            RTMP_Log(RTMP_LOGDEBUG, "%s, failed to allocate packet", __FUNCTION__);
+            return -1;
+        }
+        memcpy(packet.m_body, prefix, prefixSize);
+        memcpy(packet.m_body + prefixSize, data, size);
+        ret = RTMP_SendPacket(r, &packet, FALSE);
+        RTMPPacket_Free(&packet);
+        return ret ? (int)packet.m_nBodySize : -1;
+    }
+
+    if (packet.m_nChannel >= r->m_channelsAllocatedOut)
+    {
+        int n = packet.m_nChannel + 10;
+        RTMPPacket **packets = realloc(r->m_vecChannelsOut, sizeof(RTMPPacket*) * n);
+        if (!packets)
+        {
+            free(r->m_vecChannelsOut);
+            r->m_vecChannelsOut = NULL;
+            r->m_channelsAllocatedOut = 0;
+            return -1;
+        }
+        r->m_vecChannelsOut = packets;
+        memset(r->m_vecChannelsOut + r->m_channelsAllocatedOut, 0, sizeof(RTMPPacket*) * (n - r->m_channelsAllocatedOut));
+        r->m_channelsAllocatedOut = n;
+    }
+
+    /* same header compression as RTMP_SendPacket */
+    prevPacket = r->m_vecChannelsOut[packet.m_nChannel];
+    if (prevPacket && packet.m_headerType != RTMP_PACKET_SIZE_LARGE)
+    {
+        if (prevPacket->m_nBodySize == packet.m_nBodySize
+                && prevPacket->m_packetType == packet.m_packetType)
+            packet.m_headerType = RTMP_PACKET_SIZE_SMALL;
+
+        if (prevPacket->m_nTimeStamp == packet.m_nTimeStamp
+                && packet.m_headerType == RTMP_PACKET_SIZE_SMALL)
+            packet.m_headerType = RTMP_PACKET_SIZE_MINIMUM;
+        last = prevPacket->m_nTimeStamp;
+    }
+
+    /* channel 0x04 always fits the one byte basic header */
+    nSize = packetSize[packet.m_headerType];
+    t = packet.m_nTimeStamp - last;
+    c = (packet.m_headerType << 6) | packet.m_nChannel;
+    cont = (char)0xc0 | c;
+
+    hptr = hbuf;
+    *hptr++ = c;
+    if (nSize > 1)
+        hptr = AMF_EncodeInt24(hptr, hend, t > 0xffffff ? 0xffffff : t);
+    if (nSize > 4)
+    {
+        hptr = AMF_EncodeInt24(hptr, hend, packet.m_nBodySize);
+        *hptr++ = packet.m_packetType;
+    }
+    if (nSize > 8)
+        hptr += EncodeInt32LE(hptr, packet.m_nInfoField2);
+    if (nSize > 1 && t >= 0xffffff)
+        hptr = AMF_EncodeInt32(hptr, hend, t);
+
+    /* the prefix always fits the first chunk, send it with the header */
+    memcpy(hptr, prefix, prefixSize);
+    hptr += prefixSize;
+
+    RTMP_Log(RTMP_LOGDEBUG2, "%s: fd=%d, size=%u", __FUNCTION__,
+             (int)r->m_sb.sb_socket, packet.m_nBodySize);
+
+    nChunkSize = r->m_outChunkSize;
+    nSize = nChunkSize - prefixSize;
+    if (nSize > size)
+        nSize = size;
+
+    iov[count].base = hbuf;
+    iov[count++].len = (int)(hptr - hbuf);
+    if (nSize > 0)
+    {
+        iov[count].base = data;
+        iov[count++].len = nSize;
+    }
+    offset = nSize;
+
+    while (offset < size)
+    {
+        if (count + 2 > RTMP_MAX_IOV)
+        {
+            if (!WriteV(r, iov, count))
+                return -1;
+            count = 0;
+        }
+
+        nSize = size - offset;
+        if (nSize > nChunkSize)
+            nSize = nChunkSize;
+
+        /* every continuation chunk shares the same type 3 header byte */
+        iov[count].base = &cont;
+        iov[count++].len = 1;
+        iov[count].base = data + offset;
+        iov[count++].len = nSize;
+        offset += nSize;
+    }
+
+    if (!WriteV(r, iov, count))
+        return -1;
+
+    if (!r->m_vecChannelsOut[packet.m_nChannel])
+        r->m_vecChannelsOut[packet.m_nChannel] = malloc(sizeof(RTMPPacket));
+    if (r->m_vecChannelsOut[packet.m_nChannel])
+        memcpy(r->m_vecChannelsOut[packet.m_nChannel], &packet, sizeof(RTMPPacket));
+    return (int)packet.m_nBodySize;
+}
@@ -110,6 +110,8 @@ extern "C"
 #define RTMP_PACKET_TYPE_FLASH_VIDEO        0x16
 
 #define RTMP_MAX_HEADER_SIZE 18
+/* most codec bytes RTMP_WriteMedia sends ahead of the payload */
+#define RTMP_MAX_PREFIX_SIZE 16
 
 #define RTMP_PACKET_SIZE_LARGE    0
 #define RTMP_PACKET_SIZE_MEDIUM   1
@@ -414,6 +416,9 @@ extern "C"
     void RTMP_DropRequest(RTMP *r, int i, int freeit);
     int RTMP_Read(RTMP *r, char *buf, int size);
     int RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx);
+    int RTMP_WriteMedia(RTMP *r, int packetType, uint32_t timestamp,
+                        const char *prefix, int prefixSize,
+                        const char *data, int size, int streamIdx);
 
     /* hashswf.c */
     int RTMP_HashSWF(const char *url, unsigned int *size, unsigned char *hash,
@@ -14,16 +14,23 @@ MODULE_EXPORT const char *obs_module_description(void)
 }
 
 extern struct obs_output_info rtmp_output_info;
+extern struct obs_output_info rtmp_multi_output_info;
 extern struct obs_output_info null_output_info;
 extern struct obs_output_info flv_output_info;
 extern struct obs_output_info janus_output_info;
 extern struct obs_output_info wowza_output_info;
 extern struct obs_output_info millicast_output_info;
 extern struct obs_output_info evercast_output_info;
+extern struct obs_output_info janus_encoded_output_info;
+extern struct obs_output_info wowza_encoded_output_info;
+extern struct obs_output_info millicast_encoded_output_info;
+extern struct obs_output_info evercast_encoded_output_info;
 #if COMPILE_FTL
 extern struct obs_output_info ftl_output_info;
 #endif
 
+extern void webrtc_context_shutdown(void);
+
 bool obs_module_load(void)
 {
 #ifdef _WIN32
@@ -32,12 +39,17 @@ bool obs_module_load(void)
 #endif
 
 	obs_register_output(&rtmp_output_info);
+	obs_register_output(&rtmp_multi_output_info);
 	obs_register_output(&null_output_info);
 	obs_register_output(&flv_output_info);
 	obs_register_output(&janus_output_info);
 	obs_register_output(&wowza_output_info);
 	obs_register_output(&millicast_output_info);
 	obs_register_output(&evercast_output_info);
+	obs_register_output(&janus_encoded_output_info);
+	obs_register_output(&wowza_encoded_output_info);
+	obs_register_output(&millicast_encoded_output_info);
+	obs_register_output(&evercast_encoded_output_info);
 #if COMPILE_FTL
 	obs_register_output(&ftl_output_info);
 #endif
@@ -46,6 +58,8 @@ bool obs_module_load(void)
 
 void obs_module_unload(void)
 {
+	webrtc_context_shutdown();
+
 #ifdef _WIN32
 	WSACleanup();
 #endif
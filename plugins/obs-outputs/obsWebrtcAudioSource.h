@@ -7,6 +7,8 @@
 // lib obs include
 #include "media-io/audio-io.h"
 
+#include "AudioFramer.h"
+
 // webrtc includes
 #include "api/scoped_refptr.h"
 #include "api/notifier.h"
@@ -38,8 +40,7 @@ public:
 
 protected:
         audio_t *audio_;
-        uint16_t pending_remainder;
-        uint8_t *pending;
+        AudioFramer framer;
 
         // webrtc
         cricket::AudioOptions options_;
@@ -0,0 +1,118 @@
+#include "rtmp-dbr.h"
+
+#define MIN_ESTIMATE_DURATION_MS 1000
+#define MAX_ESTIMATE_DURATION_MS 2000
+
+void dbr_reset(struct dbr *dbr, long orig_bitrate, long audio_bitrate)
+{
+	circlebuf_free(&dbr->frames);
+	dbr->data_size = 0;
+	dbr->inc_timeout = 0;
+	dbr->inc_timer_ns = DBR_INC_TIMER;
+	dbr->audio_bitrate = audio_bitrate;
+	dbr->est_bitrate = 0;
+	dbr->orig_bitrate = orig_bitrate;
+	dbr->prev_bitrate = 0;
+	dbr->cur_bitrate = orig_bitrate;
+	dbr->inc_bitrate = orig_bitrate / 10;
+}
+
+void dbr_free(struct dbr *dbr)
+{
+	circlebuf_free(&dbr->frames);
+}
+
+/* Keeps a sliding window of the packets sent over the last couple of
+ * seconds to estimate the video bitrate the connection actually sustains */
+void dbr_add_frame(struct dbr *dbr, const struct dbr_frame *back)
+{
+	struct dbr_frame front;
+	uint64_t dur;
+
+	circlebuf_push_back(&dbr->frames, back, sizeof(*back));
+	circlebuf_peek_front(&dbr->frames, &front, sizeof(front));
+
+	dbr->data_size += back->size;
+
+	dur = (back->send_end - front.send_beg) / 1000000;
+
+	if (dur >= MAX_ESTIMATE_DURATION_MS) {
+		dbr->data_size -= front.size;
+		circlebuf_pop_front(&dbr->frames, NULL, sizeof(front));
+	}
+
+	if (dur >= MIN_ESTIMATE_DURATION_MS) {
+		/* bytes per ms to kbps */
+		dbr->est_bitrate = (long)(dbr->data_size * 8 / dur);
+		dbr->est_bitrate -= dbr->audio_bitrate;
+		if (dbr->est_bitrate < 50)
+			dbr->est_bitrate = 50;
+	} else {
+		dbr->est_bitrate = 0;
+	}
+}
+
+/* Lowers the bitrate to what the connection was measured to sustain, or
+ * back to the previous step if it was just raised */
+static bool dbr_bitrate_lowered(struct dbr *dbr, uint64_t now_ns)
+{
+	long prev_bitrate = dbr->prev_bitrate;
+	long est_bitrate = 0;
+	long new_bitrate;
+
+	if (dbr->est_bitrate && dbr->est_bitrate < dbr->cur_bitrate) {
+		dbr->data_size = 0;
+		circlebuf_pop_front(&dbr->frames, NULL, dbr->frames.size);
+		est_bitrate = dbr->est_bitrate / 100 * 100;
+		if (est_bitrate < 50)
+			est_bitrate = 50;
+	}
+
+	if (est_bitrate)
+		new_bitrate = est_bitrate;
+	else if (prev_bitrate)
+		new_bitrate = prev_bitrate;
+	else
+		return false;
+
+	if (new_bitrate == dbr->cur_bitrate)
+		return false;
+
+	dbr->prev_bitrate = 0;
+	dbr->cur_bitrate = new_bitrate;
+	dbr->inc_timeout = now_ns + dbr->inc_timer_ns;
+	return true;
+}
+
+/* Steps the bitrate back up by a tenth of the original bitrate, remembering
+ * the previous step to fall back to if the connection can't take it */
+static void dbr_inc_bitrate(struct dbr *dbr, uint64_t now_ns)
+{
+	dbr->prev_bitrate = dbr->cur_bitrate;
+	dbr->cur_bitrate += dbr->inc_bitrate;
+
+	if (dbr->cur_bitrate >= dbr->orig_bitrate) {
+		dbr->cur_bitrate = dbr->orig_bitrate;
+		dbr->inc_timeout = 0;
+	} else {
+		dbr->inc_timeout = now_ns + dbr->inc_timer_ns;
+	}
+}
+
+/* Lowers the bitrate as soon as packets pile up, well before frames would
+ * be dropped, and raises it again one step at a time once the buffer stayed
+ * below the trigger for inc_timer_ns */
+enum dbr_change dbr_update(struct dbr *dbr, int64_t buffer_duration_usec,
+			   uint64_t now_ns)
+{
+	if (buffer_duration_usec >= (int64_t)DBR_TRIGGER_USEC) {
+		if (dbr_bitrate_lowered(dbr, now_ns))
+			return DBR_DECREASED;
+
+	} else if (dbr->inc_timeout && now_ns >= dbr->inc_timeout) {
+		dbr_inc_bitrate(dbr, now_ns);
+		return DBR_INCREASED;
+	}
+
+	return DBR_UNCHANGED;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <util/circlebuf.h>
+
+/* buffered duration at which the bitrate is lowered */
+#define DBR_TRIGGER_USEC (200ULL * 1000ULL)
+/* time without congestion before stepping the bitrate back up */
+#define DBR_INC_TIMER (30ULL * 1000000000ULL)
+
+struct dbr_frame {
+	uint64_t send_beg;
+	uint64_t send_end;
+	size_t size;
+};
+
+enum dbr_change {
+	DBR_UNCHANGED,
+	DBR_DECREASED,
+	DBR_INCREASED,
+};
+
+/* Dynamic bitrate controller of the RTMP output, all bitrates in kbps.  It
+ * estimates the video bitrate the connection sustains from the packets
+ * sent, lowers the bitrate when packets pile up and steps it back up once
+ * they stopped to.  Not thread safe. */
+struct dbr {
+	struct circlebuf frames;
+	size_t data_size;
+	uint64_t inc_timeout;
+	uint64_t inc_timer_ns;
+	long audio_bitrate;
+	long est_bitrate;
+	long orig_bitrate;
+	long prev_bitrate;
+	long cur_bitrate;
+	long inc_bitrate;
+};
+
+extern void dbr_reset(struct dbr *dbr, long orig_bitrate, long audio_bitrate);
+extern void dbr_free(struct dbr *dbr);
+
+/* Adds a packet once it was sent */
+extern void dbr_add_frame(struct dbr *dbr, const struct dbr_frame *frame);
+
+/* Checks the duration of the packets still waiting to be sent, cur_bitrate
+ * holds the new bitrate when it changed */
+extern enum dbr_change dbr_update(struct dbr *dbr,
+				  int64_t buffer_duration_usec,
+				  uint64_t now_ns);
@@ -0,0 +1,352 @@
+#ifdef __linux__
+#include "rtmp-stream.h"
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+static void fatal_sock_shutdown(struct rtmp_stream *stream)
+{
+	close(stream->rtmp.m_sb.sb_socket);
+	stream->rtmp.m_sb.sb_socket = -1;
+	stream->write_buf_len = 0;
+	os_event_signal(stream->buffer_space_available_event);
+}
+
+static bool socket_event(struct rtmp_stream *stream, uint32_t events,
+			 bool *can_write, uint64_t last_send_time)
+{
+	if (events & EPOLLOUT)
+		*can_write = true;
+
+	if (events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+		int err_code = 0;
+		socklen_t size = sizeof(err_code);
+
+		getsockopt(stream->rtmp.m_sb.sb_socket, SOL_SOCKET, SO_ERROR,
+			   &err_code, &size);
+
+		if (last_send_time) {
+			uint32_t diff =
+				(os_gettime_ns() / 1000000) - last_send_time;
+
+			blog(LOG_ERROR,
+			     "socket_thread_linux: Socket closed, "
+			     "%u ms since last send (buffer: %d / %d)",
+			     diff, (int)stream->write_buf_len,
+			     (int)stream->write_buf_size);
+		}
+
+		if (os_event_try(stream->stop_event) != EAGAIN)
+			blog(LOG_ERROR,
+			     "socket_thread_linux: Aborting due "
+			     "to socket close during shutdown, "
+			     "%d bytes lost, error %d",
+			     (int)stream->write_buf_len, err_code);
+		else
+			blog(LOG_ERROR,
+			     "socket_thread_linux: Aborting due "
+			     "to socket close, error %d",
+			     err_code);
+
+		stream->rtmp.last_error_code = err_code;
+		fatal_sock_shutdown(stream);
+		return false;
+	}
+
+	if (events & EPOLLIN) {
+		char discard[16384];
+
+		/* edge triggered, so read until the socket is drained */
+		for (;;) {
+			ssize_t ret = recv(stream->rtmp.m_sb.sb_socket,
+					   discard, sizeof(discard), 0);
+			int err_code = 0;
+
+			if (ret > 0)
+				continue;
+
+			if (ret == -1) {
+				err_code = errno;
+				if (err_code == EAGAIN ||
+				    err_code == EWOULDBLOCK)
+					break;
+				if (err_code == EINTR)
+					continue;
+			}
+
+			blog(LOG_ERROR,
+			     "socket_thread_linux: "
+			     "Socket error, recv() returned "
+			     "%d, errno %d",
+			     (int)ret, err_code);
+			stream->rtmp.last_error_code = err_code;
+			fatal_sock_shutdown(stream);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void tcp_info_event(struct rtmp_stream *stream)
+{
+	struct tcp_info tcp_info;
+	socklen_t size = sizeof(tcp_info);
+
+	if (getsockopt(stream->rtmp.m_sb.sb_socket, IPPROTO_TCP, TCP_INFO,
+		       &tcp_info, &size) != 0)
+		return;
+
+	stream->tcp_rtt_ms = tcp_info.tcpi_rtt / 1000;
+	stream->tcp_cwnd = tcp_info.tcpi_snd_cwnd;
+	stream->tcp_retransmits = tcp_info.tcpi_total_retrans;
+
+	/* only data the kernel could not send yet is backlog, bytes in
+	 * flight are bounded by the congestion window and drain on their
+	 * own */
+	int unsent = 0;
+	if (ioctl(stream->rtmp.m_sb.sb_socket, SIOCOUTQNSD, &unsent) != 0)
+		unsent = 0;
+	os_atomic_set_long(&stream->tcp_unsent_bytes, (long)unsent);
+}
+
+enum data_ret { RET_BREAK, RET_FATAL, RET_CONTINUE };
+
+static enum data_ret write_data(struct rtmp_stream *stream, bool *can_write,
+				uint64_t *last_send_time,
+				size_t latency_packet_size, int delay_time)
+{
+	bool exit_loop = false;
+
+	pthread_mutex_lock(&stream->write_buf_mutex);
+
+	if (!stream->write_buf_len) {
+		/* the buffer may have been emptied in a previous cycle */
+		pthread_mutex_unlock(&stream->write_buf_mutex);
+		return RET_BREAK;
+	}
+
+	int ret;
+	if (stream->low_latency_mode) {
+		size_t send_len = latency_packet_size < stream->write_buf_len
+					  ? latency_packet_size
+					  : stream->write_buf_len;
+
+		ret = RTMPSockBuf_Send(&stream->rtmp.m_sb,
+				       (const char *)stream->write_buf,
+				       (int)send_len);
+	} else {
+		ret = RTMPSockBuf_Send(&stream->rtmp.m_sb,
+				       (const char *)stream->write_buf,
+				       (int)stream->write_buf_len);
+	}
+
+	if (ret > 0) {
+		if (stream->write_buf_len - ret)
+			memmove(stream->write_buf, stream->write_buf + ret,
+				stream->write_buf_len - ret);
+		stream->write_buf_len -= ret;
+
+		*last_send_time = os_gettime_ns() / 1000000;
+
+		os_event_signal(stream->buffer_space_available_event);
+	} else {
+		int err_code = 0;
+
+		if (ret == -1) {
+			err_code = errno;
+
+			if (err_code == EAGAIN || err_code == EWOULDBLOCK) {
+				*can_write = false;
+				pthread_mutex_unlock(&stream->write_buf_mutex);
+				return RET_BREAK;
+			}
+
+			if (err_code == EINTR) {
+				pthread_mutex_unlock(&stream->write_buf_mutex);
+				return RET_CONTINUE;
+			}
+		}
+
+		/* connection closed, or connection was aborted /
+		 * socket closed / etc, that's a fatal error. */
+		blog(LOG_ERROR,
+		     "socket_thread_linux: "
+		     "Socket error, send() returned %d, errno %d",
+		     ret, err_code);
+
+		pthread_mutex_unlock(&stream->write_buf_mutex);
+		stream->rtmp.last_error_code = err_code;
+		fatal_sock_shutdown(stream);
+		return RET_FATAL;
+	}
+
+	/* finish writing for now */
+	if (stream->write_buf_len <= 1000)
+		exit_loop = true;
+
+	pthread_mutex_unlock(&stream->write_buf_mutex);
+
+	if (delay_time)
+		os_sleep_ms(delay_time);
+
+	return exit_loop ? RET_BREAK : RET_CONTINUE;
+}
+
+#define LATENCY_FACTOR 20
+#define TCP_INFO_INTERVAL_MS 250
+
+static inline void socket_thread_linux_internal(struct rtmp_stream *stream)
+{
+	bool can_write = false;
+
+	int delay_time;
+	size_t latency_packet_size;
+	uint64_t last_send_time = 0;
+	uint64_t last_tcp_info_time = 0;
+
+	struct epoll_event ev;
+	struct epoll_event events[2];
+	int epoll_fd;
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd == -1) {
+		blog(LOG_ERROR,
+		     "socket_thread_linux: Aborting due "
+		     "to epoll_create1 failure, %d",
+		     errno);
+		fatal_sock_shutdown(stream);
+		return;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+	ev.data.fd = stream->rtmp.m_sb.sb_socket;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev) == -1)
+		goto epoll_fail;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = stream->socket_wake_fd;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev) == -1)
+		goto epoll_fail;
+
+	if (stream->low_latency_mode) {
+		delay_time = 1000 / LATENCY_FACTOR;
+		latency_packet_size =
+			stream->write_buf_size / (LATENCY_FACTOR - 2);
+	} else {
+		latency_packet_size = stream->write_buf_size;
+		delay_time = 0;
+	}
+
+	for (;;) {
+		if (os_event_try(stream->send_thread_signaled_exit) != EAGAIN) {
+			pthread_mutex_lock(&stream->write_buf_mutex);
+			if (stream->write_buf_len == 0) {
+				pthread_mutex_unlock(&stream->write_buf_mutex);
+				os_event_reset(
+					stream->send_thread_signaled_exit);
+				break;
+			}
+
+			pthread_mutex_unlock(&stream->write_buf_mutex);
+		}
+
+		int count = epoll_wait(epoll_fd, events, 2,
+				       TCP_INFO_INTERVAL_MS);
+		if (count == -1) {
+			if (errno == EINTR)
+				continue;
+
+			blog(LOG_ERROR,
+			     "socket_thread_linux: Aborting due "
+			     "to epoll_wait failure, %d",
+			     errno);
+			fatal_sock_shutdown(stream);
+			goto exit;
+		}
+
+		for (int i = 0; i < count; i++) {
+			if (events[i].data.fd == stream->socket_wake_fd) {
+				/* Buffer has data (or exit) */
+				uint64_t value;
+				if (read(stream->socket_wake_fd, &value,
+					 sizeof(value)) < 0 &&
+				    errno != EAGAIN)
+					blog(LOG_WARNING,
+					     "socket_thread_linux: "
+					     "Failed to reset wake event, "
+					     "%d",
+					     errno);
+
+			} else if (!socket_event(stream, events[i].events,
+						 &can_write, last_send_time)) {
+				goto exit;
+			}
+		}
+
+		uint64_t now = os_gettime_ns() / 1000000;
+		if (now - last_tcp_info_time >= TCP_INFO_INTERVAL_MS) {
+			tcp_info_event(stream);
+			last_tcp_info_time = now;
+		}
+
+		if (can_write) {
+			for (;;) {
+				enum data_ret ret = write_data(
+					stream, &can_write, &last_send_time,
+					latency_packet_size, delay_time);
+
+				switch (ret) {
+				case RET_BREAK:
+					goto exit_write_loop;
+				case RET_FATAL:
+					goto exit;
+				case RET_CONTINUE:;
+				}
+			}
+		}
+	exit_write_loop:;
+	}
+
+	blog(LOG_INFO,
+	     "socket_thread_linux: Normal exit (rtt: %u ms, cwnd: %u, "
+	     "retransmits: %u)",
+	     stream->tcp_rtt_ms, stream->tcp_cwnd, stream->tcp_retransmits);
+
+exit:
+	close(epoll_fd);
+	return;
+
+epoll_fail:
+	blog(LOG_ERROR,
+	     "socket_thread_linux: Aborting due "
+	     "to epoll_ctl failure, %d",
+	     errno);
+	close(epoll_fd);
+	fatal_sock_shutdown(stream);
+}
+
+void socket_thread_linux_wake(struct rtmp_stream *stream)
+{
+	uint64_t value = 1;
+
+	if (write(stream->socket_wake_fd, &value, sizeof(value)) < 0 &&
+	    errno != EAGAIN)
+		blog(LOG_WARNING,
+		     "socket_thread_linux: Failed to signal wake event, %d",
+		     errno);
+}
+
+void *socket_thread_linux(void *data)
+{
+	struct rtmp_stream *stream = data;
+	os_set_thread_name("rtmp-stream: socket_thread_linux");
+	socket_thread_linux_internal(stream);
+	return NULL;
+}
+#endif
@@ -0,0 +1,658 @@
+#include "rtmp-stream.h"
+
+/*
+ * Streams the same encoders to several RTMP servers.  Each destination is a
+ * regular rtmp_stream with its own send thread, frame dropping and
+ * connection, but the output is only interleaved once and video packets are
+ * only parsed once: every destination queues a reference to the same packet
+ * and sends the payload straight from it.
+ */
+
+#undef do_log
+#define do_log(level, format, ...)                \
+	blog(level, "[rtmp multi: '%s'] " format, \
+	     obs_output_get_name(multi->output), ##__VA_ARGS__)
+
+#define OPT_DESTINATIONS "destinations"
+#define OPT_RECONNECT_DELAY_SEC "reconnect_delay_sec"
+
+/* per destination, along with the optional drop thresholds and bind ip */
+#define DEST_SERVER "server"
+#define DEST_KEY "key"
+#define DEST_USERNAME "username"
+#define DEST_PASSWORD "password"
+
+#define RECONNECT_POLL_MS 250
+
+struct rtmp_multi;
+
+struct rtmp_dest {
+	struct rtmp_multi *multi;
+	struct rtmp_stream *stream;
+	size_t idx;
+
+	/* connecting or connected */
+	volatile bool running;
+	/* sending, packets are queued to it */
+	volatile bool started;
+	volatile bool need_keyframe;
+
+	uint64_t retry_ts;
+	int attempts;
+	volatile long last_code;
+};
+
+struct rtmp_multi {
+	obs_output_t *output;
+
+	/* the stats getters run on the UI thread while start rebuilds the
+	 * list, it only changes with this held */
+	pthread_mutex_t dests_mutex;
+	DARRAY(struct rtmp_dest *) dests;
+
+	pthread_t reconnect_thread;
+	bool reconnect_thread_active;
+	os_event_t *stop_event;
+	uint64_t reconnect_delay_ns;
+
+	volatile bool stopping;
+	volatile bool capturing;
+	volatile bool finished;
+	volatile bool encode_error;
+	volatile long active_dests;
+};
+
+static const char *rtmp_multi_getname(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("RTMPMulti");
+}
+
+static void stop_reconnect_thread(struct rtmp_multi *multi)
+{
+	if (!multi->reconnect_thread_active)
+		return;
+
+	os_event_signal(multi->stop_event);
+	pthread_join(multi->reconnect_thread, NULL);
+	multi->reconnect_thread_active = false;
+}
+
+/* every destination is stopped and its threads joined before any is freed,
+ * a stopping destination still reads the others */
+static void free_dests(struct rtmp_multi *multi)
+{
+	DARRAY(struct rtmp_dest *) dests;
+
+	for (size_t i = 0; i < multi->dests.num; i++)
+		rtmp_stream_stop(multi->dests.array[i]->stream, 0);
+
+	/* not under dests_mutex, the stopping threads read the list */
+	for (size_t i = 0; i < multi->dests.num; i++)
+		rtmp_stream_join_threads(multi->dests.array[i]->stream);
+
+	da_init(dests);
+	pthread_mutex_lock(&multi->dests_mutex);
+	da_move(dests, multi->dests);
+	pthread_mutex_unlock(&multi->dests_mutex);
+
+	for (size_t i = 0; i < dests.num; i++) {
+		struct rtmp_dest *dest = dests.array[i];
+		rtmp_stream_destroy(dest->stream);
+		bfree(dest);
+	}
+
+	da_free(dests);
+}
+
+/* the output as a whole is done once every destination is */
+static void finish(struct rtmp_multi *multi, int code)
+{
+	if (os_atomic_set_bool(&multi->finished, true))
+		return;
+
+	if (code == OBS_OUTPUT_SUCCESS &&
+	    os_atomic_load_bool(&multi->encode_error))
+		code = OBS_OUTPUT_ENCODE_ERROR;
+
+	if (code != OBS_OUTPUT_SUCCESS)
+		obs_output_signal_stop(multi->output, code);
+	else if (os_atomic_load_bool(&multi->capturing))
+		obs_output_end_data_capture(multi->output);
+	else
+		obs_output_signal_stop(multi->output, OBS_OUTPUT_SUCCESS);
+}
+
+static inline bool ending(struct rtmp_multi *multi)
+{
+	return os_atomic_load_bool(&multi->stopping) ||
+	       os_atomic_load_bool(&multi->encode_error);
+}
+
+void rtmp_multi_dest_started(struct rtmp_dest *dest)
+{
+	struct rtmp_multi *multi = dest->multi;
+
+	os_atomic_inc_long(&multi->active_dests);
+	os_atomic_set_bool(&dest->need_keyframe, true);
+	os_atomic_set_bool(&dest->started, true);
+
+	info("Destination %d connected", (int)dest->idx);
+
+	if (os_atomic_load_bool(&multi->encode_error)) {
+		rtmp_stream_data(dest->stream, NULL);
+		return;
+	}
+
+	if (!os_atomic_load_bool(&multi->stopping) &&
+	    !os_atomic_set_bool(&multi->capturing, true))
+		obs_output_begin_data_capture(multi->output, 0);
+}
+
+/* true if no destination could be connected to at all */
+static bool all_failed(struct rtmp_multi *multi)
+{
+	if (os_atomic_load_bool(&multi->capturing))
+		return false;
+
+	for (size_t i = 0; i < multi->dests.num; i++) {
+		struct rtmp_dest *dest = multi->dests.array[i];
+		if (!dest->attempts || os_atomic_load_bool(&dest->running))
+			return false;
+	}
+
+	return true;
+}
+
+void rtmp_multi_dest_stopped(struct rtmp_dest *dest, int code)
+{
+	struct rtmp_multi *multi = dest->multi;
+	struct rtmp_stream *stream = dest->stream;
+	bool was_started = os_atomic_set_bool(&dest->started, false);
+
+	os_atomic_set_long(&dest->last_code, code);
+
+	if (was_started)
+		info("Destination %d stopped (%d): %" PRIu64 " bytes sent, "
+		     "%d frames dropped",
+		     (int)dest->idx, code, stream->total_bytes_sent,
+		     stream->dropped_frames);
+
+	if (code != OBS_OUTPUT_SUCCESS && !ending(multi))
+		info("Destination %d will reconnect in %d second(s)",
+		     (int)dest->idx,
+		     (int)(multi->reconnect_delay_ns / 1000000000ULL));
+
+	dest->retry_ts = os_gettime_ns() + multi->reconnect_delay_ns;
+	os_atomic_set_bool(&dest->running, false);
+
+	if (was_started) {
+		if (os_atomic_dec_long(&multi->active_dests) == 0 &&
+		    ending(multi))
+			finish(multi, OBS_OUTPUT_SUCCESS);
+
+	} else if (code != OBS_OUTPUT_SUCCESS && !ending(multi) &&
+		   all_failed(multi)) {
+		warn("Could not connect to any destination");
+		os_atomic_set_bool(&multi->stopping, true);
+		os_event_signal(multi->stop_event);
+		finish(multi, code);
+	}
+}
+
+static void *reconnect_thread(void *data)
+{
+	struct rtmp_multi *multi = data;
+
+	os_set_thread_name("rtmp-multi: reconnect_thread");
+
+	do {
+		uint64_t now = os_gettime_ns();
+
+		if (ending(multi))
+			break;
+
+		for (size_t i = 0; i < multi->dests.num; i++) {
+			struct rtmp_dest *dest = multi->dests.array[i];
+
+			if (os_atomic_load_bool(&dest->running) ||
+			    now < dest->retry_ts)
+				continue;
+
+			/* running is cleared just before the threads of the
+			 * previous attempt exit */
+			rtmp_stream_join_threads(dest->stream);
+
+			if (dest->attempts)
+				info("Reconnecting destination %d", (int)i);
+
+			dest->attempts++;
+			os_atomic_set_bool(&dest->running, true);
+
+			if (!rtmp_stream_connect(dest->stream)) {
+				warn("Failed to create connect thread");
+				dest->retry_ts = now + multi->reconnect_delay_ns;
+				os_atomic_set_bool(&dest->running, false);
+			}
+		}
+	} while (os_event_timedwait(multi->stop_event, RECONNECT_POLL_MS) ==
+		 ETIMEDOUT);
+
+	return NULL;
+}
+
+static void get_destination_count(void *data, calldata_t *cd)
+{
+	struct rtmp_multi *multi = data;
+
+	pthread_mutex_lock(&multi->dests_mutex);
+	calldata_set_int(cd, "count", (long long)multi->dests.num);
+	pthread_mutex_unlock(&multi->dests_mutex);
+}
+
+static void get_destination_stats(void *data, calldata_t *cd)
+{
+	struct rtmp_multi *multi = data;
+	size_t idx = (size_t)calldata_int(cd, "index");
+	struct rtmp_dest *dest;
+	struct rtmp_stream *stream;
+
+	pthread_mutex_lock(&multi->dests_mutex);
+
+	if (idx >= multi->dests.num) {
+		pthread_mutex_unlock(&multi->dests_mutex);
+		return;
+	}
+
+	dest = multi->dests.array[idx];
+	stream = dest->stream;
+
+	calldata_set_string(cd, "server", stream->path.array);
+	calldata_set_bool(cd, "connected",
+			  os_atomic_load_bool(&dest->started));
+	calldata_set_int(cd, "total_bytes",
+			 (long long)rtmp_stream_total_bytes_sent(stream));
+	calldata_set_int(cd, "dropped_frames",
+			 rtmp_stream_dropped_frames(stream));
+	calldata_set_float(cd, "congestion", rtmp_stream_congestion(stream));
+	calldata_set_int(cd, "connect_time_ms",
+			 rtmp_stream_connect_time(stream));
+	calldata_set_int(cd, "reconnects",
+			 dest->attempts ? dest->attempts - 1 : 0);
+	calldata_set_int(cd, "last_code",
+			 os_atomic_load_long(&dest->last_code));
+
+	pthread_mutex_unlock(&multi->dests_mutex);
+}
+
+static void rtmp_multi_destroy(void *data)
+{
+	struct rtmp_multi *multi = data;
+
+	os_atomic_set_bool(&multi->stopping, true);
+	stop_reconnect_thread(multi);
+	free_dests(multi);
+
+	if (os_atomic_load_bool(&multi->capturing) &&
+	    !os_atomic_set_bool(&multi->finished, true))
+		obs_output_end_data_capture(multi->output);
+
+	RTMP_TLS_Free();
+	os_event_destroy(multi->stop_event);
+	pthread_mutex_destroy(&multi->dests_mutex);
+	bfree(multi);
+}
+
+static void *rtmp_multi_create(obs_data_t *settings, obs_output_t *output)
+{
+	struct rtmp_multi *multi = bzalloc(sizeof(struct rtmp_multi));
+	proc_handler_t *ph = obs_output_get_proc_handler(output);
+
+	multi->output = output;
+	pthread_mutex_init_value(&multi->dests_mutex);
+
+	if (pthread_mutex_init(&multi->dests_mutex, NULL) != 0) {
+		bfree(multi);
+		return NULL;
+	}
+	if (os_event_init(&multi->stop_event, OS_EVENT_TYPE_MANUAL) != 0) {
+		pthread_mutex_destroy(&multi->dests_mutex);
+		bfree(multi);
+		return NULL;
+	}
+
+	proc_handler_add(ph, "void get_destination_count(out int count)",
+			 get_destination_count, multi);
+	proc_handler_add(ph,
+			 "void get_destination_stats(in int index, "
+			 "out string server, out bool connected, "
+			 "out int total_bytes, out int dropped_frames, "
+			 "out float congestion, out int connect_time_ms, "
+			 "out int reconnects, out int last_code)",
+			 get_destination_stats, multi);
+
+	UNUSED_PARAMETER(settings);
+	return multi;
+}
+
+static inline int64_t get_threshold(obs_data_t *item, obs_data_t *settings,
+				    const char *name)
+{
+	int64_t val = obs_data_get_int(item, name);
+	return val ? val : obs_data_get_int(settings, name);
+}
+
+static bool add_dest(struct rtmp_multi *multi, obs_data_t *settings,
+		     obs_data_t *item)
+{
+	const char *server = obs_data_get_string(item, DEST_SERVER);
+	const char *bind_ip = obs_data_get_string(item, OPT_BIND_IP);
+	struct rtmp_stream *stream;
+	struct rtmp_dest *dest;
+	int64_t drop_b;
+	int64_t drop_p;
+
+	if (!*server) {
+		warn("Destination %d has no server, skipping",
+		     (int)multi->dests.num);
+		return false;
+	}
+
+	stream = rtmp_stream_create(NULL, multi->output);
+	if (!stream)
+		return false;
+
+	dest = bzalloc(sizeof(struct rtmp_dest));
+	dest->multi = multi;
+	dest->stream = stream;
+	dest->idx = multi->dests.num;
+	stream->dest = dest;
+
+	dstr_copy(&stream->path, server);
+	dstr_copy(&stream->key, obs_data_get_string(item, DEST_KEY));
+	dstr_copy(&stream->username, obs_data_get_string(item, DEST_USERNAME));
+	dstr_copy(&stream->password, obs_data_get_string(item, DEST_PASSWORD));
+	dstr_depad(&stream->path);
+	dstr_depad(&stream->key);
+
+	if (!*bind_ip)
+		bind_ip = obs_data_get_string(settings, OPT_BIND_IP);
+	dstr_copy(&stream->bind_ip, bind_ip);
+
+	drop_b = get_threshold(item, settings, OPT_DROP_THRESHOLD);
+	drop_p = get_threshold(item, settings, OPT_PFRAME_DROP_THRESHOLD);
+	if (drop_p < (drop_b + 200))
+		drop_p = drop_b + 200;
+
+	stream->drop_threshold_usec = 1000 * drop_b;
+	stream->pframe_drop_threshold_usec = 1000 * drop_p;
+	stream->max_shutdown_time_sec =
+		(int)obs_data_get_int(settings, OPT_MAX_SHUTDOWN_TIME_SEC);
+	stream->new_socket_loop =
+		obs_data_get_bool(settings, OPT_NEWSOCKETLOOP_ENABLED);
+	stream->low_latency_mode =
+		obs_data_get_bool(settings, OPT_LOWLATENCY_ENABLED);
+
+	/* the encoder is shared, so is its bitrate: no dynamic bitrate */
+	stream->dbr_enabled = false;
+
+	pthread_mutex_lock(&multi->dests_mutex);
+	da_push_back(multi->dests, &dest);
+	pthread_mutex_unlock(&multi->dests_mutex);
+	return true;
+}
+
+static bool create_dests(struct rtmp_multi *multi, obs_data_t *settings)
+{
+	obs_data_array_t *array = obs_data_get_array(settings, OPT_DESTINATIONS);
+	size_t count = obs_data_array_count(array);
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *item = obs_data_array_item(array, i);
+		add_dest(multi, settings, item);
+		obs_data_release(item);
+	}
+
+	obs_data_array_release(array);
+	return multi->dests.num > 0;
+}
+
+static bool rtmp_multi_start(void *data)
+{
+	struct rtmp_multi *multi = data;
+	obs_data_t *settings;
+	bool success;
+
+	if (!obs_output_can_begin_data_capture(multi->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(multi->output, 0))
+		return false;
+
+	/* from the previous run, all stopped by now */
+	stop_reconnect_thread(multi);
+	free_dests(multi);
+
+	settings = obs_output_get_settings(multi->output);
+	success = create_dests(multi, settings);
+	multi->reconnect_delay_ns =
+		(uint64_t)obs_data_get_int(settings, OPT_RECONNECT_DELAY_SEC) *
+		1000000000ULL;
+	obs_data_release(settings);
+
+	if (!success) {
+		warn("No destinations to stream to");
+		return false;
+	}
+
+	os_atomic_set_bool(&multi->stopping, false);
+	os_atomic_set_bool(&multi->capturing, false);
+	os_atomic_set_bool(&multi->finished, false);
+	os_atomic_set_bool(&multi->encode_error, false);
+	os_atomic_set_long(&multi->active_dests, 0);
+	os_event_reset(multi->stop_event);
+
+	info("Streaming to %d destinations", (int)multi->dests.num);
+
+	if (pthread_create(&multi->reconnect_thread, NULL, reconnect_thread,
+			   multi) != 0) {
+		warn("Failed to create reconnect thread");
+		return false;
+	}
+
+	multi->reconnect_thread_active = true;
+	return true;
+}
+
+static void rtmp_multi_stop(void *data, uint64_t ts)
+{
+	struct rtmp_multi *multi = data;
+
+	os_atomic_set_bool(&multi->stopping, true);
+	stop_reconnect_thread(multi);
+
+	for (size_t i = 0; i < multi->dests.num; i++)
+		rtmp_stream_stop(multi->dests.array[i]->stream, ts);
+
+	if (os_atomic_load_long(&multi->active_dests) == 0)
+		finish(multi, OBS_OUTPUT_SUCCESS);
+}
+
+static void rtmp_multi_data(void *data, struct encoder_packet *packet)
+{
+	struct rtmp_multi *multi = data;
+	struct encoder_packet parsed;
+
+	/* encoder fail */
+	if (!packet) {
+		os_atomic_set_bool(&multi->encode_error, true);
+		for (size_t i = 0; i < multi->dests.num; i++) {
+			struct rtmp_dest *dest = multi->dests.array[i];
+			if (os_atomic_load_bool(&dest->started))
+				rtmp_stream_data(dest->stream, NULL);
+		}
+
+		/* nothing left to wait for */
+		if (os_atomic_load_long(&multi->active_dests) == 0)
+			finish(multi, OBS_OUTPUT_ENCODE_ERROR);
+		return;
+	}
+
+	if (packet->type == OBS_ENCODER_VIDEO)
+		obs_parse_avc_packet(&parsed, packet);
+	else
+		obs_encoder_packet_ref(&parsed, packet);
+
+	for (size_t i = 0; i < multi->dests.num; i++) {
+		struct rtmp_dest *dest = multi->dests.array[i];
+		struct encoder_packet ref;
+
+		if (!os_atomic_load_bool(&dest->started))
+			continue;
+
+		/* a destination that just (re)connected starts on a
+		 * keyframe */
+		if (os_atomic_load_bool(&dest->need_keyframe)) {
+			if (parsed.type != OBS_ENCODER_VIDEO || !parsed.keyframe)
+				continue;
+			os_atomic_set_bool(&dest->need_keyframe, false);
+		}
+
+		obs_encoder_packet_ref(&ref, &parsed);
+		rtmp_stream_queue_packet(dest->stream, &ref);
+	}
+
+	obs_encoder_packet_release(&parsed);
+}
+
+static void rtmp_multi_defaults(obs_data_t *defaults)
+{
+	obs_data_set_default_int(defaults, OPT_DROP_THRESHOLD, 700);
+	obs_data_set_default_int(defaults, OPT_PFRAME_DROP_THRESHOLD, 900);
+	obs_data_set_default_int(defaults, OPT_MAX_SHUTDOWN_TIME_SEC, 30);
+	obs_data_set_default_string(defaults, OPT_BIND_IP, "default");
+	obs_data_set_default_bool(defaults, OPT_NEWSOCKETLOOP_ENABLED, false);
+	obs_data_set_default_bool(defaults, OPT_LOWLATENCY_ENABLED, false);
+	obs_data_set_default_int(defaults, OPT_RECONNECT_DELAY_SEC, 10);
+}
+
+static obs_properties_t *rtmp_multi_properties(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+
+	obs_properties_t *props = obs_properties_create();
+	struct netif_saddr_data addrs = {0};
+	obs_property_t *p;
+
+	obs_properties_add_int(props, OPT_DROP_THRESHOLD,
+			       obs_module_text("RTMPStream.DropThreshold"), 200,
+			       10000, 100);
+	obs_properties_add_int(props, OPT_RECONNECT_DELAY_SEC,
+			       obs_module_text("RTMPMulti.ReconnectDelay"), 1,
+			       60, 1);
+
+	p = obs_properties_add_list(props, OPT_BIND_IP,
+				    obs_module_text("RTMPStream.BindIP"),
+				    OBS_COMBO_TYPE_LIST,
+				    OBS_COMBO_FORMAT_STRING);
+
+	obs_property_list_add_string(p, obs_module_text("Default"), "default");
+
+	netif_get_addrs(&addrs);
+	for (size_t i = 0; i < addrs.addrs.num; i++) {
+		struct netif_saddr_item item = addrs.addrs.array[i];
+		obs_property_list_add_string(p, item.name, item.addr);
+	}
+	netif_saddr_data_free(&addrs);
+
+	obs_properties_add_bool(props, OPT_NEWSOCKETLOOP_ENABLED,
+				obs_module_text("RTMPStream.NewSocketLoop"));
+	obs_properties_add_bool(props, OPT_LOWLATENCY_ENABLED,
+				obs_module_text("RTMPStream.LowLatencyMode"));
+
+	return props;
+}
+
+static uint64_t rtmp_multi_total_bytes_sent(void *data)
+{
+	struct rtmp_multi *multi = data;
+	uint64_t total = 0;
+
+	pthread_mutex_lock(&multi->dests_mutex);
+	for (size_t i = 0; i < multi->dests.num; i++)
+		total += rtmp_stream_total_bytes_sent(
+			multi->dests.array[i]->stream);
+	pthread_mutex_unlock(&multi->dests_mutex);
+	return total;
+}
+
+static int rtmp_multi_dropped_frames(void *data)
+{
+	struct rtmp_multi *multi = data;
+	int dropped = 0;
+
+	pthread_mutex_lock(&multi->dests_mutex);
+	for (size_t i = 0; i < multi->dests.num; i++)
+		dropped += rtmp_stream_dropped_frames(
+			multi->dests.array[i]->stream);
+	pthread_mutex_unlock(&multi->dests_mutex);
+	return dropped;
+}
+
+/* the worst connected destination */
+static float rtmp_multi_congestion(void *data)
+{
+	struct rtmp_multi *multi = data;
+	float congestion = 0.0f;
+
+	pthread_mutex_lock(&multi->dests_mutex);
+	for (size_t i = 0; i < multi->dests.num; i++) {
+		struct rtmp_dest *dest = multi->dests.array[i];
+		float val;
+
+		if (!os_atomic_load_bool(&dest->started))
+			continue;
+
+		val = rtmp_stream_congestion(dest->stream);
+		if (val > congestion)
+			congestion = val;
+	}
+	pthread_mutex_unlock(&multi->dests_mutex);
+
+	return congestion;
+}
+
+static int rtmp_multi_connect_time(void *data)
+{
+	struct rtmp_multi *multi = data;
+	int connect_time = 0;
+
+	pthread_mutex_lock(&multi->dests_mutex);
+	for (size_t i = 0; i < multi->dests.num; i++) {
+		int val = rtmp_stream_connect_time(
+			multi->dests.array[i]->stream);
+		if (val > connect_time)
+			connect_time = val;
+	}
+	pthread_mutex_unlock(&multi->dests_mutex);
+
+	return connect_time;
+}
+
+struct obs_output_info rtmp_multi_output_info = {
+	.id = "rtmp_multi_output",
+	.flags = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED | OBS_OUTPUT_MULTI_TRACK,
+	.encoded_video_codecs = "h264",
+	.encoded_audio_codecs = "aac",
+	.get_name = rtmp_multi_getname,
+	.create = rtmp_multi_create,
+	.destroy = rtmp_multi_destroy,
+	.start = rtmp_multi_start,
+	.stop = rtmp_multi_stop,
+	.encoded_packet = rtmp_multi_data,
+	.get_defaults = rtmp_multi_defaults,
+	.get_properties = rtmp_multi_properties,
+	.get_total_bytes = rtmp_multi_total_bytes_sent,
+	.get_congestion = rtmp_multi_congestion,
+	.get_connect_time_ms = rtmp_multi_connect_time,
+	.get_dropped_frames = rtmp_multi_dropped_frames,
+};
@@ -71,11 +71,40 @@ static inline bool disconnected(struct rtmp_stream *stream)
 	return os_atomic_load_bool(&stream->disconnected);
 }
 
-static void rtmp_stream_destroy(void *data)
+static void join_connect_thread(struct rtmp_stream *stream)
+{
+	if (stream->dest) {
+		if (stream->connect_thread_active) {
+			pthread_join(stream->connect_thread, NULL);
+			stream->connect_thread_active = false;
+		}
+	} else if (connecting(stream)) {
+		pthread_join(stream->connect_thread, NULL);
+	}
+}
+
+/* for destinations only: waits for the threads of the last connection
+ * attempt, which have reported the stop to rtmp_multi by the time they
+ * exit.  doesn't stop them, see rtmp_stream_stop */
+void rtmp_stream_join_threads(struct rtmp_stream *stream)
+{
+	join_connect_thread(stream);
+
+	if (stream->send_thread_active) {
+		pthread_join(stream->send_thread, NULL);
+		stream->send_thread_active = false;
+	}
+}
+
+void rtmp_stream_destroy(void *data)
 {
 	struct rtmp_stream *stream = data;
 
-	if (stopping(stream) && !connecting(stream)) {
+	if (stream->dest) {
+		rtmp_stream_stop(stream, 0);
+		rtmp_stream_join_threads(stream);
+
+	} else if (stopping(stream) && !connecting(stream)) {
 		pthread_join(stream->send_thread, NULL);
 
 	} else if (connecting(stream) || active(stream)) {
@@ -87,12 +116,15 @@ static void rtmp_stream_destroy(void *data)
 
 		if (active(stream)) {
 			os_sem_post(stream->send_sem);
-			obs_output_end_data_capture(stream->output);
+			if (!stream->dest)
+				obs_output_end_data_capture(stream->output);
 			pthread_join(stream->send_thread, NULL);
 		}
 	}
 
-	RTMP_TLS_Free();
+	/* the TLS context is shared, rtmp_multi frees it once */
+	if (!stream->dest)
+		RTMP_TLS_Free();
 	free_packets(stream);
 	dstr_free(&stream->path);
 	dstr_free(&stream->key);
@@ -104,6 +136,8 @@ static void rtmp_stream_destroy(void *data)
 	os_sem_destroy(stream->send_sem);
 	pthread_mutex_destroy(&stream->packets_mutex);
 	circlebuf_free(&stream->packets);
+	pthread_mutex_destroy(&stream->dbr_mutex);
+	dbr_free(&stream->dbr);
 #ifdef TEST_FRAMEDROPS
 	circlebuf_free(&stream->droptest_info);
 #endif
@@ -113,17 +147,25 @@ static void rtmp_stream_destroy(void *data)
 	os_event_destroy(stream->socket_available_event);
 	os_event_destroy(stream->send_thread_signaled_exit);
 	pthread_mutex_destroy(&stream->write_buf_mutex);
+#ifdef __linux__
+	if (stream->socket_wake_fd != -1)
+		close(stream->socket_wake_fd);
+#endif
 
 	if (stream->write_buf)
 		bfree(stream->write_buf);
 	bfree(stream);
 }
 
-static void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
+void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
 {
 	struct rtmp_stream *stream = bzalloc(sizeof(struct rtmp_stream));
 	stream->output = output;
 	pthread_mutex_init_value(&stream->packets_mutex);
+	pthread_mutex_init_value(&stream->dbr_mutex);
+#ifdef __linux__
+	stream->socket_wake_fd = -1;
+#endif
 
 	RTMP_Init(&stream->rtmp);
 	RTMP_LogSetCallback(log_rtmp);
@@ -131,6 +173,8 @@ static void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
 
 	if (pthread_mutex_init(&stream->packets_mutex, NULL) != 0)
 		goto fail;
+	if (pthread_mutex_init(&stream->dbr_mutex, NULL) != 0)
+		goto fail;
 	if (os_event_init(&stream->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
 		goto fail;
 
@@ -159,6 +203,13 @@ static void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
 		warn("Failed to initialize socket exit event");
 		goto fail;
 	}
+#ifdef __linux__
+	stream->socket_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (stream->socket_wake_fd == -1) {
+		warn("Failed to initialize socket wake event");
+		goto fail;
+	}
+#endif
 
 	UNUSED_PARAMETER(settings);
 	return stream;
@@ -168,15 +219,14 @@ fail:
 	return NULL;
 }
 
-static void rtmp_stream_stop(void *data, uint64_t ts)
+void rtmp_stream_stop(void *data, uint64_t ts)
 {
 	struct rtmp_stream *stream = data;
 
 	if (stopping(stream) && ts != 0)
 		return;
 
-	if (connecting(stream))
-		pthread_join(stream->connect_thread, NULL);
+	join_connect_thread(stream);
 
 	stream->stop_ts = ts / 1000ULL;
 
@@ -189,7 +239,7 @@ static void rtmp_stream_stop(void *data, uint64_t ts)
 		os_event_signal(stream->stop_event);
 		if (stream->stop_ts == 0)
 			os_sem_post(stream->send_sem);
-	} else {
+	} else if (!stream->dest) {
 		obs_output_signal_stop(stream->output, OBS_OUTPUT_SUCCESS);
 	}
 }
@@ -326,6 +376,9 @@ retry_send:
 	pthread_mutex_unlock(&stream->write_buf_mutex);
 
 	os_event_signal(stream->buffer_has_data_event);
+#ifdef __linux__
+	socket_thread_linux_wake(stream);
+#endif
 
 	return len;
 }
@@ -334,8 +387,8 @@ static int send_packet(struct rtmp_stream *stream,
 		       struct encoder_packet *packet, bool is_header,
 		       size_t idx)
 {
-	uint8_t *data;
-	size_t size;
+	struct flv_tag tag;
+	size_t size = 0;
 	int recv_size = 0;
 	int ret = 0;
 
@@ -353,15 +406,24 @@ static int send_packet(struct rtmp_stream *stream,
 		}
 	}
 
-	flv_packet_mux(packet, is_header ? 0 : stream->start_dts_offset, &data,
-		       &size, is_header);
+	/* the payload goes out straight from the packet, only the FLV tag
+	 * fields are built here */
+	if (packet->data && packet->size) {
+		flv_packet_tag(packet, is_header ? 0 : stream->start_dts_offset,
+			       &tag, is_header);
+		size = FLV_TAG_OVERHEAD + tag.prefix_size + packet->size;
 
 #ifdef TEST_FRAMEDROPS
-	droptest_cap_data_rate(stream, size);
+		droptest_cap_data_rate(stream, size);
 #endif
 
-	ret = RTMP_Write(&stream->rtmp, (char *)data, (int)size, (int)idx);
-	bfree(data);
+		ret = RTMP_WriteMedia(&stream->rtmp, tag.type,
+				      (uint32_t)tag.time_ms & 0x7FFFFFFF,
+				      (const char *)tag.prefix,
+				      (int)tag.prefix_size,
+				      (const char *)packet->data,
+				      (int)packet->size, (int)idx);
+	}
 
 	if (is_header)
 		bfree(packet->data);
@@ -449,9 +511,29 @@ static void set_output_error(struct rtmp_stream *stream)
 		}
 	}
 
+	/* a destination of rtmp_multi doesn't stop the output, its error
+	 * is only logged */
+	if (stream->dest) {
+		if (msg)
+			info("Error: %s", msg);
+		return;
+	}
+
 	obs_output_set_last_error(stream->output, msg);
 }
 
+static void dbr_set_bitrate(struct rtmp_stream *stream)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
+	obs_data_t *settings = obs_data_create();
+
+	/* applied by the encoder thread before its next frame */
+	obs_data_set_int(settings, "bitrate", stream->dbr.cur_bitrate);
+	obs_encoder_update(vencoder, settings);
+
+	obs_data_release(settings);
+}
+
 static void *send_thread(void *data)
 {
 	struct rtmp_stream *stream = data;
@@ -460,6 +542,7 @@ static void *send_thread(void *data)
 
 	while (os_sem_wait(stream->send_sem) == 0) {
 		struct encoder_packet packet;
+		struct dbr_frame dbr_frame;
 
 		if (stopping(stream) && stream->stop_ts == 0) {
 			break;
@@ -482,10 +565,23 @@ static void *send_thread(void *data)
 			}
 		}
 
+		if (stream->dbr_enabled) {
+			dbr_frame.send_beg = os_gettime_ns();
+			dbr_frame.size = packet.size;
+		}
+
 		if (send_packet(stream, &packet, false, packet.track_idx) < 0) {
 			os_atomic_set_bool(&stream->disconnected, true);
 			break;
 		}
+
+		if (stream->dbr_enabled) {
+			dbr_frame.send_end = os_gettime_ns();
+
+			pthread_mutex_lock(&stream->dbr_mutex);
+			dbr_add_frame(&stream->dbr, &dbr_frame);
+			pthread_mutex_unlock(&stream->dbr_mutex);
+		}
 	}
 
 	bool encode_error = os_atomic_load_bool(&stream->encode_error);
@@ -501,6 +597,9 @@ static void *send_thread(void *data)
 	if (stream->new_socket_loop) {
 		os_event_signal(stream->send_thread_signaled_exit);
 		os_event_signal(stream->buffer_has_data_event);
+#ifdef __linux__
+		socket_thread_linux_wake(stream);
+#endif
 		pthread_join(stream->socket_thread, NULL);
 		stream->socket_thread_active = false;
 		stream->rtmp.m_bCustomSend = false;
@@ -509,19 +608,39 @@ static void *send_thread(void *data)
 	set_output_error(stream);
 	RTMP_Close(&stream->rtmp);
 
+	/* don't leave the lowered bitrate in the encoder settings */
+	if (stream->dbr_enabled &&
+	    stream->dbr.cur_bitrate != stream->dbr.orig_bitrate) {
+		stream->dbr.cur_bitrate = stream->dbr.orig_bitrate;
+		dbr_set_bitrate(stream);
+		info("Bitrate restored to %ld", stream->dbr.cur_bitrate);
+	}
+
+	int code = OBS_OUTPUT_SUCCESS;
+
 	if (!stopping(stream)) {
-		pthread_detach(stream->send_thread);
-		obs_output_signal_stop(stream->output, OBS_OUTPUT_DISCONNECTED);
+		if (!stream->dest)
+			pthread_detach(stream->send_thread);
+		code = OBS_OUTPUT_DISCONNECTED;
 	} else if (encode_error) {
-		obs_output_signal_stop(stream->output, OBS_OUTPUT_ENCODE_ERROR);
-	} else {
-		obs_output_end_data_capture(stream->output);
+		code = OBS_OUTPUT_ENCODE_ERROR;
+	}
+
+	if (!stream->dest) {
+		if (code != OBS_OUTPUT_SUCCESS)
+			obs_output_signal_stop(stream->output, code);
+		else
+			obs_output_end_data_capture(stream->output);
 	}
 
 	free_packets(stream);
 	os_event_reset(stream->stop_event);
 	os_atomic_set_bool(&stream->active, false);
 	stream->sent_headers = false;
+
+	/* last, the destination may be reconnected right away */
+	if (stream->dest)
+		rtmp_multi_dest_stopped(stream->dest, code);
 	return NULL;
 }
 
@@ -643,6 +762,9 @@ static int init_send(struct rtmp_stream *stream)
 		return OBS_OUTPUT_ERROR;
 	}
 
+	if (stream->dest)
+		stream->send_thread_active = true;
+
 	if (stream->new_socket_loop) {
 		int one = 1;
 #ifdef _WIN32
@@ -713,6 +835,10 @@ static int init_send(struct rtmp_stream *stream)
 #ifdef _WIN32
 		ret = pthread_create(&stream->socket_thread, NULL,
 				     socket_thread_windows, stream);
+#elif defined(__linux__)
+		os_atomic_set_long(&stream->tcp_unsent_bytes, 0);
+		ret = pthread_create(&stream->socket_thread, NULL,
+				     socket_thread_linux, stream);
 #else
 		warn("New socket loop not supported on this platform");
 		return OBS_OUTPUT_ERROR;
@@ -739,7 +865,11 @@ static int init_send(struct rtmp_stream *stream)
 			return OBS_OUTPUT_DISCONNECTED;
 		}
 	}
-	obs_output_begin_data_capture(stream->output, 0);
+
+	if (stream->dest)
+		rtmp_multi_dest_started(stream->dest);
+	else
+		obs_output_begin_data_capture(stream->output, 0);
 
 	return OBS_OUTPUT_SUCCESS;
 }
@@ -873,6 +1003,49 @@ static int try_connect(struct rtmp_stream *stream)
 	return init_send(stream);
 }
 
+static void dbr_init(struct rtmp_stream *stream)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
+	obs_encoder_t *aencoder = obs_output_get_audio_encoder(stream->output, 0);
+	obs_data_t *vsettings;
+	obs_data_t *asettings;
+
+	if (stream->new_socket_loop) {
+		/* packets are only queued, the send rate says nothing */
+		info("Dynamic bitrate disabled, not supported with the new "
+		     "socket loop");
+		stream->dbr_enabled = false;
+		return;
+	}
+
+	if (!vencoder ||
+	    !(obs_encoder_get_caps(vencoder) & OBS_ENCODER_CAP_DYN_BITRATE)) {
+		info("Dynamic bitrate disabled, the video encoder can't change "
+		     "its bitrate while streaming");
+		stream->dbr_enabled = false;
+		return;
+	}
+
+	vsettings = obs_encoder_get_settings(vencoder);
+	asettings = aencoder ? obs_encoder_get_settings(aencoder) : NULL;
+
+	dbr_reset(&stream->dbr, (long)obs_data_get_int(vsettings, "bitrate"),
+		  asettings ? (long)obs_data_get_int(asettings, "bitrate") : 0);
+
+	obs_data_release(vsettings);
+	obs_data_release(asettings);
+
+	if (!stream->dbr.orig_bitrate) {
+		info("Dynamic bitrate disabled, the video encoder has no "
+		     "bitrate setting");
+		stream->dbr_enabled = false;
+		return;
+	}
+
+	info("Dynamic bitrate enabled, original bitrate %ld",
+	     stream->dbr.orig_bitrate);
+}
+
 static bool init_connect(struct rtmp_stream *stream)
 {
 	obs_service_t *service;
@@ -881,16 +1054,13 @@ static bool init_connect(struct rtmp_stream *stream)
 	int64_t drop_p;
 	int64_t drop_b;
 
-	if (stopping(stream)) {
+	/* destinations are joined by rtmp_multi before reconnecting */
+	if (stopping(stream) && !stream->dest) {
 		pthread_join(stream->send_thread, NULL);
 	}
 
 	free_packets(stream);
 
-	service = obs_output_get_service(stream->output);
-	if (!service)
-		return false;
-
 	os_atomic_set_bool(&stream->disconnected, false);
 	os_atomic_set_bool(&stream->encode_error, false);
 	stream->total_bytes_sent = 0;
@@ -898,6 +1068,14 @@ static bool init_connect(struct rtmp_stream *stream)
 	stream->min_priority = 0;
 	stream->got_first_video = false;
 
+	/* destinations of rtmp_multi are configured by it */
+	if (stream->dest)
+		return true;
+
+	service = obs_output_get_service(stream->output);
+	if (!service)
+		return false;
+
 	settings = obs_output_get_settings(stream->output);
 	dstr_copy(&stream->path, obs_service_get_url(service));
 	dstr_copy(&stream->key, obs_service_get_key(service));
@@ -924,6 +1102,10 @@ static bool init_connect(struct rtmp_stream *stream)
 	stream->low_latency_mode =
 		obs_data_get_bool(settings, OPT_LOWLATENCY_ENABLED);
 
+	stream->dbr_enabled = obs_data_get_bool(settings, OPT_DYN_BITRATE);
+	if (stream->dbr_enabled)
+		dbr_init(stream);
+
 	obs_data_release(settings);
 	return true;
 }
@@ -943,17 +1125,42 @@ static void *connect_thread(void *data)
 	ret = try_connect(stream);
 
 	if (ret != OBS_OUTPUT_SUCCESS) {
-		obs_output_signal_stop(stream->output, ret);
+		if (!stream->dest)
+			obs_output_signal_stop(stream->output, ret);
 		info("Connection to %s failed: %d", stream->path.array, ret);
 	}
 
-	if (!stopping(stream))
+	if (!stopping(stream) && !stream->dest)
 		pthread_detach(stream->connect_thread);
 
 	os_atomic_set_bool(&stream->connecting, false);
+
+	if (ret != OBS_OUTPUT_SUCCESS && stream->dest) {
+		/* once the send thread is up it reports the failure */
+		if (active(stream)) {
+			os_atomic_set_bool(&stream->disconnected, true);
+			os_sem_post(stream->send_sem);
+		} else {
+			rtmp_multi_dest_stopped(stream->dest, ret);
+		}
+	}
 	return NULL;
 }
 
+bool rtmp_stream_connect(struct rtmp_stream *stream)
+{
+	os_atomic_set_bool(&stream->connecting, true);
+	if (pthread_create(&stream->connect_thread, NULL, connect_thread,
+			   stream) != 0) {
+		os_atomic_set_bool(&stream->connecting, false);
+		return false;
+	}
+
+	if (stream->dest)
+		stream->connect_thread_active = true;
+	return true;
+}
+
 static bool rtmp_stream_start(void *data)
 {
 	struct rtmp_stream *stream = data;
@@ -963,9 +1170,7 @@ static bool rtmp_stream_start(void *data)
 	if (!obs_output_initialize_encoders(stream->output, 0))
 		return false;
 
-	os_atomic_set_bool(&stream->connecting, true);
-	return pthread_create(&stream->connect_thread, NULL, connect_thread,
-			      stream) == 0;
+	return rtmp_stream_connect(stream);
 }
 
 static inline bool add_packet(struct rtmp_stream *stream,
@@ -1044,6 +1249,35 @@ static bool find_first_video_packet(struct rtmp_stream *stream,
 	return false;
 }
 
+/* congestion has to last this long before the bitrate is lowered */
+/* Called with the packets mutex held, from whichever encoder thread queued
+ * the packet, the new bitrate is applied by the video encoder thread */
+static void dbr_check(struct rtmp_stream *stream, int64_t buffer_duration_usec)
+{
+	enum dbr_change change;
+	long est_bitrate;
+	bool done;
+
+	pthread_mutex_lock(&stream->dbr_mutex);
+	change = dbr_update(&stream->dbr, buffer_duration_usec,
+			    os_gettime_ns());
+	est_bitrate = stream->dbr.est_bitrate;
+	done = stream->dbr.inc_timeout == 0;
+	pthread_mutex_unlock(&stream->dbr_mutex);
+
+	if (change == DBR_DECREASED) {
+		info("Congested, bitrate decreased to %ld (estimated %ld)",
+		     stream->dbr.cur_bitrate, est_bitrate);
+		debug("buffer_duration_usec: %" PRId64, buffer_duration_usec);
+	} else if (change == DBR_INCREASED) {
+		info("Bitrate increased to %ld, %s", stream->dbr.cur_bitrate,
+		     done ? "done" : "waiting");
+	}
+
+	if (change != DBR_UNCHANGED)
+		dbr_set_bitrate(stream);
+}
+
 static void check_to_drop_frames(struct rtmp_stream *stream, bool pframes)
 {
 	struct encoder_packet first;
@@ -1056,8 +1290,11 @@ static void check_to_drop_frames(struct rtmp_stream *stream, bool pframes)
 					 : stream->drop_threshold_usec;
 
 	if (num_packets < 5) {
-		if (!pframes)
+		if (!pframes) {
 			stream->congestion = 0.0f;
+			if (stream->dbr_enabled)
+				dbr_check(stream, 0);
+		}
 		return;
 	}
 
@@ -1073,6 +1310,9 @@ static void check_to_drop_frames(struct rtmp_stream *stream, bool pframes)
 			(float)buffer_duration_usec / (float)drop_threshold;
 	}
 
+	if (!pframes && stream->dbr_enabled)
+		dbr_check(stream, buffer_duration_usec);
+
 	if (buffer_duration_usec > drop_threshold) {
 		debug("buffer_duration_usec: %" PRId64, buffer_duration_usec);
 		drop_frames(stream, name, priority, pframes);
@@ -1098,11 +1338,36 @@ static bool add_video_packet(struct rtmp_stream *stream,
 	return add_packet(stream, packet);
 }
 
-static void rtmp_stream_data(void *data, struct encoder_packet *packet)
+void rtmp_stream_queue_packet(struct rtmp_stream *stream,
+			      struct encoder_packet *packet)
+{
+	bool added_packet = false;
+
+	if (packet->type == OBS_ENCODER_VIDEO && !stream->got_first_video) {
+		stream->start_dts_offset = get_ms_time(packet, packet->dts);
+		stream->got_first_video = true;
+	}
+
+	pthread_mutex_lock(&stream->packets_mutex);
+
+	if (!disconnected(stream)) {
+		added_packet = (packet->type == OBS_ENCODER_VIDEO)
+				       ? add_video_packet(stream, packet)
+				       : add_packet(stream, packet);
+	}
+
+	pthread_mutex_unlock(&stream->packets_mutex);
+
+	if (added_packet)
+		os_sem_post(stream->send_sem);
+	else
+		obs_encoder_packet_release(packet);
+}
+
+void rtmp_stream_data(void *data, struct encoder_packet *packet)
 {
 	struct rtmp_stream *stream = data;
 	struct encoder_packet new_packet;
-	bool added_packet = false;
 
 	if (disconnected(stream) || !active(stream))
 		return;
@@ -1114,32 +1379,12 @@ static void rtmp_stream_data(void *data, struct encoder_packet *packet)
 		return;
 	}
 
-	if (packet->type == OBS_ENCODER_VIDEO) {
-		if (!stream->got_first_video) {
-			stream->start_dts_offset =
-				get_ms_time(packet, packet->dts);
-			stream->got_first_video = true;
-		}
-
+	if (packet->type == OBS_ENCODER_VIDEO)
 		obs_parse_avc_packet(&new_packet, packet);
-	} else {
+	else
 		obs_encoder_packet_ref(&new_packet, packet);
-	}
-
-	pthread_mutex_lock(&stream->packets_mutex);
-
-	if (!disconnected(stream)) {
-		added_packet = (packet->type == OBS_ENCODER_VIDEO)
-				       ? add_video_packet(stream, &new_packet)
-				       : add_packet(stream, &new_packet);
-	}
-
-	pthread_mutex_unlock(&stream->packets_mutex);
 
-	if (added_packet)
-		os_sem_post(stream->send_sem);
-	else
-		obs_encoder_packet_release(&new_packet);
+	rtmp_stream_queue_packet(stream, &new_packet);
 }
 
 static void rtmp_stream_defaults(obs_data_t *defaults)
@@ -1150,6 +1395,7 @@ static void rtmp_stream_defaults(obs_data_t *defaults)
 	obs_data_set_default_string(defaults, OPT_BIND_IP, "default");
 	obs_data_set_default_bool(defaults, OPT_NEWSOCKETLOOP_ENABLED, false);
 	obs_data_set_default_bool(defaults, OPT_LOWLATENCY_ENABLED, false);
+	obs_data_set_default_bool(defaults, OPT_DYN_BITRATE, false);
 }
 
 static obs_properties_t *rtmp_stream_properties(void *unused)
@@ -1182,34 +1428,43 @@ static obs_properties_t *rtmp_stream_properties(void *unused)
 				obs_module_text("RTMPStream.NewSocketLoop"));
 	obs_properties_add_bool(props, OPT_LOWLATENCY_ENABLED,
 				obs_module_text("RTMPStream.LowLatencyMode"));
+	obs_properties_add_bool(props, OPT_DYN_BITRATE,
+				obs_module_text("RTMPStream.DynamicBitrate"));
 
 	return props;
 }
 
-static uint64_t rtmp_stream_total_bytes_sent(void *data)
+uint64_t rtmp_stream_total_bytes_sent(void *data)
 {
 	struct rtmp_stream *stream = data;
 	return stream->total_bytes_sent;
 }
 
-static int rtmp_stream_dropped_frames(void *data)
+int rtmp_stream_dropped_frames(void *data)
 {
 	struct rtmp_stream *stream = data;
 	return stream->dropped_frames;
 }
 
-static float rtmp_stream_congestion(void *data)
+float rtmp_stream_congestion(void *data)
 {
 	struct rtmp_stream *stream = data;
 
-	if (stream->new_socket_loop)
-		return (float)stream->write_buf_len /
-		       (float)stream->write_buf_size;
-	else
+	if (stream->new_socket_loop) {
+		size_t backlog = stream->write_buf_len;
+#ifdef __linux__
+		backlog += (size_t)os_atomic_load_long(
+			&stream->tcp_unsent_bytes);
+#endif
+		float congestion =
+			(float)backlog / (float)stream->write_buf_size;
+		return congestion > 1.0f ? 1.0f : congestion;
+	} else {
 		return stream->min_priority > 0 ? 1.0f : stream->congestion;
+	}
 }
 
-static int rtmp_stream_connect_time(void *data)
+int rtmp_stream_connect_time(void *data)
 {
 	struct rtmp_stream *stream = data;
 	return stream->rtmp.connect_time_ms;
@@ -9,6 +9,7 @@
 #include "librtmp/log.h"
 #include "flv-mux.h"
 #include "net-if.h"
+#include "rtmp-dbr.h"
 
 #ifdef _WIN32
 #include <Iphlpapi.h>
@@ -16,6 +17,10 @@
 #include <sys/ioctl.h>
 #endif
 
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
 #define do_log(level, format, ...)                 \
 	blog(level, "[rtmp stream: '%s'] " format, \
 	     obs_output_get_name(stream->output), ##__VA_ARGS__)
@@ -30,6 +35,7 @@
 #define OPT_BIND_IP "bind_ip"
 #define OPT_NEWSOCKETLOOP_ENABLED "new_socket_loop_enabled"
 #define OPT_LOWLATENCY_ENABLED "low_latency_mode_enabled"
+#define OPT_DYN_BITRATE "dyn_bitrate"
 
 //#define TEST_FRAMEDROPS
 
@@ -44,9 +50,15 @@ struct droptest_info {
 };
 #endif
 
+struct rtmp_dest;
+
 struct rtmp_stream {
 	obs_output_t *output;
 
+	/* set when this is one destination of an rtmp_multi output, which
+	 * owns the output, configures the connection and queues packets */
+	struct rtmp_dest *dest;
+
 	pthread_mutex_t packets_mutex;
 	struct circlebuf packets;
 	bool sent_headers;
@@ -62,6 +74,11 @@ struct rtmp_stream {
 	volatile bool encode_error;
 	pthread_t send_thread;
 
+	/* destinations never detach their threads, these are set until
+	 * rtmp_stream_join_threads has joined them */
+	bool connect_thread_active;
+	bool send_thread_active;
+
 	int max_shutdown_time_sec;
 
 	os_sem_t *send_sem;
@@ -92,6 +109,11 @@ struct rtmp_stream {
 
 	RTMP rtmp;
 
+	/* dynamic bitrate, frames are added by the send thread */
+	bool dbr_enabled;
+	pthread_mutex_t dbr_mutex;
+	struct dbr dbr;
+
 	bool new_socket_loop;
 	bool low_latency_mode;
 	bool disable_send_window_optimization;
@@ -105,8 +127,41 @@ struct rtmp_stream {
 	os_event_t *buffer_has_data_event;
 	os_event_t *socket_available_event;
 	os_event_t *send_thread_signaled_exit;
+
+#ifdef __linux__
+	/* eventfd waking the epoll socket thread, os events can't be polled */
+	int socket_wake_fd;
+	volatile long tcp_unsent_bytes;
+	uint32_t tcp_rtt_ms;
+	uint32_t tcp_cwnd;
+	uint32_t tcp_retransmits;
+#endif
 };
 
 #ifdef _WIN32
 void *socket_thread_windows(void *data);
+#elif defined(__linux__)
+void *socket_thread_linux(void *data);
+void socket_thread_linux_wake(struct rtmp_stream *stream);
 #endif
+
+/* used by rtmp_multi to run one stream per destination */
+extern void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output);
+extern void rtmp_stream_destroy(void *data);
+extern bool rtmp_stream_connect(struct rtmp_stream *stream);
+extern void rtmp_stream_stop(void *data, uint64_t ts);
+extern void rtmp_stream_join_threads(struct rtmp_stream *stream);
+extern void rtmp_stream_data(void *data, struct encoder_packet *packet);
+extern uint64_t rtmp_stream_total_bytes_sent(void *data);
+extern int rtmp_stream_dropped_frames(void *data);
+extern float rtmp_stream_congestion(void *data);
+extern int rtmp_stream_connect_time(void *data);
+
+/* takes ownership of the packet, video packets must already be parsed with
+ * obs_parse_avc_packet */
+extern void rtmp_stream_queue_packet(struct rtmp_stream *stream,
+				     struct encoder_packet *packet);
+
+/* rtmp-multi.c, called from the destination's own threads */
+extern void rtmp_multi_dest_started(struct rtmp_dest *dest);
+extern void rtmp_multi_dest_stopped(struct rtmp_dest *dest, int code);
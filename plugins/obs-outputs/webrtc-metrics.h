@@ -0,0 +1,38 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Transport metrics of a WebRTC output, filled by the output's
+ * "void get_webrtc_metrics(in ptr metrics)" procedure:
+ *
+ *   struct webrtc_stream_metrics metrics = {0};
+ *   calldata_t cd = {0};
+ *   calldata_set_ptr(&cd, "metrics", &metrics);
+ *   proc_handler_call(obs_output_get_proc_handler(output),
+ *                     "get_webrtc_metrics", &cd);
+ *   calldata_free(&cd);
+ *
+ * Values are those of the last stats sample, rates are per second over the
+ * last sampling interval.
+ */
+struct webrtc_stream_metrics {
+	uint64_t total_bytes_sent;
+	double target_bitrate;             /* bits per second */
+	double available_outgoing_bitrate; /* bits per second */
+	double round_trip_time;            /* seconds */
+	double packet_loss;                /* lost / sent, 0.0 - 1.0 */
+	double nack_rate;
+	double pli_rate;
+	float congestion;                  /* 0.0 - 1.0 */
+};
+
+#ifdef __cplusplus
+}
+#endif
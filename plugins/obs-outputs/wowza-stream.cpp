@@ -19,6 +19,8 @@
 #define OPT_BIND_IP "bind_ip"
 #define OPT_NEWSOCKETLOOP_ENABLED "new_socket_loop_enabled"
 #define OPT_LOWLATENCY_ENABLED "low_latency_mode_enabled"
+#define OPT_STATS_INTERVAL_MS "stats_interval_ms"
+#define OPT_KEEPALIVE_INTERVAL_MS "keepalive_interval_ms"
 
 #include "WebRTCStream.h"
 
@@ -106,6 +108,8 @@ extern "C" void wowza_stream_defaults(obs_data_t *defaults)
 	obs_data_set_default_string(defaults, OPT_BIND_IP, "default");
 	obs_data_set_default_bool(defaults, OPT_NEWSOCKETLOOP_ENABLED, false);
 	obs_data_set_default_bool(defaults, OPT_LOWLATENCY_ENABLED, false);
+	obs_data_set_default_int(defaults, OPT_STATS_INTERVAL_MS, 1000);
+	obs_data_set_default_int(defaults, OPT_KEEPALIVE_INTERVAL_MS, 10000);
 }
 
 extern "C" obs_properties_t *wowza_stream_properties(void *unused)
@@ -149,8 +153,35 @@ extern "C" int wowza_stream_dropped_frames(void *data)
 
 extern "C" float wowza_stream_congestion(void *data)
 {
-	UNUSED_PARAMETER(data);
-	return 0.0f;
+	//Get stream
+	WebRTCStream *stream = (WebRTCStream*)data;
+	return stream->getCongestion();
+}
+
+extern "C" const char *wowza_encoded_stream_getname(void *unused)
+{
+	info("wowza_encoded_stream_getname");
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("WOWZAStream.Encoded");
+}
+
+extern "C" void *wowza_encoded_stream_create(obs_data_t *, obs_output_t *output)
+{
+	info("wowza_encoded_stream_create");
+	//Create new stream fed by the OBS video encoder
+	WebRTCStream *stream = new WebRTCStream(output, true);
+	//Don't allow it to be deleted
+	stream->AddRef();
+	//Return it
+	return (void*)stream;
+}
+
+extern "C" void wowza_receive_video_packet(void *data, struct encoder_packet *packet)
+{
+	//Get stream
+	WebRTCStream *stream = (WebRTCStream*)data;
+	//Process encoded video
+	stream->onVideoPacket(packet);
 }
 
 extern "C" {
@@ -209,3 +240,59 @@ extern "C" {
 	};
 #endif
 }
+
+extern "C" {
+#ifdef _WIN32
+	struct obs_output_info wowza_encoded_output_info = {
+		"wowza_encoded_output", //id
+		OBS_OUTPUT_VIDEO | OBS_OUTPUT_ENCODED | OBS_OUTPUT_SERVICE, //flags
+		wowza_encoded_stream_getname, //get_name
+		wowza_encoded_stream_create, //create
+		wowza_stream_destroy, //destroy
+		wowza_stream_start, //start
+		wowza_stream_stop, //stop
+		nullptr, //raw_video
+		nullptr, //raw_audio
+		wowza_receive_video_packet, //encoded_packet
+		nullptr, //update
+		wowza_stream_defaults, //get_defaults
+		wowza_stream_properties, //get_properties
+		nullptr, //unused1 (formerly pause)
+		wowza_stream_total_bytes_sent, //get_total_bytes
+		wowza_stream_dropped_frames, //get_dropped_frames
+		nullptr, //type_data
+		nullptr, //free_type_data
+		wowza_stream_congestion, //get_congestion
+		nullptr, //get_connect_time_ms
+		"h264", //encoded_video_codecs
+		nullptr, //encoded_audio_codecs
+		nullptr //raw_audio2
+	};
+#else
+	struct obs_output_info wowza_encoded_output_info = {
+		.id                   = "wowza_encoded_output",
+		.flags                = OBS_OUTPUT_VIDEO | OBS_OUTPUT_ENCODED | OBS_OUTPUT_SERVICE,
+		.get_name             = wowza_encoded_stream_getname,
+		.create               = wowza_encoded_stream_create,
+		.destroy              = wowza_stream_destroy,
+		.start                = wowza_stream_start,
+		.stop                 = wowza_stream_stop,
+		.raw_video            = nullptr,
+		.raw_audio            = nullptr,
+		.encoded_packet       = wowza_receive_video_packet,
+		.update               = nullptr,
+		.get_defaults         = wowza_stream_defaults,
+		.get_properties       = wowza_stream_properties,
+		.unused1              = nullptr,
+		.get_total_bytes      = wowza_stream_total_bytes_sent,
+		.get_dropped_frames   = wowza_stream_dropped_frames,
+		.type_data            = nullptr,
+		.free_type_data       = nullptr,
+		.get_congestion       = wowza_stream_congestion,
+		.get_connect_time_ms  = nullptr,
+		.encoded_video_codecs = "h264",
+		.encoded_audio_codecs = nullptr,
+		.raw_audio2           = nullptr
+	};
+#endif
+}
@@ -32,7 +32,9 @@ static void webrtc_evercast_update(void *data, obs_data_t *settings)
   service->room = bstrdup(obs_data_get_string(settings, "room"));
   service->password = bstrdup(obs_data_get_string(settings, "password"));
   service->codec = bstrdup(obs_data_get_string(settings, "codec"));
-  service->output = bstrdup("evercast_output");
+  service->output = bstrdup(obs_data_get_bool(settings, "encoded")
+                              ? "evercast_encoded_output"
+                              : "evercast_output");
 }
 
 static void webrtc_evercast_destroy(void *data)
@@ -98,6 +100,7 @@ static obs_properties_t *webrtc_evercast_properties(void *unused)
 
   obs_properties_add_text(ppts, "codec", "Codec", OBS_TEXT_DEFAULT);
   obs_properties_add_text(ppts, "protocol", "Protocol", OBS_TEXT_DEFAULT);
+  obs_properties_add_bool(ppts, "encoded", "Use OBS video encoder (H264 pass-through)");
 
   obs_properties_add_text(ppts, "server", "Server Name", OBS_TEXT_DEFAULT);
   obs_properties_add_text(ppts, "room",   "Server Room", OBS_TEXT_DEFAULT);
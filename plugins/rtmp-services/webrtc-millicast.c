@@ -35,7 +35,9 @@ static void webrtc_millicast_update(void *data, obs_data_t *settings)
 	service->username = bstrdup(obs_data_get_string(settings, "username"));
 	service->password = bstrdup(obs_data_get_string(settings, "password"));
 	service->codec = bstrdup(obs_data_get_string(settings, "codec"));
-	service->output = bstrdup("millicast_output");
+	service->output = bstrdup(obs_data_get_bool(settings, "encoded")
+					  ? "millicast_encoded_output"
+					  : "millicast_output");
 
 }
 
@@ -89,6 +91,15 @@ static bool use_auth_modified(obs_properties_t *ppts, obs_property_t *p,
 	return true;
 }
 
+static void webrtc_millicast_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_bool(settings, "simulcast", false);
+	obs_data_set_default_int(settings, "simulcast_layers", 3);
+	obs_data_set_default_int(settings, "simulcast_bitrate_full", 0);
+	obs_data_set_default_int(settings, "simulcast_bitrate_half", 800);
+	obs_data_set_default_int(settings, "simulcast_bitrate_quarter", 300);
+}
+
 static obs_properties_t *webrtc_millicast_properties(void *unused)
 {
 	UNUSED_PARAMETER(unused);
@@ -108,6 +119,17 @@ static obs_properties_t *webrtc_millicast_properties(void *unused)
 
 	obs_properties_add_text(ppts, "codec", "Codec", OBS_TEXT_DEFAULT);
 	obs_properties_add_text(ppts, "protocol", "Protocol", OBS_TEXT_DEFAULT);
+	obs_properties_add_bool(ppts, "encoded", "Use OBS video encoder (H264 pass-through)");
+
+	obs_properties_add_bool(ppts, "simulcast", "Simulcast");
+	obs_properties_add_int(ppts, "simulcast_layers", "Simulcast layers", 2, 3, 1);
+	obs_properties_add_int(ppts, "simulcast_bitrate_full",
+			       "Full resolution bitrate (kbps, 0 = encoder bitrate)",
+			       0, 100000, 50);
+	obs_properties_add_int(ppts, "simulcast_bitrate_half",
+			       "Half resolution bitrate (kbps)", 50, 100000, 50);
+	obs_properties_add_int(ppts, "simulcast_bitrate_quarter",
+			       "Quarter resolution bitrate (kbps)", 50, 100000, 50);
 
 	// obs_properties_add_list(ppts, "codec", "Codec", OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
 	// obs_property_list_add_string(obs_properties_get(ppts, "codec"), "Automatic", "");
@@ -205,6 +227,7 @@ struct obs_service_info webrtc_millicast_service = {
 	.create          = webrtc_millicast_create,
 	.destroy         = webrtc_millicast_destroy,
 	.update          = webrtc_millicast_update,
+	.get_defaults    = webrtc_millicast_defaults,
 	.get_properties  = webrtc_millicast_properties,
 	.get_url         = webrtc_millicast_url,
 	.get_key         = webrtc_millicast_key,
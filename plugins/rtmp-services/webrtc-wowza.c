@@ -36,7 +36,9 @@ static void webrtc_wowza_update(void *data, obs_data_t *settings)
 	// service->password = bstrdup(obs_data_get_string(settings, "password"));
 	service->codec = bstrdup(obs_data_get_string(settings, "codec"));
 	service->protocol = bstrdup(obs_data_get_string(settings, "protocol"));
-	service->output = bstrdup("wowza_output");
+	service->output = bstrdup(obs_data_get_bool(settings, "encoded")
+					  ? "wowza_encoded_output"
+					  : "wowza_output");
 }
 
 static void webrtc_wowza_destroy(void *data)
@@ -104,6 +106,7 @@ static obs_properties_t *webrtc_wowza_properties(void *unused)
 
 	obs_properties_add_text(ppts, "codec", "Codec", OBS_TEXT_DEFAULT);
 	obs_properties_add_text(ppts, "protocol", "Protocol", OBS_TEXT_DEFAULT);
+	obs_properties_add_bool(ppts, "encoded", "Use OBS video encoder (H264 pass-through)");
 
 	// obs_properties_add_list(ppts, "codec", obs_module_text("Codec"), OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
 	// obs_property_list_add_string(obs_properties_get(ppts, "codec"), "Automatic", "");
@@ -5,6 +5,7 @@
 
 #include <util/base.h>
 
+#include <algorithm>
 #include <iostream>
 #include <string>
 
@@ -17,6 +18,8 @@ using json = nlohmann::json;
 typedef websocketpp::config::asio_client::message_type::ptr message_ptr;
 
 EvercastWebsocketClientImpl::EvercastWebsocketClientImpl()
+    : is_running(false),
+      keepalive_interval(std::chrono::milliseconds(10000))
 {
     // Set logging to be pretty verbose (everything except message payloads)
     client.set_access_channels(websocketpp::log::alevel::all);
@@ -24,6 +27,7 @@ EvercastWebsocketClientImpl::EvercastWebsocketClientImpl()
     client.set_error_channels(websocketpp::log::elevel::all);
     // Initialize ASIO
     client.init_asio();
+    keepalive_timer.reset(new asio::steady_timer(client.get_io_service()));
 }
 
 EvercastWebsocketClientImpl::~EvercastWebsocketClientImpl()
@@ -96,9 +100,7 @@ bool EvercastWebsocketClientImpl::connect(
                     logged = true;
                     // Keep the connection alive
                     is_running.store(true);
-                    thread_keepAlive = std::thread([&]() {
-                        keepConnectionAlive(listener);
-                    });
+                    keepConnectionAlive(listener);
                 } else { // logged
                     handle_id = data["id"];
                     sendJoinMessage(room);
@@ -120,12 +122,9 @@ bool EvercastWebsocketClientImpl::connect(
                     handle_id = 0;
                     sendLoginMessage(username, token, room);
 
-                    // Keepalive stuff to prevent doubling-up on keepalive threads
+                    // Keepalive stuff to prevent doubling-up on keepalive timers
                     is_running.store(false);
-                    if (thread_keepAlive.joinable())
-                    {
-                        thread_keepAlive.join();
-                    }
+                    keepalive_timer->cancel();
 
                     // Launch logged event
                     listener->onLogged(session_id);
@@ -241,18 +240,35 @@ trickle(
     return result;
 }
 
+void
+EvercastWebsocketClientImpl::
+setKeepAliveInterval(int interval_ms)
+{
+    if (interval_ms > 0)
+        keepalive_interval = std::chrono::milliseconds(interval_ms);
+}
+
+// Runs on the io_service thread, re-armed after each keepalive until
+// disconnect() or a timeout
 void
 EvercastWebsocketClientImpl::
 keepConnectionAlive(
   WebsocketClient::Listener * listener
 )
 {
-    while (is_running.load()) {
+    if (!is_running.load())
+        return;
+
+    keepalive_timer->expires_after(keepalive_interval);
+    keepalive_timer->async_wait([this, listener](const asio::error_code & ec) {
+        if (ec || !is_running.load())
+            return;
         if (connection) {
             if (hasTimedOut()) {
                 warn("Connection timed Out.");
+                is_running.store(false);
                 listener->onDisconnected();
-                break;
+                return;
             }
             try {
                 sendKeepAliveMessage();
@@ -260,7 +276,8 @@ keepConnectionAlive(
                 warn("keepConnectionAlive exception: %s", e.what());
             }
         }
-    }
+        keepConnectionAlive(listener);
+    });
 }
 
 void
@@ -280,16 +297,21 @@ bool
 EvercastWebsocketClientImpl::
 disconnect(bool wait)
 {
+    // Stop keepAlive, a pending wait returns without re-arming. The timer
+    // belongs to the io_service thread, so it is cancelled from there; if
+    // the loop never runs it again, the handler is dropped unrun along with
+    // the io_service.
+    is_running.store(false);
+    asio::post(client.get_io_service(), [this]() {
+        asio::error_code ec;
+        keepalive_timer->cancel(ec);
+    });
+
     destroy();
     if (!connection)
         return true;
     websocketpp::lib::error_code ec;
     try {
-        // Stop keepAlive
-        if (thread_keepAlive.joinable()) {
-           is_running.store(false);
-            thread_keepAlive.join();
-        }
         // Stop client
         if (connection->get_state() == websocketpp::session::state::open)
             client.close(connection, websocketpp::close::status::normal, std::string("disconnect"), ec);
@@ -299,6 +321,9 @@ disconnect(bool wait)
         client.stop();
         if (wait && thread.joinable()) {
             thread.join();
+            // Nothing else touches the timer with the loop gone
+            asio::error_code timer_ec;
+            keepalive_timer->cancel(timer_ec);
         } else {
             // Remove handlers
             client.set_open_handler([](...) {});
@@ -592,6 +617,8 @@ hasTimedOut()
 {
     auto current_time = std::chrono::system_clock::now();
     std::chrono::duration<double> gap = current_time - last_message_recd_time;
-    return gap.count() > EVERCAST_MESSAGE_TIMEOUT;
+    // Every keepalive is acked, allow a few of them to go missing
+    std::chrono::duration<double> timeout = 3 * keepalive_interval;
+    return gap.count() > std::max(EVERCAST_MESSAGE_TIMEOUT, timeout.count());
 }
 
@@ -19,6 +19,10 @@
 #include <websocketpp/common/connection_hdl.hpp>
 #include "websocketpp/config/asio_client.hpp"
 #include "websocketpp/client.hpp"
+#include "asio/steady_timer.hpp"
+
+#include <chrono>
+#include <memory>
 #include "nlohmann/json.hpp"
 
 typedef websocketpp::client<websocketpp::config::asio_tls_client> Client;
@@ -45,6 +49,7 @@ public:
           const std::string & candidate,
           const bool last) override;
   bool disconnect(const bool wait) override;
+  void setKeepAliveInterval(int interval_ms) override;
 
   void keepConnectionAlive(WebsocketClient::Listener * listener);
   void destroy();
@@ -57,8 +62,10 @@ private:
   Client client;
   Client::connection_ptr connection;
   std::thread thread;
-  std::thread thread_keepAlive;
   std::atomic<bool> is_running;
+  // Keepalive, driven by the io_service run by thread
+  std::unique_ptr<asio::steady_timer> keepalive_timer;
+  std::chrono::milliseconds keepalive_interval;
 
   std::chrono::time_point<std::chrono::system_clock> last_message_recd_time;
 
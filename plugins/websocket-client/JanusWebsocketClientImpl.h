@@ -16,6 +16,10 @@ using json = nlohmann::json;
 
 #include "websocketpp/config/asio_client.hpp"
 #include "websocketpp/client.hpp"
+#include "asio/steady_timer.hpp"
+
+#include <chrono>
+#include <memory>
 
 typedef websocketpp::client<websocketpp::config::asio_tls_client> Client;
 
@@ -41,6 +45,7 @@ public:
         const std::string & candidate,
         bool last) override;
     bool disconnect(bool wait) override;
+    void setKeepAliveInterval(int interval_ms) override;
 
     void keepConnectionAlive( WebsocketClient::Listener * listener );
     void destroy();
@@ -75,8 +80,10 @@ private:
     Client client;
     Client::connection_ptr connection;
     std::thread thread;
-    std::thread thread_keepAlive;
     std::atomic<bool> is_running;
+    // Keepalive, driven by the io_service run by thread
+    std::unique_ptr<asio::steady_timer> keepalive_timer;
+    std::chrono::milliseconds keepalive_interval;
 
     std::string sanitizeString(const std::string & s);
     bool sendMessage(json msg, const char *name);
@@ -57,6 +57,8 @@ public:
             const std::string & candidate,
             bool last) = 0;
     virtual bool disconnect(bool wait) = 0;
+    // Only used by protocols with an application level keepalive
+    virtual void setKeepAliveInterval(int /* interval_ms */) {}
 };
 
 WEBSOCKETCLIENT_API WebsocketClient * createWebsocketClient(int type);
@@ -0,0 +1,255 @@
+/*
+ * Micro-benchmark of audio mixing: the SSE kernels of media-io/audio-mix.h
+ * against the scalar loops they replaced, mixing stereo sources into all
+ * mixes or only into the active ones.  Not a test: prints the time per audio
+ * tick of each, and whether the kernels' output matches the scalar loops'.
+ * The compiler may vectorize the scalar loops on its own at higher
+ * optimization levels.
+ *
+ *   bench-audio-mix [sources] [active mixes]
+ */
+
+#include "media-io/audio-io.h"
+#include "media-io/audio-mix.h"
+#include "util/bmem.h"
+#include "util/platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHANNELS 2
+#define TICKS 2000
+
+struct source {
+	float *buf[MAX_AUDIO_MIXES][CHANNELS];
+	size_t start_point;
+	bool fading;
+};
+
+struct mixer {
+	float *mixes[MAX_AUDIO_MIXES][CHANNELS];
+	float fade[AUDIO_OUTPUT_FRAMES];
+	struct source *sources;
+	size_t num_sources;
+};
+
+static void mixer_init(struct mixer *mixer, size_t num_sources)
+{
+	uint32_t rand_state = 1;
+
+	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++)
+		for (size_t ch = 0; ch < CHANNELS; ch++)
+			mixer->mixes[mix][ch] = bzalloc(AUDIO_OUTPUT_FRAMES *
+							sizeof(float));
+
+	for (size_t i = 0; i < AUDIO_OUTPUT_FRAMES; i++)
+		mixer->fade[i] = (float)i / AUDIO_OUTPUT_FRAMES;
+
+	mixer->num_sources = num_sources;
+	mixer->sources = bzalloc(num_sources * sizeof(struct source));
+
+	for (size_t s = 0; s < num_sources; s++) {
+		struct source *source = mixer->sources + s;
+
+		/* a few sources start within the tick, a few are scene items
+		 * fading in */
+		source->start_point = s % 8 == 7 ? 1 + s % 13 : 0;
+		source->fading = s % 4 == 3;
+
+		for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+			for (size_t ch = 0; ch < CHANNELS; ch++) {
+				float *buf = bmalloc(AUDIO_OUTPUT_FRAMES *
+						     sizeof(float));
+
+				for (size_t i = 0; i < AUDIO_OUTPUT_FRAMES;
+				     i++) {
+					rand_state = rand_state * 1103515245 +
+						     12345;
+					buf[i] = (float)(rand_state >> 16) /
+							 32768.0f -
+						 1.0f;
+				}
+				source->buf[mix][ch] = buf;
+			}
+		}
+	}
+}
+
+static void mixer_free(struct mixer *mixer)
+{
+	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+		for (size_t ch = 0; ch < CHANNELS; ch++) {
+			bfree(mixer->mixes[mix][ch]);
+			for (size_t s = 0; s < mixer->num_sources; s++)
+				bfree(mixer->sources[s].buf[mix][ch]);
+		}
+	}
+	bfree(mixer->sources);
+}
+
+/* ------------------------------------------------------------------------- */
+/* previous implementation                                                   */
+
+static void scalar_add(float *dst, const float *src, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] += src[i];
+}
+
+static void scalar_add_mul(float *dst, const float *src, const float *mul,
+			   size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] += src[i] * mul[i];
+}
+
+static void scalar_clamp(float *data, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		float val = data[i];
+		val = (val > 1.0f) ? 1.0f : val;
+		val = (val < -1.0f) ? -1.0f : val;
+		data[i] = val;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct kernels {
+	const char *name;
+	void (*add)(float *dst, const float *src, size_t count);
+	void (*add_mul)(float *dst, const float *src, const float *mul,
+			size_t count);
+	void (*clamp)(float *data, size_t count);
+};
+
+static void sse_add(float *dst, const float *src, size_t count)
+{
+	audio_mix_add(dst, src, count);
+}
+
+static void sse_add_mul(float *dst, const float *src, const float *mul,
+			size_t count)
+{
+	audio_mix_add_mul(dst, src, mul, count);
+}
+
+static void sse_clamp(float *data, size_t count)
+{
+	audio_mix_clamp(data, count);
+}
+
+static const struct kernels scalar = {"scalar", scalar_add, scalar_add_mul,
+				      scalar_clamp};
+static const struct kernels sse = {"sse", sse_add, sse_add_mul, sse_clamp};
+
+/* one tick of the mixer: clear, add every source, clamp */
+static void mix_tick(struct mixer *mixer, const struct kernels *k,
+		     uint32_t active_mixes)
+{
+	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+		if ((active_mixes & (1 << mix)) == 0)
+			continue;
+
+		for (size_t ch = 0; ch < CHANNELS; ch++)
+			memset(mixer->mixes[mix][ch], 0,
+			       AUDIO_OUTPUT_FRAMES * sizeof(float));
+	}
+
+	for (size_t s = 0; s < mixer->num_sources; s++) {
+		struct source *source = mixer->sources + s;
+		size_t start = source->start_point;
+		size_t count = AUDIO_OUTPUT_FRAMES - start;
+
+		for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+			if ((active_mixes & (1 << mix)) == 0)
+				continue;
+
+			for (size_t ch = 0; ch < CHANNELS; ch++) {
+				float *dst = mixer->mixes[mix][ch] + start;
+				const float *src = source->buf[mix][ch];
+
+				if (source->fading)
+					k->add_mul(dst, src, mixer->fade,
+						   count);
+				else
+					k->add(dst, src, count);
+			}
+		}
+	}
+
+	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+		if ((active_mixes & (1 << mix)) == 0)
+			continue;
+
+		for (size_t ch = 0; ch < CHANNELS; ch++)
+			k->clamp(mixer->mixes[mix][ch], AUDIO_OUTPUT_FRAMES);
+	}
+}
+
+static void run(struct mixer *mixer, const struct kernels *k,
+		uint32_t active_mixes, size_t num_active)
+{
+	uint64_t start = os_gettime_ns();
+
+	for (size_t i = 0; i < TICKS; i++)
+		mix_tick(mixer, k, active_mixes);
+
+	printf("%-8s %zu mixes %9.1f us/tick\n", k->name, num_active,
+	       (double)(os_gettime_ns() - start) / 1000.0 / TICKS);
+}
+
+static bool same_output(struct mixer *mixer, uint32_t active_mixes)
+{
+	float *expected[MAX_AUDIO_MIXES][CHANNELS];
+	bool same = true;
+
+	mix_tick(mixer, &scalar, active_mixes);
+	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++)
+		for (size_t ch = 0; ch < CHANNELS; ch++)
+			expected[mix][ch] =
+				bmemdup(mixer->mixes[mix][ch],
+					AUDIO_OUTPUT_FRAMES * sizeof(float));
+
+	mix_tick(mixer, &sse, active_mixes);
+	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+		for (size_t ch = 0; ch < CHANNELS; ch++) {
+			if (memcmp(expected[mix][ch], mixer->mixes[mix][ch],
+				   AUDIO_OUTPUT_FRAMES * sizeof(float)) != 0)
+				same = false;
+			bfree(expected[mix][ch]);
+		}
+	}
+
+	return same;
+}
+
+int main(int argc, char **argv)
+{
+	size_t num_sources = argc > 1 ? (size_t)atol(argv[1]) : 48;
+	size_t num_active = argc > 2 ? (size_t)atol(argv[2]) : 2;
+	uint32_t all_mixes = (1 << MAX_AUDIO_MIXES) - 1;
+	uint32_t active_mixes;
+	struct mixer mixer;
+
+	if (!num_sources)
+		num_sources = 48;
+	if (!num_active || num_active > MAX_AUDIO_MIXES)
+		num_active = 2;
+	active_mixes = (1 << num_active) - 1;
+
+	mixer_init(&mixer, num_sources);
+
+	printf("%zu stereo sources, %d frames per tick, output %s\n",
+	       num_sources, AUDIO_OUTPUT_FRAMES,
+	       same_output(&mixer, all_mixes) ? "identical" : "DIFFERS");
+
+	run(&mixer, &scalar, all_mixes, MAX_AUDIO_MIXES);
+	run(&mixer, &sse, all_mixes, MAX_AUDIO_MIXES);
+	run(&mixer, &scalar, active_mixes, num_active);
+	run(&mixer, &sse, active_mixes, num_active);
+
+	mixer_free(&mixer);
+	return 0;
+}
@@ -0,0 +1,293 @@
+/*
+ * Micro-benchmark of AVC packet parsing: the NAL index of obs-avc.c, built
+ * with its vectorized start code scan, against the byte-wise FFmpeg scan and
+ * serializer it replaced.  Not a test: prints the throughput of each over
+ * synthetic x264-like Annex B packets at a given bitrate.
+ *
+ *   bench-avc-scan [kbps] [seconds]
+ */
+
+#include "obs.h"
+#include "obs-avc.h"
+#include "util/array-serializer.h"
+#include "util/platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FPS 60
+#define KEYINT (2 * FPS)
+
+/* ------------------------------------------------------------------------- */
+/* x264-like output: SEI, SPS and PPS before every keyframe, slices with     */
+/* emulation prevention so no start code appears inside a NAL                */
+
+static uint32_t rand_state = 1;
+
+static inline uint8_t rand_byte(void)
+{
+	rand_state = rand_state * 1103515245 + 12345;
+	return (uint8_t)(rand_state >> 16);
+}
+
+static void write_nal(struct serializer *s, int type, int ref_idc, size_t size,
+		      bool long_start_code)
+{
+	size_t zeros = 0;
+
+	if (long_start_code)
+		s_w8(s, 0);
+	s_wb24(s, 1);
+	s_w8(s, (uint8_t)(ref_idc << 5 | type));
+
+	for (size_t i = 0; i < size; i++) {
+		/* entropy coded data is mostly free of zero bytes */
+		uint8_t byte = rand_byte() < 8 ? 0 : rand_byte();
+
+		if (zeros >= 2 && byte <= 3) {
+			s_w8(s, 3);
+			zeros = 0;
+		}
+		s_w8(s, byte);
+		zeros = byte ? 0 : zeros + 1;
+	}
+
+	/* rbsp trailing bits */
+	s_w8(s, 0x80);
+}
+
+static void create_packet(struct array_output_data *out, size_t frame,
+			  size_t frame_size)
+{
+	struct serializer s;
+
+	array_output_serializer_init(&s, out);
+
+	if (frame % KEYINT == 0) {
+		write_nal(&s, OBS_NAL_SEI, 0, frame ? 32 : 600, true);
+		write_nal(&s, OBS_NAL_SPS, 3, 24, true);
+		write_nal(&s, OBS_NAL_PPS, 3, 4, true);
+		write_nal(&s, OBS_NAL_SLICE_IDR, 3, frame_size * 8, false);
+	} else {
+		/* a few slices per frame, every other frame unreferenced */
+		int ref_idc = frame % 2 ? 2 : 0;
+
+		for (int i = 0; i < 4; i++)
+			write_nal(&s, OBS_NAL_SLICE, ref_idc, frame_size / 4,
+				  i == 0);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* previous implementation                                                   */
+
+static const uint8_t *bytewise_find_startcode_internal(const uint8_t *p,
+						       const uint8_t *end)
+{
+	const uint8_t *a = p + 4 - ((intptr_t)p & 3);
+
+	for (end -= 3; p < a && p < end; p++) {
+		if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+			return p;
+	}
+
+	for (end -= 3; p < end; p += 4) {
+		uint32_t x = *(const uint32_t *)p;
+
+		if ((x - 0x01010101) & (~x) & 0x80808080) {
+			if (p[1] == 0) {
+				if (p[0] == 0 && p[2] == 1)
+					return p;
+				if (p[2] == 0 && p[3] == 1)
+					return p + 1;
+			}
+
+			if (p[3] == 0) {
+				if (p[2] == 0 && p[4] == 1)
+					return p + 2;
+				if (p[4] == 0 && p[5] == 1)
+					return p + 3;
+			}
+		}
+	}
+
+	for (end += 3; p < end; p++) {
+		if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+			return p;
+	}
+
+	return end + 3;
+}
+
+static const uint8_t *bytewise_find_startcode(const uint8_t *p,
+					      const uint8_t *end)
+{
+	const uint8_t *out = bytewise_find_startcode_internal(p, end);
+	if (p < out && out < end && !out[-1])
+		out--;
+	return out;
+}
+
+static void bytewise_parse_packet(struct encoder_packet *avc_packet,
+				  const struct encoder_packet *src)
+{
+	struct array_output_data output;
+	struct serializer s;
+	const uint8_t *nal_start, *nal_end;
+	const uint8_t *end = src->data + src->size;
+	long ref = 1;
+	int type;
+
+	array_output_serializer_init(&s, &output);
+	*avc_packet = *src;
+
+	serialize(&s, &ref, sizeof(ref));
+
+	nal_start = bytewise_find_startcode(src->data, end);
+	while (true) {
+		while (nal_start < end && !*(nal_start++))
+			;
+
+		if (nal_start == end)
+			break;
+
+		type = nal_start[0] & 0x1F;
+
+		if (type == OBS_NAL_SLICE_IDR || type == OBS_NAL_SLICE) {
+			avc_packet->keyframe = (type == OBS_NAL_SLICE_IDR);
+			avc_packet->priority = nal_start[0] >> 5;
+		}
+
+		nal_end = bytewise_find_startcode(nal_start, end);
+		s_wb32(&s, (uint32_t)(nal_end - nal_start));
+		s_write(&s, nal_start, nal_end - nal_start);
+		nal_start = nal_end;
+	}
+
+	avc_packet->data = output.bytes.array + sizeof(ref);
+	avc_packet->size = output.bytes.num - sizeof(ref);
+	avc_packet->drop_priority = avc_packet->priority;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static size_t bytewise_scan(const uint8_t *data, size_t size)
+{
+	const uint8_t *end = data + size;
+	const uint8_t *nal_start = bytewise_find_startcode(data, end);
+	size_t nals = 0;
+
+	while (true) {
+		while (nal_start < end && !*(nal_start++))
+			;
+
+		if (nal_start == end)
+			break;
+
+		nals++;
+		nal_start = bytewise_find_startcode(nal_start, end);
+	}
+
+	return nals;
+}
+
+static size_t index_scan(const uint8_t *data, size_t size)
+{
+	struct obs_avc_index index;
+	size_t nals;
+
+	obs_avc_index_build(&index, data, size);
+	nals = index.num;
+	obs_avc_index_free(&index);
+	return nals;
+}
+
+static size_t bytewise_parse(const uint8_t *data, size_t size)
+{
+	struct encoder_packet src = {.data = (uint8_t *)data, .size = size};
+	struct encoder_packet avc;
+
+	bytewise_parse_packet(&avc, &src);
+	bfree(avc.data - sizeof(long));
+	return avc.size;
+}
+
+static size_t index_parse(const uint8_t *data, size_t size)
+{
+	struct encoder_packet src = {.data = (uint8_t *)data, .size = size};
+	struct encoder_packet avc;
+
+	obs_parse_avc_packet(&avc, &src);
+	bfree(avc.data - sizeof(long));
+	return avc.size;
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct stream {
+	struct array_output_data *packets;
+	size_t num_packets;
+	size_t bytes;
+};
+
+static size_t sink = 0;
+
+static void run(const char *name, size_t (*parse)(const uint8_t *, size_t),
+		const struct stream *stream, size_t passes)
+{
+	uint64_t start = os_gettime_ns();
+	double sec;
+
+	for (size_t pass = 0; pass < passes; pass++) {
+		for (size_t i = 0; i < stream->num_packets; i++) {
+			struct array_output_data *pkt = stream->packets + i;
+			sink += parse(pkt->bytes.array, pkt->bytes.num);
+		}
+	}
+
+	sec = (double)(os_gettime_ns() - start) / 1e9;
+	printf("%-16s %9.1f MB/s %9.1f ns/packet\n", name,
+	       (double)(stream->bytes * passes) / sec / 1e6,
+	       sec * 1e9 / (double)(stream->num_packets * passes));
+}
+
+int main(int argc, char **argv)
+{
+	size_t kbps = argc > 1 ? (size_t)atol(argv[1]) : 6000;
+	size_t seconds = argc > 2 ? (size_t)atol(argv[2]) : 10;
+	struct stream stream = {0};
+	size_t frame_size;
+	size_t passes;
+
+	if (!kbps)
+		kbps = 6000;
+	if (!seconds)
+		seconds = 10;
+
+	frame_size = kbps * 1000 / 8 / FPS;
+	stream.num_packets = seconds * FPS;
+	stream.packets = bzalloc(stream.num_packets * sizeof(*stream.packets));
+
+	for (size_t i = 0; i < stream.num_packets; i++) {
+		create_packet(stream.packets + i, i, frame_size);
+		stream.bytes += stream.packets[i].bytes.num;
+	}
+
+	/* at least a couple hundred megabytes through each */
+	passes = 200000000 / stream.bytes + 1;
+
+	printf("%zu kbps, %zu packets, %.1f MB, %zu passes\n", kbps,
+	       stream.num_packets, (double)stream.bytes / 1e6, passes);
+
+	run("byte-wise scan", bytewise_scan, &stream, passes);
+	run("index scan", index_scan, &stream, passes);
+	run("byte-wise parse", bytewise_parse, &stream, passes);
+	run("index parse", index_parse, &stream, passes);
+
+	for (size_t i = 0; i < stream.num_packets; i++)
+		da_free(stream.packets[i].bytes);
+	bfree(stream.packets);
+
+	return sink == 42 ? 1 : 0;
+}
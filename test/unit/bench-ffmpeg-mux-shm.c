@@ -0,0 +1,168 @@
+/*
+ * Micro-benchmark of handing packets to the muxer: the shared memory ring
+ * against the pipe it replaces.  Not a test: prints the throughput of each
+ * for a given packet size.
+ *
+ *   bench-ffmpeg-mux-shm [packet size] [megabytes]
+ */
+
+#include "ffmpeg-mux-shm.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct transport {
+	const char *name;
+	size_t (*write)(struct transport *t, const void *data, size_t size);
+	size_t (*read)(struct transport *t, void *data, size_t size);
+	void (*close)(struct transport *t);
+
+	struct ffm_shm producer;
+	struct ffm_shm consumer;
+	int pipe_fds[2];
+};
+
+struct bench {
+	struct transport *transport;
+	size_t packet_size;
+	size_t total;
+	size_t read;
+};
+
+static bool always_alive(void *param)
+{
+	(void)param;
+	return true;
+}
+
+static size_t shm_write(struct transport *t, const void *data, size_t size)
+{
+	return ffm_shm_write(&t->producer, data, size, always_alive, NULL);
+}
+
+static size_t shm_read(struct transport *t, void *data, size_t size)
+{
+	return ffm_shm_read(&t->consumer, data, size, always_alive, NULL);
+}
+
+static void shm_close(struct transport *t)
+{
+	ffm_shm_close(&t->producer);
+}
+
+static size_t pipe_write(struct transport *t, const void *data, size_t size)
+{
+	const uint8_t *ptr = data;
+	size_t total = 0;
+
+	while (total < size) {
+		ssize_t ret = write(t->pipe_fds[1], ptr + total, size - total);
+		if (ret <= 0)
+			break;
+		total += (size_t)ret;
+	}
+	return total;
+}
+
+static size_t pipe_read(struct transport *t, void *data, size_t size)
+{
+	uint8_t *ptr = data;
+	size_t total = 0;
+
+	while (total < size) {
+		ssize_t ret = read(t->pipe_fds[0], ptr + total, size - total);
+		if (ret <= 0)
+			break;
+		total += (size_t)ret;
+	}
+	return total;
+}
+
+static void pipe_close(struct transport *t)
+{
+	close(t->pipe_fds[1]);
+}
+
+static void *reader_thread(void *data)
+{
+	struct bench *bench = data;
+	uint8_t *buf = malloc(bench->packet_size);
+	size_t got;
+
+	while ((got = bench->transport->read(bench->transport, buf,
+					     bench->packet_size)) > 0)
+		bench->read += got;
+
+	free(buf);
+	return NULL;
+}
+
+static void run(struct transport *t, size_t packet_size, size_t total)
+{
+	struct bench bench = {t, packet_size, total, 0};
+	uint8_t *buf = calloc(1, packet_size);
+	struct timespec start, end;
+	pthread_t reader;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pthread_create(&reader, NULL, reader_thread, &bench);
+
+	for (size_t sent = 0; sent < total; sent += packet_size)
+		t->write(t, buf, packet_size);
+	t->close(t);
+
+	pthread_join(reader, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	double sec = (double)(end.tv_sec - start.tv_sec) +
+		     (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%-6s %8zu B packets %10.1f MB/s %10.2f us/packet\n", t->name,
+	       packet_size, (double)bench.read / sec / 1e6,
+	       sec * 1e6 / (double)(total / packet_size));
+	free(buf);
+}
+
+int main(int argc, char **argv)
+{
+	size_t packet_size = argc > 1 ? (size_t)atol(argv[1]) : 16384;
+	size_t megabytes = argc > 2 ? (size_t)atol(argv[2]) : 1024;
+	size_t total;
+	char path[64];
+
+	if (!packet_size)
+		packet_size = 16384;
+	if (!megabytes)
+		megabytes = 1024;
+	total = megabytes * 1024 * 1024 / packet_size * packet_size;
+
+	struct transport shm = {.name = "shm",
+				.write = shm_write,
+				.read = shm_read,
+				.close = shm_close};
+	if (!ffm_shm_create(&shm.producer, FFM_SHM_SIZE)) {
+		fprintf(stderr, "failed to create the ring\n");
+		return 1;
+	}
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", shm.producer.fd);
+	if (!ffm_shm_open(&shm.consumer, path)) {
+		fprintf(stderr, "failed to open the ring\n");
+		return 1;
+	}
+	run(&shm, packet_size, total);
+	ffm_shm_free(&shm.consumer);
+	ffm_shm_free(&shm.producer);
+
+	struct transport pipe_transport = {.name = "pipe",
+					   .write = pipe_write,
+					   .read = pipe_read,
+					   .close = pipe_close};
+	if (pipe(pipe_transport.pipe_fds) != 0) {
+		fprintf(stderr, "failed to create the pipe\n");
+		return 1;
+	}
+	run(&pipe_transport, packet_size, total);
+	close(pipe_transport.pipe_fds[0]);
+
+	return 0;
+}
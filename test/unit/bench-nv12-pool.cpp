@@ -0,0 +1,109 @@
+/*
+ * Per-frame cost of handing OBS video frames to libwebrtc.  Not a test:
+ * prints the mean time per frame of allocating an I420Buffer and converting
+ * into it, as WebRTCStream used to, against copying into a pooled NV12
+ * buffer, with and without the encoder asking for I420.  A couple of frames
+ * are kept in flight, as they would be queued in the encoder.
+ *
+ *   bench-nv12-pool [width] [height] [frames]
+ */
+
+#include "NV12Buffer.h"
+
+#include <libyuv.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <deque>
+#include <vector>
+
+typedef std::chrono::steady_clock bench_clock;
+typedef rtc::scoped_refptr<webrtc::VideoFrameBuffer> frame_ref;
+
+#define FRAMES_IN_FLIGHT 2
+
+static size_t sink = 0;
+
+template<typename Func>
+static void run(const char *name, int frames, Func func)
+{
+	std::deque<frame_ref> in_flight;
+
+	bench_clock::time_point start = bench_clock::now();
+	for (int i = 0; i < frames; i++) {
+		frame_ref frame = func();
+		if (frame)
+			sink += frame->width();
+
+		in_flight.push_back(frame);
+		if (in_flight.size() > FRAMES_IN_FLIGHT)
+			in_flight.pop_front();
+	}
+	std::chrono::duration<double, std::micro> elapsed =
+		bench_clock::now() - start;
+
+	printf("%-24s %10.1f us/frame\n", name, elapsed.count() / frames);
+}
+
+int main(int argc, char **argv)
+{
+	int width = argc > 1 ? atoi(argv[1]) : 1920;
+	int height = argc > 2 ? atoi(argv[2]) : 1080;
+	int frames = argc > 3 ? atoi(argv[3]) : 1000;
+
+	if (width <= 0 || height <= 0) {
+		width = 1920;
+		height = 1080;
+	}
+	if (frames <= 0)
+		frames = 1000;
+
+	/* the frame as OBS outputs it, NV12 with packed planes */
+	const int stride_uv = (width + 1) / 2 * 2;
+	std::vector<uint8_t> nv12(width * height +
+				  stride_uv * ((height + 1) / 2));
+	for (size_t i = 0; i < nv12.size(); i++)
+		nv12[i] = (uint8_t)(i * 7);
+
+	const uint8_t *src_y = nv12.data();
+	const uint8_t *src_uv = nv12.data() + width * height;
+
+	printf("%dx%d, %d frames\n", width, height, frames);
+
+	run("I420 create + convert", frames, [&]() -> frame_ref {
+		rtc::scoped_refptr<webrtc::I420Buffer> buffer =
+			webrtc::I420Buffer::Create(width, height);
+		libyuv::ConvertToI420(
+			nv12.data(), nv12.size(), buffer->MutableDataY(),
+			buffer->StrideY(), buffer->MutableDataU(),
+			buffer->StrideU(), buffer->MutableDataV(),
+			buffer->StrideV(), 0, 0, width, height, width, height,
+			libyuv::kRotate0, libyuv::FOURCC_NV12);
+		return buffer;
+	});
+
+	NV12BufferPool pool;
+
+	run("NV12 pool", frames, [&]() -> frame_ref {
+		rtc::scoped_refptr<NV12Buffer> buffer =
+			pool.CreateBuffer(width, height);
+		if (buffer)
+			buffer->CopyFrom(src_y, width, src_uv, stride_uv);
+		return buffer;
+	});
+
+	run("NV12 pool + ToI420", frames, [&]() -> frame_ref {
+		rtc::scoped_refptr<NV12Buffer> buffer =
+			pool.CreateBuffer(width, height);
+		if (!buffer)
+			return nullptr;
+		buffer->CopyFrom(src_y, width, src_uv, stride_uv);
+		return buffer->ToI420();
+	});
+
+	pool.Release();
+
+	return sink ? 0 : 1;
+}
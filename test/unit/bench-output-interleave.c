@@ -0,0 +1,208 @@
+/*
+ * Micro-benchmark of output interleaving: the per-track queues of
+ * obs-interleave.h against the single dts-sorted array they replaced.  Not
+ * a test: prints the time per packet of keeping a given number of packets
+ * buffered, each packet inserted and later popped in interleaving order,
+ * with video and several audio tracks.
+ *
+ *   bench-output-interleave [audio tracks] [packets]
+ */
+
+#include "obs-interleave.h"
+#include "util/platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define VIDEO_INTERVAL_USEC 16667
+#define AUDIO_INTERVAL_USEC 21333
+
+struct track {
+	enum obs_encoder_type type;
+	size_t track_idx;
+	int64_t interval_usec;
+	int64_t next_dts_usec;
+};
+
+struct stream {
+	struct track tracks[1 + MAX_AUDIO_MIXES];
+	size_t num_tracks;
+	int64_t id;
+};
+
+static void stream_init(struct stream *stream, size_t audio_tracks)
+{
+	stream->num_tracks = 1 + audio_tracks;
+	stream->id = 0;
+
+	stream->tracks[0].type = OBS_ENCODER_VIDEO;
+	stream->tracks[0].track_idx = 0;
+	stream->tracks[0].interval_usec = VIDEO_INTERVAL_USEC;
+	stream->tracks[0].next_dts_usec = 0;
+
+	for (size_t i = 1; i < stream->num_tracks; i++) {
+		stream->tracks[i].type = OBS_ENCODER_AUDIO;
+		stream->tracks[i].track_idx = i - 1;
+		stream->tracks[i].interval_usec = AUDIO_INTERVAL_USEC;
+		/* audio encoders lag a little behind video */
+		stream->tracks[i].next_dts_usec = -(int64_t)i * 1000;
+	}
+}
+
+/* the track due next, the way the encoders' callbacks arrive */
+static struct encoder_packet next_packet(struct stream *stream)
+{
+	struct encoder_packet packet = {0};
+	struct track *track = &stream->tracks[0];
+
+	for (size_t i = 1; i < stream->num_tracks; i++) {
+		if (stream->tracks[i].next_dts_usec < track->next_dts_usec)
+			track = &stream->tracks[i];
+	}
+
+	packet.type = track->type;
+	packet.track_idx = track->track_idx;
+	packet.dts_usec = track->next_dts_usec;
+	packet.pts = stream->id++;
+	packet.size = 1000;
+	track->next_dts_usec += track->interval_usec;
+	return packet;
+}
+
+/* ------------------------------------------------------------------------- */
+/* previous implementation: one array sorted on insertion                    */
+
+struct sorted_array {
+	DARRAY(struct encoder_packet) packets;
+};
+
+static void sorted_insert(void *data, struct encoder_packet *out)
+{
+	struct sorted_array *sa = data;
+	size_t idx;
+
+	for (idx = 0; idx < sa->packets.num; idx++) {
+		struct encoder_packet *cur_packet = sa->packets.array + idx;
+
+		if (out->dts_usec == cur_packet->dts_usec &&
+		    out->type == OBS_ENCODER_VIDEO) {
+			break;
+		} else if (out->dts_usec < cur_packet->dts_usec) {
+			break;
+		}
+	}
+
+	da_insert(sa->packets, idx, out);
+}
+
+static int64_t sorted_pop(void *data)
+{
+	struct sorted_array *sa = data;
+	int64_t pts = sa->packets.array[0].pts;
+
+	da_erase(sa->packets, 0);
+	return pts;
+}
+
+static void sorted_free(void *data)
+{
+	struct sorted_array *sa = data;
+	da_free(sa->packets);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void queues_insert(void *data, struct encoder_packet *out)
+{
+	interleave_insert(data, out);
+}
+
+static int64_t queues_pop(void *data)
+{
+	struct interleave_queues *iq = data;
+	struct interleaved_packet entry;
+
+	interleave_pop(iq, interleave_first_queue(iq), &entry);
+	return entry.packet.pts;
+}
+
+static void queues_free(void *data)
+{
+	struct interleave_queues *iq = data;
+
+	for (size_t i = 0; i < NUM_INTERLEAVED_QUEUES; i++)
+		circlebuf_free(&iq->queues[i]);
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct interleaver {
+	const char *name;
+	void (*insert)(void *data, struct encoder_packet *out);
+	int64_t (*pop)(void *data);
+	void (*free)(void *data);
+};
+
+static int64_t sink = 0;
+
+static double run(const struct interleaver *il, void *data,
+		  size_t audio_tracks, size_t buffered, size_t packets)
+{
+	struct stream stream;
+	uint64_t start;
+
+	stream_init(&stream, audio_tracks);
+
+	/* startup buffering, not timed */
+	for (size_t i = 0; i < buffered; i++) {
+		struct encoder_packet packet = next_packet(&stream);
+		il->insert(data, &packet);
+	}
+
+	start = os_gettime_ns();
+	for (size_t i = 0; i < packets; i++) {
+		struct encoder_packet packet = next_packet(&stream);
+		il->insert(data, &packet);
+		sink += il->pop(data);
+	}
+	double ns = (double)(os_gettime_ns() - start) / (double)packets;
+
+	il->free(data);
+	return ns;
+}
+
+int main(int argc, char **argv)
+{
+	static const size_t buffered[] = {16, 256, 4096};
+	size_t audio_tracks = argc > 1 ? (size_t)atol(argv[1]) : 6;
+	size_t packets = argc > 2 ? (size_t)atol(argv[2]) : 200000;
+
+	static const struct interleaver sorted = {
+		"sorted array", sorted_insert, sorted_pop, sorted_free};
+	static const struct interleaver queues = {
+		"track queues", queues_insert, queues_pop, queues_free};
+
+	if (!audio_tracks || audio_tracks > MAX_AUDIO_MIXES)
+		audio_tracks = 6;
+	if (!packets)
+		packets = 200000;
+
+	printf("video and %zu audio tracks, %zu packets\n", audio_tracks,
+	       packets);
+
+	for (size_t i = 0; i < sizeof(buffered) / sizeof(buffered[0]); i++) {
+		struct sorted_array sa = {0};
+		struct interleave_queues iq = {0};
+		double sorted_ns = run(&sorted, &sa, audio_tracks,
+				       buffered[i], packets);
+		double queues_ns = run(&queues, &iq, audio_tracks,
+				       buffered[i], packets);
+
+		printf("%6zu buffered: %-12s %9.1f ns/packet, "
+		       "%-12s %9.1f ns/packet\n",
+		       buffered[i], sorted.name, sorted_ns, queues.name,
+		       queues_ns);
+	}
+
+	return sink == 42 ? 1 : 0;
+}
@@ -0,0 +1,184 @@
+/*
+ * Micro-benchmark of sending media packets over RTMP: RTMP_WriteMedia, which
+ * gathers the chunks straight from the packet data, against muxing every
+ * packet into an FLV tag and handing that to RTMP_Write, as rtmp-stream did
+ * before.  Not a test: prints the throughput of each into a loopback TCP
+ * connection drained by another thread.
+ *
+ *   bench-rtmp-send [packet size] [megabytes]
+ */
+
+#include "flv-mux.h"
+#include "librtmp/rtmp.h"
+
+#include <util/bmem.h>
+#include <util/platform.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define FPS 60
+#define CHUNK_SIZE 4096
+
+struct sink {
+	int fd;
+	size_t read;
+};
+
+static void *sink_thread(void *data)
+{
+	struct sink *sink = data;
+	char buf[65536];
+	ssize_t got;
+
+	while ((got = recv(sink->fd, buf, sizeof(buf), 0)) > 0)
+		sink->read += (size_t)got;
+
+	return NULL;
+}
+
+/* a connected pair of loopback sockets */
+static bool connect_loopback(int *send_fd, int *recv_fd)
+{
+	struct sockaddr_in addr = {0};
+	socklen_t len = sizeof(addr);
+	int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	bool success = false;
+
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (listen_fd < 0)
+		return false;
+	if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+	    getsockname(listen_fd, (struct sockaddr *)&addr, &len) != 0 ||
+	    listen(listen_fd, 1) != 0)
+		goto fail;
+
+	*send_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (*send_fd < 0)
+		goto fail;
+	if (connect(*send_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		close(*send_fd);
+		goto fail;
+	}
+
+	*recv_fd = accept(listen_fd, NULL, NULL);
+	success = *recv_fd >= 0;
+	if (!success)
+		close(*send_fd);
+
+fail:
+	close(listen_fd);
+	return success;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int write_muxed(RTMP *rtmp, struct encoder_packet *packet)
+{
+	uint8_t *data;
+	size_t size;
+	int ret;
+
+	flv_packet_mux(packet, 0, &data, &size, false);
+	ret = RTMP_Write(rtmp, (char *)data, (int)size, 0);
+	bfree(data);
+	return ret;
+}
+
+static int write_media(RTMP *rtmp, struct encoder_packet *packet)
+{
+	struct flv_tag tag;
+
+	flv_packet_tag(packet, 0, &tag, false);
+	return RTMP_WriteMedia(rtmp, tag.type,
+			       (uint32_t)tag.time_ms & 0x7FFFFFFF,
+			       (const char *)tag.prefix, (int)tag.prefix_size,
+			       (const char *)packet->data, (int)packet->size, 0);
+}
+
+static void run(const char *name,
+		int (*write)(RTMP *rtmp, struct encoder_packet *packet),
+		uint8_t *data, size_t packet_size, size_t count)
+{
+	struct sink sink = {0};
+	pthread_t thread;
+	RTMP rtmp;
+	int fd;
+	uint64_t start;
+
+	if (!connect_loopback(&fd, &sink.fd)) {
+		fprintf(stderr, "failed to connect over loopback\n");
+		return;
+	}
+
+	/* a published stream, past the handshake */
+	RTMP_Init(&rtmp);
+	rtmp.m_sb.sb_socket = fd;
+	rtmp.m_outChunkSize = CHUNK_SIZE;
+	rtmp.Link.nStreams = 1;
+	rtmp.Link.streams[0].id = 1;
+
+	start = os_gettime_ns();
+	pthread_create(&thread, NULL, sink_thread, &sink);
+
+	for (size_t i = 0; i < count; i++) {
+		struct encoder_packet packet = {0};
+
+		packet.type = OBS_ENCODER_VIDEO;
+		packet.data = data;
+		packet.size = packet_size;
+		packet.pts = packet.dts = (int64_t)i;
+		packet.timebase_num = 1;
+		packet.timebase_den = FPS;
+		packet.keyframe = i % (2 * FPS) == 0;
+
+		if (write(&rtmp, &packet) < 0) {
+			fprintf(stderr, "%s: send failed\n", name);
+			break;
+		}
+	}
+
+	shutdown(fd, SHUT_WR);
+	pthread_join(thread, NULL);
+
+	double sec = (double)(os_gettime_ns() - start) / 1e9;
+	printf("%-12s %8zu B packets %10.1f MB/s %10.2f us/packet\n", name,
+	       packet_size, (double)sink.read / sec / 1e6,
+	       sec * 1e6 / (double)count);
+
+	close(fd);
+	close(sink.fd);
+	rtmp.m_sb.sb_socket = -1;
+	RTMP_Close(&rtmp);
+}
+
+int main(int argc, char **argv)
+{
+	size_t packet_size = argc > 1 ? (size_t)atol(argv[1]) : 16384;
+	size_t megabytes = argc > 2 ? (size_t)atol(argv[2]) : 1024;
+	size_t count;
+	uint8_t *data;
+
+	if (!packet_size)
+		packet_size = 16384;
+	if (!megabytes)
+		megabytes = 1024;
+	count = megabytes * 1024 * 1024 / packet_size;
+
+	data = bmalloc(packet_size);
+	for (size_t i = 0; i < packet_size; i++)
+		data[i] = (uint8_t)(i * 7);
+
+	run("mux + write", write_muxed, data, packet_size, count);
+	run("write media", write_media, data, packet_size, count);
+
+	bfree(data);
+	return 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * Micro-benchmark of the SDP munging done per offer, answer and remote
+ * candidate.  Not a test: prints the mean time per call.
+ *
+ *   bench-sdp-modif [iterations]
+ */
+
+#include "SDPModif.h"
+#include "sdp-offer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+
+typedef std::chrono::steady_clock bench_clock;
+
+static size_t sink = 0;
+
+template<typename Func>
+static void run(const char *name, int iterations, Func func)
+{
+	func();
+
+	bench_clock::time_point start = bench_clock::now();
+	for (int i = 0; i < iterations; i++)
+		func();
+	std::chrono::duration<double, std::micro> elapsed =
+		bench_clock::now() - start;
+
+	printf("%-24s %10.2f us/call\n", name, elapsed.count() / iterations);
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 10000;
+	if (iterations <= 0)
+		iterations = 10000;
+
+	/* same edits as WebRTCStream::OnSuccess for a single layer */
+	run("offer (h264)", iterations, [] {
+		std::string sdp = sdp_offer;
+		std::vector<int> audio;
+		std::vector<int> video;
+		SDPModif::Description description(sdp);
+		description.forcePayload(audio, video, "opus", "h264", 0,
+					 "42e01f", 0);
+		description.bitrateMaxMin(2500, video);
+		description.stereo(128);
+		sink += description.toString().size();
+	});
+
+	run("offer (automatic)", iterations, [] {
+		std::string sdp = sdp_offer;
+		std::vector<int> audio;
+		std::vector<int> video;
+		SDPModif::Description description(sdp);
+		description.forcePayload(audio, video, "", "", 0, "42e01f", 0);
+		description.bitrateMaxMin(2500, video);
+		description.stereo(128);
+		sink += description.toString().size();
+	});
+
+	/* same edits as WebRTCStream::onOpened */
+	run("answer", iterations, [] {
+		SDPModif::Description description(sdp_offer);
+		description.bitrate(2500);
+		description.stereo(128);
+		sink += description.toString().size();
+	});
+
+	run("parse + serialize", iterations, [] {
+		sink += SDPModif::Description(sdp_offer).toString().size();
+	});
+
+	run("filterIceCandidates", iterations * 10, [] {
+		sink += SDPModif::filterIceCandidates(
+			"candidate:842163049 1 udp 1677729535 203.0.113.7 "
+			"52133 typ srflx raddr 0.0.0.0 rport 0 generation 0",
+			"udp");
+	});
+
+	return sink ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+/*
+ * Start latency of the WebRTC outputs' shared libwebrtc state.  Not a test:
+ * prints the mean time a starting output spends getting its threads and
+ * PeerConnection factory, when it is the only output (the context is built
+ * and torn down each time, as every output used to) and when another output
+ * already holds the context.
+ *
+ *   bench-webrtc-context [iterations]
+ */
+
+#include "WebRTCContext.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+
+typedef std::chrono::steady_clock bench_clock;
+
+static size_t sink = 0;
+
+template<typename Func>
+static void run(const char *name, int iterations, Func func)
+{
+	func();
+
+	bench_clock::time_point start = bench_clock::now();
+	for (int i = 0; i < iterations; i++)
+		func();
+	std::chrono::duration<double, std::milli> elapsed =
+		bench_clock::now() - start;
+
+	printf("%-24s %10.3f ms/start\n", name, elapsed.count() / iterations);
+}
+
+static void start_stop(bool encoded)
+{
+	WebRTCContext *context = WebRTCContext::acquire(encoded);
+	if (context->peerConnectionFactory())
+		sink++;
+	WebRTCContext::release(context);
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 20;
+	if (iterations <= 0)
+		iterations = 20;
+
+	run("raw, only output", iterations, [] { start_stop(false); });
+	run("encoded, only output", iterations, [] { start_stop(true); });
+
+	WebRTCContext *raw = WebRTCContext::acquire(false);
+	WebRTCContext *encoded = WebRTCContext::acquire(true);
+
+	run("raw, shared", iterations * 100, [] { start_stop(false); });
+	run("encoded, shared", iterations * 100, [] { start_stop(true); });
+
+	WebRTCContext::release(encoded);
+	WebRTCContext::release(raw);
+	WebRTCContext::shutdown();
+
+	return sink ? 0 : 1;
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+/* Answers to sdp_offer the way each WebRTC service sends them back,
+ * trimmed to what the answer edits look at. */
+
+/* Janus video room: ice-lite, candidates inline, VP8 with RTX. */
+static const char sdp_answer_janus[] =
+	"v=0\r\n"
+	"o=- 4611731400430051336 2 IN IP4 203.0.113.10\r\n"
+	"s=VideoRoom 1234\r\n"
+	"t=0 0\r\n"
+	"a=group:BUNDLE 0 1\r\n"
+	"a=msid-semantic: WMS janus\r\n"
+	"a=ice-lite\r\n"
+	"m=audio 9 UDP/TLS/RTP/SAVPF 111\r\n"
+	"c=IN IP4 203.0.113.10\r\n"
+	"a=recvonly\r\n"
+	"a=mid:0\r\n"
+	"a=rtcp-mux\r\n"
+	"a=ice-ufrag:Wc5S\r\n"
+	"a=ice-pwd:WMrVIK4WqzMbnrD0n6pPgX\r\n"
+	"a=ice-options:trickle\r\n"
+	"a=fingerprint:sha-256 D2:B9:31:8F:DF:24:D8:0E:ED:D2:EF:25:9E:AF:6F:B8:34:AE:53:9C:E6:F3:8F:F2:64:15:FA:E8:7F:53:2D:38\r\n"
+	"a=setup:active\r\n"
+	"a=rtpmap:111 opus/48000/2\r\n"
+	"a=fmtp:111 minptime=10;useinbandfec=1\r\n"
+	"a=candidate:1 1 udp 2015363327 203.0.113.10 20012 typ host\r\n"
+	"a=end-of-candidates\r\n"
+	"m=video 9 UDP/TLS/RTP/SAVPF 96 97\r\n"
+	"c=IN IP4 203.0.113.10\r\n"
+	"a=recvonly\r\n"
+	"a=mid:1\r\n"
+	"a=rtcp-mux\r\n"
+	"a=ice-ufrag:Wc5S\r\n"
+	"a=ice-pwd:WMrVIK4WqzMbnrD0n6pPgX\r\n"
+	"a=ice-options:trickle\r\n"
+	"a=fingerprint:sha-256 D2:B9:31:8F:DF:24:D8:0E:ED:D2:EF:25:9E:AF:6F:B8:34:AE:53:9C:E6:F3:8F:F2:64:15:FA:E8:7F:53:2D:38\r\n"
+	"a=setup:active\r\n"
+	"a=rtpmap:96 VP8/90000\r\n"
+	"a=rtcp-fb:96 ccm fir\r\n"
+	"a=rtcp-fb:96 nack\r\n"
+	"a=rtcp-fb:96 nack pli\r\n"
+	"a=rtcp-fb:96 goog-remb\r\n"
+	"a=rtpmap:97 rtx/90000\r\n"
+	"a=fmtp:97 apt=96\r\n"
+	"a=candidate:1 1 udp 2015363327 203.0.113.10 20012 typ host\r\n"
+	"a=end-of-candidates\r\n";
+
+/* Wowza Streaming Engine: connection line at session level only, H264
+ * and VP8 both accepted. */
+static const char sdp_answer_wowza[] =
+	"v=0\r\n"
+	"o=WowzaStreamingEngine-next 1795283645 2 IN IP4 127.0.0.1\r\n"
+	"s=-\r\n"
+	"c=IN IP4 198.51.100.20\r\n"
+	"t=0 0\r\n"
+	"a=fingerprint:sha-256 0A:47:33:FE:2B:6E:E3:22:53:8B:C3:C8:3B:8F:B9:8A:2C:31:0B:16:34:22:51:F4:A9:60:54:37:8B:61:7C:46\r\n"
+	"a=group:BUNDLE 0 1\r\n"
+	"a=ice-ufrag:2b3d7c44\r\n"
+	"a=ice-pwd:ba6f9a2f6e0c8fcf8d8ec0f5b61b76a5\r\n"
+	"a=msid-semantic: WMS\r\n"
+	"m=audio 9 UDP/TLS/RTP/SAVPF 111\r\n"
+	"a=rtpmap:111 opus/48000/2\r\n"
+	"a=fmtp:111 minptime=10;useinbandfec=1\r\n"
+	"a=rtcp-mux\r\n"
+	"a=setup:passive\r\n"
+	"a=mid:0\r\n"
+	"a=recvonly\r\n"
+	"a=candidate:0 1 UDP 50 198.51.100.20 1935 typ host generation 0\r\n"
+	"m=video 9 UDP/TLS/RTP/SAVPF 125 107 96 97\r\n"
+	"a=rtpmap:125 H264/90000\r\n"
+	"a=fmtp:125 level-asymmetry-allowed=1;packetization-mode=1;profile-level-id=42e01f\r\n"
+	"a=rtcp-fb:125 nack pli\r\n"
+	"a=rtpmap:107 rtx/90000\r\n"
+	"a=fmtp:107 apt=125\r\n"
+	"a=rtpmap:96 VP8/90000\r\n"
+	"a=rtcp-fb:96 nack pli\r\n"
+	"a=rtpmap:97 rtx/90000\r\n"
+	"a=fmtp:97 apt=96\r\n"
+	"a=rtcp-mux\r\n"
+	"a=setup:passive\r\n"
+	"a=mid:1\r\n"
+	"a=recvonly\r\n"
+	"a=candidate:0 1 UDP 50 198.51.100.20 1935 typ host generation 0\r\n";
+
+/* Millicast: Opus already stereo, VP9 profile 0 and H264 without
+ * interleaving. */
+static const char sdp_answer_millicast[] =
+	"v=0\r\n"
+	"o=- 7153463960413307384 2 IN IP4 127.0.0.1\r\n"
+	"s=-\r\n"
+	"t=0 0\r\n"
+	"a=group:BUNDLE 0 1\r\n"
+	"a=msid-semantic: WMS *\r\n"
+	"a=ice-lite\r\n"
+	"m=audio 9 UDP/TLS/RTP/SAVPF 111\r\n"
+	"c=IN IP4 0.0.0.0\r\n"
+	"a=rtcp:9 IN IP4 0.0.0.0\r\n"
+	"a=ice-ufrag:lc3N\r\n"
+	"a=ice-pwd:uTMsy8ZV1pIyIpC2fWHpx7G0\r\n"
+	"a=fingerprint:sha-256 5E:C0:55:29:97:5C:39:7B:3F:D4:5A:7A:AC:B1:21:F0:44:8F:5D:89:D5:9E:43:C0:45:30:FB:80:96:E4:CE:2E\r\n"
+	"a=setup:passive\r\n"
+	"a=mid:0\r\n"
+	"a=recvonly\r\n"
+	"a=rtcp-mux\r\n"
+	"a=rtpmap:111 opus/48000/2\r\n"
+	"a=fmtp:111 minptime=10;useinbandfec=1;stereo=1;sprop-stereo=1\r\n"
+	"m=video 9 UDP/TLS/RTP/SAVPF 98 99 108\r\n"
+	"c=IN IP4 0.0.0.0\r\n"
+	"a=rtcp:9 IN IP4 0.0.0.0\r\n"
+	"a=ice-ufrag:lc3N\r\n"
+	"a=ice-pwd:uTMsy8ZV1pIyIpC2fWHpx7G0\r\n"
+	"a=fingerprint:sha-256 5E:C0:55:29:97:5C:39:7B:3F:D4:5A:7A:AC:B1:21:F0:44:8F:5D:89:D5:9E:43:C0:45:30:FB:80:96:E4:CE:2E\r\n"
+	"a=setup:passive\r\n"
+	"a=mid:1\r\n"
+	"a=recvonly\r\n"
+	"a=rtcp-mux\r\n"
+	"a=rtcp-rsize\r\n"
+	"a=rtpmap:98 VP9/90000\r\n"
+	"a=rtcp-fb:98 nack pli\r\n"
+	"a=fmtp:98 profile-id=0\r\n"
+	"a=rtpmap:99 rtx/90000\r\n"
+	"a=fmtp:99 apt=98\r\n"
+	"a=rtpmap:108 H264/90000\r\n"
+	"a=rtcp-fb:108 nack pli\r\n"
+	"a=fmtp:108 level-asymmetry-allowed=1;packetization-mode=0;profile-level-id=42e01f\r\n";
+
+/* Evercast: bandwidth already capped by the server, Opus without an fmtp
+ * line next to G722. */
+static const char sdp_answer_evercast[] =
+	"v=0\r\n"
+	"o=- 3904017626 1 IN IP4 192.0.2.30\r\n"
+	"s=Evercast\r\n"
+	"t=0 0\r\n"
+	"a=group:BUNDLE 0 1\r\n"
+	"a=msid-semantic: WMS evercast\r\n"
+	"m=audio 9 UDP/TLS/RTP/SAVPF 111 9\r\n"
+	"c=IN IP4 192.0.2.30\r\n"
+	"a=rtcp:9 IN IP4 0.0.0.0\r\n"
+	"a=ice-ufrag:Ev7q\r\n"
+	"a=ice-pwd:0bOq3iO5l0yFh6jR8KzW4c2N\r\n"
+	"a=fingerprint:sha-256 9F:21:7A:C4:0D:52:E1:38:6B:AE:15:70:2C:93:D8:46:FB:0E:61:C7:3A:58:94:BD:12:E6:7F:03:A9:C5:28:D1\r\n"
+	"a=setup:active\r\n"
+	"a=mid:0\r\n"
+	"a=recvonly\r\n"
+	"a=rtcp-mux\r\n"
+	"a=rtpmap:111 opus/48000/2\r\n"
+	"a=rtpmap:9 G722/8000\r\n"
+	"m=video 9 UDP/TLS/RTP/SAVPF 108 109\r\n"
+	"c=IN IP4 192.0.2.30\r\n"
+	"b=AS:6000\r\n"
+	"a=rtcp:9 IN IP4 0.0.0.0\r\n"
+	"a=ice-ufrag:Ev7q\r\n"
+	"a=ice-pwd:0bOq3iO5l0yFh6jR8KzW4c2N\r\n"
+	"a=fingerprint:sha-256 9F:21:7A:C4:0D:52:E1:38:6B:AE:15:70:2C:93:D8:46:FB:0E:61:C7:3A:58:94:BD:12:E6:7F:03:A9:C5:28:D1\r\n"
+	"a=setup:active\r\n"
+	"a=mid:1\r\n"
+	"a=recvonly\r\n"
+	"a=rtcp-mux\r\n"
+	"a=rtpmap:108 H264/90000\r\n"
+	"a=rtcp-fb:108 nack pli\r\n"
+	"a=fmtp:108 level-asymmetry-allowed=1;packetization-mode=0;profile-level-id=42e01f\r\n"
+	"a=rtpmap:109 rtx/90000\r\n"
+	"a=fmtp:109 apt=108\r\n";
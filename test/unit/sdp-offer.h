@@ -0,0 +1,94 @@
+#pragma once
+
+/* libwebrtc style offer: Opus plus the usual audio codecs, VP8, VP9 and
+ * H264 in both packetization modes, each video codec with its RTX. */
+static const char sdp_offer[] =
+	"v=0\r\n"
+	"o=- 4611731400430051336 2 IN IP4 127.0.0.1\r\n"
+	"s=-\r\n"
+	"t=0 0\r\n"
+	"a=group:BUNDLE 0 1\r\n"
+	"a=msid-semantic: WMS stream\r\n"
+	"m=audio 9 UDP/TLS/RTP/SAVPF 111 103 104 9 0 8 106 105 13 110 112 113 126\r\n"
+	"c=IN IP4 0.0.0.0\r\n"
+	"a=rtcp:9 IN IP4 0.0.0.0\r\n"
+	"a=ice-ufrag:Kd2v\r\n"
+	"a=ice-pwd:8vXJ4ZU4pHdqE8pbqZV5xKMq\r\n"
+	"a=ice-options:trickle\r\n"
+	"a=fingerprint:sha-256 6B:8B:F0:65:5F:78:E2:51:3B:AC:6F:F3:3F:46:1B:35:DC:B8:5F:64:1A:24:C2:43:F0:A1:58:D0:A1:2C:19:08\r\n"
+	"a=setup:actpass\r\n"
+	"a=mid:0\r\n"
+	"a=extmap:1 urn:ietf:params:rtp-hdrext:ssrc-audio-level\r\n"
+	"a=sendrecv\r\n"
+	"a=msid:stream audio\r\n"
+	"a=rtcp-mux\r\n"
+	"a=rtpmap:111 opus/48000/2\r\n"
+	"a=rtcp-fb:111 transport-cc\r\n"
+	"a=fmtp:111 minptime=10;useinbandfec=1\r\n"
+	"a=rtpmap:103 ISAC/16000\r\n"
+	"a=rtpmap:104 ISAC/32000\r\n"
+	"a=rtpmap:9 G722/8000\r\n"
+	"a=rtpmap:0 PCMU/8000\r\n"
+	"a=rtpmap:8 PCMA/8000\r\n"
+	"a=rtpmap:106 CN/32000\r\n"
+	"a=rtpmap:105 CN/16000\r\n"
+	"a=rtpmap:13 CN/8000\r\n"
+	"a=rtpmap:110 telephone-event/48000\r\n"
+	"a=rtpmap:112 telephone-event/32000\r\n"
+	"a=rtpmap:113 telephone-event/16000\r\n"
+	"a=rtpmap:126 telephone-event/8000\r\n"
+	"a=ssrc:1211486823 cname:dvPq0Nd1lHZ1K0a3\r\n"
+	"a=ssrc:1211486823 msid:stream audio\r\n"
+	"m=video 9 UDP/TLS/RTP/SAVPF 96 97 98 99 100 101 102 121 127 120 125 107 108 109\r\n"
+	"c=IN IP4 0.0.0.0\r\n"
+	"a=rtcp:9 IN IP4 0.0.0.0\r\n"
+	"a=ice-ufrag:Kd2v\r\n"
+	"a=ice-pwd:8vXJ4ZU4pHdqE8pbqZV5xKMq\r\n"
+	"a=ice-options:trickle\r\n"
+	"a=fingerprint:sha-256 6B:8B:F0:65:5F:78:E2:51:3B:AC:6F:F3:3F:46:1B:35:DC:B8:5F:64:1A:24:C2:43:F0:A1:58:D0:A1:2C:19:08\r\n"
+	"a=setup:actpass\r\n"
+	"a=mid:1\r\n"
+	"a=extmap:14 urn:ietf:params:rtp-hdrext:toffset\r\n"
+	"a=sendrecv\r\n"
+	"a=msid:stream video\r\n"
+	"a=rtcp-mux\r\n"
+	"a=rtcp-rsize\r\n"
+	"a=rtpmap:96 VP8/90000\r\n"
+	"a=rtcp-fb:96 goog-remb\r\n"
+	"a=rtcp-fb:96 nack\r\n"
+	"a=rtcp-fb:96 nack pli\r\n"
+	"a=rtpmap:97 rtx/90000\r\n"
+	"a=fmtp:97 apt=96\r\n"
+	"a=rtpmap:98 VP9/90000\r\n"
+	"a=rtcp-fb:98 nack pli\r\n"
+	"a=fmtp:98 profile-id=0\r\n"
+	"a=rtpmap:99 rtx/90000\r\n"
+	"a=fmtp:99 apt=98\r\n"
+	"a=rtpmap:100 VP9/90000\r\n"
+	"a=rtcp-fb:100 nack pli\r\n"
+	"a=fmtp:100 profile-id=2\r\n"
+	"a=rtpmap:101 rtx/90000\r\n"
+	"a=fmtp:101 apt=100\r\n"
+	"a=rtpmap:102 H264/90000\r\n"
+	"a=rtcp-fb:102 nack pli\r\n"
+	"a=fmtp:102 level-asymmetry-allowed=1;packetization-mode=1;profile-level-id=42001f\r\n"
+	"a=rtpmap:121 rtx/90000\r\n"
+	"a=fmtp:121 apt=102\r\n"
+	"a=rtpmap:127 H264/90000\r\n"
+	"a=rtcp-fb:127 nack pli\r\n"
+	"a=fmtp:127 level-asymmetry-allowed=1;packetization-mode=0;profile-level-id=42001f\r\n"
+	"a=rtpmap:120 rtx/90000\r\n"
+	"a=fmtp:120 apt=127\r\n"
+	"a=rtpmap:125 H264/90000\r\n"
+	"a=rtcp-fb:125 nack pli\r\n"
+	"a=fmtp:125 level-asymmetry-allowed=1;packetization-mode=1;profile-level-id=42e01f\r\n"
+	"a=rtpmap:107 rtx/90000\r\n"
+	"a=fmtp:107 apt=125\r\n"
+	"a=rtpmap:108 H264/90000\r\n"
+	"a=rtcp-fb:108 nack pli\r\n"
+	"a=fmtp:108 level-asymmetry-allowed=1;packetization-mode=0;profile-level-id=42e01f\r\n"
+	"a=rtpmap:109 rtx/90000\r\n"
+	"a=fmtp:109 apt=108\r\n"
+	"a=ssrc-group:FID 2846254423 3412553434\r\n"
+	"a=ssrc:2846254423 cname:dvPq0Nd1lHZ1K0a3\r\n"
+	"a=ssrc:3412553434 cname:dvPq0Nd1lHZ1K0a3\r\n";
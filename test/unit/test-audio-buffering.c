@@ -0,0 +1,180 @@
+/*
+ * Audio buffering decay: an audio output at 192 kHz, so that ticks are short,
+ * whose input callback buffers ticks the way audio_callback does and takes
+ * them out again through audio_output_request_tick(), with the audio thread
+ * made to catch up right when a tick is taken out.
+ */
+
+#include "obs-audio-buffering.h"
+#include "media-io/audio-io.h"
+#include "util/platform.h"
+#include "util/threading.h"
+
+#include <stdio.h>
+
+#define SAMPLE_RATE 192000
+#define INITIAL_TICKS 6
+#define DECAYS 3
+#define CATCH_UP_TICKS 8
+
+static int failures = 0;
+
+#define check(cond)                                                       \
+	do {                                                              \
+		if (!(cond)) {                                            \
+			fprintf(stderr, "%s:%d: check failed: %s\n",      \
+				__FILE__, __LINE__, #cond);               \
+			failures++;                                       \
+		}                                                         \
+	} while (false)
+
+struct state {
+	audio_t *audio;
+	uint64_t tick_ns;
+
+	/* touched by the audio thread only until it is stopped */
+	struct circlebuf timestamps;
+	int total_ticks;
+	int stable_ticks;
+	bool requested;
+	uint64_t last_end;
+	uint64_t last_out_end;
+
+	volatile long decays;
+	int decays_catching_up;
+	int ticks;
+	int outputs;
+	uint64_t last_output_ts;
+};
+
+static bool input_callback(void *param, uint64_t start_ts, uint64_t end_ts,
+			   uint64_t *out_ts, uint32_t mixers,
+			   struct audio_output_data *mixes)
+{
+	struct state *state = param;
+	bool requested = start_ts == end_ts;
+	struct ts_info ts;
+
+	/* the requested tick comes right after the tick asking for it, with
+	 * an empty range where that tick ended */
+	check(requested == state->requested);
+	if (requested)
+		check(start_ts == state->last_end);
+	state->requested = false;
+	state->last_end = end_ts;
+
+	if (!buffered_ts_next(&state->timestamps, start_ts, end_ts, &ts)) {
+		check(false);
+		return false;
+	}
+
+	/* start out with a few ticks of buffering, as if a source had
+	 * fallen behind */
+	if (!state->ticks++) {
+		for (int i = 1; i <= INITIAL_TICKS; i++) {
+			struct ts_info old_ts = {
+				start_ts - (uint64_t)i * state->tick_ns,
+				start_ts - (uint64_t)(i - 1) * state->tick_ns};
+			circlebuf_push_front(&state->timestamps, &old_ts,
+					     sizeof(old_ts));
+		}
+		state->total_ticks = INITIAL_TICKS;
+		circlebuf_peek_front(&state->timestamps, &ts, sizeof(ts));
+		state->last_out_end = ts.start;
+	}
+
+	/* output timestamps stay continuous, no range is ever empty */
+	check(ts.end > ts.start);
+	check(ts.start == state->last_out_end);
+	state->last_out_end = ts.end;
+
+	circlebuf_pop_front(&state->timestamps, NULL, sizeof(ts));
+	check(buffered_ts_count(&state->timestamps) ==
+	      (size_t)state->total_ticks);
+
+	if (!requested && state->total_ticks > INITIAL_TICKS - DECAYS) {
+		if (buffering_decay_due(&state->stable_ticks, true)) {
+			uint64_t now = os_gettime_ns();
+
+			/* not the last tick of a catch up */
+			if (now > end_ts + state->tick_ns)
+				state->decays_catching_up++;
+
+			state->total_ticks--;
+			state->requested = true;
+			audio_output_request_tick(state->audio);
+			os_atomic_inc_long(&state->decays);
+
+		} else if (state->stable_ticks == BUFFERING_DECAY_TICKS - 2) {
+			/* the tick taken out next but one is caught up on */
+			os_sleep_ms((uint32_t)(CATCH_UP_TICKS * state->tick_ns /
+					       1000000));
+		}
+	}
+
+	*out_ts = ts.start;
+	UNUSED_PARAMETER(mixers);
+	UNUSED_PARAMETER(mixes);
+	return true;
+}
+
+static void output_callback(void *param, size_t mix_idx,
+			    struct audio_data *data)
+{
+	struct state *state = param;
+
+	if (state->outputs++) {
+		uint64_t diff = data->timestamp - state->last_output_ts;
+		check(diff + 1 >= state->tick_ns && diff <= state->tick_ns + 1);
+	}
+	state->last_output_ts = data->timestamp;
+
+	check(data->frames == AUDIO_OUTPUT_FRAMES);
+	UNUSED_PARAMETER(mix_idx);
+}
+
+int main(void)
+{
+	struct state state = {0};
+	struct audio_output_info info = {0};
+
+	state.tick_ns = audio_frames_to_ns(SAMPLE_RATE, AUDIO_OUTPUT_FRAMES);
+
+	info.name = "test";
+	info.samples_per_sec = SAMPLE_RATE;
+	info.format = AUDIO_FORMAT_FLOAT_PLANAR;
+	info.speakers = SPEAKERS_STEREO;
+	info.input_callback = input_callback;
+	info.input_param = &state;
+
+	if (audio_output_open(&state.audio, &info) != AUDIO_OUTPUT_SUCCESS) {
+		fprintf(stderr, "failed to open the audio output\n");
+		return 1;
+	}
+	check(audio_output_connect(state.audio, 0, NULL, output_callback,
+				   &state));
+
+	uint64_t timeout = os_gettime_ns() + 10000000000ULL;
+	while (os_atomic_load_long(&state.decays) < DECAYS &&
+	       os_gettime_ns() < timeout)
+		os_sleep_ms(10);
+
+	/* a few more ticks after the last one taken out */
+	os_sleep_ms(50);
+
+	audio_output_disconnect(state.audio, 0, output_callback, &state);
+	audio_output_close(state.audio);
+
+	check(state.decays == DECAYS);
+	check(state.decays_catching_up == DECAYS);
+	check(state.total_ticks == INITIAL_TICKS - DECAYS);
+	check(buffered_ts_count(&state.timestamps) ==
+	      (size_t)(INITIAL_TICKS - DECAYS));
+	check(state.outputs > BUFFERING_DECAY_TICKS * DECAYS);
+
+	circlebuf_free(&state.timestamps);
+
+	if (failures)
+		fprintf(stderr, "%d check(s) failed\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,159 @@
+/*
+ * AudioFramer: 10 ms chunking at 44.1 and 48 kHz, and the mono, stereo and
+ * 5.1 conversions, against a plain scalar reference.
+ */
+
+#include "AudioFramer.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#define OBS_FRAMES 1024
+#define BLOCKS 40
+
+static int failures = 0;
+
+#define check(cond)                                                       \
+	do {                                                              \
+		if (!(cond)) {                                            \
+			fprintf(stderr, "%s:%d: check failed: %s\n",      \
+				__FILE__, __LINE__, #cond);               \
+			failures++;                                       \
+		}                                                         \
+	} while (false)
+
+static int16_t ref_s16(float sample)
+{
+	sample *= 32767.0f;
+	if (sample > 32767.0f)
+		return 32767;
+	if (sample < -32768.0f)
+		return -32768;
+	return (int16_t)lrintf(sample);
+}
+
+/* left and right of OBS 5.1 (FL, FR, FC, LFE, RL, RR), LFE dropped */
+static void ref_downmix_51(const float *in, float &l, float &r)
+{
+	const float k = 0.70710678f;
+	l = in[0] + k * in[2] + k * in[4];
+	r = in[1] + k * in[2] + k * in[5];
+}
+
+/* distinct per channel and frame, crosses 0 and clips now and then */
+static float signal(size_t channel, size_t frame)
+{
+	return 1.2f * sinf((float)frame * 0.013f * (float)(channel + 1) +
+			   (float)channel);
+}
+
+static void test_format(uint32_t rate, size_t channels)
+{
+	size_t out_channels = AudioFramer::outputChannels(channels);
+	size_t chunk = rate / 100;
+	size_t total = OBS_FRAMES * BLOCKS;
+
+	std::vector<std::vector<float>> planes(channels,
+					       std::vector<float>(total));
+	for (size_t c = 0; c < channels; c++)
+		for (size_t i = 0; i < total; i++)
+			planes[c][i] = signal(c, i);
+
+	AudioFramer framer;
+	std::vector<int16_t> out;
+	size_t calls = 0;
+	bool sizes_ok = true;
+
+	for (size_t b = 0; b < BLOCKS; b++) {
+		const float *block[8];
+		for (size_t c = 0; c < channels; c++)
+			block[c] = planes[c].data() + b * OBS_FRAMES;
+
+		framer.push(block, channels, OBS_FRAMES, rate,
+			    [&](const int16_t *data, size_t frames,
+				size_t chans, uint32_t sample_rate) {
+				    sizes_ok = sizes_ok && frames == chunk &&
+					       chans == out_channels &&
+					       sample_rate == rate;
+				    out.insert(out.end(), data,
+					       data + frames * chans);
+				    calls++;
+			    });
+	}
+
+	check(sizes_ok);
+	check(calls == total / chunk);
+	check(out.size() == calls * chunk * out_channels);
+
+	/* SSE and scalar paths may round the downmix sums differently */
+	int max_diff = 0;
+	for (size_t i = 0; i < calls * chunk; i++) {
+		int16_t expect[2];
+
+		if (channels == 1) {
+			expect[0] = ref_s16(planes[0][i]);
+		} else if (channels == 2) {
+			expect[0] = ref_s16(planes[0][i]);
+			expect[1] = ref_s16(planes[1][i]);
+		} else {
+			float in[6], l, r;
+			for (size_t c = 0; c < 6; c++)
+				in[c] = planes[c][i];
+			ref_downmix_51(in, l, r);
+			expect[0] = ref_s16(l);
+			expect[1] = ref_s16(r);
+		}
+
+		for (size_t c = 0; c < out_channels; c++) {
+			int diff = abs(out[i * out_channels + c] - expect[c]);
+			if (diff > max_diff)
+				max_diff = diff;
+		}
+	}
+
+	check(max_diff <= (channels > 2 ? 1 : 0));
+	if (failures)
+		fprintf(stderr, "  at %u Hz, %zu channel(s), max diff %d\n",
+			rate, channels, max_diff);
+}
+
+/* a partial chunk is dropped when the format changes */
+static void test_format_change(void)
+{
+	std::vector<float> mono(OBS_FRAMES, 0.5f);
+	const float *planes[2] = {mono.data(), mono.data()};
+	AudioFramer framer;
+	size_t frames_out = 0;
+	auto sink = [&](const int16_t *, size_t frames, size_t, uint32_t) {
+		frames_out += frames;
+	};
+
+	framer.push(planes, 1, 100, 48000, sink);
+	check(frames_out == 0);
+
+	framer.push(planes, 2, 480, 48000, sink);
+	check(frames_out == 480);
+
+	framer.push(planes, 2, 100, 48000, sink);
+	framer.push(planes, 2, 441, 44100, sink);
+	check(frames_out == 480 + 441);
+}
+
+int main(void)
+{
+	static const uint32_t rates[] = {44100, 48000};
+	static const size_t layouts[] = {1, 2, 6};
+
+	for (uint32_t rate : rates)
+		for (size_t channels : layouts)
+			test_format(rate, channels);
+
+	test_format_change();
+
+	if (failures)
+		fprintf(stderr, "%d check(s) failed\n", failures);
+	return failures ? 1 : 0;
+}
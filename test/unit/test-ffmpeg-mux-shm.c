@@ -0,0 +1,192 @@
+/*
+ * ffmpeg-mux shared memory ring: a writer and a reader thread move a byte
+ * stream through small rings, so that both sides wrap and sleep, and the
+ * reader must get every byte written before the ring was closed.
+ */
+
+#include "ffmpeg-mux-shm.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define RUNS 300
+
+static int failures = 0;
+
+#define check(cond)                                                       \
+	do {                                                              \
+		if (!(cond)) {                                            \
+			fprintf(stderr, "%s:%d: check failed: %s\n",      \
+				__FILE__, __LINE__, #cond);               \
+			failures++;                                       \
+		}                                                         \
+	} while (false)
+
+static inline uint8_t stream_byte(uint64_t offset)
+{
+	return (uint8_t)(offset * 31 + (offset >> 8) + 7);
+}
+
+static bool always_alive(void *param)
+{
+	(void)param;
+	return true;
+}
+
+struct run {
+	struct ffm_shm producer;
+	struct ffm_shm consumer;
+	size_t total;
+	size_t max_chunk;
+	unsigned seed;
+
+	size_t written;
+	size_t read;
+	bool data_ok;
+};
+
+static void *writer_thread(void *data)
+{
+	struct run *run = data;
+	uint8_t *buf = malloc(run->max_chunk);
+	unsigned seed = run->seed;
+
+	while (run->written < run->total) {
+		size_t size = 1 + (size_t)rand_r(&seed) % run->max_chunk;
+		if (size > run->total - run->written)
+			size = run->total - run->written;
+
+		for (size_t i = 0; i < size; i++)
+			buf[i] = stream_byte(run->written + i);
+
+		run->written += ffm_shm_write(&run->producer, buf, size,
+					      always_alive, NULL);
+	}
+
+	/* close right behind the last write, the reader may be anywhere */
+	ffm_shm_close(&run->producer);
+	free(buf);
+	return NULL;
+}
+
+static void *reader_thread(void *data)
+{
+	struct run *run = data;
+	uint8_t *buf = malloc(run->max_chunk);
+	unsigned seed = run->seed * 7 + 1;
+
+	run->data_ok = true;
+
+	for (;;) {
+		size_t size = 1 + (size_t)rand_r(&seed) % run->max_chunk;
+		size_t got = ffm_shm_read(&run->consumer, buf, size,
+					  always_alive, NULL);
+
+		for (size_t i = 0; i < got; i++) {
+			if (buf[i] != stream_byte(run->read + i))
+				run->data_ok = false;
+		}
+		run->read += got;
+
+		if (got < size)
+			break;
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static bool open_run(struct run *run, size_t ring_size)
+{
+	char path[64];
+
+	if (!ffm_shm_create(&run->producer, ring_size))
+		return false;
+
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", run->producer.fd);
+	if (!ffm_shm_open(&run->consumer, path)) {
+		ffm_shm_free(&run->producer);
+		return false;
+	}
+	return true;
+}
+
+static void test_threads(size_t ring_size, size_t max_chunk, size_t total)
+{
+	for (unsigned i = 1; i <= RUNS; i++) {
+		struct run run = {0};
+		pthread_t writer, reader;
+
+		run.total = total;
+		run.max_chunk = max_chunk;
+		run.seed = i;
+
+		check(open_run(&run, ring_size));
+		if (!run.producer.header)
+			return;
+
+		pthread_create(&reader, NULL, reader_thread, &run);
+		pthread_create(&writer, NULL, writer_thread, &run);
+		pthread_join(writer, NULL);
+		pthread_join(reader, NULL);
+
+		check(run.written == total);
+		check(run.read == total);
+		check(run.data_ok);
+
+		ffm_shm_free(&run.consumer);
+		ffm_shm_free(&run.producer);
+
+		if (run.read != total || !run.data_ok) {
+			fprintf(stderr, "  ring %zu, chunk %zu, seed %u\n",
+				ring_size, max_chunk, i);
+			return;
+		}
+	}
+}
+
+/* everything written before the close is still read after it */
+static void test_drain_after_close(void)
+{
+	struct run run = {0};
+	uint8_t buf[256];
+
+	check(open_run(&run, 1024));
+	if (!run.producer.header)
+		return;
+
+	for (size_t i = 0; i < sizeof(buf); i++)
+		buf[i] = stream_byte(i);
+	check(ffm_shm_write(&run.producer, buf, 200, always_alive, NULL) ==
+	      200);
+	ffm_shm_close(&run.producer);
+
+	memset(buf, 0, sizeof(buf));
+	check(ffm_shm_read(&run.consumer, buf, 100, always_alive, NULL) ==
+	      100);
+	check(ffm_shm_read(&run.consumer, buf + 100, 156, always_alive,
+			   NULL) == 100);
+	for (size_t i = 0; i < 200; i++)
+		check(buf[i] == stream_byte(i));
+	check(ffm_shm_read(&run.consumer, buf, 1, always_alive, NULL) == 0);
+
+	ffm_shm_free(&run.consumer);
+	ffm_shm_free(&run.producer);
+}
+
+int main(void)
+{
+	test_drain_after_close();
+
+	/* tiny ring: both sides sleep all the time */
+	test_threads(64, 100, 20000);
+	/* packets smaller than the ring, frequent wraparound */
+	test_threads(4096, 1500, 200000);
+	/* writes bigger than the ring */
+	test_threads(4096, 10000, 200000);
+
+	if (failures)
+		fprintf(stderr, "%d check(s) failed\n", failures);
+	return failures ? 1 : 0;
+}
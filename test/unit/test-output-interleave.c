@@ -0,0 +1,273 @@
+/*
+ * Output interleaving: the per-track queues of obs-interleave.h against the
+ * single dts-sorted array they replaced, on random multi-track streams with
+ * timestamp ties.
+ */
+
+#include "obs-interleave.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define RUNS 2000
+#define MAX_TRACKS 3
+
+static int failures = 0;
+
+#define check(cond)                                                       \
+	do {                                                              \
+		if (!(cond)) {                                            \
+			fprintf(stderr, "%s:%d: check failed: %s\n",      \
+				__FILE__, __LINE__, #cond);               \
+			failures++;                                       \
+		}                                                         \
+	} while (false)
+
+/* ------------------------------------------------------------------------- */
+/* previous implementation: one array sorted on insertion                    */
+
+struct reference {
+	DARRAY(struct encoder_packet) packets;
+};
+
+static void reference_insert(struct reference *ref, struct encoder_packet *out)
+{
+	size_t idx;
+	for (idx = 0; idx < ref->packets.num; idx++) {
+		struct encoder_packet *cur_packet = ref->packets.array + idx;
+
+		if (out->dts_usec == cur_packet->dts_usec &&
+		    out->type == OBS_ENCODER_VIDEO) {
+			break;
+		} else if (out->dts_usec < cur_packet->dts_usec) {
+			break;
+		}
+	}
+
+	da_insert(ref->packets, idx, out);
+}
+
+static void reference_resort(struct reference *ref)
+{
+	DARRAY(struct encoder_packet) old_array;
+
+	old_array.da = ref->packets.da;
+	memset(&ref->packets, 0, sizeof(ref->packets));
+
+	for (size_t i = 0; i < old_array.num; i++)
+		reference_insert(ref, &old_array.array[i]);
+
+	da_free(old_array);
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct track {
+	enum obs_encoder_type type;
+	size_t track_idx;
+	int64_t interval_usec;
+	int64_t next_dts_usec;
+};
+
+static int64_t id_counter = 0;
+
+/* next packet of a track, timestamps are rounded to 10 ms so that tracks
+ * often share a dts */
+static struct encoder_packet next_packet(struct track *track)
+{
+	struct encoder_packet packet = {0};
+
+	packet.type = track->type;
+	packet.track_idx = track->track_idx;
+	packet.dts_usec = track->next_dts_usec / 10000 * 10000;
+	packet.pts = id_counter++;
+	packet.size = 100 + (size_t)(rand() % 1000);
+	track->next_dts_usec += track->interval_usec;
+	return packet;
+}
+
+static uint64_t queued_bytes(struct reference *ref)
+{
+	uint64_t bytes = 0;
+	for (size_t i = 0; i < ref->packets.num; i++)
+		bytes += ref->packets.array[i].size;
+	return bytes;
+}
+
+/* the cursor walks the queues in the order they would be popped */
+static bool cursor_matches(struct interleave_queues *iq,
+			   struct reference *ref)
+{
+	struct interleave_cursor cursor = {0};
+	struct interleaved_packet *entry;
+	size_t i = 0;
+
+	while ((entry = interleave_cursor_next(iq, &cursor))) {
+		if (i >= ref->packets.num ||
+		    entry->packet.pts != ref->packets.array[i].pts)
+			return false;
+		i++;
+	}
+	return i == ref->packets.num;
+}
+
+static bool pop_matches(struct interleave_queues *iq, struct reference *ref)
+{
+	struct circlebuf *queue = interleave_first_queue(iq);
+	struct interleaved_packet entry;
+
+	if (!queue)
+		return ref->packets.num == 0;
+	if (!ref->packets.num)
+		return false;
+
+	interleave_pop(iq, queue, &entry);
+	bool match = entry.packet.pts == ref->packets.array[0].pts;
+	da_erase(ref->packets, 0);
+	return match;
+}
+
+static void run_stream(unsigned seed)
+{
+	struct interleave_queues iq = {0};
+	struct reference ref = {0};
+	struct track tracks[1 + MAX_TRACKS];
+	size_t num_tracks;
+	bool started = false;
+	bool order_ok = true;
+
+	srand(seed);
+	num_tracks = 2 + (size_t)(rand() % MAX_TRACKS);
+
+	tracks[0].type = OBS_ENCODER_VIDEO;
+	tracks[0].track_idx = 0;
+	tracks[0].interval_usec = rand() % 2 ? 33333 : 16667;
+	tracks[0].next_dts_usec = rand() % 100000;
+	for (size_t i = 1; i < num_tracks; i++) {
+		tracks[i].type = OBS_ENCODER_AUDIO;
+		tracks[i].track_idx = i - 1;
+		tracks[i].interval_usec = 21333;
+		tracks[i].next_dts_usec = rand() % 100000;
+	}
+
+	for (int op = 0; op < 600; op++) {
+		int r = rand() % 8;
+
+		if (r < 5) {
+			struct track *track = &tracks[rand() % num_tracks];
+			struct encoder_packet packet = next_packet(track);
+
+			interleave_insert(&iq, &packet);
+			reference_insert(&ref, &packet);
+
+		} else if (r < 7 && started) {
+			order_ok = order_ok && pop_matches(&iq, &ref);
+
+		} else if (!started && op > 50) {
+			/* startup: every track is shifted to start at 0 */
+			interleave_renumber(&iq);
+			for (size_t i = 0; i < NUM_INTERLEAVED_QUEUES; i++) {
+				struct circlebuf *queue = &iq.queues[i];
+				int64_t offset = (int64_t)i * 7000;
+
+				for (size_t j = 0; j < interleave_count(queue);
+				     j++)
+					interleave_at(queue, j)->packet.dts_usec -=
+						offset;
+			}
+			for (size_t i = 0; i < ref.packets.num; i++) {
+				struct encoder_packet *packet =
+					&ref.packets.array[i];
+				size_t queue = packet->type == OBS_ENCODER_VIDEO
+						       ? 0
+						       : 1 + packet->track_idx;
+				packet->dts_usec -= (int64_t)queue * 7000;
+			}
+			reference_resort(&ref);
+
+			for (size_t i = 0; i < num_tracks; i++) {
+				size_t queue = tracks[i].type ==
+							       OBS_ENCODER_VIDEO
+						       ? 0
+						       : 1 + tracks[i].track_idx;
+				tracks[i].next_dts_usec -=
+					(int64_t)queue * 7000;
+			}
+			started = true;
+		}
+
+		if (op % 50 == 0)
+			order_ok = order_ok && cursor_matches(&iq, &ref);
+	}
+
+	order_ok = order_ok && cursor_matches(&iq, &ref);
+	check(iq.bytes == queued_bytes(&ref));
+
+	while (ref.packets.num && order_ok)
+		order_ok = pop_matches(&iq, &ref);
+	check(order_ok);
+	check(interleave_first_queue(&iq) == NULL);
+	check(iq.bytes == 0);
+
+	if (!order_ok)
+		fprintf(stderr, "  order differs, seed %u\n", seed);
+
+	for (size_t i = 0; i < NUM_INTERLEAVED_QUEUES; i++)
+		circlebuf_free(&iq.queues[i]);
+	da_free(ref.packets);
+}
+
+/* hand written case: video ahead of audio of the same dts, audio of the
+ * same dts in arrival order whatever the track */
+static void test_ties(void)
+{
+	struct interleave_queues iq = {0};
+	static const struct {
+		enum obs_encoder_type type;
+		size_t track_idx;
+		int64_t dts_usec;
+	} in[] = {
+		{OBS_ENCODER_AUDIO, 1, 0},     {OBS_ENCODER_AUDIO, 0, 0},
+		{OBS_ENCODER_VIDEO, 0, 0},     {OBS_ENCODER_AUDIO, 0, 10000},
+		{OBS_ENCODER_AUDIO, 1, 10000}, {OBS_ENCODER_VIDEO, 0, 10000},
+		{OBS_ENCODER_AUDIO, 1, 5000},
+	};
+	static const int64_t expected[] = {2, 0, 1, 6, 5, 3, 4};
+
+	for (size_t i = 0; i < sizeof(in) / sizeof(in[0]); i++) {
+		struct encoder_packet packet = {0};
+		packet.type = in[i].type;
+		packet.track_idx = in[i].track_idx;
+		packet.dts_usec = in[i].dts_usec;
+		packet.pts = (int64_t)i;
+		packet.size = 1;
+		interleave_insert(&iq, &packet);
+	}
+
+	for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+		struct circlebuf *queue = interleave_first_queue(&iq);
+		struct interleaved_packet entry;
+
+		check(queue != NULL);
+		if (!queue)
+			break;
+		interleave_pop(&iq, queue, &entry);
+		check(entry.packet.pts == expected[i]);
+	}
+	check(interleave_first_queue(&iq) == NULL);
+
+	for (size_t i = 0; i < NUM_INTERLEAVED_QUEUES; i++)
+		circlebuf_free(&iq.queues[i]);
+}
+
+int main(void)
+{
+	test_ties();
+
+	for (unsigned seed = 1; seed <= RUNS; seed++)
+		run_stream(seed);
+
+	if (failures)
+		fprintf(stderr, "%d check(s) failed\n", failures);
+	return failures ? 1 : 0;
+}
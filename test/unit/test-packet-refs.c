@@ -0,0 +1,176 @@
+/*
+ * Encoded packets shared between outputs: every encoder packet is copied
+ * once into a refcounted instance, each output queues its own reference to
+ * it with its own timestamps, and the data is freed with the last output
+ * that sends it.
+ */
+
+#include "obs-internal.h"
+#include "obs-interleave.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define OUTPUTS 3
+#define PACKETS 90
+#define PACKET_SIZE 1000
+#define FRAME_USEC 33333
+
+static int failures = 0;
+
+#define check(cond)                                                       \
+	do {                                                              \
+		if (!(cond)) {                                            \
+			fprintf(stderr, "%s:%d: check failed: %s\n",      \
+				__FILE__, __LINE__, #cond);               \
+			failures++;                                       \
+		}                                                         \
+	} while (false)
+
+static inline long data_refs(const uint8_t *data)
+{
+	return os_atomic_load_long(((long *)data) - 1);
+}
+
+static inline long packet_refs(const struct encoder_packet *pkt)
+{
+	return data_refs(pkt->data);
+}
+
+static inline uint8_t packet_byte(int64_t idx, size_t offset)
+{
+	return (uint8_t)(idx * 13 + offset);
+}
+
+/* video and two audio tracks, the way an encoder writes them: into the
+ * same buffer every time */
+static void encode_packet(struct encoder_packet *pkt, uint8_t *buf,
+			  int64_t idx)
+{
+	memset(pkt, 0, sizeof(*pkt));
+
+	for (size_t i = 0; i < PACKET_SIZE; i++)
+		buf[i] = packet_byte(idx, i);
+
+	pkt->data = buf;
+	pkt->size = PACKET_SIZE;
+	pkt->pts = pkt->dts = idx;
+	pkt->dts_usec = idx / 3 * FRAME_USEC;
+	pkt->timebase_num = 1;
+	pkt->timebase_den = 1000000 / FRAME_USEC;
+	pkt->type = idx % 3 == 0 ? OBS_ENCODER_VIDEO : OBS_ENCODER_AUDIO;
+	pkt->track_idx = idx % 3 == 2 ? 1 : 0;
+	pkt->keyframe = idx % 30 == 0;
+}
+
+static bool payload_intact(const struct encoder_packet *pkt)
+{
+	for (size_t i = 0; i < pkt->size; i++) {
+		if (pkt->data[i] != packet_byte(pkt->pts, i))
+			return false;
+	}
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void test_shared_instances(void)
+{
+	struct interleave_queues outputs[OUTPUTS] = {0};
+	uint8_t *shared_data[PACKETS];
+	uint8_t buf[PACKET_SIZE];
+	size_t queue_size = PACKETS * sizeof(struct interleaved_packet);
+	long allocs = bnum_allocs();
+	long queue_allocs;
+
+	/* circlebufs grow on their first packets, not counted below */
+	for (size_t o = 0; o < OUTPUTS; o++)
+		for (size_t q = 0; q < NUM_INTERLEAVED_QUEUES; q++)
+			circlebuf_reserve(&outputs[o].queues[q], queue_size);
+	queue_allocs = bnum_allocs() - allocs;
+
+	for (int64_t idx = 0; idx < PACKETS; idx++) {
+		struct encoder_packet pkt;
+		struct encoder_packet shared;
+
+		encode_packet(&pkt, buf, idx);
+		obs_encoder_packet_create_instance(&shared, &pkt);
+		check(shared.data != buf);
+		check(packet_refs(&shared) == 1);
+		shared_data[idx] = shared.data;
+
+		/* each output gets its own struct, and adjusts its own
+		 * timestamps for where it started */
+		for (size_t o = 0; o < OUTPUTS; o++) {
+			struct encoder_packet out = shared;
+			struct encoder_packet ref;
+
+			obs_encoder_packet_ref(&ref, &out);
+			ref.dts -= (int64_t)o;
+			ref.pts -= (int64_t)o;
+			ref.dts_usec -= (int64_t)o * FRAME_USEC;
+			interleave_insert(&outputs[o], &ref);
+		}
+
+		check(packet_refs(&shared) == OUTPUTS + 1);
+		obs_encoder_packet_release(&shared);
+		check(data_refs(shared_data[idx]) == OUTPUTS);
+
+		/* the encoder reuses its buffer, queued data doesn't change */
+		memset(buf, 0, sizeof(buf));
+	}
+
+	/* one allocation per encoder packet, however many outputs */
+	check(bnum_allocs() - allocs - queue_allocs == PACKETS);
+
+	for (size_t o = 0; o < OUTPUTS; o++)
+		check(outputs[o].bytes == PACKETS * PACKET_SIZE);
+
+	/* outputs stop one after the other, the last one frees the data */
+	for (size_t o = 0; o < OUTPUTS; o++) {
+		struct interleaved_packet entry;
+		struct circlebuf *queue;
+		size_t sent = 0;
+
+		while ((queue = interleave_first_queue(&outputs[o]))) {
+			int64_t idx;
+
+			interleave_pop(&outputs[o], queue, &entry);
+			idx = entry.packet.pts + (int64_t)o;
+
+			check(entry.packet.data == shared_data[idx]);
+			check(entry.packet.dts_usec ==
+			      idx / 3 * FRAME_USEC - (int64_t)o * FRAME_USEC);
+			check(packet_refs(&entry.packet) ==
+			      (long)(OUTPUTS - o));
+
+			entry.packet.pts = idx;
+			check(payload_intact(&entry.packet));
+
+			obs_encoder_packet_release(&entry.packet);
+			check(entry.packet.data == NULL);
+			sent++;
+		}
+
+		check(sent == PACKETS);
+		check(outputs[o].bytes == 0);
+	}
+
+	for (size_t o = 0; o < OUTPUTS; o++)
+		for (size_t q = 0; q < NUM_INTERLEAVED_QUEUES; q++)
+			circlebuf_free(&outputs[o].queues[q]);
+
+	check(bnum_allocs() == allocs);
+}
+
+int main(void)
+{
+	test_shared_instances();
+
+	if (failures)
+		fprintf(stderr, "%d check(s) failed\n", failures);
+	else
+		printf("all checks passed\n");
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,282 @@
+/*
+ * Replay buffer store: packets over max_memory_mb are spilled to a file and
+ * read back from it by saves, a pinned save keeps its part of the file while
+ * the store keeps wrapping around it, and the memory size the frontend reads
+ * under the muxer's store mutex always matches the segments in memory.
+ */
+
+#include "replay-store.h"
+
+#include <util/platform.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FPS 30
+#define FRAME_USEC (1000000 / FPS)
+#define PACKET_SIZE 10000
+#define MB (1024 * 1024)
+#define MAX_SIZE (4 * MB)
+#define MAX_MEMORY (1 * MB)
+
+/* the current segment and the one just closed aren't spilled yet */
+#define SEGMENT_SIZE (FPS * PACKET_SIZE)
+#define MAX_MEM_SIZE (MAX_MEMORY + 2 * SEGMENT_SIZE)
+
+static int failures = 0;
+
+#define check(cond)                                                       \
+	do {                                                              \
+		if (!(cond)) {                                            \
+			fprintf(stderr, "%s:%d: check failed: %s\n",      \
+				__FILE__, __LINE__, #cond);               \
+			failures++;                                       \
+		}                                                         \
+	} while (false)
+
+static inline uint8_t packet_byte(int64_t idx, size_t offset)
+{
+	return (uint8_t)(idx * 131 + offset * 7 + (offset >> 8));
+}
+
+/* refcounted the way encoders hand them out, a keyframe every second */
+static struct encoder_packet create_packet(int64_t idx)
+{
+	struct encoder_packet pkt = {0};
+	long *refs = bmalloc(sizeof(long) + PACKET_SIZE);
+	uint8_t *data = (uint8_t *)(refs + 1);
+
+	*refs = 1;
+	for (size_t i = 0; i < PACKET_SIZE; i++)
+		data[i] = packet_byte(idx, i);
+
+	pkt.data = data;
+	pkt.size = PACKET_SIZE;
+	pkt.type = OBS_ENCODER_VIDEO;
+	pkt.keyframe = idx % FPS == 0;
+	pkt.pts = pkt.dts = idx;
+	pkt.dts_usec = idx * FRAME_USEC;
+	pkt.timebase_num = 1;
+	pkt.timebase_den = FPS;
+	return pkt;
+}
+
+static bool packet_intact(const struct encoder_packet *pkt)
+{
+	for (size_t i = 0; i < pkt->size; i++) {
+		if (pkt->data[i] != packet_byte(pkt->pts, i))
+			return false;
+	}
+	return true;
+}
+
+static int64_t segments_mem_size(struct replay_store *rs)
+{
+	int64_t size = 0;
+
+	for (size_t i = 0; i < replay_store_num_segments(rs); i++) {
+		struct replay_segment *seg = replay_store_segment(rs, i);
+		if (!seg->spilled)
+			size += seg->size;
+	}
+	return size;
+}
+
+/* the save thread's side: snapshot, check and drop the packets */
+static void check_snapshot(struct replay_store *rs, struct darray *packets,
+			   struct replay_spill *spill, uint64_t pin)
+{
+	DARRAY(struct encoder_packet) snap;
+	size_t spilled = 0;
+	int64_t pts;
+
+	snap.da = *packets;
+
+	check(snap.num == replay_store_num_packets(rs));
+	pts = snap.num ? snap.array[0].pts : 0;
+
+	for (size_t i = 0; i < snap.num; i++) {
+		struct encoder_packet *pkt = snap.array + i;
+
+		check(packet_intact(pkt));
+		check(pkt->pts == pts++);
+
+		if (replay_spill_owns(spill, pkt->data))
+			spilled++;
+		else
+			obs_encoder_packet_release(pkt);
+	}
+
+	check(spilled > 0);
+	replay_spill_unpin(spill, pin);
+	da_free(snap);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void test_spill(void)
+{
+	struct replay_store rs;
+	DARRAY(struct encoder_packet) packets;
+	struct replay_spill *spill;
+	uint64_t pin = 0;
+	int64_t idx = 0;
+	int64_t peak = 0;
+
+	replay_store_init(&rs, 3600 * 1000000LL, MAX_SIZE, MAX_MEMORY, true,
+			  ".");
+	check(rs.spill != NULL);
+	if (!rs.spill) {
+		replay_store_free(&rs);
+		return;
+	}
+
+	/* long enough for the spill file to wrap a couple of times */
+	for (; idx < 3 * MAX_SIZE / PACKET_SIZE; idx++) {
+		struct encoder_packet pkt = create_packet(idx);
+		replay_store_push(&rs, &pkt);
+
+		if (rs.mem_size > peak)
+			peak = rs.mem_size;
+		check(rs.mem_size == segments_mem_size(&rs));
+	}
+
+	printf("%d MB buffer, %d MB in memory: %d segments, %d spilled, "
+	       "at most %.1f MB in memory\n",
+	       MAX_SIZE / MB, MAX_MEMORY / MB,
+	       (int)replay_store_num_segments(&rs), (int)rs.num_spilled,
+	       (double)peak / MB);
+
+	check(rs.num_spilled > 0);
+	check(peak <= MAX_MEM_SIZE);
+	check(rs.size <= MAX_SIZE + SEGMENT_SIZE);
+
+	/* everything still in the buffer reads back, spilled or not */
+	da_init(packets);
+	spill = replay_store_snapshot(&rs, 0, &packets.da, &pin);
+	check(spill == rs.spill);
+	check(packets.num > 0);
+	check(packets.array[packets.num - 1].pts == idx - 1);
+
+	/* the buffer goes on around the pinned save, which still has to be
+	 * written, and stops spilling rather than overwrite it */
+	for (int64_t end = idx + 2 * MAX_SIZE / PACKET_SIZE; idx < end;
+	     idx++) {
+		struct encoder_packet pkt = create_packet(idx);
+		replay_store_push(&rs, &pkt);
+		check(rs.mem_size == segments_mem_size(&rs));
+	}
+
+	for (size_t i = 0; i < packets.num; i++)
+		check(packet_intact(packets.array + i));
+
+	for (size_t i = 0; i < packets.num; i++) {
+		struct encoder_packet *pkt = packets.array + i;
+		if (!replay_spill_owns(spill, pkt->data))
+			obs_encoder_packet_release(pkt);
+	}
+	replay_spill_unpin(spill, pin);
+	da_free(packets);
+
+	/* unpinned, it spills again */
+	for (int64_t end = idx + MAX_SIZE / PACKET_SIZE; idx < end; idx++) {
+		struct encoder_packet pkt = create_packet(idx);
+		replay_store_push(&rs, &pkt);
+		check(rs.mem_size == segments_mem_size(&rs));
+	}
+	check(rs.mem_size <= MAX_MEM_SIZE);
+
+	da_init(packets);
+	spill = replay_store_snapshot(&rs, replay_store_seek(&rs, 0),
+				      &packets.da, &pin);
+	check(spill != NULL);
+	if (spill)
+		check_snapshot(&rs, &packets.da, spill, pin);
+	else
+		da_free(packets);
+
+	replay_store_free(&rs);
+	check(rs.size == 0 && rs.mem_size == 0);
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct mem_size_reader {
+	struct replay_store *rs;
+	pthread_mutex_t *store_mutex;
+	volatile bool stop;
+	long reads;
+};
+
+static void *mem_size_thread(void *data)
+{
+	struct mem_size_reader *reader = data;
+
+	while (!os_atomic_load_bool(&reader->stop)) {
+		struct replay_store *rs = reader->rs;
+
+		pthread_mutex_lock(reader->store_mutex);
+		check(rs->mem_size >= 0 && rs->mem_size <= rs->size);
+		check(rs->mem_size == segments_mem_size(rs));
+		pthread_mutex_unlock(reader->store_mutex);
+
+		reader->reads++;
+	}
+
+	return NULL;
+}
+
+/* the retained bytes the frontend polls, read while packets are pushed and
+ * segments spilled, under the lock the muxer pushes with */
+static void test_locked_mem_size(void)
+{
+	struct replay_store rs;
+	pthread_mutex_t store_mutex;
+	struct mem_size_reader reader = {0};
+	pthread_t thread;
+
+	check(pthread_mutex_init(&store_mutex, NULL) == 0);
+	replay_store_init(&rs, 3600 * 1000000LL, MAX_SIZE, MAX_MEMORY, true,
+			  ".");
+	check(rs.spill != NULL);
+
+	reader.rs = &rs;
+	reader.store_mutex = &store_mutex;
+	check(pthread_create(&thread, NULL, mem_size_thread, &reader) == 0);
+
+	for (int64_t idx = 0; idx < 3 * MAX_SIZE / PACKET_SIZE; idx++) {
+		struct encoder_packet pkt = create_packet(idx);
+
+		pthread_mutex_lock(&store_mutex);
+		replay_store_push(&rs, &pkt);
+		pthread_mutex_unlock(&store_mutex);
+	}
+
+	os_atomic_set_bool(&reader.stop, true);
+	pthread_join(thread, NULL);
+
+	printf("%ld locked mem size reads\n", reader.reads);
+	check(reader.reads > 0);
+
+	replay_store_free(&rs);
+	pthread_mutex_destroy(&store_mutex);
+}
+
+int main(void)
+{
+	long allocs = bnum_allocs();
+
+	test_spill();
+	test_locked_mem_size();
+
+	/* every packet reference was dropped */
+	check(bnum_allocs() == allocs);
+
+	if (failures)
+		fprintf(stderr, "%d check(s) failed\n", failures);
+	else
+		printf("all checks passed\n");
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,346 @@
+/*
+ * RTMP dynamic bitrate: the controller of the RTMP output, first on made up
+ * send times, then sending frames sized after its bitrate through a local
+ * TCP connection whose reader is throttled.
+ */
+
+#include "rtmp-dbr.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FPS 30
+#define FRAME_USEC (1000000 / FPS)
+#define MS 1000000ULL
+#define SEC 1000000000ULL
+
+static int failures = 0;
+
+#define check(cond)                                                       \
+	do {                                                              \
+		if (!(cond)) {                                            \
+			fprintf(stderr, "%s:%d: check failed: %s\n",      \
+				__FILE__, __LINE__, #cond);               \
+			failures++;                                       \
+		}                                                         \
+	} while (false)
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * SEC + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_ns(uint64_t ns)
+{
+	struct timespec ts = {(time_t)(ns / SEC), (long)(ns % SEC)};
+	nanosleep(&ts, NULL);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* one second of frames at |kbps| sent back to back starting at |*t| */
+static void add_second(struct dbr *dbr, uint64_t *t, long kbps)
+{
+	for (int i = 0; i < FPS; i++) {
+		struct dbr_frame frame;
+		frame.send_beg = *t;
+		*t += SEC / FPS;
+		frame.send_end = *t;
+		frame.size = (size_t)kbps * 1000 / 8 / FPS;
+		dbr_add_frame(dbr, &frame);
+	}
+}
+
+static void test_steps(void)
+{
+	struct dbr dbr = {0};
+	uint64_t t = SEC;
+
+	dbr_reset(&dbr, 3000, 128);
+	check(dbr.cur_bitrate == 3000 && dbr.inc_bitrate == 300);
+
+	/* no estimate yet and nothing to fall back to */
+	check(dbr_update(&dbr, DBR_TRIGGER_USEC, t) == DBR_UNCHANGED);
+
+	/* 1328 kbps on the wire, audio included */
+	add_second(&dbr, &t, 1328);
+	add_second(&dbr, &t, 1328);
+	check(dbr.est_bitrate >= 1150 && dbr.est_bitrate <= 1250);
+	check(dbr_update(&dbr, DBR_TRIGGER_USEC - 1, t) == DBR_UNCHANGED);
+	check(dbr_update(&dbr, DBR_TRIGGER_USEC, t) == DBR_DECREASED);
+	check(dbr.cur_bitrate == 1100 || dbr.cur_bitrate == 1200);
+	long lowered = dbr.cur_bitrate;
+
+	/* congestion keeps the bitrate until a new estimate */
+	check(dbr_update(&dbr, DBR_TRIGGER_USEC, t) == DBR_UNCHANGED);
+
+	/* steps up once the timer ran out without congestion */
+	check(dbr_update(&dbr, 0, t + DBR_INC_TIMER - 1) == DBR_UNCHANGED);
+	t += DBR_INC_TIMER;
+	check(dbr_update(&dbr, 0, t) == DBR_INCREASED);
+	check(dbr.cur_bitrate == lowered + 300);
+
+	/* congested right after a step: back to the previous one */
+	check(dbr_update(&dbr, DBR_TRIGGER_USEC, t) == DBR_DECREASED);
+	check(dbr.cur_bitrate == lowered);
+
+	/* and up to the original bitrate, not past it */
+	for (int i = 0; i < 20 && dbr.cur_bitrate < 3000; i++) {
+		t += DBR_INC_TIMER;
+		check(dbr_update(&dbr, 0, t) == DBR_INCREASED);
+	}
+	check(dbr.cur_bitrate == 3000);
+	check(dbr.inc_timeout == 0);
+	check(dbr_update(&dbr, 0, t + 10 * DBR_INC_TIMER) == DBR_UNCHANGED);
+
+	dbr_free(&dbr);
+}
+
+/* ------------------------------------------------------------------------- */
+
+#define MAX_QUEUE 1024
+
+struct sim {
+	int sender;
+	int receiver;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool stop;
+
+	/* reader throughput in kbps */
+	volatile long throttle_kbps;
+
+	/* frames waiting to be sent, as in the output packet queue */
+	struct {
+		int64_t dts_usec;
+		size_t size;
+	} queue[MAX_QUEUE];
+	size_t head;
+	size_t count;
+
+	pthread_mutex_t dbr_mutex;
+	struct dbr dbr;
+};
+
+static void *reader_thread(void *data)
+{
+	struct sim *sim = data;
+	char buf[2048];
+
+	for (;;) {
+		ssize_t ret = recv(sim->receiver, buf, sizeof(buf), 0);
+		if (ret <= 0)
+			break;
+		sleep_ns((uint64_t)ret * 8 * MS / (uint64_t)sim->throttle_kbps);
+	}
+	return NULL;
+}
+
+static void *sender_thread(void *data)
+{
+	struct sim *sim = data;
+	static char payload[1 << 20];
+
+	pthread_mutex_lock(&sim->mutex);
+	for (;;) {
+		while (!sim->count && !sim->stop)
+			pthread_cond_wait(&sim->cond, &sim->mutex);
+		if (sim->stop)
+			break;
+
+		size_t size = sim->queue[sim->head].size;
+		pthread_mutex_unlock(&sim->mutex);
+
+		struct dbr_frame frame;
+		frame.send_beg = now_ns();
+		frame.size = size;
+		for (size_t sent = 0; sent < size;) {
+			ssize_t ret = send(sim->sender, payload, size - sent,
+					   MSG_NOSIGNAL);
+			if (ret <= 0)
+				return NULL;
+			sent += (size_t)ret;
+		}
+		frame.send_end = now_ns();
+
+		pthread_mutex_lock(&sim->dbr_mutex);
+		dbr_add_frame(&sim->dbr, &frame);
+		pthread_mutex_unlock(&sim->dbr_mutex);
+
+		pthread_mutex_lock(&sim->mutex);
+		sim->head = (sim->head + 1) % MAX_QUEUE;
+		sim->count--;
+	}
+	pthread_mutex_unlock(&sim->mutex);
+	return NULL;
+}
+
+static bool connect_pair(struct sim *sim)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int buf_size = 16384;
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	/* small buffers so that the sender blocks like on a slow uplink */
+	setsockopt(listener, SOL_SOCKET, SO_RCVBUF, &buf_size,
+		   sizeof(buf_size));
+	if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+	    listen(listener, 1) != 0 ||
+	    getsockname(listener, (struct sockaddr *)&addr, &len) != 0)
+		return false;
+
+	sim->sender = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(sim->sender, SOL_SOCKET, SO_SNDBUF, &buf_size,
+		   sizeof(buf_size));
+	if (connect(sim->sender, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+		return false;
+
+	sim->receiver = accept(listener, NULL, NULL);
+	close(listener);
+	return sim->receiver != -1;
+}
+
+struct phase_result {
+	int decreased;
+	int increased;
+	int64_t first_buffer_usec;
+	int64_t last_buffer_usec;
+};
+
+/* The encoder side: queues a frame sized after the current bitrate every
+ * frame interval, and checks the queue like check_to_drop_frames does */
+static void run_phase(struct sim *sim, uint64_t duration,
+		      int64_t *dts_usec, struct phase_result *result)
+{
+	uint64_t start = now_ns();
+	uint64_t end = start + duration;
+	uint64_t next = start;
+
+	memset(result, 0, sizeof(*result));
+
+	while (now_ns() < end) {
+		int64_t buffer_usec = 0;
+
+		pthread_mutex_lock(&sim->mutex);
+		if (sim->count >= 5)
+			buffer_usec = *dts_usec - sim->queue[sim->head].dts_usec;
+		pthread_mutex_unlock(&sim->mutex);
+
+		pthread_mutex_lock(&sim->dbr_mutex);
+		enum dbr_change change =
+			dbr_update(&sim->dbr, buffer_usec, now_ns());
+		long kbps = sim->dbr.cur_bitrate;
+		pthread_mutex_unlock(&sim->dbr_mutex);
+
+		if (change == DBR_DECREASED)
+			result->decreased++;
+		else if (change == DBR_INCREASED)
+			result->increased++;
+		if (next == start)
+			result->first_buffer_usec = buffer_usec;
+		result->last_buffer_usec = buffer_usec;
+
+		pthread_mutex_lock(&sim->mutex);
+		if (sim->count < MAX_QUEUE) {
+			size_t tail = (sim->head + sim->count) % MAX_QUEUE;
+			*dts_usec += FRAME_USEC;
+			sim->queue[tail].dts_usec = *dts_usec;
+			sim->queue[tail].size = (size_t)kbps * 1000 / 8 / FPS;
+			sim->count++;
+			pthread_cond_signal(&sim->cond);
+		}
+		pthread_mutex_unlock(&sim->mutex);
+
+		next += SEC / FPS;
+		uint64_t t = now_ns();
+		if (next > t)
+			sleep_ns(next - t);
+	}
+}
+
+static void test_throttled_socket(void)
+{
+	struct sim sim;
+	struct phase_result result;
+	pthread_t reader, sender;
+	int64_t dts_usec = 0;
+
+	memset(&sim, 0, sizeof(sim));
+	pthread_mutex_init(&sim.mutex, NULL);
+	pthread_mutex_init(&sim.dbr_mutex, NULL);
+	pthread_cond_init(&sim.cond, NULL);
+	dbr_reset(&sim.dbr, 3000, 0);
+	sim.dbr.inc_timer_ns = SEC / 2;
+
+	if (!connect_pair(&sim)) {
+		check(!"local connection");
+		return;
+	}
+
+	/* 3000 kbps through a 1500 kbps link: lowered to what the link
+	 * sustains, after which the queue stops growing (the output drops
+	 * frames to drain it, not simulated here) */
+	sim.throttle_kbps = 1500;
+	pthread_create(&reader, NULL, reader_thread, &sim);
+	pthread_create(&sender, NULL, sender_thread, &sim);
+
+	run_phase(&sim, 4 * SEC, &dts_usec, &result);
+	long lowered = sim.dbr.cur_bitrate;
+	printf("throttled: %d decrease(s), %ld kbps, %lld ms buffered\n",
+	       result.decreased, lowered,
+	       (long long)result.last_buffer_usec / 1000);
+	check(result.decreased >= 1);
+	check(lowered >= 500 && lowered <= 1500);
+
+	run_phase(&sim, 2 * SEC, &dts_usec, &result);
+	check(result.last_buffer_usec <= result.first_buffer_usec + 100000);
+
+	/* link restored: back up to the original bitrate one step per
+	 * timer, without going back down */
+	sim.throttle_kbps = 50000;
+	run_phase(&sim, 5 * SEC, &dts_usec, &result);
+	printf("restored: %d increase(s), %d decrease(s), %ld kbps\n",
+	       result.increased, result.decreased, sim.dbr.cur_bitrate);
+	check(result.decreased == 0);
+	check(result.increased >= 1);
+	check(sim.dbr.cur_bitrate == 3000);
+
+	pthread_mutex_lock(&sim.mutex);
+	sim.stop = true;
+	pthread_cond_signal(&sim.cond);
+	pthread_mutex_unlock(&sim.mutex);
+	pthread_join(sender, NULL);
+	shutdown(sim.sender, SHUT_RDWR);
+	close(sim.sender);
+	pthread_join(reader, NULL);
+	close(sim.receiver);
+
+	dbr_free(&sim.dbr);
+	pthread_cond_destroy(&sim.cond);
+	pthread_mutex_destroy(&sim.dbr_mutex);
+	pthread_mutex_destroy(&sim.mutex);
+}
+
+int main(void)
+{
+	test_steps();
+	test_throttled_socket();
+
+	if (failures)
+		fprintf(stderr, "%d check(s) failed\n", failures);
+	return failures ? 1 : 0;
+}
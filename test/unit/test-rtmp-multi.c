@@ -0,0 +1,373 @@
+/*
+ * RTMP multi output: destinations are started and stopped over and over,
+ * with their send threads faked, while another thread keeps reading the
+ * destination stats the way the UI does.  Every thread a destination started
+ * is joined before the destination is freed.
+ */
+
+/* the output is faked too, rtmp-multi.c only gets its settings, proc handler
+ * and data capture calls from it */
+#define obs_output_get_name fake_output_get_name
+#define obs_output_get_settings fake_output_get_settings
+#define obs_output_get_proc_handler fake_output_get_proc_handler
+#define obs_output_can_begin_data_capture fake_output_can_begin_data_capture
+#define obs_output_initialize_encoders fake_output_initialize_encoders
+#define obs_output_begin_data_capture fake_output_begin_data_capture
+#define obs_output_end_data_capture fake_output_end_data_capture
+#define obs_output_signal_stop fake_output_signal_stop
+
+#include "rtmp-multi.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DESTS 3
+#define CYCLES 50
+#define TIMEOUT_MS 5000
+
+static int failures = 0;
+
+#define check(cond)                                                       \
+	do {                                                              \
+		if (!(cond)) {                                            \
+			fprintf(stderr, "%s:%d: check failed: %s\n",      \
+				__FILE__, __LINE__, #cond);               \
+			failures++;                                       \
+		}                                                         \
+	} while (false)
+
+static bool wait_until(volatile long *counter, long value)
+{
+	for (int i = 0; i < TIMEOUT_MS; i++) {
+		if (os_atomic_load_long(counter) >= value)
+			return true;
+		os_sleep_ms(1);
+	}
+	return false;
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct fake_output {
+	obs_data_t *settings;
+	proc_handler_t *ph;
+	volatile long began;
+	volatile long ended;
+	volatile long stopped;
+};
+
+const char *fake_output_get_name(const obs_output_t *output)
+{
+	UNUSED_PARAMETER(output);
+	return "test";
+}
+
+obs_data_t *fake_output_get_settings(const obs_output_t *output)
+{
+	struct fake_output *fake = (struct fake_output *)output;
+	obs_data_addref(fake->settings);
+	return fake->settings;
+}
+
+proc_handler_t *fake_output_get_proc_handler(const obs_output_t *output)
+{
+	return ((struct fake_output *)output)->ph;
+}
+
+bool fake_output_can_begin_data_capture(const obs_output_t *output,
+					uint32_t flags)
+{
+	UNUSED_PARAMETER(output);
+	UNUSED_PARAMETER(flags);
+	return true;
+}
+
+bool fake_output_initialize_encoders(obs_output_t *output, uint32_t flags)
+{
+	UNUSED_PARAMETER(output);
+	UNUSED_PARAMETER(flags);
+	return true;
+}
+
+bool fake_output_begin_data_capture(obs_output_t *output, uint32_t flags)
+{
+	os_atomic_inc_long(&((struct fake_output *)output)->began);
+	UNUSED_PARAMETER(flags);
+	return true;
+}
+
+void fake_output_end_data_capture(obs_output_t *output)
+{
+	os_atomic_inc_long(&((struct fake_output *)output)->ended);
+}
+
+void fake_output_signal_stop(obs_output_t *output, int code)
+{
+	os_atomic_inc_long(&((struct fake_output *)output)->stopped);
+	UNUSED_PARAMETER(code);
+}
+
+const char *obs_module_text(const char *lookup_string)
+{
+	return lookup_string;
+}
+
+void RTMP_TLS_Free(void) {}
+
+/* ------------------------------------------------------------------------- */
+/* destinations connect at once and send until they're stopped              */
+
+static volatile long streams_created = 0;
+static volatile long streams_destroyed = 0;
+static volatile long threads_started = 0;
+static volatile long threads_joined = 0;
+
+void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
+{
+	struct rtmp_stream *stream = bzalloc(sizeof(struct rtmp_stream));
+
+	stream->output = output;
+	if (os_event_init(&stream->stop_event, OS_EVENT_TYPE_MANUAL) != 0) {
+		bfree(stream);
+		return NULL;
+	}
+
+	os_atomic_inc_long(&streams_created);
+	UNUSED_PARAMETER(settings);
+	return stream;
+}
+
+void rtmp_stream_destroy(void *data)
+{
+	struct rtmp_stream *stream = data;
+
+	check(!stream->connect_thread_active);
+
+	dstr_free(&stream->path);
+	dstr_free(&stream->key);
+	dstr_free(&stream->username);
+	dstr_free(&stream->password);
+	dstr_free(&stream->bind_ip);
+	os_event_destroy(stream->stop_event);
+	bfree(stream);
+
+	os_atomic_inc_long(&streams_destroyed);
+}
+
+static void *send_thread(void *data)
+{
+	struct rtmp_stream *stream = data;
+
+	rtmp_multi_dest_started(stream->dest);
+
+	while (os_event_timedwait(stream->stop_event, 1) == ETIMEDOUT)
+		stream->total_bytes_sent += 1000;
+
+	rtmp_multi_dest_stopped(stream->dest, OBS_OUTPUT_SUCCESS);
+	return NULL;
+}
+
+bool rtmp_stream_connect(struct rtmp_stream *stream)
+{
+	os_event_reset(stream->stop_event);
+
+	if (pthread_create(&stream->connect_thread, NULL, send_thread,
+			   stream) != 0)
+		return false;
+
+	stream->connect_thread_active = true;
+	os_atomic_inc_long(&threads_started);
+	return true;
+}
+
+void rtmp_stream_stop(void *data, uint64_t ts)
+{
+	struct rtmp_stream *stream = data;
+	os_event_signal(stream->stop_event);
+	UNUSED_PARAMETER(ts);
+}
+
+void rtmp_stream_join_threads(struct rtmp_stream *stream)
+{
+	if (!stream->connect_thread_active)
+		return;
+
+	pthread_join(stream->connect_thread, NULL);
+	stream->connect_thread_active = false;
+	os_atomic_inc_long(&threads_joined);
+}
+
+void rtmp_stream_data(void *data, struct encoder_packet *packet)
+{
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(packet);
+}
+
+void rtmp_stream_queue_packet(struct rtmp_stream *stream,
+			      struct encoder_packet *packet)
+{
+	obs_encoder_packet_release(packet);
+	UNUSED_PARAMETER(stream);
+}
+
+uint64_t rtmp_stream_total_bytes_sent(void *data)
+{
+	struct rtmp_stream *stream = data;
+	return stream->total_bytes_sent;
+}
+
+int rtmp_stream_dropped_frames(void *data)
+{
+	struct rtmp_stream *stream = data;
+	return stream->dropped_frames;
+}
+
+float rtmp_stream_congestion(void *data)
+{
+	struct rtmp_stream *stream = data;
+	return stream->congestion;
+}
+
+int rtmp_stream_connect_time(void *data)
+{
+	UNUSED_PARAMETER(data);
+	return 10;
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct stats_reader {
+	struct rtmp_multi *multi;
+	proc_handler_t *ph;
+	volatile bool stop;
+	long reads;
+};
+
+static void *stats_thread(void *data)
+{
+	struct stats_reader *reader = data;
+	calldata_t cd = {0};
+
+	while (!os_atomic_load_bool(&reader->stop)) {
+		long long count;
+
+		calldata_clear(&cd);
+		proc_handler_call(reader->ph, "get_destination_count", &cd);
+		count = calldata_int(&cd, "count");
+		check(count >= 0 && count <= DESTS);
+
+		for (long long i = 0; i < DESTS; i++) {
+			const char *server = NULL;
+
+			calldata_clear(&cd);
+			calldata_set_int(&cd, "index", i);
+			proc_handler_call(reader->ph, "get_destination_stats",
+					  &cd);
+			if (calldata_get_string(&cd, "server", &server))
+				check(strncmp(server, "rtmp://", 7) == 0);
+		}
+
+		rtmp_multi_total_bytes_sent(reader->multi);
+		rtmp_multi_dropped_frames(reader->multi);
+		rtmp_multi_congestion(reader->multi);
+		check(rtmp_multi_connect_time(reader->multi) % 10 == 0);
+		reader->reads++;
+	}
+
+	calldata_free(&cd);
+	return NULL;
+}
+
+static obs_data_t *create_settings(void)
+{
+	obs_data_t *settings = obs_data_create();
+	obs_data_array_t *dests = obs_data_array_create();
+
+	for (int i = 0; i < DESTS; i++) {
+		obs_data_t *dest = obs_data_create();
+		char server[64];
+
+		snprintf(server, sizeof(server), "rtmp://127.0.0.%d/live",
+			 i + 1);
+		obs_data_set_string(dest, DEST_SERVER, server);
+		obs_data_set_string(dest, DEST_KEY, "key");
+		obs_data_array_push_back(dests, dest);
+		obs_data_release(dest);
+	}
+
+	rtmp_multi_defaults(settings);
+	obs_data_set_int(settings, OPT_RECONNECT_DELAY_SEC, 0);
+	obs_data_set_array(settings, OPT_DESTINATIONS, dests);
+	obs_data_array_release(dests);
+	return settings;
+}
+
+static void test_start_stop(void)
+{
+	struct fake_output fake = {0};
+	struct stats_reader reader = {0};
+	struct rtmp_multi *multi;
+	pthread_t thread;
+
+	fake.settings = create_settings();
+	fake.ph = proc_handler_create();
+
+	multi = rtmp_multi_create(fake.settings, (obs_output_t *)&fake);
+	check(multi != NULL);
+	if (!multi)
+		return;
+
+	reader.multi = multi;
+	reader.ph = fake.ph;
+	check(pthread_create(&thread, NULL, stats_thread, &reader) == 0);
+
+	for (long i = 0; i < CYCLES; i++) {
+		long started = os_atomic_load_long(&threads_started);
+
+		/* the destinations of the previous run are joined and freed
+		 * before the new ones are created */
+		check(rtmp_multi_start(multi));
+		check(os_atomic_load_long(&threads_joined) == started);
+		check(os_atomic_load_long(&streams_destroyed) == i * DESTS);
+		check(os_atomic_load_long(&streams_created) == (i + 1) * DESTS);
+
+		/* data capture begins with the first destination connected,
+		 * after it counted itself active */
+		check(wait_until(&fake.began, i + 1));
+		check(wait_until(&multi->active_dests, DESTS));
+
+		rtmp_multi_stop(multi, 0);
+		check(wait_until(&fake.ended, i + 1));
+		check(os_atomic_load_long(&multi->active_dests) == 0);
+	}
+
+	os_atomic_set_bool(&reader.stop, true);
+	pthread_join(thread, NULL);
+
+	rtmp_multi_destroy(multi);
+
+	printf("%d cycles: %ld threads started, %ld joined, %ld stats reads\n",
+	       CYCLES, os_atomic_load_long(&threads_started),
+	       os_atomic_load_long(&threads_joined), reader.reads);
+
+	check(os_atomic_load_long(&threads_started) == CYCLES * DESTS);
+	check(os_atomic_load_long(&threads_joined) == CYCLES * DESTS);
+	check(os_atomic_load_long(&streams_destroyed) == CYCLES * DESTS);
+	check(os_atomic_load_long(&fake.stopped) == 0);
+
+	proc_handler_destroy(fake.ph);
+	obs_data_release(fake.settings);
+}
+
+int main(void)
+{
+	test_start_stop();
+
+	if (failures)
+		fprintf(stderr, "%d check(s) failed\n", failures);
+	else
+		printf("all checks passed\n");
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,393 @@
+/*
+ * SDPModif: parsing, serialization and the edits applied to offers and
+ * answers, on a libwebrtc style offer and the answers of each service.
+ */
+
+#include "SDPModif.h"
+#include "sdp-offer.h"
+#include "sdp-answers.h"
+
+#include <stdio.h>
+
+static int failures = 0;
+
+#define check(cond)                                                       \
+	do {                                                              \
+		if (!(cond)) {                                            \
+			fprintf(stderr, "%s:%d: check failed: %s\n",      \
+				__FILE__, __LINE__, #cond);               \
+			failures++;                                       \
+		}                                                         \
+	} while (false)
+
+static bool has_line(const std::string &sdp, const std::string &line)
+{
+	return sdp.find("\r\n" + line + "\r\n") != std::string::npos;
+}
+
+static size_t count_lines(const std::string &sdp, const std::string &line)
+{
+	size_t count = 0;
+	size_t pos = 0;
+	std::string match = "\r\n" + line + "\r\n";
+	while ((pos = sdp.find(match, pos)) != std::string::npos) {
+		count++;
+		pos += match.size() - 2;
+	}
+	return count;
+}
+
+/* the lines following |first|, up to the next m-line */
+static std::string section(const std::string &sdp, const std::string &first)
+{
+	size_t begin = sdp.find(first);
+	if (begin == std::string::npos)
+		return "";
+	size_t end = sdp.find("\r\nm=", begin);
+	return sdp.substr(begin, end == std::string::npos ? end
+							 : end - begin + 2);
+}
+
+static void test_round_trip(void)
+{
+	std::string sdp = sdp_offer;
+	check(SDPModif::Description(sdp).toString() == sdp);
+
+	std::string lf = "v=0\no=- 1 2 IN IP4 127.0.0.1\ns=-\nt=0 0\n"
+			 "m=audio 9 RTP/SAVPF 111\na=rtpmap:111 opus/48000/2\n";
+	check(SDPModif::Description(lf).toString() ==
+	      "v=0\r\no=- 1 2 IN IP4 127.0.0.1\r\ns=-\r\nt=0 0\r\n"
+	      "m=audio 9 RTP/SAVPF 111\r\na=rtpmap:111 opus/48000/2\r\n");
+}
+
+static void test_force_h264(void)
+{
+	std::string sdp = sdp_offer;
+	std::vector<int> audio;
+	std::vector<int> video;
+
+	SDPModif::forcePayload(sdp, audio, video, "opus", "h264", 0,
+			       "42e01f", 0);
+
+	check(audio == std::vector<int>{111});
+	check(video == std::vector<int>{108});
+	check(has_line(sdp, "m=audio 9 UDP/TLS/RTP/SAVPF 111"));
+	check(has_line(sdp, "m=video 9 UDP/TLS/RTP/SAVPF 108 109"));
+	check(has_line(sdp, "a=rtpmap:108 H264/90000"));
+	check(has_line(sdp, "a=rtcp-fb:108 nack pli"));
+	check(has_line(sdp, "a=fmtp:109 apt=108"));
+	check(!has_line(sdp, "a=rtpmap:9 G722/8000"));
+	check(!has_line(sdp, "a=rtcp-fb:96 nack"));
+	check(!has_line(sdp, "a=fmtp:107 apt=125"));
+	check(sdp.find("a=rtpmap:125") == std::string::npos);
+
+	/* lines that are not payload attributes stay, even ':9 ' ones */
+	check(count_lines(sdp, "a=rtcp:9 IN IP4 0.0.0.0") == 2);
+	check(has_line(sdp, "a=ssrc-group:FID 2846254423 3412553434"));
+}
+
+static void test_force_vp9_profile(void)
+{
+	std::string sdp = sdp_offer;
+	std::vector<int> audio;
+	std::vector<int> video;
+
+	SDPModif::forcePayload(sdp, audio, video, "vp9", 2);
+
+	check(video == std::vector<int>{100});
+	check(has_line(sdp, "m=video 9 UDP/TLS/RTP/SAVPF 100 101"));
+	check(has_line(sdp, "a=fmtp:100 profile-id=2"));
+	check(!has_line(sdp, "a=fmtp:98 profile-id=0"));
+}
+
+static void test_force_automatic(void)
+{
+	std::string sdp = sdp_offer;
+	std::vector<int> audio;
+	std::vector<int> video;
+
+	SDPModif::forcePayload(sdp, audio, video, "", "", 0, "42e01f", 0);
+
+	check(sdp == sdp_offer);
+	check(audio.size() == 13 && audio.front() == 111);
+	check(video.size() == 14 && video.front() == 96);
+}
+
+static void test_bitrate(void)
+{
+	std::string sdp = sdp_offer;
+
+	SDPModif::bitrateSDP(sdp, 2500);
+	SDPModif::bitrateSDP(sdp, 1000);
+
+	std::string video = section(sdp, "m=video");
+	check(video.find("\r\nc=IN IP4 0.0.0.0\r\nb=AS:2500\r\n") !=
+	      std::string::npos);
+	check(count_lines(sdp, "b=AS:2500") == 1);
+	check(sdp.find("b=AS:1000") == std::string::npos);
+	check(section(sdp, "m=audio").find("b=AS") == std::string::npos);
+}
+
+static void test_bitrate_max_min(void)
+{
+	std::string sdp = sdp_offer;
+
+	SDPModif::bitrateSDP(sdp, 1000);
+	SDPModif::bitrateMaxMinSDP(sdp, 2500, {108, 42});
+
+	check(count_lines(sdp, "b=AS:2500") == 1);
+	check(sdp.find("b=AS:1000") == std::string::npos);
+	check(has_line(sdp,
+		       "a=fmtp:108 level-asymmetry-allowed=1;"
+		       "packetization-mode=0;profile-level-id=42e01f;"
+		       "x-google-min-bitrate=2500;x-google-max-bitrate=2500"));
+	check(has_line(sdp, "a=fmtp:109 apt=108"));
+	check(sdp.find("a=fmtp:42") == std::string::npos);
+}
+
+/* libwebrtc offer for a video transceiver sending one encoding per
+ * simulcast layer, lowest resolution first */
+static std::string simulcast_offer(void)
+{
+	std::string sdp = sdp_offer;
+	sdp.erase(sdp.find("a=ssrc-group:FID"));
+	sdp += "a=extmap:4 urn:ietf:params:rtp-hdrext:sdes:rtp-stream-id\r\n"
+	       "a=rid:q send\r\n"
+	       "a=rid:h send\r\n"
+	       "a=rid:f send\r\n"
+	       "a=simulcast:send q;h;f\r\n";
+	return sdp;
+}
+
+/* what WebRTCStream::OnSuccess does with more than one layer: codecs and
+ * stereo only when the offer is munged, the total video bitrate in either
+ * case, and no per codec cap that would hold every layer to the total */
+static void test_simulcast_offer(void)
+{
+	for (int munged = 0; munged < 2; munged++) {
+		std::string sdp = simulcast_offer();
+
+		if (munged) {
+			std::vector<int> audio;
+			std::vector<int> video;
+			SDPModif::Description description(sdp);
+			description.forcePayload(audio, video, "opus", "h264",
+						 0, "42e01f", 0);
+			description.stereo(128);
+			sdp = description.toString();
+			check(video == std::vector<int>{108});
+		}
+
+		SDPModif::Description description(sdp);
+		description.bitrate(4000);
+		sdp = description.toString();
+
+		std::string video = section(sdp, "m=video");
+		check(video.find("\r\nc=IN IP4 0.0.0.0\r\nb=AS:4000\r\n") !=
+		      std::string::npos);
+		check(count_lines(sdp, "b=AS:4000") == 1);
+		check(video.find("x-google-") == std::string::npos);
+
+		check(has_line(sdp, "a=rid:q send"));
+		check(has_line(sdp, "a=rid:h send"));
+		check(has_line(sdp, "a=rid:f send"));
+		check(has_line(sdp, "a=simulcast:send q;h;f"));
+		check(has_line(sdp, "a=extmap:4 urn:ietf:params:rtp-hdrext:"
+				    "sdes:rtp-stream-id"));
+		check(has_line(sdp, munged ? "m=video 9 UDP/TLS/RTP/SAVPF 108 109"
+					   : "m=video 9 UDP/TLS/RTP/SAVPF 96 97 "
+					     "98 99 100 101 102 121 127 120 "
+					     "125 107 108 109"));
+	}
+}
+
+static void test_stereo(void)
+{
+	std::string sdp = sdp_offer;
+
+	SDPModif::stereoSDP(sdp, 128);
+	check(has_line(sdp,
+		       "a=fmtp:111 minptime=10;useinbandfec=1;stereo=1;"
+		       "sprop-stereo=1;maxplaybackrate=48000;"
+		       "sprop-maxcapturerate=48000;maxaveragebitrate=131072;"
+		       "x-google-min-bitrate=128;x-google-max-bitrate=128"));
+
+	/* already stereo, left as is */
+	std::string again = sdp;
+	SDPModif::stereoSDP(again, 64);
+	check(again == sdp);
+
+	/* no fmtp line yet, created right after the rtpmap */
+	sdp = sdp_offer;
+	sdp.erase(sdp.find("a=fmtp:111"),
+		  strlen("a=fmtp:111 minptime=10;useinbandfec=1\r\n"));
+	SDPModif::stereoSDP(sdp, 0);
+	check(sdp.find("a=rtpmap:111 opus/48000/2\r\n"
+		       "a=fmtp:111 minptime=10;useinbandfec=1;stereo=1;"
+		       "sprop-stereo=1;maxplaybackrate=48000;"
+		       "sprop-maxcapturerate=48000\r\n") != std::string::npos);
+}
+
+static const char stereo_128[] =
+	"minptime=10;useinbandfec=1;stereo=1;sprop-stereo=1;"
+	"maxplaybackrate=48000;sprop-maxcapturerate=48000;"
+	"maxaveragebitrate=131072;x-google-min-bitrate=128;"
+	"x-google-max-bitrate=128";
+
+/* the edits WebRTCStream::onOpened applies to an answer */
+static std::string edit_answer(const char *answer)
+{
+	SDPModif::Description description(answer);
+	description.bitrate(2500);
+	description.stereo(128);
+	return description.toString();
+}
+
+static void test_answer_janus(void)
+{
+	std::string sdp = edit_answer(sdp_answer_janus);
+	check(SDPModif::Description(sdp_answer_janus).toString() ==
+	      sdp_answer_janus);
+
+	check(section(sdp, "m=video")
+		      .find("\r\nc=IN IP4 203.0.113.10\r\nb=AS:2500\r\n") !=
+	      std::string::npos);
+	check(section(sdp, "m=audio").find("b=AS") == std::string::npos);
+	check(has_line(sdp, std::string("a=fmtp:111 ") + stereo_128));
+	check(count_lines(sdp, "a=end-of-candidates") == 2);
+
+	std::string forced = sdp_answer_janus;
+	std::vector<int> audio;
+	std::vector<int> video;
+	SDPModif::forcePayload(forced, audio, video, "opus", "vp8", 0,
+			       "42e01f", 0);
+	check(audio == std::vector<int>{111});
+	check(video == std::vector<int>{96});
+	check(forced == sdp_answer_janus);
+}
+
+static void test_answer_wowza(void)
+{
+	std::string sdp = edit_answer(sdp_answer_wowza);
+	check(SDPModif::Description(sdp_answer_wowza).toString() ==
+	      sdp_answer_wowza);
+
+	/* no connection line in the section, b=AS right after m= */
+	check(sdp.find("m=video 9 UDP/TLS/RTP/SAVPF 125 107 96 97\r\n"
+		       "b=AS:2500\r\na=rtpmap:125 ") != std::string::npos);
+	check(count_lines(sdp, "b=AS:2500") == 1);
+	check(has_line(sdp, std::string("a=fmtp:111 ") + stereo_128));
+
+	std::string forced = sdp_answer_wowza;
+	std::vector<int> audio;
+	std::vector<int> video;
+	SDPModif::forcePayload(forced, audio, video, "opus", "h264", 1,
+			       "42e01f", 0);
+	check(video == std::vector<int>{125});
+	check(has_line(forced, "m=video 9 UDP/TLS/RTP/SAVPF 125 107"));
+	check(has_line(forced, "a=fmtp:107 apt=125"));
+	check(forced.find("a=rtpmap:96") == std::string::npos);
+	check(forced.find("a=fmtp:97") == std::string::npos);
+	check(count_lines(forced, "a=candidate:0 1 UDP 50 198.51.100.20 1935 "
+				  "typ host generation 0") == 2);
+}
+
+static void test_answer_millicast(void)
+{
+	std::string sdp = edit_answer(sdp_answer_millicast);
+	check(SDPModif::Description(sdp_answer_millicast).toString() ==
+	      sdp_answer_millicast);
+
+	check(section(sdp, "m=video")
+		      .find("\r\nc=IN IP4 0.0.0.0\r\nb=AS:2500\r\n") !=
+	      std::string::npos);
+	/* already stereo, audio left as is */
+	check(section(sdp, "m=audio") ==
+	      section(sdp_answer_millicast, "m=audio"));
+
+	std::string forced = sdp_answer_millicast;
+	std::vector<int> audio;
+	std::vector<int> video;
+	SDPModif::forcePayload(forced, audio, video, "opus", "h264", 0,
+			       "42e01f", 0);
+	check(video == std::vector<int>{108});
+	check(has_line(forced, "m=video 9 UDP/TLS/RTP/SAVPF 108"));
+	check(forced.find("a=fmtp:98") == std::string::npos);
+	check(forced.find("a=fmtp:99") == std::string::npos);
+
+	forced = sdp_answer_millicast;
+	audio.clear();
+	video.clear();
+	SDPModif::forcePayload(forced, audio, video, "vp9", 0);
+	check(video == std::vector<int>{98});
+	check(has_line(forced, "m=video 9 UDP/TLS/RTP/SAVPF 98 99"));
+	check(forced.find("a=rtpmap:108") == std::string::npos);
+}
+
+static void test_answer_evercast(void)
+{
+	std::string sdp = edit_answer(sdp_answer_evercast);
+	check(SDPModif::Description(sdp_answer_evercast).toString() ==
+	      sdp_answer_evercast);
+
+	/* the server's own cap stays */
+	check(has_line(sdp, "b=AS:6000"));
+	check(sdp.find("b=AS:2500") == std::string::npos);
+	/* the fmtp line is created right after Opus' rtpmap */
+	check(sdp.find(std::string("a=rtpmap:111 opus/48000/2\r\n"
+				   "a=fmtp:111 ") +
+		       stereo_128 + "\r\na=rtpmap:9 G722/8000\r\n") !=
+	      std::string::npos);
+
+	std::string forced = sdp_answer_evercast;
+	std::vector<int> audio;
+	std::vector<int> video;
+	SDPModif::forcePayload(forced, audio, video, "opus", "h264", 0,
+			       "42e01f", 0);
+	check(audio == std::vector<int>{111});
+	check(video == std::vector<int>{108});
+	check(has_line(forced, "m=audio 9 UDP/TLS/RTP/SAVPF 111"));
+	check(has_line(forced, "m=video 9 UDP/TLS/RTP/SAVPF 108 109"));
+	check(forced.find("G722") == std::string::npos);
+	check(count_lines(forced, "a=rtcp:9 IN IP4 0.0.0.0") == 2);
+}
+
+static void test_ice_candidates(void)
+{
+	const std::string udp =
+		"candidate:842163049 1 udp 1677729535 203.0.113.7 52133 "
+		"typ srflx raddr 0.0.0.0 rport 0 generation 0";
+	const std::string tcp =
+		"a=candidate:1051236017 1 tcp 1518280447 192.168.1.2 9 "
+		"typ host tcptype active generation 0";
+
+	check(SDPModif::filterIceCandidates(udp, "udp"));
+	check(SDPModif::filterIceCandidates(udp, "UDP"));
+	check(!SDPModif::filterIceCandidates(udp, "tcp"));
+	check(SDPModif::filterIceCandidates(tcp, "TCP"));
+	check(!SDPModif::filterIceCandidates(tcp, "udp"));
+	check(!SDPModif::filterIceCandidates("candidate:x 1 udp", "udp"));
+	check(!SDPModif::filterIceCandidates("candidate:1 1", "udp"));
+	check(!SDPModif::filterIceCandidates("", "udp"));
+}
+
+int main(void)
+{
+	test_round_trip();
+	test_force_h264();
+	test_force_vp9_profile();
+	test_force_automatic();
+	test_bitrate();
+	test_bitrate_max_min();
+	test_simulcast_offer();
+	test_stereo();
+	test_answer_janus();
+	test_answer_wowza();
+	test_answer_millicast();
+	test_answer_evercast();
+	test_ice_candidates();
+
+	if (failures)
+		fprintf(stderr, "%d check(s) failed\n", failures);
+	return failures ? 1 : 0;
+}
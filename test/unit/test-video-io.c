@@ -0,0 +1,397 @@
+/*
+ * video-io inputs: every input is fed from its own thread, so inputs that
+ * each keep up with the frame rate on their own keep up together, and an
+ * input can disconnect itself from its callback while the output is being
+ * disconnected or stopped from another thread.  Inputs asking for the same
+ * conversion share one converter, which scales each frame once.
+ */
+
+#include "util/platform.h"
+#include "util/threading.h"
+#include "media-io/video-frame.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INPUTS 3
+#define FRAMES 500
+#define FRAME_INTERVAL_NS 4000000ULL
+#define CALLBACK_NS 3000000ULL
+#define TIMEOUT_MS 5000
+#define CONVERTED_FRAMES 30
+
+static int failures = 0;
+
+#define check(cond)                                                       \
+	do {                                                              \
+		if (!(cond)) {                                            \
+			fprintf(stderr, "%s:%d: check failed: %s\n",      \
+				__FILE__, __LINE__, #cond);               \
+			failures++;                                       \
+		}                                                         \
+	} while (false)
+
+static video_t *open_video(uint32_t fps_num)
+{
+	struct video_output_info info = {
+		.name = "test",
+		.format = VIDEO_FORMAT_I420,
+		.fps_num = fps_num,
+		.fps_den = 1,
+		.width = 16,
+		.height = 16,
+		.cache_size = 8,
+		.colorspace = VIDEO_CS_709,
+		.range = VIDEO_RANGE_PARTIAL,
+	};
+	video_t *video = NULL;
+
+	if (video_output_open(&video, &info) != VIDEO_OUTPUT_SUCCESS)
+		return NULL;
+	return video;
+}
+
+static void add_frame(video_t *video, uint64_t timestamp)
+{
+	struct video_frame frame;
+
+	if (video_output_lock_frame(video, &frame, 1, timestamp))
+		video_output_unlock_frame(video);
+}
+
+static bool wait_until(volatile long *counter, long value)
+{
+	for (int i = 0; i < TIMEOUT_MS; i++) {
+		if (os_atomic_load_long(counter) >= value)
+			return true;
+		os_sleep_ms(1);
+	}
+	return false;
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct busy_input {
+	uint64_t frame_time;
+	uint64_t next_ts;
+	bool contiguous;
+	volatile long frames;
+};
+
+static void busy_callback(void *param, struct video_data *frame)
+{
+	struct busy_input *input = param;
+
+	if (frame->timestamp != input->next_ts)
+		input->contiguous = false;
+	input->next_ts = frame->timestamp + input->frame_time;
+
+	os_sleepto_ns(os_gettime_ns() + CALLBACK_NS);
+	os_atomic_inc_long(&input->frames);
+}
+
+/* each input takes most of a frame interval, which all of them together
+ * could never do on a single thread */
+static void test_throughput(void)
+{
+	struct busy_input inputs[INPUTS] = {0};
+	video_t *video = open_video(1000000000 / FRAME_INTERVAL_NS);
+
+	check(video != NULL);
+	if (!video)
+		return;
+
+	uint64_t frame_time = video_output_get_frame_time(video);
+
+	for (size_t i = 0; i < INPUTS; i++) {
+		inputs[i].frame_time = frame_time;
+		inputs[i].contiguous = true;
+		check(video_output_connect(video, NULL, busy_callback,
+					   &inputs[i]));
+	}
+
+	uint64_t t = os_gettime_ns();
+	for (uint64_t i = 0; i < FRAMES; i++) {
+		add_frame(video, i * frame_time);
+		os_sleepto_ns(t += FRAME_INTERVAL_NS);
+	}
+
+	for (size_t i = 0; i < INPUTS; i++) {
+		/* skipped frames are repeated, every input still outputs one
+		 * frame per frame interval */
+		check(wait_until(&inputs[i].frames, FRAMES));
+		check(inputs[i].contiguous);
+	}
+
+	uint32_t skipped = video_output_get_skipped_frames(video);
+	printf("%d inputs, %d frames: %u skipped\n", INPUTS, FRAMES, skipped);
+	check(skipped <= FRAMES / 50);
+
+	video_output_close(video);
+
+	for (size_t i = 0; i < INPUTS; i++)
+		check(os_atomic_load_long(&inputs[i].frames) == FRAMES);
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct self_disconnecting_input {
+	video_t *video;
+	long disconnect_after;
+	int delay_ms;
+	os_event_t *entered;
+	volatile long frames;
+};
+
+static void self_disconnecting_callback(void *param, struct video_data *frame)
+{
+	struct self_disconnecting_input *input = param;
+
+	if (os_atomic_inc_long(&input->frames) != input->disconnect_after)
+		return;
+
+	/* gives the other thread time to get to its disconnect or stop */
+	os_event_signal(input->entered);
+	os_sleep_ms(input->delay_ms);
+
+	video_output_disconnect(input->video, self_disconnecting_callback,
+				input);
+
+	UNUSED_PARAMETER(frame);
+}
+
+static void test_self_disconnect(void)
+{
+	struct self_disconnecting_input input = {0};
+
+	input.video = open_video(60);
+	input.disconnect_after = 3;
+	check(input.video != NULL);
+	check(os_event_init(&input.entered, OS_EVENT_TYPE_MANUAL) == 0);
+	if (!input.video || !input.entered)
+		return;
+
+	check(video_output_connect(input.video, NULL,
+				   self_disconnecting_callback, &input));
+	check(video_output_active(input.video));
+
+	for (uint64_t i = 0; i < 3; i++)
+		add_frame(input.video, i);
+	check(wait_until(&input.frames, 3));
+
+	/* the input thread frees itself once the callback returns, and the
+	 * frames added afterwards don't reach it */
+	for (int i = 0; i < 100 && video_output_active(input.video); i++)
+		os_sleep_ms(1);
+	check(!video_output_active(input.video));
+
+	for (uint64_t i = 3; i < 6; i++)
+		add_frame(input.video, i);
+	os_sleep_ms(20);
+	check(os_atomic_load_long(&input.frames) == 3);
+
+	video_output_close(input.video);
+	os_event_destroy(input.entered);
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct racing_stop {
+	struct self_disconnecting_input input;
+	bool stop;
+	os_event_t *done;
+};
+
+static void *race_thread(void *param)
+{
+	struct racing_stop *race = param;
+	struct self_disconnecting_input *input = &race->input;
+
+	os_event_wait(input->entered);
+
+	if (race->stop)
+		video_output_stop(input->video);
+	else
+		video_output_disconnect(input->video,
+					self_disconnecting_callback, input);
+
+	os_event_signal(race->done);
+	return NULL;
+}
+
+/* the input's thread has to be joined while its callback is disconnecting
+ * it, which waits on the same lock the stop/disconnect took */
+static void test_self_disconnect_racing(bool stop)
+{
+	struct racing_stop race = {0};
+	struct self_disconnecting_input *input = &race.input;
+	pthread_t thread;
+
+	race.stop = stop;
+	input->video = open_video(60);
+	input->disconnect_after = 1;
+	input->delay_ms = 50;
+	check(input->video != NULL);
+	check(os_event_init(&input->entered, OS_EVENT_TYPE_MANUAL) == 0);
+	check(os_event_init(&race.done, OS_EVENT_TYPE_MANUAL) == 0);
+	if (!input->video || !input->entered || !race.done)
+		return;
+
+	check(video_output_connect(input->video, NULL,
+				   self_disconnecting_callback, input));
+	check(pthread_create(&thread, NULL, race_thread, &race) == 0);
+
+	add_frame(input->video, 0);
+
+	if (os_event_timedwait(race.done, TIMEOUT_MS) != 0) {
+		/* nothing left to clean up with two threads stuck */
+		fprintf(stderr, "%s deadlocked with a self-disconnecting "
+				"input\n",
+			stop ? "video_output_stop" : "video_output_disconnect");
+		exit(1);
+	}
+
+	pthread_join(thread, NULL);
+	check(os_atomic_load_long(&input->frames) == 1);
+	check(!video_output_active(input->video));
+
+	video_output_close(input->video);
+	os_event_destroy(race.done);
+	os_event_destroy(input->entered);
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct converted_input {
+	struct video_scale_info conversion;
+	uint64_t frame_time;
+	uint8_t *data[CONVERTED_FRAMES];
+	volatile long frames;
+};
+
+static void converted_callback(void *param, struct video_data *frame)
+{
+	struct converted_input *input = param;
+	uint64_t idx = frame->timestamp / input->frame_time;
+
+	if (idx < CONVERTED_FRAMES)
+		input->data[idx] = frame->data[0];
+	os_atomic_inc_long(&input->frames);
+}
+
+struct conversion_log {
+	log_handler_t handler;
+	void *param;
+	long converters;
+	long scaled;
+	long shared;
+};
+
+static void conversion_log_handler(int lvl, const char *msg, va_list args,
+				   void *p)
+{
+	struct conversion_log *log = p;
+	char str[256];
+	long scaled, shared;
+	va_list args2;
+
+	va_copy(args2, args);
+	vsnprintf(str, sizeof(str), msg, args2);
+	va_end(args2);
+
+	if (strstr(str, "Video conversion to ") == str) {
+		const char *counts = strstr(str, "scaled");
+
+		if (counts && sscanf(counts, "scaled %ld frames, shared %ld",
+				     &scaled, &shared) == 2) {
+			log->converters++;
+			log->scaled += scaled;
+			log->shared += shared;
+		}
+	}
+
+	log->handler(lvl, msg, args, log->param);
+}
+
+/* the first two ask for the same conversion, the others each differ from
+ * them in one part of the converter key */
+static void test_shared_conversion(void)
+{
+	struct converted_input inputs[] = {
+		{{VIDEO_FORMAT_I420, 8, 8, VIDEO_RANGE_PARTIAL, VIDEO_CS_709}},
+		{{VIDEO_FORMAT_I420, 8, 8, VIDEO_RANGE_PARTIAL, VIDEO_CS_709}},
+		{{VIDEO_FORMAT_NV12, 8, 8, VIDEO_RANGE_PARTIAL, VIDEO_CS_709}},
+		{{VIDEO_FORMAT_I420, 8, 4, VIDEO_RANGE_PARTIAL, VIDEO_CS_709}},
+		{{VIDEO_FORMAT_I420, 8, 8, VIDEO_RANGE_FULL, VIDEO_CS_709}},
+		{{VIDEO_FORMAT_I420, 8, 8, VIDEO_RANGE_PARTIAL, VIDEO_CS_601}},
+	};
+	const size_t num = sizeof(inputs) / sizeof(inputs[0]);
+	struct conversion_log log = {0};
+	video_t *video = open_video(60);
+
+	check(video != NULL);
+	if (!video)
+		return;
+
+	uint64_t frame_time = video_output_get_frame_time(video);
+
+	for (size_t i = 0; i < num; i++) {
+		inputs[i].frame_time = frame_time;
+		check(video_output_connect(video, &inputs[i].conversion,
+					   converted_callback, &inputs[i]));
+	}
+
+	/* one frame at a time, so that none is skipped or repeated */
+	for (uint64_t f = 0; f < CONVERTED_FRAMES; f++) {
+		add_frame(video, f * frame_time);
+		for (size_t i = 0; i < num; i++)
+			check(wait_until(&inputs[i].frames, (long)f + 1));
+	}
+
+	/* the same frame comes out of the same buffer for inputs sharing a
+	 * converter, out of its own for every other one */
+	for (uint64_t f = 0; f < CONVERTED_FRAMES; f++) {
+		check(inputs[0].data[f] != NULL);
+		check(inputs[1].data[f] == inputs[0].data[f]);
+
+		for (size_t i = 2; i < num; i++) {
+			check(inputs[i].data[f] != NULL);
+			for (size_t j = 0; j < num; j++)
+				check(j == i ||
+				      inputs[i].data[f] != inputs[j].data[f]);
+		}
+	}
+
+	/* converters report how often they were shared when they go */
+	base_get_log_handler(&log.handler, &log.param);
+	base_set_log_handler(conversion_log_handler, &log);
+
+	video_output_close(video);
+
+	base_set_log_handler(log.handler, log.param);
+
+	printf("%d inputs, %d frames: %ld shared converter(s), scaled %ld, "
+	       "shared %ld\n",
+	       (int)num, CONVERTED_FRAMES, log.converters, log.scaled,
+	       log.shared);
+	check(log.converters == 1);
+	check(log.scaled == CONVERTED_FRAMES);
+	check(log.shared == CONVERTED_FRAMES);
+}
+
+int main(void)
+{
+	test_self_disconnect();
+	test_self_disconnect_racing(false);
+	test_self_disconnect_racing(true);
+	test_throughput();
+	test_shared_conversion();
+
+	if (failures)
+		fprintf(stderr, "%d check(s) failed\n", failures);
+	else
+		printf("all checks passed\n");
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,360 @@
+/*
+ * Drives the Janus and Evercast clients against a local mock Janus server:
+ * checks that keepalives follow the configured interval once logged in,
+ * that none are sent and no listener callback runs after disconnect() and
+ * after the client is destroyed, and that a server that stops answering is
+ * reported as a disconnection.
+ */
+
+#include "JanusWebsocketClientImpl.h"
+#include "EvercastWebsocketClientImpl.h"
+
+#include "websocketpp/config/asio.hpp"
+#include "websocketpp/server.hpp"
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+typedef websocketpp::server<websocketpp::config::asio_tls> Server;
+
+#define KEEPALIVE_MS 20
+
+static int failures = 0;
+
+#define check(cond)                                                       \
+	do {                                                              \
+		if (!(cond)) {                                            \
+			fprintf(stderr, "%s:%d: check failed: %s\n",      \
+				__FILE__, __LINE__, #cond);               \
+			failures++;                                       \
+		}                                                         \
+	} while (false)
+
+/* ------------------------------------------------------------------------- */
+/* the client asks for a TLS 1.0 context, which recent OpenSSL only allows at
+ * security level 0; set that up before OpenSSL reads its configuration */
+
+static std::string conf_path;
+
+static bool allow_tls1(void)
+{
+	char path[] = "/tmp/test-websocket-keepalive-XXXXXX";
+	int fd = mkstemp(path);
+	if (fd == -1)
+		return false;
+
+	FILE *f = fdopen(fd, "w");
+	fputs("openssl_conf = init\n"
+	      "[init]\n"
+	      "ssl_conf = ssl\n"
+	      "[ssl]\n"
+	      "system_default = tls\n"
+	      "[tls]\n"
+	      "MinProtocol = TLSv1\n"
+	      "CipherString = DEFAULT:@SECLEVEL=0\n",
+	      f);
+	fclose(f);
+
+	conf_path = path;
+	setenv("OPENSSL_CONF", path, 1);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* self-signed certificate for the mock server */
+
+static bool make_cert(std::string &cert_pem, std::string &key_pem)
+{
+	EVP_PKEY *pkey = nullptr;
+	EVP_PKEY_CTX *pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+	if (!pctx || EVP_PKEY_keygen_init(pctx) <= 0 ||
+	    EVP_PKEY_CTX_set_rsa_keygen_bits(pctx, 2048) <= 0 ||
+	    EVP_PKEY_keygen(pctx, &pkey) <= 0) {
+		EVP_PKEY_CTX_free(pctx);
+		return false;
+	}
+	EVP_PKEY_CTX_free(pctx);
+
+	X509 *x509 = X509_new();
+	ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+	X509_gmtime_adj(X509_getm_notBefore(x509), 0);
+	X509_gmtime_adj(X509_getm_notAfter(x509), 3600);
+	X509_set_pubkey(x509, pkey);
+	X509_NAME *name = X509_get_subject_name(x509);
+	X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+				   (const unsigned char *)"localhost", -1, -1,
+				   0);
+	X509_set_issuer_name(x509, name);
+	X509_sign(x509, pkey, EVP_sha256());
+
+	BIO *bio = BIO_new(BIO_s_mem());
+	PEM_write_bio_X509(bio, x509);
+	char *data;
+	long size = BIO_get_mem_data(bio, &data);
+	cert_pem.assign(data, size);
+	BIO_free(bio);
+
+	bio = BIO_new(BIO_s_mem());
+	PEM_write_bio_PrivateKey(bio, pkey, nullptr, nullptr, 0, nullptr,
+				 nullptr);
+	size = BIO_get_mem_data(bio, &data);
+	key_pem.assign(data, size);
+	BIO_free(bio);
+
+	X509_free(x509);
+	EVP_PKEY_free(pkey);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* mock Janus server: session create, attach and keepalive, nothing at all
+ * once muted */
+
+struct MockJanus {
+	Server server;
+	std::thread thread;
+	std::string cert_pem;
+	std::string key_pem;
+	std::atomic<int> keepalives{0};
+	std::atomic<int> destroys{0};
+	std::atomic<bool> mute{false};
+	uint16_t port = 0;
+
+	bool start()
+	{
+		if (!make_cert(cert_pem, key_pem))
+			return false;
+
+		server.clear_access_channels(websocketpp::log::alevel::all);
+		server.clear_error_channels(websocketpp::log::elevel::all);
+		server.init_asio();
+		server.set_reuse_addr(true);
+
+		server.set_tls_init_handler([this](websocketpp::connection_hdl) {
+			auto ctx = websocketpp::lib::make_shared<asio::ssl::context>(
+				asio::ssl::context::sslv23);
+			ctx->use_certificate_chain(
+				asio::buffer(cert_pem.data(), cert_pem.size()));
+			ctx->use_private_key(
+				asio::buffer(key_pem.data(), key_pem.size()),
+				asio::ssl::context::pem);
+			return ctx;
+		});
+
+		server.set_validate_handler([this](websocketpp::connection_hdl hdl) {
+			auto con = server.get_con_from_hdl(hdl);
+			for (const auto &proto : con->get_requested_subprotocols())
+				if (proto == "janus-protocol")
+					con->select_subprotocol(proto);
+			return true;
+		});
+
+		server.set_message_handler([this](websocketpp::connection_hdl hdl,
+						  Server::message_ptr msg) {
+			json req = json::parse(msg->get_payload());
+			std::string janus = req["janus"];
+			json res = {{"transaction", req["transaction"]}};
+
+			if (mute)
+				return;
+
+			if (janus == "create") {
+				res["janus"] = "success";
+				res["data"] = {{"id", 1234}};
+			} else if (janus == "attach") {
+				res["janus"] = "success";
+				res["data"] = {{"id", 5678}};
+			} else if (janus == "keepalive") {
+				keepalives++;
+				res["janus"] = "ack";
+			} else if (janus == "destroy") {
+				destroys++;
+				res["janus"] = "success";
+			} else {
+				res["janus"] = "ack";
+			}
+
+			websocketpp::lib::error_code ec;
+			server.send(hdl, res.dump(),
+				    websocketpp::frame::opcode::text, ec);
+		});
+
+		asio::ip::tcp::endpoint endpoint(
+			asio::ip::address::from_string("127.0.0.1"), 0);
+		websocketpp::lib::error_code ec;
+		server.listen(endpoint, ec);
+		if (ec)
+			return false;
+		port = server.get_local_endpoint(ec).port();
+		server.start_accept();
+
+		thread = std::thread([this]() { server.run(); });
+		return true;
+	}
+
+	void stop()
+	{
+		server.stop();
+		if (thread.joinable())
+			thread.join();
+	}
+};
+
+/* ------------------------------------------------------------------------- */
+
+struct Listener : public WebsocketClient::Listener {
+	std::atomic<int> logged{0};
+	std::atomic<int> disconnected{0};
+	std::atomic<int> callbacks{0};
+
+	void onConnected() override { callbacks++; }
+	void onDisconnected() override
+	{
+		callbacks++;
+		disconnected++;
+	}
+	void onLogged(int) override
+	{
+		callbacks++;
+		logged++;
+	}
+	void onLoggedError(int) override { callbacks++; }
+	void onOpened(const std::string &) override { callbacks++; }
+	void onOpenedError(int) override { callbacks++; }
+	void onRemoteIceCandidate(const std::string &) override { callbacks++; }
+};
+
+static void sleep_ms(int ms)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+template<typename Pred> static bool wait_for(Pred pred, int timeout_ms)
+{
+	for (int waited = 0; waited < timeout_ms; waited += 5) {
+		if (pred())
+			return true;
+		sleep_ms(5);
+	}
+	return pred();
+}
+
+template<typename Client>
+static void test_keepalive(MockJanus &mock, bool wait)
+{
+	Listener listener;
+	Client *client = new Client();
+	std::string url = "wss://127.0.0.1:" + std::to_string(mock.port);
+
+	client->setKeepAliveInterval(KEEPALIVE_MS);
+	mock.keepalives = 0;
+
+	check(client->connect(url, "1234", "obs", "token", &listener));
+	check(wait_for([&]() { return listener.logged > 0; }, 5000));
+
+	/* keepalives follow the configured interval, not the 10 s default */
+	check(wait_for([&]() { return mock.keepalives >= 5; },
+		       50 * KEEPALIVE_MS));
+
+	check(client->disconnect(wait));
+	if (!wait)
+		sleep_ms(KEEPALIVE_MS);
+
+	int keepalives = mock.keepalives;
+	int callbacks = listener.callbacks;
+
+	sleep_ms(5 * KEEPALIVE_MS);
+	check(mock.keepalives == keepalives);
+
+	delete client;
+
+	sleep_ms(5 * KEEPALIVE_MS);
+	check(mock.keepalives == keepalives);
+	check(listener.callbacks == callbacks);
+}
+
+template<typename Client>
+static void test_disconnect_unconnected()
+{
+	/* nothing to stop, and nothing left behind to fire */
+	Client *client = new Client();
+	check(client->disconnect(false));
+	check(client->disconnect(true));
+	delete client;
+}
+
+/* both clients give up once nothing was received for 3 keepalive
+ * intervals, but never in less than 5 seconds */
+template<typename Client>
+static void test_timeout(MockJanus &mock)
+{
+	Listener listener;
+	Client *client = new Client();
+	std::string url = "wss://127.0.0.1:" + std::to_string(mock.port);
+
+	client->setKeepAliveInterval(KEEPALIVE_MS);
+	mock.keepalives = 0;
+	mock.mute = false;
+
+	check(client->connect(url, "1234", "obs", "token", &listener));
+	check(wait_for([&]() { return listener.logged > 0; }, 5000));
+	check(wait_for([&]() { return mock.keepalives >= 2; },
+		       50 * KEEPALIVE_MS));
+
+	auto muted = std::chrono::steady_clock::now();
+	mock.mute = true;
+
+	check(wait_for([&]() { return listener.disconnected > 0; }, 8000));
+	std::chrono::duration<double> elapsed =
+		std::chrono::steady_clock::now() - muted;
+	check(elapsed.count() > 4.9);
+
+	/* keepalives end with the timeout, reported only once */
+	sleep_ms(2 * KEEPALIVE_MS);
+	int keepalives = mock.keepalives;
+	sleep_ms(5 * KEEPALIVE_MS);
+	check(mock.keepalives == keepalives);
+	check(listener.disconnected == 1);
+
+	check(client->disconnect(true));
+	delete client;
+	mock.mute = false;
+}
+
+template<typename Client>
+static void test_client(MockJanus &mock)
+{
+	test_disconnect_unconnected<Client>();
+	test_keepalive<Client>(mock, true);
+	test_keepalive<Client>(mock, false);
+	test_timeout<Client>(mock);
+}
+
+int main(void)
+{
+	MockJanus mock;
+
+	if (!allow_tls1() || !mock.start()) {
+		fprintf(stderr, "failed to start the mock server\n");
+		return 1;
+	}
+
+	test_client<JanusWebsocketClientImpl>(mock);
+	test_client<EvercastWebsocketClientImpl>(mock);
+
+	mock.stop();
+	unlink(conf_path.c_str());
+
+	if (failures)
+		fprintf(stderr, "%d check(s) failed\n", failures);
+	return failures ? 1 : 0;
+}